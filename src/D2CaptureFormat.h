@@ -0,0 +1,100 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2CaptureFormat.h                                                       *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Declares the layout of packet capture files. A capture is a header, the *
+ *   packet records in the order they were captured, and a sparse index that *
+ *   is appended once the capture is closed.                                 *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2CAPTUREFORMAT_H
+#define _D2CAPTUREFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace D2CaptureFormat {
+// "D2PC" in little endian.
+static constexpr uint32_t MAGIC = 0x43503244;
+static constexpr uint32_t VERSION = 1;
+static constexpr size_t RECORD_ALIGNMENT = 8;
+static constexpr uint32_t DEFAULT_INDEX_INTERVAL = 1024;
+static constexpr size_t OPCODE_COUNT = 256;
+
+// Every offset is from the start of the file. Until the capture is closed,
+// indexOffset is zero, and dataEnd is only advanced when the writer moves to
+// another segment, so readers scan the records to find where they end.
+struct FileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t indexInterval;
+    uint64_t startTimestamp;
+    uint64_t dataEnd;
+    uint64_t recordCount;
+    uint64_t indexOffset;
+    uint64_t indexCount;
+    uint64_t reserved;
+};
+
+// Timestamps are in nanoseconds of a steady clock. The payload follows the
+// header, and starts with the opcode, so it is never empty. A header of
+// zeroes marks the end of an unfinished capture.
+struct RecordHeader {
+    uint64_t timestamp;
+    uint32_t size;
+    uint8_t direction;
+    uint8_t opcode;
+    uint16_t reserved;
+};
+
+// Describes a block of indexInterval records. The opcodes of the block are
+// kept as a bit mask, so that blocks without a wanted opcode are skipped.
+// Packets of both directions may be captured on different threads, so the
+// timestamps of a block are bounds rather than its first and last.
+struct IndexEntry {
+    uint64_t minTimestamp;
+    uint64_t maxTimestamp;
+    uint64_t offset;
+    uint32_t firstRecord;
+    uint32_t recordCount;
+    uint8_t opcodeMask[OPCODE_COUNT / 8];
+};
+
+static_assert(sizeof(FileHeader) == 64, "The file header must not be padded");
+static_assert(sizeof(RecordHeader) == 16, "The record header must not be padded");
+static_assert(sizeof(IndexEntry) == 64, "The index entry must not be padded");
+
+constexpr size_t getRecordSize(size_t payloadSize) {
+    return (sizeof(RecordHeader) + payloadSize + RECORD_ALIGNMENT - 1) &
+           ~(RECORD_ALIGNMENT - 1);
+}
+
+constexpr bool hasOpcode(const IndexEntry& indexEntry, uint8_t opcode) {
+    return (indexEntry.opcodeMask[opcode / 8] & (1 << (opcode % 8))) != 0;
+}
+
+inline void addOpcode(IndexEntry& indexEntry, uint8_t opcode) {
+    indexEntry.opcodeMask[opcode / 8] |= (uint8_t)(1 << (opcode % 8));
+}
+}
+
+#endif
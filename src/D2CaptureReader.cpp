@@ -0,0 +1,184 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2CaptureReader.cpp                                                     *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2CaptureReader class. Captures that were never   *
+ *   closed have no index, which is rebuilt by scanning their records.       *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2CaptureReader.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "D2CaptureFormat.h"
+#include "D2MappedFile.h"
+
+D2CaptureReader::D2CaptureReader() : fileHeader(), dataEnd(0) {
+}
+
+bool D2CaptureReader::open(const std::wstring& filePath) {
+    close();
+
+    if (!mappedFile.open(filePath) || mappedFile.getSize() < sizeof(fileHeader)) {
+        close();
+        return false;
+    }
+
+    std::memcpy(&fileHeader, mappedFile.getData(), sizeof(fileHeader));
+
+    if (fileHeader.magic != D2CaptureFormat::MAGIC
+            || fileHeader.version != D2CaptureFormat::VERSION
+            || fileHeader.headerSize < sizeof(fileHeader)
+            || fileHeader.headerSize > mappedFile.getSize()
+            || fileHeader.indexInterval == 0) {
+        close();
+        return false;
+    }
+
+    if (!isFinished() || !loadIndex()) {
+        rebuildIndex();
+    }
+
+    return true;
+}
+
+void D2CaptureReader::close() {
+    mappedFile.close();
+    fileHeader = {};
+    indexEntries.clear();
+    dataEnd = 0;
+}
+
+bool D2CaptureReader::isOpen() const {
+    return mappedFile.isOpen();
+}
+
+bool D2CaptureReader::isFinished() const {
+    return fileHeader.indexOffset != 0;
+}
+
+uint64_t D2CaptureReader::getRecordCount() const {
+    return fileHeader.recordCount;
+}
+
+uint64_t D2CaptureReader::getStartTimestamp() const {
+    return fileHeader.startTimestamp;
+}
+
+const std::vector<D2CaptureFormat::IndexEntry>&
+D2CaptureReader::getIndexEntries() const {
+    return indexEntries;
+}
+
+bool D2CaptureReader::readRecord(uint64_t offset,
+                                 D2CaptureRecord& record) const {
+    if (offset < fileHeader.headerSize || offset > dataEnd
+            || offset % D2CaptureFormat::RECORD_ALIGNMENT != 0
+            || dataEnd - offset < sizeof(D2CaptureFormat::RecordHeader)) {
+        return false;
+    }
+
+    const D2CaptureFormat::RecordHeader* recordHeader =
+        (const D2CaptureFormat::RecordHeader*) &mappedFile.getData()[offset];
+
+    if (recordHeader->size == 0
+            || recordHeader->direction > (uint8_t) D2PacketDirection::SERVER_TO_CLIENT
+            || dataEnd - offset < D2CaptureFormat::getRecordSize(recordHeader->size)) {
+        return false;
+    }
+
+    const uint8_t* data = (const uint8_t*)(recordHeader + 1);
+
+    record = { recordHeader->timestamp, (D2PacketDirection) recordHeader->direction,
+               data[0], data, recordHeader->size, offset
+             };
+    return true;
+}
+
+uint64_t D2CaptureReader::getNextOffset(const D2CaptureRecord& record) {
+    return record.offset + D2CaptureFormat::getRecordSize(record.size);
+}
+
+size_t D2CaptureReader::findIndexEntry(uint64_t timestamp) const {
+    // Timestamps of both directions can interleave, so the entries are not
+    // sorted by their bounds, and are searched from the start.
+    for (size_t i = 0; i < indexEntries.size(); i++) {
+        if (indexEntries[i].maxTimestamp >= timestamp) {
+            return i;
+        }
+    }
+
+    return indexEntries.size();
+}
+
+bool D2CaptureReader::loadIndex() {
+    uint64_t indexOffset = fileHeader.indexOffset;
+    uint64_t indexCount = fileHeader.indexCount;
+
+    if (indexOffset < fileHeader.headerSize || indexOffset > mappedFile.getSize()
+            || fileHeader.dataEnd > indexOffset
+            || indexCount > (mappedFile.getSize() - indexOffset) / sizeof(
+                D2CaptureFormat::IndexEntry)) {
+        return false;
+    }
+
+    dataEnd = fileHeader.dataEnd;
+    indexEntries.resize((size_t) indexCount);
+    std::memcpy(indexEntries.data(), &mappedFile.getData()[indexOffset],
+                indexEntries.size() * sizeof(D2CaptureFormat::IndexEntry));
+    return true;
+}
+
+void D2CaptureReader::rebuildIndex() {
+    // The records end at the first header of zeroes that the file was grown
+    // with, or at the first damaged record.
+    dataEnd = mappedFile.getSize();
+    indexEntries.clear();
+
+    D2CaptureRecord record;
+    uint64_t offset = fileHeader.headerSize;
+    uint64_t recordCount = 0;
+
+    while (readRecord(offset, record)) {
+        if (recordCount % fileHeader.indexInterval == 0) {
+            indexEntries.push_back({ record.timestamp, record.timestamp, offset, (uint32_t) recordCount, 0, {} });
+        }
+
+        D2CaptureFormat::IndexEntry& indexEntry = indexEntries.back();
+        indexEntry.minTimestamp = std::min(indexEntry.minTimestamp, record.timestamp);
+        indexEntry.maxTimestamp = std::max(indexEntry.maxTimestamp, record.timestamp);
+        indexEntry.recordCount++;
+        D2CaptureFormat::addOpcode(indexEntry, record.opcode);
+
+        if (recordCount == 0) {
+            fileHeader.startTimestamp = record.timestamp;
+        }
+
+        recordCount++;
+        offset = getNextOffset(record);
+    }
+
+    dataEnd = offset;
+    fileHeader.recordCount = recordCount;
+}
@@ -0,0 +1,122 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2CaptureReader.h                                                       *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Declares the D2CaptureReader class, which maps a packet capture file    *
+ *   and walks its records by time and opcode through the sparse index.      *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2CAPTUREREADER_H
+#define _D2CAPTUREREADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "D2CaptureFormat.h"
+#include "D2MappedFile.h"
+#include "D2PacketTable.h"
+
+// The data points into the mapped file, and stays valid until it is closed.
+struct D2CaptureRecord {
+    uint64_t timestamp;
+    D2PacketDirection direction;
+    uint8_t opcode;
+    const uint8_t* data;
+    size_t size;
+    uint64_t offset;
+};
+
+class D2CaptureReader {
+public:
+    static constexpr int ANY_OPCODE = -1;
+
+    D2CaptureReader();
+
+    D2CaptureReader(const D2CaptureReader&) = delete;
+    D2CaptureReader& operator=(const D2CaptureReader&) = delete;
+
+    bool open(const std::wstring& filePath);
+    void close();
+
+    bool isOpen() const;
+    // False for captures whose writer never closed them.
+    bool isFinished() const;
+
+    uint64_t getRecordCount() const;
+    uint64_t getStartTimestamp() const;
+    const std::vector<D2CaptureFormat::IndexEntry>& getIndexEntries() const;
+
+    // Returns false past the last record, or if the record is damaged.
+    bool readRecord(uint64_t offset, D2CaptureRecord& record) const;
+    static uint64_t getNextOffset(const D2CaptureRecord& record);
+
+    // Returns the first index entry that may hold records at or after the
+    // timestamp, or the number of entries if there is none.
+    size_t findIndexEntry(uint64_t timestamp) const;
+
+    // Calls the function with every record at or after the timestamp, in the
+    // order they were written. Blocks of records without the opcode are
+    // skipped through the index.
+    template<class F>
+    size_t forEachRecord(uint64_t fromTimestamp, int opcode, F function) const {
+        size_t recordCount = 0;
+
+        for (size_t i = findIndexEntry(fromTimestamp); i < indexEntries.size(); i++) {
+            const D2CaptureFormat::IndexEntry& indexEntry = indexEntries[i];
+
+            if (opcode != ANY_OPCODE
+                    && !D2CaptureFormat::hasOpcode(indexEntry, (uint8_t) opcode)) {
+                continue;
+            }
+
+            D2CaptureRecord record;
+            uint64_t offset = indexEntry.offset;
+
+            for (uint32_t j = 0; j < indexEntry.recordCount
+                    && readRecord(offset, record); j++) {
+                offset = getNextOffset(record);
+
+                if (record.timestamp < fromTimestamp
+                        || (opcode != ANY_OPCODE && record.opcode != opcode)) {
+                    continue;
+                }
+
+                function(record);
+                recordCount++;
+            }
+        }
+
+        return recordCount;
+    }
+
+private:
+    D2MappedFile mappedFile;
+    D2CaptureFormat::FileHeader fileHeader;
+    std::vector<D2CaptureFormat::IndexEntry> indexEntries;
+    uint64_t dataEnd;
+
+    bool loadIndex();
+    void rebuildIndex();
+};
+
+#endif
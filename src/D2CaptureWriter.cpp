@@ -0,0 +1,331 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2CaptureWriter.cpp                                                     *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2CaptureWriter class. Records are copied into a  *
+ *   mapped window of the file, which is moved forward and grown a whole     *
+ *   segment at a time, so that appending a record makes no system call.     *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2CaptureWriter.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "D2CaptureFormat.h"
+#include "D2PacketRing.h"
+
+D2CaptureWriter::D2CaptureWriter() : fileHeader(), segment(nullptr),
+    segmentOffset(0), writeOffset(0), fileSize(0)
+#ifdef _WIN32
+    , fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr)
+#else
+    , fileDescriptor(-1)
+#endif
+{
+}
+
+D2CaptureWriter::~D2CaptureWriter() {
+    close();
+}
+
+bool D2CaptureWriter::open(const std::wstring& filePath,
+                           uint32_t indexInterval) {
+    close();
+
+#ifdef _WIN32
+    fileHandle = CreateFileW(filePath.c_str(), GENERIC_READ | GENERIC_WRITE,
+                             FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+    std::string narrowPath(filePath.begin(), filePath.end());
+    fileDescriptor = ::open(narrowPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+#endif
+
+    if (!isOpen()) {
+        return false;
+    }
+
+    fileHeader = {};
+    fileHeader.magic = D2CaptureFormat::MAGIC;
+    fileHeader.version = D2CaptureFormat::VERSION;
+    fileHeader.headerSize = sizeof(fileHeader);
+    fileHeader.indexInterval = (indexInterval != 0) ? indexInterval :
+                               D2CaptureFormat::DEFAULT_INDEX_INTERVAL;
+    fileHeader.dataEnd = sizeof(fileHeader);
+
+    indexEntries.clear();
+    writeOffset = sizeof(fileHeader);
+    fileSize = 0;
+
+    if (!mapSegment(0) || !writeAt(0, &fileHeader, sizeof(fileHeader))) {
+        closeFile();
+        return false;
+    }
+
+    return true;
+}
+
+bool D2CaptureWriter::close() {
+    if (!isOpen()) {
+        return false;
+    }
+
+    unmapSegment();
+
+    size_t indexSize = indexEntries.size() * sizeof(D2CaptureFormat::IndexEntry);
+    fileHeader.dataEnd = writeOffset;
+    fileHeader.indexOffset = writeOffset;
+    fileHeader.indexCount = indexEntries.size();
+
+    // The header is written last, so that a capture whose index could not be
+    // written is still read as an unfinished one.
+    bool success = writeAt(writeOffset, indexEntries.data(), indexSize)
+                   && setFileSize(writeOffset + indexSize)
+                   && writeAt(0, &fileHeader, sizeof(fileHeader));
+
+    closeFile();
+    return success;
+}
+
+bool D2CaptureWriter::isOpen() const {
+#ifdef _WIN32
+    return fileHandle != INVALID_HANDLE_VALUE;
+#else
+    return fileDescriptor >= 0;
+#endif
+}
+
+bool D2CaptureWriter::write(uint64_t timestamp, D2PacketDirection direction,
+                            const uint8_t* data, size_t size) {
+    if (segment == nullptr || size == 0 || size > MAX_PAYLOAD_SIZE
+            || fileHeader.recordCount == UINT32_MAX) {
+        return false;
+    }
+
+    size_t recordSize = D2CaptureFormat::getRecordSize(size);
+
+    if (writeOffset + recordSize > segmentOffset + SEGMENT_SIZE) {
+        // Readers of an unfinished capture can trust every record before
+        // the segment that is being written.
+        fileHeader.dataEnd = writeOffset;
+
+        if (!writeAt(0, &fileHeader, sizeof(fileHeader))
+                || !mapSegment(writeOffset & ~(uint64_t)(ALLOCATION_GRANULARITY - 1))) {
+            return false;
+        }
+    }
+
+    D2CaptureFormat::RecordHeader* recordHeader = (D2CaptureFormat::RecordHeader*)
+            &segment[writeOffset - segmentOffset];
+    recordHeader->timestamp = timestamp;
+    recordHeader->size = (uint32_t) size;
+    recordHeader->direction = (uint8_t) direction;
+    recordHeader->opcode = data[0];
+    recordHeader->reserved = 0;
+    std::memcpy(recordHeader + 1, data, size);
+
+    if (fileHeader.recordCount % fileHeader.indexInterval == 0) {
+        indexEntries.push_back({ timestamp, timestamp, writeOffset, (uint32_t) fileHeader.recordCount, 0, {} });
+    }
+
+    D2CaptureFormat::IndexEntry& indexEntry = indexEntries.back();
+    indexEntry.minTimestamp = std::min(indexEntry.minTimestamp, timestamp);
+    indexEntry.maxTimestamp = std::max(indexEntry.maxTimestamp, timestamp);
+    indexEntry.recordCount++;
+    D2CaptureFormat::addOpcode(indexEntry, data[0]);
+
+    if (fileHeader.recordCount == 0) {
+        fileHeader.startTimestamp = timestamp;
+    }
+
+    fileHeader.recordCount++;
+    writeOffset += recordSize;
+    return true;
+}
+
+uint64_t D2CaptureWriter::getRecordCount() const {
+    return fileHeader.recordCount;
+}
+
+void D2CaptureWriter::writeCapturedPacket(const D2CapturedPacket& packet,
+        void* context) {
+    ((D2CaptureWriter*) context)->write(packet.timestamp, packet.direction,
+                                        packet.data, packet.size);
+}
+
+#ifdef _WIN32
+
+bool D2CaptureWriter::mapSegment(uint64_t offset) {
+    unmapSegment();
+
+    uint64_t segmentEnd = offset + SEGMENT_SIZE;
+
+    if (segmentEnd > fileSize) {
+        if (!setFileSize(segmentEnd)) {
+            return false;
+        }
+
+        fileSize = segmentEnd;
+    }
+
+    mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READWRITE,
+                                       (DWORD)(segmentEnd >> 32), (DWORD) segmentEnd, nullptr);
+
+    if (mappingHandle == nullptr) {
+        return false;
+    }
+
+    segment = (uint8_t*) MapViewOfFile(mappingHandle, FILE_MAP_WRITE,
+                                       (DWORD)(offset >> 32), (DWORD) offset, SEGMENT_SIZE);
+
+    if (segment == nullptr) {
+        unmapSegment();
+        return false;
+    }
+
+    segmentOffset = offset;
+    return true;
+}
+
+void D2CaptureWriter::unmapSegment() {
+    if (segment != nullptr) {
+        UnmapViewOfFile(segment);
+    }
+
+    // The size of a file cannot be changed while it has a mapping.
+    if (mappingHandle != nullptr) {
+        CloseHandle(mappingHandle);
+    }
+
+    segment = nullptr;
+    mappingHandle = nullptr;
+}
+
+bool D2CaptureWriter::setFileSize(uint64_t size) {
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG) size;
+
+    return SetFilePointerEx(fileHandle, position, nullptr, FILE_BEGIN)
+           && SetEndOfFile(fileHandle);
+}
+
+bool D2CaptureWriter::writeAt(uint64_t offset, const void* data, size_t size) {
+    LARGE_INTEGER position;
+    position.QuadPart = (LONGLONG) offset;
+
+    if (!SetFilePointerEx(fileHandle, position, nullptr, FILE_BEGIN)) {
+        return false;
+    }
+
+    DWORD writtenSize;
+    return size == 0 || (WriteFile(fileHandle, data, (DWORD) size, &writtenSize,
+                                   nullptr) && writtenSize == size);
+}
+
+void D2CaptureWriter::closeFile() {
+    unmapSegment();
+
+    if (fileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(fileHandle);
+    }
+
+    fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool D2CaptureWriter::mapSegment(uint64_t offset) {
+    unmapSegment();
+
+    uint64_t segmentEnd = offset + SEGMENT_SIZE;
+
+    if (segmentEnd > fileSize) {
+        if (!setFileSize(segmentEnd)) {
+            return false;
+        }
+
+        fileSize = segmentEnd;
+    }
+
+    void* mappedSegment = mmap(nullptr, SEGMENT_SIZE, PROT_READ | PROT_WRITE,
+                               MAP_SHARED, fileDescriptor, (off_t) offset);
+
+    if (mappedSegment == MAP_FAILED) {
+        return false;
+    }
+
+    segment = (uint8_t*) mappedSegment;
+    segmentOffset = offset;
+    return true;
+}
+
+void D2CaptureWriter::unmapSegment() {
+    if (segment != nullptr) {
+        munmap(segment, SEGMENT_SIZE);
+    }
+
+    segment = nullptr;
+}
+
+bool D2CaptureWriter::setFileSize(uint64_t size) {
+    return ftruncate(fileDescriptor, (off_t) size) == 0;
+}
+
+bool D2CaptureWriter::writeAt(uint64_t offset, const void* data, size_t size) {
+    const uint8_t* remainingData = (const uint8_t*) data;
+
+    while (size > 0) {
+        ssize_t writtenSize = pwrite(fileDescriptor, remainingData, size,
+                                     (off_t) offset);
+
+        if (writtenSize <= 0) {
+            return false;
+        }
+
+        remainingData += writtenSize;
+        offset += writtenSize;
+        size -= writtenSize;
+    }
+
+    return true;
+}
+
+void D2CaptureWriter::closeFile() {
+    unmapSegment();
+
+    if (fileDescriptor >= 0) {
+        ::close(fileDescriptor);
+    }
+
+    fileDescriptor = -1;
+}
+
+#endif
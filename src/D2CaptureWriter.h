@@ -0,0 +1,98 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2CaptureWriter.h                                                       *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Declares the D2CaptureWriter class, which appends packet records to a   *
+ *   capture file through a memory-mapped segment that is grown ahead of the *
+ *   records.                                                                *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2CAPTUREWRITER_H
+#define _D2CAPTUREWRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "D2CaptureFormat.h"
+#include "D2PacketRing.h"
+#include "D2PacketTable.h"
+
+// Writing is meant for the consumer thread of a D2PacketCapture, so that the
+// game's own threads never touch the file.
+class D2CaptureWriter {
+public:
+    // Segments are mapped at multiples of the allocation granularity of
+    // Windows, which every page size divides.
+    static constexpr size_t ALLOCATION_GRANULARITY = 0x10000;
+    static constexpr size_t SEGMENT_SIZE = 0x1000000;
+    static constexpr size_t MAX_PAYLOAD_SIZE = SEGMENT_SIZE -
+            ALLOCATION_GRANULARITY - sizeof(D2CaptureFormat::RecordHeader);
+
+    D2CaptureWriter();
+    ~D2CaptureWriter();
+
+    D2CaptureWriter(const D2CaptureWriter&) = delete;
+    D2CaptureWriter& operator=(const D2CaptureWriter&) = delete;
+
+    // Replaces the file with an empty capture.
+    bool open(const std::wstring& filePath,
+              uint32_t indexInterval = D2CaptureFormat::DEFAULT_INDEX_INTERVAL);
+
+    // Appends the index, and trims the file to the end of it.
+    bool close();
+
+    bool isOpen() const;
+
+    bool write(uint64_t timestamp, D2PacketDirection direction,
+               const uint8_t* data, size_t size);
+    uint64_t getRecordCount() const;
+
+    // Can be given to D2PacketCapture::start, with the writer as the context.
+    static void writeCapturedPacket(const D2CapturedPacket& packet,
+                                    void* context);
+
+private:
+    D2CaptureFormat::FileHeader fileHeader;
+    std::vector<D2CaptureFormat::IndexEntry> indexEntries;
+
+    uint8_t* segment;
+    uint64_t segmentOffset;
+    uint64_t writeOffset;
+    // How far the file was grown, which is past the last record.
+    uint64_t fileSize;
+
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#else
+    int fileDescriptor;
+#endif
+
+    bool mapSegment(uint64_t offset);
+    void unmapSegment();
+    bool setFileSize(uint64_t size);
+    bool writeAt(uint64_t offset, const void* data, size_t size);
+    void closeFile();
+};
+
+#endif
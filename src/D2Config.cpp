@@ -25,124 +25,507 @@
 
 #include "D2Config.h"
 
-#include <cstdlib>
-#include <regex>
 #include <windows.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "D2ConfigSnapshot.h"
+#include "D2EpochReclaimer.h"
+#include "D2IniFile.h"
+#include "D2MappedFile.h"
+
+namespace {
+constexpr uint8_t UTF8_BOM[] = { 0xEF, 0xBB, 0xBF };
+constexpr uint8_t UTF16_BOM[] = { 0xFF, 0xFE };
+
+bool startsWith(const uint8_t* data, size_t size, const uint8_t* prefix,
+                size_t prefixSize) {
+    return size >= prefixSize && std::equal(prefix, prefix + prefixSize, data);
+}
+
+std::wstring decodeText(const uint8_t* data, size_t size, UINT codePage) {
+    if (size == 0) {
+        return std::wstring();
+    }
+
+    int length = MultiByteToWideChar(codePage, 0, (LPCSTR) data, (int) size,
+                                     nullptr, 0);
+    std::wstring text(length, L'\0');
+    MultiByteToWideChar(codePage, 0, (LPCSTR) data, (int) size, &text[0], length);
+    return text;
+}
+
+std::string encodeText(std::wstring_view text, UINT codePage) {
+    if (text.empty()) {
+        return std::string();
+    }
+
+    int length = WideCharToMultiByte(codePage, 0, text.data(), (int) text.length(),
+                                     nullptr, 0, nullptr, nullptr);
+    std::string encodedText(length, '\0');
+    WideCharToMultiByte(codePage, 0, text.data(), (int) text.length(),
+                        &encodedText[0], length, nullptr, nullptr);
+    return encodedText;
+}
+
+// Converts with the locale of the C library, without a limit on the length.
+std::wstring toWideString(const std::string& narrowString) {
+    size_t length = std::mbstowcs(nullptr, narrowString.c_str(), 0);
+
+    if (length == (size_t) - 1) {
+        return std::wstring();
+    }
+
+    std::wstring wideString(length, L'\0');
+    std::mbstowcs(&wideString[0], narrowString.c_str(), length);
+    return wideString;
+}
+
+std::string toNarrowString(const std::wstring& wideString) {
+    size_t length = std::wcstombs(nullptr, wideString.c_str(), 0);
+
+    if (length == (size_t) - 1) {
+        return std::string();
+    }
+
+    std::string narrowString(length, '\0');
+    std::wcstombs(&narrowString[0], wideString.c_str(), length);
+    return narrowString;
+}
+
+}
 
 D2Config::D2Config() : D2Config(DEFAULT_CONFIG_PATH) {
 }
 
-D2Config::D2Config(const std::wstring& configPath) : configPath(configPath) {
+D2Config::D2Config(const std::wstring& configPath) : configPath(configPath),
+    currentSnapshot(nullptr), fileEncoding(FileEncoding::ANSI),
+    fileStamp({ false, 0, 0 }), nextGeneration(1), nextListenerId(1),
+    stopRequested(false) {
+}
+
+D2Config::~D2Config() {
+    D2EpochReclaimer& reclaimer = D2EpochReclaimer::getInstance();
+    reclaimer.retire(currentSnapshot.exchange(nullptr, std::memory_order_seq_cst));
+    reclaimer.reclaim();
 }
 
 bool D2Config::readBool(const std::wstring& sectionName,
                         const std::wstring& keyName, const bool defaultValue) const {
-    const std::wregex VALID_BOOL_REGEX(L"false|true|0|1",
-                                       std::regex_constants::ECMAScript | std::regex_constants::icase);
-    const std::wregex TRUE_VALUE_REGEX(L"true|1");
-
-    WCHAR privateProfileStringBuffer[MAX_PATH];
-    GetPrivateProfileStringW(sectionName.c_str(), keyName.c_str(), nullptr,
-                             privateProfileStringBuffer, MAX_PATH, configPath.c_str());
-    std::wstring privateProfileString(privateProfileStringBuffer);
+    D2ConfigSnapshotRef snapshot(*this);
+    bool value;
 
-    if (!std::regex_match(privateProfileString, VALID_BOOL_REGEX)) {
-        const std::wstring defaultString = defaultValue ? L"true" : L"false";
-
-        WritePrivateProfileStringW(sectionName.c_str(), keyName.c_str(),
-                                   defaultString.c_str(), configPath.c_str());
+    if (!snapshot->findBool(sectionName, keyName, value)) {
+        setDefault(sectionName, keyName, defaultValue ? L"true" : L"false");
         return defaultValue;
     }
 
-    return std::regex_match(privateProfileString, TRUE_VALUE_REGEX);
+    return value;
 }
 
 unsigned int D2Config::readHex(const std::wstring& sectionName,
                                const std::wstring& keyName, const unsigned int defaultValue) const {
-    const std::wregex HEX_REGEX(L"0x[0-9A-F]{8}",
-                                std::regex_constants::ECMAScript | std::regex_constants::icase);
-
-    WCHAR hexBuffer[MAX_PATH];
-    GetPrivateProfileStringW(sectionName.c_str(), keyName.c_str(), nullptr,
-                             hexBuffer, MAX_PATH, configPath.c_str());
-
-    std::wstring privateProfileString(hexBuffer);
+    D2ConfigSnapshotRef snapshot(*this);
+    unsigned int value;
 
-    if (!std::regex_match(privateProfileString, HEX_REGEX)) {
-        std::wostringstream ouputStream;
-        ouputStream << std::showbase << std::hex << defaultValue;
-        WritePrivateProfileStringW(sectionName.c_str(), keyName.c_str(),
-                                   ouputStream.str().c_str(), configPath.c_str());
+    if (!snapshot->findHex(sectionName, keyName, value)) {
+        wchar_t defaultString[11];
+        std::swprintf(defaultString, sizeof(defaultString) / sizeof(defaultString[0]),
+                      L"0x%08X", defaultValue);
+        setDefault(sectionName, keyName, defaultString);
         return defaultValue;
     }
 
-    return std::stoul(privateProfileString, nullptr, 16);
+    return value;
 }
 
 int D2Config::readInt(const std::wstring& sectionName,
                       const std::wstring& keyName, const int defaultValue) const {
-    const std::wregex VALID_INT_REGEX(L"-?[0-9]+");
-
-    WCHAR privateProfileStringBuffer[MAX_PATH];
-    GetPrivateProfileStringW(sectionName.c_str(), keyName.c_str(), nullptr,
-                             privateProfileStringBuffer, MAX_PATH, configPath.c_str());
-
-    std::wstring privateProfileString(privateProfileStringBuffer);
+    D2ConfigSnapshotRef snapshot(*this);
+    int value;
 
-    if (!std::regex_match(privateProfileString, VALID_INT_REGEX)) {
-        WritePrivateProfileStringW(sectionName.c_str(), keyName.c_str(),
-                                   std::to_wstring(defaultValue).c_str(), configPath.c_str());
+    if (!snapshot->findInt(sectionName, keyName, value)) {
+        setDefault(sectionName, keyName, std::to_wstring(defaultValue));
         return defaultValue;
     }
 
-    return std::stol(privateProfileString);
+    return value;
 }
 
 std::string D2Config::readString(const std::wstring& sectionName, const std::wstring& keyName, const std::string& defaultValue) const {
-    wchar_t defaultValueWideStringBuffer[MAX_PATH];
-    std::mbstowcs(defaultValueWideStringBuffer, defaultValue.c_str(), MAX_PATH);
-    std::wstring returnValueWideString = readWideString(sectionName, keyName, defaultValueWideStringBuffer);
-
-    char returnValueCharStringBuffer[MAX_PATH];
-    std::wcstombs(returnValueCharStringBuffer, returnValueWideString.c_str(), MAX_PATH);
-    return returnValueCharStringBuffer;
+    std::wstring returnValueWideString = readWideString(sectionName, keyName,
+                                         toWideString(defaultValue));
+    return toNarrowString(returnValueWideString);
 }
 
 unsigned int D2Config::readUnsignedInt(const std::wstring& sectionName,
                                        const std::wstring& keyName, const unsigned int defaultValue) const {
-    const std::wregex VALID_UNSIGNED_INT_REGEX(L"[0-9]+");
-
-    WCHAR privateProfileStringBuffer[MAX_PATH];
-    GetPrivateProfileStringW(sectionName.c_str(), keyName.c_str(), nullptr,
-                             privateProfileStringBuffer, MAX_PATH, configPath.c_str());
+    D2ConfigSnapshotRef snapshot(*this);
+    unsigned int value;
 
-    std::wstring privateProfileString(privateProfileStringBuffer);
-
-    if (!std::regex_match(privateProfileString, VALID_UNSIGNED_INT_REGEX)) {
-        WritePrivateProfileStringW(sectionName.c_str(), keyName.c_str(),
-                                   std::to_wstring(defaultValue).c_str(), configPath.c_str());
+    if (!snapshot->findUnsignedInt(sectionName, keyName, value)) {
+        setDefault(sectionName, keyName, std::to_wstring(defaultValue));
         return defaultValue;
     }
 
-    return std::stoul(privateProfileString);
+    return value;
 }
 
 std::wstring D2Config::readWideString(const std::wstring& sectionName,
                                       const std::wstring& keyName, const std::wstring& defaultValue) const {
-    WCHAR privateProfileStringBuffer[MAX_PATH];
-    GetPrivateProfileStringW(sectionName.c_str(), keyName.c_str(), nullptr,
-                             privateProfileStringBuffer, MAX_PATH, configPath.c_str());
-    std::wstring privateProfileString(privateProfileStringBuffer);
-
-    if (privateProfileString.length() == 0) {
-        WritePrivateProfileStringW(sectionName.c_str(), keyName.c_str(),
-                                   defaultValue.c_str(), configPath.c_str());
+    D2ConfigSnapshotRef snapshot(*this);
+    std::wstring_view valueString;
+
+    if (!snapshot->findValue(sectionName, keyName, valueString)
+            || valueString.empty()) {
+        setDefault(sectionName, keyName, defaultValue);
         return defaultValue;
     }
 
-    return privateProfileString;
+    return std::wstring(valueString);
+}
+
+void D2Config::loadSettings() {
+    reload();
+    readSettings();
+    writeDefaults();
+}
+
+bool D2Config::writeDefaults() {
+    std::vector<D2IniValue> defaults;
+
+    {
+        std::lock_guard<std::mutex> defaultsLock(defaultsMutex);
+        defaults.swap(pendingDefaults);
+    }
+
+    if (defaults.empty()) {
+        return true;
+    }
+
+    // The file is read again, so that changes made to it since it was
+    // parsed are kept.
+    std::unique_lock<std::mutex> updateLock(updateMutex);
+    std::wstring text;
+    FileEncoding encoding;
+
+    if (!readFileText(text, encoding)) {
+        encoding = FileEncoding::ANSI;
+    }
+
+    std::wstring newText = D2IniFile::setValues(text, defaults);
+    std::string fileData;
+
+    if (encoding == FileEncoding::UTF16) {
+        fileData.assign((const char*) UTF16_BOM, sizeof(UTF16_BOM));
+        fileData.append((const char*) newText.data(), newText.length() * sizeof(wchar_t));
+    } else if (encoding == FileEncoding::UTF8) {
+        fileData.assign((const char*) UTF8_BOM, sizeof(UTF8_BOM));
+        fileData.append(encodeText(newText, CP_UTF8));
+    } else {
+        fileData = encodeText(newText, CP_ACP);
+    }
+
+    std::wstring temporaryPath = configPath + L"." + std::to_wstring(
+                                     GetCurrentProcessId()) + L".tmp";
+
+    HANDLE configFile = CreateFileW(temporaryPath.c_str(), GENERIC_WRITE, 0,
+                                    nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    DWORD bytesWritten = 0;
+    BOOL writeResult = FALSE;
+
+    if (configFile != INVALID_HANDLE_VALUE) {
+        writeResult = WriteFile(configFile, fileData.data(), (DWORD) fileData.size(),
+                                &bytesWritten, nullptr);
+        CloseHandle(configFile);
+    }
+
+    if (!writeResult || bytesWritten != fileData.size()
+            || !MoveFileExW(temporaryPath.c_str(), configPath.c_str(),
+                             MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileW(temporaryPath.c_str());
+        updateLock.unlock();
+
+        // Kept for the next attempt, behind any defaults queued meanwhile.
+        std::lock_guard<std::mutex> defaultsLock(defaultsMutex);
+        pendingDefaults.insert(pendingDefaults.begin(), defaults.cbegin(),
+                               defaults.cend());
+        return false;
+    }
+
+    // The watcher does not need to read back what was just written.
+    fileStamp = readFileStamp();
+    fileEncoding = encoding;
+    publishText(std::move(newText), updateLock);
+    return true;
+}
+
+bool D2Config::reload() {
+    return publishFile();
+}
+
+D2ConfigSnapshotRef D2Config::getSnapshot() const {
+    return D2ConfigSnapshotRef(*this);
+}
+
+bool D2Config::startWatching(unsigned int intervalMilliseconds) {
+    std::lock_guard<std::mutex> watcherLock(watcherMutex);
+
+    if (watcherThread.joinable()) {
+        return false;
+    }
+
+    loadSnapshot();
+    stopRequested = false;
+    watcherThread = std::thread(&D2Config::watchFile, this, intervalMilliseconds);
+    return true;
+}
+
+void D2Config::stopWatching() {
+    {
+        std::lock_guard<std::mutex> watcherLock(watcherMutex);
+
+        if (!watcherThread.joinable()) {
+            return;
+        }
+
+        stopRequested = true;
+    }
+
+    watcherCondition.notify_all();
+    watcherThread.join();
+}
+
+bool D2Config::isWatching() const {
+    std::lock_guard<std::mutex> watcherLock(watcherMutex);
+    return watcherThread.joinable();
+}
+
+size_t D2Config::addChangeListener(const std::wstring& sectionName,
+                                   D2ConfigChangeListener listener) {
+    std::lock_guard<std::mutex> updateLock(updateMutex);
+    size_t listenerId = nextListenerId++;
+    changeListeners.push_back({ listenerId, sectionName, std::move(listener) });
+    return listenerId;
+}
+
+bool D2Config::removeChangeListener(size_t listenerId) {
+    std::lock_guard<std::mutex> updateLock(updateMutex);
+    auto changeListener = std::find_if(changeListeners.begin(),
+                                       changeListeners.end(), [listenerId](const ChangeListener & entry) {
+        return entry.listenerId == listenerId;
+    });
+
+    if (changeListener == changeListeners.end()) {
+        return false;
+    }
+
+    changeListeners.erase(changeListener);
+    return true;
+}
+
+void D2Config::setValidator(D2ConfigValidator validator) {
+    std::lock_guard<std::mutex> updateLock(updateMutex);
+    this->validator = std::move(validator);
 }
 
 std::wstring D2Config::getConfigPath() const {
     return D2Config::configPath;
 }
+
+void D2Config::shutdown() {
+    stopWatching();
+
+    // The derived class may be destroyed next, so nothing it registered may
+    // be called after this.
+    {
+        std::lock_guard<std::mutex> updateLock(updateMutex);
+        changeListeners.clear();
+        validator = nullptr;
+    }
+
+    writeDefaults();
+}
+
+bool D2Config::FileStamp::operator==(const FileStamp& other) const {
+    return exists == other.exists && lastWriteTime == other.lastWriteTime
+           && size == other.size;
+}
+
+const D2ConfigSnapshot* D2Config::loadSnapshot() const {
+    const D2ConfigSnapshot* snapshot = currentSnapshot.load(
+                                           std::memory_order_seq_cst);
+
+    if (snapshot == nullptr) {
+        publishFile();
+        snapshot = currentSnapshot.load(std::memory_order_seq_cst);
+    }
+
+    return snapshot;
+}
+
+bool D2Config::publishFile() const {
+    std::unique_lock<std::mutex> updateLock(updateMutex);
+
+    // The stamp is taken first, so that a change made while the file is
+    // read is seen by the next check.
+    fileStamp = readFileStamp();
+    std::wstring text;
+
+    if (!readFileText(text, fileEncoding)) {
+        text.clear();
+        fileEncoding = FileEncoding::ANSI;
+    }
+
+    return publishText(std::move(text), updateLock);
+}
+
+bool D2Config::publishText(std::wstring text,
+                           std::unique_lock<std::mutex>& updateLock) const {
+    const D2ConfigSnapshot* oldSnapshot = currentSnapshot.load(
+            std::memory_order_seq_cst);
+    std::unique_ptr<D2ConfigSnapshot> snapshot(new D2ConfigSnapshot(std::move(text),
+            nextGeneration));
+
+    // The first snapshot is always published, as the settings that fail to
+    // parse fall back to their defaults.
+    if (oldSnapshot != nullptr && (snapshot->getHash() == oldSnapshot->getHash()
+                                   || (validator && !validator(*snapshot)))) {
+        return false;
+    }
+
+    std::vector<D2ConfigChangeListener> listeners;
+
+    if (oldSnapshot != nullptr) {
+        for (const auto& changeListener : changeListeners) {
+            if (changeListener.sectionName.empty()
+                    || snapshot->getSectionHash(changeListener.sectionName) !=
+                    oldSnapshot->getSectionHash(changeListener.sectionName)) {
+                listeners.push_back(changeListener.listener);
+            }
+        }
+    }
+
+    // The guard is entered before publishing, so that the new snapshot
+    // outlives the listeners even if it is replaced while they run.
+    D2EpochGuard epochGuard;
+    const D2ConfigSnapshot* newSnapshot = snapshot.release();
+    nextGeneration++;
+    currentSnapshot.store(newSnapshot, std::memory_order_seq_cst);
+    D2EpochReclaimer::getInstance().retire(oldSnapshot);
+    updateLock.unlock();
+
+    for (const auto& listener : listeners) {
+        listener(*newSnapshot);
+    }
+
+    return true;
+}
+
+void D2Config::setDefault(const std::wstring& sectionName,
+                          const std::wstring& keyName, const std::wstring& value) const {
+    std::lock_guard<std::mutex> defaultsLock(defaultsMutex);
+
+    for (auto& pendingDefault : pendingDefaults) {
+        if (D2IniFile::compareNames(pendingDefault.sectionName, sectionName) == 0
+                && D2IniFile::compareNames(pendingDefault.keyName, keyName) == 0) {
+            pendingDefault.value = value;
+            return;
+        }
+    }
+
+    pendingDefaults.push_back({ sectionName, keyName, value });
+}
+
+bool D2Config::readFileText(std::wstring& text, FileEncoding& encoding) const {
+    D2MappedFile mappedFile;
+
+    if (!mappedFile.open(configPath)) {
+        return false;
+    }
+
+    const uint8_t* data = mappedFile.getData();
+    size_t size = mappedFile.getSize();
+
+    if (startsWith(data, size, UTF16_BOM, sizeof(UTF16_BOM))) {
+        size_t length = (size - sizeof(UTF16_BOM)) / sizeof(wchar_t);
+        text.resize(length);
+        std::memcpy(&text[0], data + sizeof(UTF16_BOM), length * sizeof(wchar_t));
+        encoding = FileEncoding::UTF16;
+    } else if (startsWith(data, size, UTF8_BOM, sizeof(UTF8_BOM))) {
+        text = decodeText(data + sizeof(UTF8_BOM), size - sizeof(UTF8_BOM), CP_UTF8);
+        encoding = FileEncoding::UTF8;
+    } else {
+        text = decodeText(data, size, CP_ACP);
+        encoding = FileEncoding::ANSI;
+    }
+
+    return true;
+}
+
+D2Config::FileStamp D2Config::readFileStamp() const {
+    WIN32_FILE_ATTRIBUTE_DATA fileAttributes;
+
+    if (!GetFileAttributesExW(configPath.c_str(), GetFileExInfoStandard,
+                              &fileAttributes)) {
+        return { false, 0, 0 };
+    }
+
+    return { true, ((uint64_t) fileAttributes.ftLastWriteTime.dwHighDateTime << 32) |
+             fileAttributes.ftLastWriteTime.dwLowDateTime,
+             ((uint64_t) fileAttributes.nFileSizeHigh << 32) | fileAttributes.nFileSizeLow
+           };
+}
+
+void D2Config::watchFile(unsigned int intervalMilliseconds) {
+    auto isStopRequested = [this]() {
+        return stopRequested;
+    };
+
+    std::unique_lock<std::mutex> watcherLock(watcherMutex);
+
+    while (!watcherCondition.wait_for(watcherLock,
+                                      std::chrono::milliseconds(intervalMilliseconds), isStopRequested)) {
+        watcherLock.unlock();
+
+        bool fileChanged;
+
+        {
+            std::lock_guard<std::mutex> updateLock(updateMutex);
+            fileChanged = !(readFileStamp() == fileStamp);
+        }
+
+        if (fileChanged) {
+            publishFile();
+        }
+
+        D2EpochReclaimer::getInstance().reclaim();
+        watcherLock.lock();
+    }
+}
+
+D2ConfigSnapshotRef::D2ConfigSnapshotRef(const D2Config& config) :
+    snapshot(config.loadSnapshot()) {
+}
+
+const D2ConfigSnapshot& D2ConfigSnapshotRef::operator*() const {
+    return *snapshot;
+}
+
+const D2ConfigSnapshot* D2ConfigSnapshotRef::operator->() const {
+    return snapshot;
+}
+
+const D2ConfigSnapshot* D2ConfigSnapshotRef::get() const {
+    return snapshot;
+}
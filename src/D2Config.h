@@ -28,15 +28,35 @@
 #ifndef D2CONFIG_H
 #define D2CONFIG_H
 
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "D2ConfigSnapshot.h"
+#include "D2EpochReclaimer.h"
+#include "D2IniFile.h"
+
+class D2ConfigSnapshotRef;
+
+typedef std::function<void(const D2ConfigSnapshot&)> D2ConfigChangeListener;
+typedef std::function<bool(const D2ConfigSnapshot&)> D2ConfigValidator;
 
 class D2Config {
 public:
     static constexpr const wchar_t* DEFAULT_CONFIG_PATH =
         L"./SlashDiablo-Tools.ini";
+    static constexpr unsigned int DEFAULT_WATCH_INTERVAL = 500;
 
     D2Config();
     D2Config(const std::wstring& configPath);
+    ~D2Config();
 
     bool readBool(const std::wstring& sectionName, const std::wstring& keyName,
                   const bool defaultValue) const;
@@ -52,10 +72,118 @@ public:
                                 const std::wstring& keyName, const std::wstring& defaultValue) const;
 
     virtual void readSettings() = 0;
+
+    // Reads the file once, calls readSettings, and writes the defaults of
+    // the settings that were missing or invalid back in a single pass.
+    void loadSettings();
+    bool writeDefaults();
+    // Parses the file again, and publishes it if any value changed. Returns
+    // false if nothing was published.
+    bool reload();
+
+    // The current settings, which stay the same for as long as the returned
+    // reference lives, even if the file is reloaded meanwhile. Taking one
+    // costs no lock and no file access, so it can be done every frame.
+    D2ConfigSnapshotRef getSnapshot() const;
+
+    // Reloads the file on a background thread whenever it changes.
+    bool startWatching(unsigned int intervalMilliseconds = DEFAULT_WATCH_INTERVAL);
+    void stopWatching();
+    bool isWatching() const;
+
+    // Listeners are called on the thread that published the new settings,
+    // only if a value of their section changed, or any value if the section
+    // name is empty. The validator may reject reloaded settings, which are
+    // then not published. It is called while reloads are blocked, so it must
+    // not call back into the config.
+    size_t addChangeListener(const std::wstring& sectionName,
+                             D2ConfigChangeListener listener);
+    bool removeChangeListener(size_t listenerId);
+    void setValidator(D2ConfigValidator validator);
+
     std::wstring getConfigPath() const;
 
+    // Stops watching, drops the listeners and the validator, and writes the
+    // defaults that are still pending. The destructor does none of this, as
+    // joining a thread or writing a file while the loader lock is held may
+    // deadlock, so call it before the config is destroyed, and not from
+    // DllMain. A config destroyed while watching ends the process, as any
+    // std::thread that is still running does.
+    void shutdown();
+
 private:
+    friend class D2ConfigSnapshotRef;
+
+    enum class FileEncoding : int {
+        ANSI,
+        UTF8,
+        UTF16
+    };
+
+    struct FileStamp {
+        bool exists;
+        uint64_t lastWriteTime;
+        uint64_t size;
+
+        bool operator==(const FileStamp& other) const;
+    };
+
+    struct ChangeListener {
+        size_t listenerId;
+        std::wstring sectionName;
+        D2ConfigChangeListener listener;
+    };
+
     std::wstring configPath;
+
+    // Only replaced while holding the update mutex, and read without it.
+    mutable std::atomic<const D2ConfigSnapshot*> currentSnapshot;
+
+    mutable std::mutex updateMutex;
+    mutable FileEncoding fileEncoding;
+    mutable FileStamp fileStamp;
+    mutable uint64_t nextGeneration;
+    std::vector<ChangeListener> changeListeners;
+    size_t nextListenerId;
+    D2ConfigValidator validator;
+
+    mutable std::mutex defaultsMutex;
+    mutable std::vector<D2IniValue> pendingDefaults;
+
+    mutable std::mutex watcherMutex;
+    std::condition_variable watcherCondition;
+    std::thread watcherThread;
+    bool stopRequested;
+
+    const D2ConfigSnapshot* loadSnapshot() const;
+    bool publishFile() const;
+    bool publishText(std::wstring text,
+                     std::unique_lock<std::mutex>& updateLock) const;
+    void setDefault(const std::wstring& sectionName, const std::wstring& keyName,
+                    const std::wstring& value) const;
+
+    bool readFileText(std::wstring& text, FileEncoding& encoding) const;
+    FileStamp readFileStamp() const;
+    void watchFile(unsigned int intervalMilliseconds);
+};
+
+// Keeps the snapshot it was taken from alive for as long as it lives. It is
+// meant to be held for a frame at most, as it holds back the freeing of every
+// snapshot replaced meanwhile.
+class D2ConfigSnapshotRef {
+public:
+    explicit D2ConfigSnapshotRef(const D2Config& config);
+
+    D2ConfigSnapshotRef(const D2ConfigSnapshotRef&) = delete;
+    D2ConfigSnapshotRef& operator=(const D2ConfigSnapshotRef&) = delete;
+
+    const D2ConfigSnapshot& operator*() const;
+    const D2ConfigSnapshot* operator->() const;
+    const D2ConfigSnapshot* get() const;
+
+private:
+    D2EpochGuard epochGuard;
+    const D2ConfigSnapshot* snapshot;
 };
 
 #endif // D2CONFIG_H
@@ -0,0 +1,119 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2ConfigSnapshot.cpp                                                    *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Defines the D2ConfigSnapshot class, an immutable parse of the settings  *
+ *   file that readers can keep using while a newer one is published.        *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2ConfigSnapshot.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "D2IniFile.h"
+
+D2ConfigSnapshot::D2ConfigSnapshot(std::wstring text, uint64_t generation) :
+    generation(generation) {
+    iniFile.parse(std::move(text));
+    hash = iniFile.hashValues();
+}
+
+bool D2ConfigSnapshot::findValue(std::wstring_view sectionName,
+                                 std::wstring_view keyName, std::wstring_view& value) const {
+    return iniFile.findValue(sectionName, keyName, value);
+}
+
+bool D2ConfigSnapshot::findBool(std::wstring_view sectionName,
+                                std::wstring_view keyName, bool& value) const {
+    std::wstring_view valueString;
+    return findValue(sectionName, keyName, valueString)
+           && D2IniFile::parseBool(valueString, value);
+}
+
+bool D2ConfigSnapshot::findHex(std::wstring_view sectionName,
+                               std::wstring_view keyName, unsigned int& value) const {
+    std::wstring_view valueString;
+    return findValue(sectionName, keyName, valueString)
+           && D2IniFile::parseHex(valueString, value);
+}
+
+bool D2ConfigSnapshot::findInt(std::wstring_view sectionName,
+                               std::wstring_view keyName, int& value) const {
+    std::wstring_view valueString;
+    return findValue(sectionName, keyName, valueString)
+           && D2IniFile::parseInt(valueString, value);
+}
+
+bool D2ConfigSnapshot::findUnsignedInt(std::wstring_view sectionName,
+                                       std::wstring_view keyName, unsigned int& value) const {
+    std::wstring_view valueString;
+    return findValue(sectionName, keyName, valueString)
+           && D2IniFile::parseUnsignedInt(valueString, value);
+}
+
+bool D2ConfigSnapshot::readBool(std::wstring_view sectionName,
+                                std::wstring_view keyName, bool defaultValue) const {
+    bool value;
+    return findBool(sectionName, keyName, value) ? value : defaultValue;
+}
+
+unsigned int D2ConfigSnapshot::readHex(std::wstring_view sectionName,
+                                       std::wstring_view keyName, unsigned int defaultValue) const {
+    unsigned int value;
+    return findHex(sectionName, keyName, value) ? value : defaultValue;
+}
+
+int D2ConfigSnapshot::readInt(std::wstring_view sectionName,
+                              std::wstring_view keyName, int defaultValue) const {
+    int value;
+    return findInt(sectionName, keyName, value) ? value : defaultValue;
+}
+
+unsigned int D2ConfigSnapshot::readUnsignedInt(std::wstring_view sectionName,
+        std::wstring_view keyName, unsigned int defaultValue) const {
+    unsigned int value;
+    return findUnsignedInt(sectionName, keyName, value) ? value : defaultValue;
+}
+
+std::wstring D2ConfigSnapshot::readWideString(std::wstring_view sectionName,
+        std::wstring_view keyName, std::wstring_view defaultValue) const {
+    std::wstring_view value;
+
+    if (!findValue(sectionName, keyName, value) || value.empty()) {
+        return std::wstring(defaultValue);
+    }
+
+    return std::wstring(value);
+}
+
+uint64_t D2ConfigSnapshot::getGeneration() const {
+    return generation;
+}
+
+uint64_t D2ConfigSnapshot::getSectionHash(std::wstring_view sectionName) const {
+    return iniFile.hashSection(sectionName);
+}
+
+uint64_t D2ConfigSnapshot::getHash() const {
+    return hash;
+}
@@ -0,0 +1,78 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2ConfigSnapshot.h                                                      *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Declares the D2ConfigSnapshot class, an immutable parse of the settings *
+ *   file that readers can keep using while a newer one is published.        *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2CONFIGSNAPSHOT_H
+#define _D2CONFIGSNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "D2IniFile.h"
+
+class D2ConfigSnapshot {
+public:
+    D2ConfigSnapshot(std::wstring text, uint64_t generation);
+
+    D2ConfigSnapshot(const D2ConfigSnapshot&) = delete;
+    D2ConfigSnapshot& operator=(const D2ConfigSnapshot&) = delete;
+
+    // The find functions return false if the value is missing or invalid.
+    bool findValue(std::wstring_view sectionName, std::wstring_view keyName,
+                   std::wstring_view& value) const;
+    bool findBool(std::wstring_view sectionName, std::wstring_view keyName,
+                  bool& value) const;
+    bool findHex(std::wstring_view sectionName, std::wstring_view keyName,
+                 unsigned int& value) const;
+    bool findInt(std::wstring_view sectionName, std::wstring_view keyName,
+                 int& value) const;
+    bool findUnsignedInt(std::wstring_view sectionName, std::wstring_view keyName,
+                         unsigned int& value) const;
+
+    bool readBool(std::wstring_view sectionName, std::wstring_view keyName,
+                  bool defaultValue) const;
+    unsigned int readHex(std::wstring_view sectionName, std::wstring_view keyName,
+                         unsigned int defaultValue) const;
+    int readInt(std::wstring_view sectionName, std::wstring_view keyName,
+                int defaultValue) const;
+    unsigned int readUnsignedInt(std::wstring_view sectionName,
+                                 std::wstring_view keyName, unsigned int defaultValue) const;
+    std::wstring readWideString(std::wstring_view sectionName,
+                                std::wstring_view keyName, std::wstring_view defaultValue) const;
+
+    // Counts up with every snapshot published by a config.
+    uint64_t getGeneration() const;
+    uint64_t getSectionHash(std::wstring_view sectionName) const;
+    uint64_t getHash() const;
+
+private:
+    D2IniFile iniFile;
+    uint64_t generation;
+    uint64_t hash;
+};
+
+#endif
@@ -30,6 +30,8 @@
 #ifndef _D2DATATABLES_H
 #define _D2DATATABLES_H
 
+#include <cstdint>
+
 #pragma pack(1)
 
 /****************************************************************************
@@ -46,8 +48,18 @@ struct D2MonstatsTXT;
  *                                                                           *
  *****************************************************************************/
 
+// Only the leading fields are known so far. BaseId, NextInClass and the
+// strings are resolved by the game while it loads the table.
 struct D2MonstatsTXT
 {
+    uint16_t nId;
+    uint16_t nBaseId;
+    uint16_t nNextInClass;
+    uint16_t nNameStr;
+    uint16_t nDescStr;
+    uint16_t nUnknown0A;
+    uint32_t dwMonStatsFlags;
+    uint32_t dwCode;
     //...
 };
 
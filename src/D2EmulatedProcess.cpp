@@ -0,0 +1,448 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2EmulatedProcess.cpp                                                   *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2EmulatedProcess class, a process backend that   *
+ *   keeps its memory and modules in memory of its own, so that the patch    *
+ *   core can be run and measured without the game or Windows.               *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2EmulatedProcess.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cwctype>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "D2PEImage.h"
+#include "D2ProcessBackend.h"
+
+namespace {
+size_t roundUpToPage(size_t size) {
+    return (size + D2EmulatedProcess::PAGE_SIZE - 1) & ~
+           (D2EmulatedProcess::PAGE_SIZE - 1);
+}
+
+uint32_t getSectionProtection(uint32_t characteristics) {
+    bool writable = (characteristics & D2PEImage::SECTION_WRITABLE) != 0;
+
+    if ((characteristics & D2PEImage::SECTION_EXECUTABLE) != 0) {
+        return writable ? D2ProcessBackend::PROTECTION_EXECUTE_READWRITE :
+               D2ProcessBackend::PROTECTION_EXECUTE_READ;
+    }
+
+    return writable ? D2ProcessBackend::PROTECTION_READWRITE :
+           D2ProcessBackend::PROTECTION_READONLY;
+}
+}
+
+D2EmulatedProcess::D2EmulatedProcess() :
+    nextAllocationAddress(FIRST_ALLOCATION_ADDRESS), protectionChangeCount(0),
+    instructionCacheFlushCount(0) {
+}
+
+uintptr_t D2EmulatedProcess::allocate(uintptr_t address, size_t size,
+                                      uint32_t protection) {
+    size = roundUpToPage(size);
+
+    if (size == 0) {
+        return 0;
+    }
+
+    if (address == 0) {
+        address = nextAllocationAddress;
+
+        while (!isRangeFree(address, size)) {
+            // Skip past the region that is in the way.
+            const auto* blockingRegion = findRegion(address);
+
+            if (blockingRegion == nullptr) {
+                blockingRegion = &*regions.lower_bound(address);
+            }
+
+            address = blockingRegion->first + blockingRegion->second.data.size();
+
+            if (address + size > LAST_ALLOCATION_ADDRESS) {
+                return 0;
+            }
+        }
+
+        nextAllocationAddress = address + size;
+    } else if ((address & (PAGE_SIZE - 1)) != 0 || !isRangeFree(address, size)) {
+        return 0;
+    }
+
+    Region& region = regions[address];
+    region.data.assign(size, 0);
+    region.pageProtections.assign(size / PAGE_SIZE, protection);
+
+    return address;
+}
+
+bool D2EmulatedProcess::release(uintptr_t address) {
+    return regions.erase(address) != 0;
+}
+
+uintptr_t D2EmulatedProcess::loadImage(std::wstring_view moduleName,
+                                       const uint8_t* fileData, size_t fileSize, uintptr_t baseAddress) {
+    D2PEImage image(fileData, fileSize, D2PEImageLayout::FILE);
+    std::vector<D2PEExport> exports;
+
+    if (!image.isValid() || !image.readExports(exports)) {
+        return 0;
+    }
+
+    if (baseAddress == 0 && isRangeFree(image.getImageBase(),
+                                        roundUpToPage(image.getSizeOfImage()))) {
+        baseAddress = image.getImageBase();
+    }
+
+    uintptr_t moduleHandle = addModule(moduleName, image.getSizeOfImage(),
+                                       PROTECTION_READONLY, baseAddress);
+
+    if (moduleHandle == 0) {
+        return 0;
+    }
+
+    Region& region = findRegion(moduleHandle)->second;
+    std::memcpy(region.data.data(), fileData,
+                std::min<size_t>({ image.getSizeOfHeaders(), fileSize, region.data.size() }));
+
+    for (const auto& section : image.getSections()) {
+        uint32_t mappedSize = std::max(section.virtualSize, section.rawDataSize);
+
+        if (section.virtualAddress >= region.data.size()) {
+            continue;
+        }
+
+        mappedSize = (uint32_t) std::min<size_t>(mappedSize,
+                     region.data.size() - section.virtualAddress);
+        size_t copySize = std::min<size_t>(std::min(section.rawDataSize, mappedSize),
+                                           (section.rawDataOffset < fileSize) ? fileSize - section.rawDataOffset : 0);
+
+        std::memcpy(&region.data[section.virtualAddress],
+                    &fileData[section.rawDataOffset], copySize);
+
+        size_t firstPage = section.virtualAddress / PAGE_SIZE;
+        size_t lastPage = roundUpToPage((size_t) section.virtualAddress + mappedSize) /
+                          PAGE_SIZE;
+
+        for (size_t page = firstPage; page < lastPage; page++) {
+            region.pageProtections[page] = getSectionProtection(section.characteristics);
+        }
+    }
+
+    for (const auto& peExport : exports) {
+        if (!peExport.forwarded) {
+            addExport(moduleHandle, peExport.ordinal, peExport.name, peExport.rva);
+        }
+    }
+
+    return moduleHandle;
+}
+
+uintptr_t D2EmulatedProcess::addModule(std::wstring_view moduleName,
+                                       size_t imageSize, uint32_t protection, uintptr_t baseAddress) {
+    if (getModuleHandle(moduleName) != 0) {
+        return 0;
+    }
+
+    uintptr_t moduleHandle = allocate(baseAddress, imageSize, protection);
+
+    if (moduleHandle != 0) {
+        modules.push_back({ normalizeName(moduleName), moduleHandle, imageSize, {}, {} });
+    }
+
+    return moduleHandle;
+}
+
+bool D2EmulatedProcess::addExport(uintptr_t moduleHandle, uint16_t ordinal,
+                                  std::string_view procName, uint32_t rva) {
+    Module* module = findModule(moduleHandle);
+
+    if (module == nullptr) {
+        return false;
+    }
+
+    module->ordinalExports[ordinal] = rva;
+
+    if (!procName.empty()) {
+        module->namedExports[std::string(procName)] = rva;
+    }
+
+    return true;
+}
+
+void D2EmulatedProcess::setFileVersion(std::wstring_view filePath,
+                                       uint32_t versionMS, uint32_t versionLS) {
+    fileVersions[normalizeName(filePath)] = { versionMS, versionLS };
+}
+
+size_t D2EmulatedProcess::getProtectionChangeCount() const {
+    return protectionChangeCount;
+}
+
+size_t D2EmulatedProcess::getInstructionCacheFlushCount() const {
+    return instructionCacheFlushCount;
+}
+
+size_t D2EmulatedProcess::getPageSize() const {
+    return PAGE_SIZE;
+}
+
+bool D2EmulatedProcess::readMemory(uintptr_t address, void* buffer,
+                                   size_t size) {
+    return copyMemory(address, (uint8_t*) buffer, nullptr, size);
+}
+
+bool D2EmulatedProcess::writeMemory(uintptr_t address, const void* buffer,
+                                    size_t size) {
+    return copyMemory(address, nullptr, (const uint8_t*) buffer, size);
+}
+
+bool D2EmulatedProcess::protectMemory(uintptr_t address, size_t size,
+                                      uint32_t protection, uint32_t& oldProtection) {
+    uintptr_t startPage = address & ~(PAGE_SIZE - 1);
+    uintptr_t endPage = roundUpToPage(address + std::max<size_t>(size, 1));
+
+    // Every page has to be committed before any is changed.
+    for (uintptr_t page = startPage; page < endPage; page += PAGE_SIZE) {
+        if (findRegion(page) == nullptr) {
+            return false;
+        }
+    }
+
+    oldProtection = 0;
+
+    for (uintptr_t page = startPage; page < endPage; page += PAGE_SIZE) {
+        auto& region = *findRegion(page);
+        uint32_t& pageProtection = region.second.pageProtections[(page - region.first) /
+                                   PAGE_SIZE];
+
+        if (page == startPage) {
+            oldProtection = pageProtection;
+        }
+
+        pageProtection = protection;
+    }
+
+    protectionChangeCount++;
+    return true;
+}
+
+bool D2EmulatedProcess::queryMemory(uintptr_t address,
+                                    D2MemoryRegion& region) const {
+    uintptr_t page = address & ~(PAGE_SIZE - 1);
+    const auto* foundRegion = findRegion(page);
+
+    if (foundRegion == nullptr) {
+        auto nextRegion = regions.upper_bound(page);
+        uintptr_t freeEnd = (nextRegion != regions.cend()) ? nextRegion->first :
+                            LAST_ALLOCATION_ADDRESS;
+
+        region = { page, (freeEnd > page) ? freeEnd - page : PAGE_SIZE, PROTECTION_NOACCESS, false };
+        return true;
+    }
+
+    // Like VirtualQuery, report the run of pages that share a protection.
+    const std::vector<uint32_t>& pageProtections =
+        foundRegion->second.pageProtections;
+    size_t firstPage = (page - foundRegion->first) / PAGE_SIZE;
+    size_t lastPage = firstPage + 1;
+
+    while (lastPage < pageProtections.size()
+            && pageProtections[lastPage] == pageProtections[firstPage]) {
+        lastPage++;
+    }
+
+    region = { page, (lastPage - firstPage) * PAGE_SIZE, pageProtections[firstPage], true };
+    return true;
+}
+
+void D2EmulatedProcess::flushInstructionCache(uintptr_t, size_t) {
+    instructionCacheFlushCount++;
+}
+
+const uint8_t* D2EmulatedProcess::getMemoryView(uintptr_t address,
+        size_t size) const {
+    const auto* region = findRegion(address);
+
+    if (region == nullptr
+            || region->second.data.size() - (address - region->first) < size) {
+        return nullptr;
+    }
+
+    return &region->second.data[address - region->first];
+}
+
+uintptr_t D2EmulatedProcess::getModuleHandle(std::wstring_view moduleName) {
+    std::wstring normalizedName = normalizeName(moduleName);
+
+    for (const auto& module : modules) {
+        if (module.name == normalizedName) {
+            return module.baseAddress;
+        }
+    }
+
+    return 0;
+}
+
+uintptr_t D2EmulatedProcess::loadModule(std::wstring_view moduleName) {
+    // Modules are only ever added explicitly.
+    return getModuleHandle(moduleName);
+}
+
+uintptr_t D2EmulatedProcess::getProcAddress(uintptr_t moduleHandle,
+        uint16_t ordinal) {
+    Module* module = findModule(moduleHandle);
+
+    if (module == nullptr) {
+        return 0;
+    }
+
+    auto ordinalExport = module->ordinalExports.find(ordinal);
+    return (ordinalExport != module->ordinalExports.cend()) ?
+           moduleHandle + ordinalExport->second : 0;
+}
+
+uintptr_t D2EmulatedProcess::getProcAddress(uintptr_t moduleHandle,
+        std::string_view procName) {
+    Module* module = findModule(moduleHandle);
+
+    if (module == nullptr) {
+        return 0;
+    }
+
+    auto namedExport = module->namedExports.find(std::string(procName));
+    return (namedExport != module->namedExports.cend()) ?
+           moduleHandle + namedExport->second : 0;
+}
+
+bool D2EmulatedProcess::getFileVersion(std::wstring_view filePath,
+                                       uint32_t& versionMS, uint32_t& versionLS) {
+    auto fileVersion = fileVersions.find(normalizeName(filePath));
+
+    if (fileVersion == fileVersions.cend()) {
+        return false;
+    }
+
+    versionMS = fileVersion->second.versionMS;
+    versionLS = fileVersion->second.versionLS;
+    return true;
+}
+
+const std::pair<const uintptr_t, D2EmulatedProcess::Region>*
+D2EmulatedProcess::findRegion(uintptr_t address) const {
+    auto region = regions.upper_bound(address);
+
+    if (region == regions.cbegin()) {
+        return nullptr;
+    }
+
+    --region;
+    return (address - region->first < region->second.data.size()) ? &*region :
+           nullptr;
+}
+
+std::pair<const uintptr_t, D2EmulatedProcess::Region>*
+D2EmulatedProcess::findRegion(uintptr_t address) {
+    return const_cast<std::pair<const uintptr_t, Region>*>(
+               static_cast<const D2EmulatedProcess*>(this)->findRegion(address));
+}
+
+bool D2EmulatedProcess::isRangeFree(uintptr_t address, size_t size) const {
+    if (address == 0 || address + size < address) {
+        return false;
+    }
+
+    auto nextRegion = regions.lower_bound(address);
+
+    if (nextRegion != regions.cend() && nextRegion->first < address + size) {
+        return false;
+    }
+
+    return findRegion(address) == nullptr;
+}
+
+bool D2EmulatedProcess::copyMemory(uintptr_t address, uint8_t* readBuffer,
+                                   const uint8_t* writeBuffer, size_t size) {
+    size_t copied = 0;
+
+    // Copy a page at a time, since each page has its own protection.
+    while (copied < size) {
+        uintptr_t currentAddress = address + copied;
+        auto* region = findRegion(currentAddress);
+
+        if (region == nullptr) {
+            return false;
+        }
+
+        size_t regionOffset = currentAddress - region->first;
+        uint32_t protection = region->second.pageProtections[regionOffset / PAGE_SIZE];
+        size_t chunkSize = std::min(size - copied,
+                                    PAGE_SIZE - (regionOffset & (PAGE_SIZE - 1)));
+
+        if (writeBuffer != nullptr) {
+            if (!isWritable(protection)) {
+                return false;
+            }
+
+            std::memcpy(&region->second.data[regionOffset], &writeBuffer[copied],
+                        chunkSize);
+        } else {
+            if (!isReadable(protection)) {
+                return false;
+            }
+
+            std::memcpy(&readBuffer[copied], &region->second.data[regionOffset],
+                        chunkSize);
+        }
+
+        copied += chunkSize;
+    }
+
+    return true;
+}
+
+D2EmulatedProcess::Module* D2EmulatedProcess::findModule(
+    uintptr_t moduleHandle) {
+    for (auto& module : modules) {
+        if (module.baseAddress == moduleHandle) {
+            return &module;
+        }
+    }
+
+    return nullptr;
+}
+
+std::wstring D2EmulatedProcess::normalizeName(std::wstring_view name) {
+    std::wstring normalizedName(name);
+
+    for (auto& character : normalizedName) {
+        character = (wchar_t) std::towlower(character);
+    }
+
+    return normalizedName;
+}
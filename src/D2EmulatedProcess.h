@@ -0,0 +1,136 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2EmulatedProcess.h                                                     *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2EmulatedProcess class, a process backend that  *
+ *   keeps its memory and modules in memory of its own, so that the patch    *
+ *   core can be run and measured without the game or Windows.               *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2EMULATEDPROCESS_H
+#define _D2EMULATEDPROCESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "D2ProcessBackend.h"
+
+// Memory is handed out in regions of pages, each page with its own
+// protection, and accesses that the protection does not allow fail the same
+// way they would in a real process. Reads may happen concurrently, but
+// anything that changes the process must not.
+class D2EmulatedProcess : public D2ProcessBackend {
+public:
+    static constexpr size_t PAGE_SIZE = 0x1000;
+    static constexpr uintptr_t FIRST_ALLOCATION_ADDRESS = 0x10000000;
+    static constexpr uintptr_t LAST_ALLOCATION_ADDRESS = 0x80000000;
+
+    D2EmulatedProcess();
+
+    // Commits a zeroed range of pages. An address of 0 picks any free range.
+    // Returns 0 if the range is already taken.
+    uintptr_t allocate(uintptr_t address, size_t size, uint32_t protection);
+    bool release(uintptr_t address);
+
+    // Maps the headers and sections of a PE image read from a file, with the
+    // protection of each section, and registers its exports. Relocations
+    // and imports are not processed, since the code is never run.
+    uintptr_t loadImage(std::wstring_view moduleName, const uint8_t* fileData,
+                        size_t fileSize, uintptr_t baseAddress = 0);
+    // Adds a module that has no PE image, such as for synthetic patch sets.
+    uintptr_t addModule(std::wstring_view moduleName, size_t imageSize,
+                        uint32_t protection, uintptr_t baseAddress = 0);
+    bool addExport(uintptr_t moduleHandle, uint16_t ordinal,
+                   std::string_view procName, uint32_t rva);
+    void setFileVersion(std::wstring_view filePath, uint32_t versionMS,
+                        uint32_t versionLS);
+
+    size_t getProtectionChangeCount() const;
+    size_t getInstructionCacheFlushCount() const;
+
+    virtual size_t getPageSize() const override;
+
+    virtual bool readMemory(uintptr_t address, void* buffer, size_t size) override;
+    virtual bool writeMemory(uintptr_t address, const void* buffer,
+                             size_t size) override;
+
+    virtual bool protectMemory(uintptr_t address, size_t size,
+                               uint32_t protection, uint32_t& oldProtection) override;
+    virtual bool queryMemory(uintptr_t address,
+                             D2MemoryRegion& region) const override;
+    virtual void flushInstructionCache(uintptr_t address, size_t size) override;
+    virtual const uint8_t* getMemoryView(uintptr_t address,
+                                         size_t size) const override;
+
+    virtual uintptr_t getModuleHandle(std::wstring_view moduleName) override;
+    virtual uintptr_t loadModule(std::wstring_view moduleName) override;
+    virtual uintptr_t getProcAddress(uintptr_t moduleHandle,
+                                     uint16_t ordinal) override;
+    virtual uintptr_t getProcAddress(uintptr_t moduleHandle,
+                                     std::string_view procName) override;
+
+    virtual bool getFileVersion(std::wstring_view filePath, uint32_t& versionMS,
+                                uint32_t& versionLS) override;
+
+private:
+    struct Region {
+        std::vector<uint8_t> data;
+        std::vector<uint32_t> pageProtections;
+    };
+
+    struct Module {
+        std::wstring name;
+        uintptr_t baseAddress;
+        size_t imageSize;
+        std::unordered_map<uint16_t, uint32_t> ordinalExports;
+        std::unordered_map<std::string, uint32_t> namedExports;
+    };
+
+    struct FileVersion {
+        uint32_t versionMS;
+        uint32_t versionLS;
+    };
+
+    // Keyed by the base address of each region.
+    std::map<uintptr_t, Region> regions;
+    std::vector<Module> modules;
+    std::unordered_map<std::wstring, FileVersion> fileVersions;
+    uintptr_t nextAllocationAddress;
+
+    size_t protectionChangeCount;
+    size_t instructionCacheFlushCount;
+
+    const std::pair<const uintptr_t, Region>* findRegion(uintptr_t address) const;
+    std::pair<const uintptr_t, Region>* findRegion(uintptr_t address);
+    bool isRangeFree(uintptr_t address, size_t size) const;
+    bool copyMemory(uintptr_t address, uint8_t* readBuffer,
+                    const uint8_t* writeBuffer, size_t size);
+    Module* findModule(uintptr_t moduleHandle);
+
+    static std::wstring normalizeName(std::wstring_view name);
+};
+
+#endif
@@ -0,0 +1,185 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2EpochReclaimer.cpp                                                    *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Defines the D2EpochReclaimer class, which frees objects that were       *
+ *   swapped out of an atomic pointer once no reader can still be using      *
+ *   them.                                                                   *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2EpochReclaimer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Every thread keeps its slot for as long as it lives, so that entering
+// only costs a store.
+struct D2EpochReaderState {
+    D2EpochReclaimer::ReaderSlot* readerSlot;
+    size_t depth;
+    bool slotClaimed;
+
+    ~D2EpochReaderState() {
+        if (readerSlot != nullptr) {
+            readerSlot->epoch.store(0, std::memory_order_release);
+            readerSlot->claimed.store(false, std::memory_order_release);
+        }
+    }
+};
+
+namespace {
+thread_local D2EpochReaderState readerState;
+}
+
+D2EpochReclaimer::D2EpochReclaimer() : globalEpoch(1), overflowReaders(0) {
+    for (auto& readerSlot : readerSlots) {
+        readerSlot.claimed.store(false, std::memory_order_relaxed);
+        readerSlot.epoch.store(0, std::memory_order_relaxed);
+    }
+}
+
+D2EpochReclaimer::~D2EpochReclaimer() {
+    // No reader may be left by now, so everything can go.
+    for (const auto& retiredObject : retiredObjects) {
+        retiredObject.destroy(retiredObject.object);
+    }
+}
+
+D2EpochReclaimer& D2EpochReclaimer::getInstance() {
+    static D2EpochReclaimer instance;
+    return instance;
+}
+
+void D2EpochReclaimer::retire(const void* object,
+                              void (*destroy)(const void*)) {
+    if (object == nullptr) {
+        return;
+    }
+
+    // Readers that enter from now on may only see the replacement.
+    uint64_t epoch = globalEpoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+
+    std::lock_guard<std::mutex> retiredLock(retiredMutex);
+    retiredObjects.push_back({ object, destroy, epoch });
+}
+
+size_t D2EpochReclaimer::reclaim() {
+    std::vector<RetiredObject> reclaimedObjects;
+
+    {
+        std::lock_guard<std::mutex> retiredLock(retiredMutex);
+
+        if (retiredObjects.empty()
+                || overflowReaders.load(std::memory_order_seq_cst) != 0) {
+            return retiredObjects.size();
+        }
+
+        uint64_t oldestEpoch = UINT64_MAX;
+
+        for (const auto& readerSlot : readerSlots) {
+            uint64_t epoch = readerSlot.epoch.load(std::memory_order_seq_cst);
+
+            if (epoch != 0) {
+                oldestEpoch = std::min(oldestEpoch, epoch);
+            }
+        }
+
+        auto stillVisible = std::stable_partition(retiredObjects.begin(),
+                            retiredObjects.end(), [oldestEpoch](const RetiredObject & retiredObject) {
+            return retiredObject.epoch > oldestEpoch;
+        });
+
+        reclaimedObjects.assign(stillVisible, retiredObjects.end());
+        retiredObjects.erase(stillVisible, retiredObjects.end());
+    }
+
+    // The objects are destroyed outside of the lock, in case destroying one
+    // retires another.
+    for (const auto& reclaimedObject : reclaimedObjects) {
+        reclaimedObject.destroy(reclaimedObject.object);
+    }
+
+    std::lock_guard<std::mutex> retiredLock(retiredMutex);
+    return retiredObjects.size();
+}
+
+size_t D2EpochReclaimer::getRetiredCount() const {
+    std::lock_guard<std::mutex> retiredLock(retiredMutex);
+    return retiredObjects.size();
+}
+
+D2EpochReclaimer::ReaderSlot* D2EpochReclaimer::claimSlot() {
+    for (auto& readerSlot : readerSlots) {
+        bool claimed = false;
+
+        if (!readerSlot.claimed.load(std::memory_order_relaxed)
+                && readerSlot.claimed.compare_exchange_strong(claimed, true,
+                        std::memory_order_acquire)) {
+            return &readerSlot;
+        }
+    }
+
+    return nullptr;
+}
+
+void D2EpochReclaimer::enter() {
+    if (readerState.depth++ != 0) {
+        return;
+    }
+
+    if (!readerState.slotClaimed) {
+        readerState.readerSlot = claimSlot();
+        readerState.slotClaimed = true;
+    }
+
+    if (readerState.readerSlot == nullptr) {
+        overflowReaders.fetch_add(1, std::memory_order_seq_cst);
+        return;
+    }
+
+    // The store must be visible before the protected pointer is loaded,
+    // which takes a full fence.
+    readerState.readerSlot->epoch.store(globalEpoch.load(
+                                            std::memory_order_seq_cst), std::memory_order_seq_cst);
+}
+
+void D2EpochReclaimer::exit() {
+    if (--readerState.depth != 0) {
+        return;
+    }
+
+    if (readerState.readerSlot == nullptr) {
+        overflowReaders.fetch_sub(1, std::memory_order_seq_cst);
+        return;
+    }
+
+    readerState.readerSlot->epoch.store(0, std::memory_order_release);
+}
+
+D2EpochGuard::D2EpochGuard() {
+    D2EpochReclaimer::getInstance().enter();
+}
+
+D2EpochGuard::~D2EpochGuard() {
+    D2EpochReclaimer::getInstance().exit();
+}
@@ -0,0 +1,112 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2EpochReclaimer.h                                                      *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Declares the D2EpochReclaimer class, which frees objects that were      *
+ *   swapped out of an atomic pointer once no reader can still be using      *
+ *   them, without readers taking a lock.                                    *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2EPOCHRECLAIMER_H
+#define _D2EPOCHRECLAIMER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Readers announce the epoch they entered in, and writers tag every object
+// they retire with the epoch that follows its replacement. An object is
+// freed once every reader has left or entered a later epoch. There is one
+// reclaimer for the process, so that a thread needs only one reader slot.
+class D2EpochReclaimer {
+public:
+    static constexpr size_t MAX_READER_THREADS = 64;
+
+    ~D2EpochReclaimer();
+
+    D2EpochReclaimer(const D2EpochReclaimer&) = delete;
+    D2EpochReclaimer& operator=(const D2EpochReclaimer&) = delete;
+
+    static D2EpochReclaimer& getInstance();
+
+    // Must be called after the object was swapped out, and frees it with the
+    // given function once it is safe.
+    void retire(const void* object, void (*destroy)(const void*));
+
+    template<class T>
+    void retire(const T* object) {
+        retire(object, [](const void* retiredObject) {
+            delete (const T*) retiredObject;
+        });
+    }
+
+    // Frees the retired objects that no reader can still see. Returns the
+    // number of objects that are still waiting.
+    size_t reclaim();
+    size_t getRetiredCount() const;
+
+private:
+    friend class D2EpochGuard;
+    friend struct D2EpochReaderState;
+
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    struct alignas(CACHE_LINE_SIZE) ReaderSlot {
+        std::atomic<bool> claimed;
+        // Zero while the thread is not reading.
+        std::atomic<uint64_t> epoch;
+    };
+
+    struct RetiredObject {
+        const void* object;
+        void (*destroy)(const void*);
+        uint64_t epoch;
+    };
+
+    std::atomic<uint64_t> globalEpoch;
+    // Readers that found no free slot hold back every reclamation.
+    std::atomic<uint32_t> overflowReaders;
+    ReaderSlot readerSlots[MAX_READER_THREADS];
+
+    mutable std::mutex retiredMutex;
+    std::vector<RetiredObject> retiredObjects;
+
+    D2EpochReclaimer();
+
+    ReaderSlot* claimSlot();
+    void enter();
+    void exit();
+};
+
+// Objects loaded from a pointer managed by the reclaimer stay valid for as
+// long as a guard lives on the thread. Guards may be nested.
+class D2EpochGuard {
+public:
+    D2EpochGuard();
+    ~D2EpochGuard();
+
+    D2EpochGuard(const D2EpochGuard&) = delete;
+    D2EpochGuard& operator=(const D2EpochGuard&) = delete;
+};
+
+#endif
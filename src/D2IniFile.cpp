@@ -0,0 +1,443 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2IniFile.cpp                                                           *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Defines the D2IniFile class, which parses the text of a settings file   *
+ *   once into a sorted index of its sections and keys, and edits the text   *
+ *   to set values.                                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2IniFile.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cwctype>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+constexpr const wchar_t* LINE_BREAK = L"\r\n";
+
+constexpr uint64_t HASH_OFFSET_BASIS = 0xCBF29CE484222325ULL;
+constexpr uint64_t HASH_PRIME = 0x00000100000001B3ULL;
+
+uint64_t hashText(std::wstring_view text, bool ignoreCase, uint64_t hash) {
+    for (wchar_t c : text) {
+        hash = (hash ^ (uint64_t)(ignoreCase ? std::towlower(c) : c)) * HASH_PRIME;
+    }
+
+    // Separates the text from whatever is hashed next.
+    return (hash ^ 0xFFFF) * HASH_PRIME;
+}
+
+std::wstring_view trim(std::wstring_view view) {
+    size_t start = 0;
+    size_t end = view.length();
+
+    while (start < end && std::iswspace(view[start])) {
+        start++;
+    }
+
+    while (end > start && std::iswspace(view[end - 1])) {
+        end--;
+    }
+
+    return view.substr(start, end - start);
+}
+
+bool isDigit(wchar_t c) {
+    return c >= L'0' && c <= L'9';
+}
+
+int getHexDigit(wchar_t c) {
+    if (isDigit(c)) {
+        return c - L'0';
+    }
+
+    if (c >= L'a' && c <= L'f') {
+        return c - L'a' + 10;
+    }
+
+    if (c >= L'A' && c <= L'F') {
+        return c - L'A' + 10;
+    }
+
+    return -1;
+}
+
+bool parseDigits(std::wstring_view text, uint64_t limit, uint64_t& value) {
+    if (text.empty()) {
+        return false;
+    }
+
+    uint64_t result = 0;
+
+    for (wchar_t c : text) {
+        if (!isDigit(c)) {
+            return false;
+        }
+
+        result = result * 10 + (uint64_t)(c - L'0');
+
+        if (result > limit) {
+            return false;
+        }
+    }
+
+    value = result;
+    return true;
+}
+
+struct Edit {
+    size_t offset;
+    size_t removeLength;
+    std::wstring insertText;
+};
+}
+
+D2IniFile::D2IniFile() {
+}
+
+void D2IniFile::parse(std::wstring text) {
+    this->text = std::move(text);
+    sections.clear();
+    entries.clear();
+
+    std::wstring_view textView(this->text);
+    size_t position = 0;
+
+    while (position < textView.length()) {
+        size_t lineEnd = textView.find_first_of(LINE_BREAK, position);
+
+        if (lineEnd == std::wstring_view::npos) {
+            lineEnd = textView.length();
+        }
+
+        std::wstring_view line = trim(textView.substr(position,
+                                      lineEnd - position));
+        position = lineEnd;
+
+        if (position < textView.length() && textView[position] == L'\r') {
+            position++;
+        }
+
+        if (position < textView.length() && textView[position] == L'\n') {
+            position++;
+        }
+
+        if (line.empty() || line[0] == L';') {
+            continue;
+        }
+
+        if (line[0] == L'[') {
+            size_t nameEnd = line.find(L']');
+            std::wstring_view sectionName = trim(line.substr(1,
+                                                 (nameEnd == std::wstring_view::npos) ? std::wstring_view::npos : nameEnd - 1));
+            sections.push_back({ getRange(sectionName), (uint32_t) lineEnd });
+            continue;
+        }
+
+        // Keys before the first section belong to no section, and lines
+        // without a separator are not keys.
+        size_t separator = line.find(L'=');
+
+        if (sections.empty() || separator == std::wstring_view::npos) {
+            continue;
+        }
+
+        std::wstring_view keyName = trim(line.substr(0, separator));
+        std::wstring_view value = trim(line.substr(separator + 1));
+
+        if (value.length() >= 2 && value.front() == L'"' && value.back() == L'"') {
+            value = value.substr(1, value.length() - 2);
+        }
+
+        sections.back().insertOffset = (uint32_t) lineEnd;
+        entries.push_back({ sections.back().name, getRange(keyName), getRange(value) });
+    }
+
+    // The sort is stable, so the first of several equal names stays first.
+    std::stable_sort(sections.begin(), sections.end(),
+    [this](const Section & left, const Section & right) {
+        return compareNames(getText(left.name), getText(right.name)) < 0;
+    });
+
+    std::stable_sort(entries.begin(), entries.end(),
+    [this](const Entry & left, const Entry & right) {
+        int result = compareNames(getText(left.sectionName),
+                                  getText(right.sectionName));
+        return (result != 0) ? result < 0 : compareNames(getText(left.keyName),
+                getText(right.keyName)) < 0;
+    });
+}
+
+void D2IniFile::clear() {
+    text.clear();
+    sections.clear();
+    entries.clear();
+}
+
+bool D2IniFile::findValue(std::wstring_view sectionName,
+                          std::wstring_view keyName, std::wstring_view& value) const {
+    const Entry* entry = findEntry(sectionName, keyName);
+
+    if (entry == nullptr) {
+        return false;
+    }
+
+    value = getText(entry->value);
+    return true;
+}
+
+size_t D2IniFile::getValueCount() const {
+    return entries.size();
+}
+
+uint64_t D2IniFile::hashSection(std::wstring_view sectionName) const {
+    const Entry* entriesEnd = entries.data() + entries.size();
+    const Entry* first = std::lower_bound(entries.data(), entriesEnd, sectionName,
+    [this](const Entry & entry, std::wstring_view name) {
+        return compareNames(getText(entry.sectionName), name) < 0;
+    });
+    const Entry* last = std::upper_bound(first, entriesEnd, sectionName,
+    [this](std::wstring_view name, const Entry & entry) {
+        return compareNames(name, getText(entry.sectionName)) < 0;
+    });
+
+    return hashEntries(first, last);
+}
+
+uint64_t D2IniFile::hashValues() const {
+    return hashEntries(entries.data(), entries.data() + entries.size());
+}
+
+std::wstring D2IniFile::setValues(std::wstring_view text,
+                                  const std::vector<D2IniValue>& values) {
+    D2IniFile iniFile;
+    iniFile.parse(std::wstring(text));
+
+    std::vector<Edit> edits;
+    std::vector<const D2IniValue*> newSectionValues;
+
+    for (const auto& value : values) {
+        const Entry* entry = iniFile.findEntry(value.sectionName, value.keyName);
+
+        if (entry != nullptr) {
+            edits.push_back({ entry->value.start, entry->value.length, value.value });
+            continue;
+        }
+
+        const Section* section = iniFile.findSection(value.sectionName);
+
+        if (section != nullptr) {
+            edits.push_back({ section->insertOffset, 0, LINE_BREAK + value.keyName + L"=" + value.value });
+        } else {
+            newSectionValues.push_back(&value);
+        }
+    }
+
+    std::stable_sort(edits.begin(), edits.end(), [](const Edit & left,
+    const Edit & right) {
+        return left.offset < right.offset;
+    });
+
+    std::wstring result;
+    size_t position = 0;
+
+    for (const auto& edit : edits) {
+        result.append(text.substr(position, edit.offset - position));
+        result.append(edit.insertText);
+        position = edit.offset + edit.removeLength;
+    }
+
+    result.append(text.substr(position));
+
+    // Keys of the same new section are written together, in the order the
+    // section was first asked for.
+    auto isNameLess = [](std::wstring_view left, std::wstring_view right) {
+        return compareNames(left, right) < 0;
+    };
+
+    std::map<std::wstring_view, size_t, decltype(isNameLess)> firstIndices(
+        isNameLess);
+
+    for (size_t i = 0; i < newSectionValues.size(); i++) {
+        firstIndices.emplace(newSectionValues[i]->sectionName, i);
+    }
+
+    std::stable_sort(newSectionValues.begin(), newSectionValues.end(),
+    [&firstIndices](const D2IniValue * left, const D2IniValue * right) {
+        return firstIndices.at(left->sectionName) < firstIndices.at(
+                   right->sectionName);
+    });
+
+    for (size_t i = 0; i < newSectionValues.size(); i++) {
+        const D2IniValue& value = *newSectionValues[i];
+
+        if (i == 0 || compareNames(newSectionValues[i - 1]->sectionName,
+                                   value.sectionName) != 0) {
+            if (!result.empty() && result.back() != L'\n') {
+                result.append(LINE_BREAK);
+            }
+
+            result.append(L"[" + value.sectionName + L"]" + LINE_BREAK);
+        }
+
+        result.append(value.keyName + L"=" + value.value + LINE_BREAK);
+    }
+
+    return result;
+}
+
+bool D2IniFile::parseBool(std::wstring_view text, bool& value) {
+    if (text == L"1" || compareNames(text, L"true") == 0) {
+        value = true;
+        return true;
+    }
+
+    if (text == L"0" || compareNames(text, L"false") == 0) {
+        value = false;
+        return true;
+    }
+
+    return false;
+}
+
+bool D2IniFile::parseHex(std::wstring_view text, unsigned int& value) {
+    if (text.length() < 3 || text.length() > 10 || text[0] != L'0'
+            || (text[1] != L'x' && text[1] != L'X')) {
+        return false;
+    }
+
+    uint32_t result = 0;
+
+    for (size_t i = 2; i < text.length(); i++) {
+        int digit = getHexDigit(text[i]);
+
+        if (digit < 0) {
+            return false;
+        }
+
+        result = (result << 4) | (uint32_t) digit;
+    }
+
+    value = result;
+    return true;
+}
+
+bool D2IniFile::parseInt(std::wstring_view text, int& value) {
+    bool negative = !text.empty() && text[0] == L'-';
+    uint64_t magnitude;
+
+    if (!parseDigits(negative ? text.substr(1) : text,
+                     negative ? (uint64_t) INT_MAX + 1 : (uint64_t) INT_MAX, magnitude)) {
+        return false;
+    }
+
+    value = negative ? (int)(0 - magnitude) : (int) magnitude;
+    return true;
+}
+
+bool D2IniFile::parseUnsignedInt(std::wstring_view text, unsigned int& value) {
+    uint64_t result;
+
+    if (!parseDigits(text, UINT_MAX, result)) {
+        return false;
+    }
+
+    value = (unsigned int) result;
+    return true;
+}
+
+int D2IniFile::compareNames(std::wstring_view left, std::wstring_view right) {
+    size_t length = std::min(left.length(), right.length());
+
+    for (size_t i = 0; i < length; i++) {
+        wint_t leftChar = std::towlower(left[i]);
+        wint_t rightChar = std::towlower(right[i]);
+
+        if (leftChar != rightChar) {
+            return (leftChar < rightChar) ? -1 : 1;
+        }
+    }
+
+    if (left.length() == right.length()) {
+        return 0;
+    }
+
+    return (left.length() < right.length()) ? -1 : 1;
+}
+
+std::wstring_view D2IniFile::getText(const Range& range) const {
+    return std::wstring_view(text).substr(range.start, range.length);
+}
+
+D2IniFile::Range D2IniFile::getRange(std::wstring_view view) const {
+    return { (uint32_t)(view.data() - text.data()), (uint32_t) view.length() };
+}
+
+const D2IniFile::Section* D2IniFile::findSection(std::wstring_view sectionName)
+const {
+    auto section = std::lower_bound(sections.cbegin(), sections.cend(),
+                                    sectionName, [this](const Section & entry, std::wstring_view name) {
+        return compareNames(getText(entry.name), name) < 0;
+    });
+
+    if (section == sections.cend()
+            || compareNames(getText(section->name), sectionName) != 0) {
+        return nullptr;
+    }
+
+    return &*section;
+}
+
+uint64_t D2IniFile::hashEntries(const Entry* first, const Entry* last) const {
+    uint64_t hash = HASH_OFFSET_BASIS;
+
+    for (const Entry* entry = first; entry != last; entry++) {
+        hash = hashText(getText(entry->sectionName), true, hash);
+        hash = hashText(getText(entry->keyName), true, hash);
+        hash = hashText(getText(entry->value), false, hash);
+    }
+
+    return hash;
+}
+
+const D2IniFile::Entry* D2IniFile::findEntry(std::wstring_view sectionName,
+        std::wstring_view keyName) const {
+    auto entry = std::lower_bound(entries.cbegin(), entries.cend(),
+                                  std::make_pair(sectionName, keyName),
+    [this](const Entry & element, const std::pair<std::wstring_view, std::wstring_view>& names) {
+        int result = compareNames(getText(element.sectionName), names.first);
+        return (result != 0) ? result < 0 : compareNames(getText(element.keyName),
+                names.second) < 0;
+    });
+
+    if (entry == entries.cend()
+            || compareNames(getText(entry->sectionName), sectionName) != 0
+            || compareNames(getText(entry->keyName), keyName) != 0) {
+        return nullptr;
+    }
+
+    return &*entry;
+}
@@ -0,0 +1,112 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2IniFile.h                                                             *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Declares the D2IniFile class, which parses the text of a settings file  *
+ *   once into a sorted index of its sections and keys, and edits the text   *
+ *   to set values.                                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2INIFILE_H
+#define _D2INIFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct D2IniValue {
+    std::wstring sectionName;
+    std::wstring keyName;
+    std::wstring value;
+};
+
+// Follows the rules of GetPrivateProfileString: names are compared without
+// case, the first of several equal keys wins, and values are trimmed and
+// stripped of surrounding quotes.
+class D2IniFile {
+public:
+    D2IniFile();
+
+    // Replaces anything parsed before. The index refers into the text, which
+    // is kept as one buffer for as long as the file.
+    void parse(std::wstring text);
+    void clear();
+
+    bool findValue(std::wstring_view sectionName, std::wstring_view keyName,
+                   std::wstring_view& value) const;
+    size_t getValueCount() const;
+
+    // Hashes the keys and values of a section, or of every section, so that
+    // two parses can be compared without comparing their text.
+    uint64_t hashSection(std::wstring_view sectionName) const;
+    uint64_t hashValues() const;
+
+    // Returns the text with the values set. A key that exists has its first
+    // value replaced, and a key that does not is added to the end of its
+    // section, or of a new section at the end of the text.
+    static std::wstring setValues(std::wstring_view text,
+                                  const std::vector<D2IniValue>& values);
+
+    static int compareNames(std::wstring_view left, std::wstring_view right);
+
+    // The parsers reject anything but the whole value, and values that do
+    // not fit. Hex values are 0x followed by up to 8 digits.
+    static bool parseBool(std::wstring_view text, bool& value);
+    static bool parseHex(std::wstring_view text, unsigned int& value);
+    static bool parseInt(std::wstring_view text, int& value);
+    static bool parseUnsignedInt(std::wstring_view text, unsigned int& value);
+
+private:
+    struct Range {
+        uint32_t start;
+        uint32_t length;
+    };
+
+    struct Section {
+        Range name;
+        // Where a new key of the section goes, which is the end of its last
+        // key or of its header.
+        uint32_t insertOffset;
+    };
+
+    struct Entry {
+        Range sectionName;
+        Range keyName;
+        Range value;
+    };
+
+    std::wstring text;
+    std::vector<Section> sections;
+    std::vector<Entry> entries;
+
+    std::wstring_view getText(const Range& range) const;
+    Range getRange(std::wstring_view view) const;
+
+    const Section* findSection(std::wstring_view sectionName) const;
+    const Entry* findEntry(std::wstring_view sectionName,
+                           std::wstring_view keyName) const;
+
+    uint64_t hashEntries(const Entry* first, const Entry* last) const;
+};
+
+#endif
@@ -0,0 +1,165 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2MappedFile.cpp                                                        *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2MappedFile class, which maps a whole file into  *
+ *   memory for reading, using the Windows file mapping functions or mmap on *
+ *   other systems.                                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+D2MappedFile::D2MappedFile() : data(nullptr), size(0)
+#ifdef _WIN32
+    , fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr)
+#endif
+{
+}
+
+D2MappedFile::~D2MappedFile() {
+    close();
+}
+
+#ifdef _WIN32
+
+bool D2MappedFile::open(const std::wstring& filePath) {
+    close();
+
+    // Other processes may replace the file while it is mapped.
+    fileHandle = CreateFileW(filePath.c_str(), GENERIC_READ,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (fileHandle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+
+    if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0
+            || (unsigned long long) fileSize.QuadPart > (size_t) - 1) {
+        close();
+        return false;
+    }
+
+    mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0,
+                                       nullptr);
+
+    if (mappingHandle == nullptr) {
+        close();
+        return false;
+    }
+
+    data = (const uint8_t*) MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+
+    if (data == nullptr) {
+        close();
+        return false;
+    }
+
+    size = (size_t) fileSize.QuadPart;
+    return true;
+}
+
+void D2MappedFile::close() {
+    if (data != nullptr) {
+        UnmapViewOfFile(data);
+    }
+
+    if (mappingHandle != nullptr) {
+        CloseHandle(mappingHandle);
+    }
+
+    if (fileHandle != INVALID_HANDLE_VALUE) {
+        CloseHandle(fileHandle);
+    }
+
+    data = nullptr;
+    size = 0;
+    mappingHandle = nullptr;
+    fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool D2MappedFile::open(const std::wstring& filePath) {
+    close();
+
+    std::string narrowPath(filePath.begin(), filePath.end());
+    int fileDescriptor = ::open(narrowPath.c_str(), O_RDONLY);
+
+    if (fileDescriptor < 0) {
+        return false;
+    }
+
+    struct stat fileStatus;
+
+    if (fstat(fileDescriptor, &fileStatus) != 0 || fileStatus.st_size <= 0) {
+        ::close(fileDescriptor);
+        return false;
+    }
+
+    void* mappedData = mmap(nullptr, (size_t) fileStatus.st_size, PROT_READ,
+                            MAP_PRIVATE, fileDescriptor, 0);
+    ::close(fileDescriptor);
+
+    if (mappedData == MAP_FAILED) {
+        return false;
+    }
+
+    data = (const uint8_t*) mappedData;
+    size = (size_t) fileStatus.st_size;
+    return true;
+}
+
+void D2MappedFile::close() {
+    if (data != nullptr) {
+        munmap((void*) data, size);
+    }
+
+    data = nullptr;
+    size = 0;
+}
+
+#endif
+
+bool D2MappedFile::isOpen() const {
+    return data != nullptr;
+}
+
+const uint8_t* D2MappedFile::getData() const {
+    return data;
+}
+
+size_t D2MappedFile::getSize() const {
+    return size;
+}
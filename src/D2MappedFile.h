@@ -0,0 +1,61 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2MappedFile.h                                                          *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2MappedFile class, which maps a whole file into *
+ *   memory for reading.                                                     *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2MAPPEDFILE_H
+#define _D2MAPPEDFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class D2MappedFile {
+public:
+    D2MappedFile();
+    ~D2MappedFile();
+
+    D2MappedFile(const D2MappedFile&) = delete;
+    D2MappedFile& operator=(const D2MappedFile&) = delete;
+
+    // Maps the file read-only. Empty files cannot be mapped, and are reported
+    // as a failure.
+    bool open(const std::wstring& filePath);
+    void close();
+
+    bool isOpen() const;
+    const uint8_t* getData() const;
+    size_t getSize() const;
+
+private:
+    const uint8_t* data;
+    size_t size;
+
+#ifdef _WIN32
+    void* fileHandle;
+    void* mappingHandle;
+#endif
+};
+
+#endif
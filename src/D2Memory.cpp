@@ -0,0 +1,157 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2Memory.cpp                                                            *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the functions used to read and write the memory of    *
+ *   the game process, regardless of the protection of the pages involved.   *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2Memory.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "D2ProcessBackend.h"
+
+DWORD D2Memory::getPageSize() {
+    return (DWORD) D2ProcessBackend::getCurrent().getPageSize();
+}
+
+DWORD D2Memory::getPageStart(DWORD address) {
+    return address & ~(getPageSize() - 1);
+}
+
+bool D2Memory::readMemory(DWORD address, BYTE* buffer, size_t size) {
+    return D2ProcessBackend::getCurrent().readMemory(address, buffer, size);
+}
+
+bool D2Memory::writeMemory(DWORD address, const BYTE* buffer, size_t size) {
+    D2ProcessBackend& backend = D2ProcessBackend::getCurrent();
+    uint32_t oldProtect;
+
+    if (!backend.protectMemory(address, size,
+                               D2ProcessBackend::PROTECTION_EXECUTE_READWRITE, oldProtect)) {
+        return false;
+    }
+
+    bool writeSuccess = backend.writeMemory(address, buffer, size);
+    backend.protectMemory(address, size, oldProtect, oldProtect);
+
+    return writeSuccess;
+}
+
+bool D2Memory::unprotectMemory(DWORD address, size_t size,
+                               std::vector<PageProtection>& oldProtections) {
+    D2ProcessBackend& backend = D2ProcessBackend::getCurrent();
+    DWORD endAddress = address + size;
+    DWORD currentAddress = address;
+
+    while (currentAddress < endAddress) {
+        D2MemoryRegion memoryRegion;
+
+        if (!backend.queryMemory(currentAddress, memoryRegion)) {
+            return false;
+        }
+
+        DWORD regionEnd = (DWORD)(memoryRegion.baseAddress + memoryRegion.regionSize);
+        regionEnd = std::min(regionEnd, endAddress);
+
+        oldProtections.push_back({ currentAddress, regionEnd - currentAddress,
+                                   memoryRegion.protection });
+        currentAddress = regionEnd;
+    }
+
+    uint32_t oldProtect;
+    return backend.protectMemory(address, size,
+                                 D2ProcessBackend::PROTECTION_EXECUTE_READWRITE, oldProtect);
+}
+
+bool D2Memory::writeUnprotectedMemory(DWORD address, const BYTE* buffer,
+                                      size_t size) {
+    return D2ProcessBackend::getCurrent().writeUnprotectedMemory(address, buffer,
+            size);
+}
+
+void D2Memory::restoreProtection(const std::vector<PageProtection>&
+                                 oldProtections) {
+    D2ProcessBackend& backend = D2ProcessBackend::getCurrent();
+
+    for (const auto& oldProtection : oldProtections) {
+        uint32_t oldProtect;
+        backend.protectMemory(oldProtection.address, oldProtection.size,
+                              oldProtection.protection, oldProtect);
+    }
+}
+
+void D2Memory::flushInstructionCache(DWORD address, size_t size) {
+    D2ProcessBackend::getCurrent().flushInstructionCache(address, size);
+}
+
+bool D2Memory::writeMemoryBatch(const std::vector<MemoryWrite>& memoryWrites) {
+    struct PageSpan {
+        DWORD startPage;
+        DWORD endPage;
+    };
+
+    std::vector<PageSpan> pageSpans;
+
+    for (const auto& memoryWrite : memoryWrites) {
+        if (memoryWrite.size > 0) {
+            pageSpans.push_back({ getPageStart(memoryWrite.address),
+                                  getPageStart(memoryWrite.address + memoryWrite.size - 1) + getPageSize() });
+        }
+    }
+
+    std::sort(pageSpans.begin(), pageSpans.end(), [](const PageSpan & left,
+    const PageSpan & right) {
+        return left.startPage < right.startPage;
+    });
+
+    std::vector<PageProtection> oldProtections;
+    size_t spanCount = 0;
+
+    for (const auto& pageSpan : pageSpans) {
+        if (spanCount > 0 && pageSpan.startPage <= pageSpans[spanCount - 1].endPage) {
+            pageSpans[spanCount - 1].endPage = std::max(pageSpans[spanCount - 1].endPage,
+                                               pageSpan.endPage);
+        } else {
+            pageSpans[spanCount++] = pageSpan;
+        }
+    }
+
+    for (size_t i = 0; i < spanCount; i++) {
+        if (!unprotectMemory(pageSpans[i].startPage,
+                             pageSpans[i].endPage - pageSpans[i].startPage, oldProtections)) {
+            restoreProtection(oldProtections);
+            return false;
+        }
+    }
+
+    bool writeSuccess = true;
+
+    for (const auto& memoryWrite : memoryWrites) {
+        writeSuccess = writeUnprotectedMemory(memoryWrite.address, memoryWrite.buffer,
+                                              memoryWrite.size) && writeSuccess;
+    }
+
+    restoreProtection(oldProtections);
+    return writeSuccess;
+}
@@ -0,0 +1,69 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2Memory.h                                                              *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the functions used to read and write the memory of   *
+ *   the game process, regardless of the protection of the pages involved.   *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2MEMORY_H
+#define _D2MEMORY_H
+
+#include <windows.h>
+#include <cstddef>
+#include <vector>
+
+namespace D2Memory {
+struct PageProtection {
+    DWORD address;
+    size_t size;
+    DWORD protection;
+};
+
+struct MemoryWrite {
+    DWORD address;
+    const BYTE* buffer;
+    size_t size;
+};
+
+DWORD getPageSize();
+DWORD getPageStart(DWORD address);
+
+bool readMemory(DWORD address, BYTE* buffer, size_t size);
+bool writeMemory(DWORD address, const BYTE* buffer, size_t size);
+
+// Used to write several ranges under a single protection change. The old
+// protection of every region in the range is saved, so that it can be
+// restored exactly even if the range spans regions of different protection.
+bool unprotectMemory(DWORD address, size_t size,
+                     std::vector<PageProtection>& oldProtections);
+bool writeUnprotectedMemory(DWORD address, const BYTE* buffer, size_t size);
+void restoreProtection(const std::vector<PageProtection>& oldProtections);
+
+// Called once after code was written. A size of 0 flushes everything.
+void flushInstructionCache(DWORD address, size_t size);
+
+// Performs the writes in the order given, changing the protection of each
+// span of contiguous pages only once.
+bool writeMemoryBatch(const std::vector<MemoryWrite>& memoryWrites);
+}
+
+#endif
@@ -0,0 +1,164 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2ModuleTable.cpp                                                       *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2ModuleTable class, which finds each of the      *
+ *   game's libraries once and keeps an index of its sections and exports.   *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2ModuleTable.h"
+
+#include <windows.h>
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+#include "D2Offset.h"
+#include "D2PEImage.h"
+#include "D2PEModuleIndex.h"
+#include "D2ProcessBackend.h"
+#include "D2Version.h"
+
+D2ModuleTable::D2ModuleTable() {
+    for (auto& module : modules) {
+        module.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+D2ModuleTable& D2ModuleTable::getInstance() {
+    static D2ModuleTable instance;
+    return instance;
+}
+
+const D2Module* D2ModuleTable::getModule(D2TEMPLATE_DLL_FILES dllFile) {
+    uint32_t generation = D2ProcessBackend::getGeneration();
+    const D2Module* module = modules[(int) dllFile].load(
+                                 std::memory_order_acquire);
+
+    if (module != nullptr && module->generation == generation) {
+        return module;
+    }
+
+    std::lock_guard<std::mutex> tableLock(tableMutex);
+    return loadModule(dllFile, generation);
+}
+
+uintptr_t D2ModuleTable::getModuleHandle(D2TEMPLATE_DLL_FILES dllFile) {
+    const D2Module* module = getModule(dllFile);
+    return (module != nullptr) ? module->handle : 0;
+}
+
+uintptr_t D2ModuleTable::getProcAddress(D2TEMPLATE_DLL_FILES dllFile,
+                                        uint16_t ordinal) {
+    const D2Module* module = getModule(dllFile);
+
+    if (module == nullptr) {
+        return 0;
+    }
+
+    uint32_t rva;
+
+    if (module->index.findExport(ordinal, rva)) {
+        return module->handle + rva;
+    }
+
+    if (module->index.isValid() && !module->index.isForwarded(ordinal)) {
+        return 0;
+    }
+
+    return D2ProcessBackend::getCurrent().getProcAddress(module->handle, ordinal);
+}
+
+uintptr_t D2ModuleTable::getProcAddress(D2TEMPLATE_DLL_FILES dllFile,
+                                        std::string_view procName) {
+    const D2Module* module = getModule(dllFile);
+
+    if (module == nullptr) {
+        return 0;
+    }
+
+    uint32_t rva;
+
+    if (module->index.findExport(procName, rva)) {
+        return module->handle + rva;
+    }
+
+    // The index cannot tell a missing name apart from a forwarded one.
+    return D2ProcessBackend::getCurrent().getProcAddress(module->handle,
+            procName);
+}
+
+std::wstring_view D2ModuleTable::getModuleName(D2TEMPLATE_DLL_FILES dllFile) {
+    const D2ModuleFile& moduleFile = MODULE_FILES[(int) dllFile];
+
+    if (moduleFile.mergedIntoGame && D2Version::isGameVersion114Plus()) {
+        return GAME_FILE_NAME;
+    }
+
+    return moduleFile.name;
+}
+
+const D2Module* D2ModuleTable::loadModule(D2TEMPLATE_DLL_FILES dllFile,
+        uint32_t generation) {
+    // Another thread may have loaded the module while the lock was taken.
+    const D2Module* module = modules[(int) dllFile].load(
+                                 std::memory_order_acquire);
+
+    if (module != nullptr && module->generation == generation) {
+        return module;
+    }
+
+    D2ProcessBackend& backend = D2ProcessBackend::getCurrent();
+    std::wstring_view moduleName = getModuleName(dllFile);
+    uintptr_t handle = backend.getModuleHandle(moduleName);
+
+    if (handle == 0) {
+        handle = backend.loadModule(moduleName);
+    }
+
+    if (handle == 0) {
+        return nullptr;
+    }
+
+    // From 1.14 onwards, most of the DLL files share Game.exe.
+    for (const auto& loadedModule : allModules) {
+        if (loadedModule->handle == handle && loadedModule->generation == generation) {
+            modules[(int) dllFile].store(loadedModule.get(), std::memory_order_release);
+            return loadedModule.get();
+        }
+    }
+
+    std::unique_ptr<D2Module> newModule(new D2Module{ handle, generation, D2PEModuleIndex() });
+    size_t imageSize;
+    const uint8_t* imageData = backend.getModuleImageView(handle, imageSize);
+
+    if (imageData != nullptr) {
+        newModule->index = D2PEModuleIndex(D2PEImage(imageData, imageSize,
+                                           D2PEImageLayout::MAPPED));
+    }
+
+    module = newModule.get();
+    allModules.push_back(std::move(newModule));
+    modules[(int) dllFile].store(module, std::memory_order_release);
+    return module;
+}
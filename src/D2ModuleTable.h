@@ -0,0 +1,120 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2ModuleTable.h                                                         *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2ModuleTable class, which finds each of the     *
+ *   game's libraries once and keeps an index of its sections and exports.   *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2MODULETABLE_H
+#define _D2MODULETABLE_H
+
+#include <windows.h>
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "D2Offset.h"
+#include "D2PEModuleIndex.h"
+
+struct D2ModuleFile {
+    const wchar_t* name;
+    // Merged into Game.exe from 1.14 onwards.
+    bool mergedIntoGame;
+};
+
+struct D2Module {
+    uintptr_t handle;
+    // The backend generation the module was found in.
+    uint32_t generation;
+    // Invalid if the headers of the module could not be read.
+    D2PEModuleIndex index;
+};
+
+class D2ModuleTable {
+public:
+    static constexpr size_t DLL_FILE_COUNT = (size_t)
+            D2TEMPLATE_DLL_FILES::D2DLL_STORM + 1;
+
+    static constexpr const wchar_t* GAME_FILE_NAME = L"Game.exe";
+
+    // Indexed by D2TEMPLATE_DLL_FILES.
+    static constexpr D2ModuleFile MODULE_FILES[DLL_FILE_COUNT] = {
+        { L"Binkw32.dll", false },
+        { L"BnClient.dll", true },
+        { L"D2Client.dll", true },
+        { L"D2CMP.dll", true },
+        { L"D2Common.dll", true },
+        { L"D2DDraw.dll", true },
+        { L"D2Direct3D.dll", true },
+        { L"D2Game.dll", true },
+        { L"D2Gdi.dll", true },
+        { L"D2Gfx.dll", true },
+        { L"D2Glide.dll", true },
+        { L"D2Lang.dll", true },
+        { L"D2Launch.dll", true },
+        { L"D2MCPClient.dll", true },
+        { L"D2Multi.dll", true },
+        { L"D2Net.dll", true },
+        { L"D2Sound.dll", true },
+        { L"D2Win.dll", true },
+        { L"Fog.dll", true },
+        { L"glide3x.dll", false },
+        { L"Ijl11.dll", false },
+        { L"SmackW32.dll", false },
+        { L"Storm.dll", true }
+    };
+
+    static D2ModuleTable& getInstance();
+
+    // Finds the module, loading it if needed, and indexes it the first time
+    // it is asked for. Returns nullptr if the module could not be loaded.
+    // Modules are never freed, so the pointer stays valid.
+    const D2Module* getModule(D2TEMPLATE_DLL_FILES dllFile);
+    uintptr_t getModuleHandle(D2TEMPLATE_DLL_FILES dllFile);
+
+    // Resolves an export from the index, and only asks the loader for
+    // exports that are forwarded or could not be indexed. Returns 0 if the
+    // export does not exist.
+    uintptr_t getProcAddress(D2TEMPLATE_DLL_FILES dllFile, uint16_t ordinal);
+    uintptr_t getProcAddress(D2TEMPLATE_DLL_FILES dllFile,
+                             std::string_view procName);
+
+    static std::wstring_view getModuleName(D2TEMPLATE_DLL_FILES dllFile);
+
+private:
+    std::atomic<const D2Module*> modules[DLL_FILE_COUNT];
+    std::mutex tableMutex;
+    // Modules found in an older backend are kept, since another thread may
+    // still be reading them.
+    std::vector<std::unique_ptr<D2Module>> allModules;
+
+    D2ModuleTable();
+
+    const D2Module* loadModule(D2TEMPLATE_DLL_FILES dllFile, uint32_t generation);
+};
+
+#endif
@@ -26,106 +26,190 @@
 #include "D2Offset.h"
 
 #include <windows.h>
+#include <cstdint>
 
-#include <string>
+#include <memory>
+#include <string_view>
 #include <unordered_map>
-#include <unordered_set>
 
+#include "D2ModuleTable.h"
+#include "D2OffsetCache.h"
+#include "D2ProcessBackend.h"
+#include "D2SignatureResolver.h"
+#include "D2SignatureScanner.h"
 #include "D2Version.h"
 #include "DLLmain.h"
 
 D2Offset::D2Offset(const D2TEMPLATE_DLL_FILES dllFile,
                    const std::unordered_map<GameVersion, long long int>& offsets) :
-    dllFile(dllFile), offsets(offsets) {
+    D2Offset(dllFile, makeOffsetTable(offsets)) {
+}
+
+D2Offset::D2Offset(const D2TEMPLATE_DLL_FILES dllFile,
+                   const std::unordered_map<GameVersion, long long int>& offsets,
+                   std::string_view signaturePattern, int resultOffset) :
+    D2Offset(dllFile, makeOffsetTable(offsets), signaturePattern, resultOffset) {
+}
+
+D2Offset::D2Offset(const D2TEMPLATE_DLL_FILES dllFile,
+                   const D2OffsetTable& offsetTable) : dllFile(dllFile),
+    offsetTable(offsetTable), resolvedAddress(0) {
+    computeCacheKey("", 0);
+}
+
+D2Offset::D2Offset(const D2TEMPLATE_DLL_FILES dllFile,
+                   const D2OffsetTable& offsetTable, std::string_view signaturePattern,
+                   int resultOffset) : dllFile(dllFile), offsetTable(offsetTable),
+    signature(std::make_shared<D2Signature>(signaturePattern, resultOffset)),
+    resolvedAddress(0) {
+    computeCacheKey(signaturePattern, resultOffset);
+    D2SignatureResolver::registerSignature(dllFile, signature);
+}
+
+D2Offset::D2Offset(const D2Offset& d2Offset) : dllFile(d2Offset.dllFile),
+    offsetTable(d2Offset.offsetTable), signature(d2Offset.signature),
+    cacheKey(d2Offset.cacheKey),
+    resolvedAddress(d2Offset.resolvedAddress.load(std::memory_order_relaxed)) {
+}
+
+D2Offset& D2Offset::operator=(const D2Offset& d2Offset) {
+    dllFile = d2Offset.dllFile;
+    offsetTable = d2Offset.offsetTable;
+    signature = d2Offset.signature;
+    cacheKey = d2Offset.cacheKey;
+    resolvedAddress.store(d2Offset.resolvedAddress.load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+    return *this;
+}
+
+D2TEMPLATE_DLL_FILES D2Offset::getDllFile() const {
+    return dllFile;
 }
 
 long long int D2Offset::getCurrentOffset() const {
-    auto offset = offsets.find(D2Version::getGameVersion());
-    return (offset != offsets.cend()) ? offset->second : 0;
+    GameVersion gameVersion = D2Version::getGameVersion();
+
+    if (offsetTable.hasOffset(gameVersion)) {
+        return offsetTable.offsets[(int) gameVersion];
+    }
+
+    if (signature != nullptr) {
+        return D2SignatureResolver::resolveRva(dllFile, signature);
+    }
+
+    return 0;
 }
 
 DWORD D2Offset::getCurrentAddress() const {
+    uint64_t currentAddress = resolvedAddress.load(std::memory_order_acquire);
+    uint32_t generation = D2ProcessBackend::getGeneration();
+
+    if ((uint32_t)(currentAddress >> 32) == generation) {
+        return (DWORD)(uint32_t) currentAddress;
+    }
+
+    DWORD address = findCurrentAddress();
+
+    // Failures are not remembered, so that a module loaded later can still
+    // be found.
+    if (address != 0) {
+        resolvedAddress.store(((uint64_t) generation << 32) | address,
+                              std::memory_order_release);
+    }
+
+    return address;
+}
+
+DWORD D2Offset::findCurrentAddress() const {
     HMODULE baseAddress = getDllAddress(dllFile);
 
     if (baseAddress == nullptr) {
         return 0;
     }
 
+    // The cache is keyed by the fingerprint of the module, so a hit does not
+    // need to know the game version at all.
+    D2OffsetCache& offsetCache = D2OffsetCache::getInstance();
+    DWORD rva;
+
+    if (offsetCache.lookup(dllFile, cacheKey, rva)) {
+        return (DWORD)(uintptr_t) baseAddress + rva;
+    }
+
     long long int offset = getCurrentOffset();
 
+    // A signature that was not found must not resolve to the module base.
+    if (offset == 0 && signature != nullptr
+            && !offsetTable.hasOffset(D2Version::getGameVersion())) {
+        return 0;
+    }
+
+    DWORD address = resolveAddress(dllFile, offset);
+
+    if (address != 0) {
+        offsetCache.store(dllFile, cacheKey, address - (DWORD)(uintptr_t) baseAddress);
+    }
+
+    return address;
+}
+
+DWORD D2Offset::resolveAddress(D2TEMPLATE_DLL_FILES dllFile,
+                               long long int offset) {
+    HMODULE baseAddress = getDllAddress(dllFile);
+
+    if (baseAddress == nullptr) {
+        return 0;
+    }
+
     DWORD address;
 
     if (offset < 0) {
-        address = (DWORD) GetProcAddress((HINSTANCE) baseAddress,
-                                         (LPSTR) - offset);
+        address = (DWORD) D2ModuleTable::getInstance().getProcAddress(dllFile,
+                  (uint16_t) - offset);
     } else {
-        address = (DWORD) baseAddress + (DWORD)offset;
+        address = (DWORD)(uintptr_t) baseAddress + (DWORD)offset;
     }
 
     return address;
 }
 
 HMODULE D2Offset::getDllAddress(D2TEMPLATE_DLL_FILES dllFile) {
-    static std::unordered_map<D2TEMPLATE_DLL_FILES, HMODULE> dllHandles;
-    static const std::unordered_map<D2TEMPLATE_DLL_FILES, std::wstring_view>
-    dllFilePaths = {
-        { D2TEMPLATE_DLL_FILES::D2DLL_BINKW32, L"Binkw32.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_BNCLIENT, L"BnClient.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2CLIENT, L"D2Client.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2CMP, L"D2CMP.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2COMMON, L"D2Common.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2DDRAW, L"D2DDraw.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2DIRECT3D, L"D2Direct3D.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2GAME, L"D2Game.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2GDI, L"D2Gdi.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2GFX, L"D2Gfx.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2GLIDE, L"D2Glide.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2LANG, L"D2Lang.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2LAUNCH, L"D2Launch.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2MCPCLIENT, L"D2MCPClient.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2MULTI, L"D2Multi.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2NET, L"D2Net.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2SOUND, L"D2Sound.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_D2WIN, L"D2Win.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_FOG, L"Fog.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_GLIDE3X, L"glide3x.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_IJL11, L"Ijl11.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_SMACKW32, L"SmackW32.dll" },
-        { D2TEMPLATE_DLL_FILES::D2DLL_STORM, L"Storm.dll" }
-    };
-
-    static const std::unordered_set<D2TEMPLATE_DLL_FILES> redirectedDlls = {
-        D2TEMPLATE_DLL_FILES::D2DLL_BNCLIENT, D2TEMPLATE_DLL_FILES::D2DLL_D2CLIENT,
-        D2TEMPLATE_DLL_FILES::D2DLL_D2CMP, D2TEMPLATE_DLL_FILES::D2DLL_D2COMMON,
-        D2TEMPLATE_DLL_FILES::D2DLL_D2DDRAW, D2TEMPLATE_DLL_FILES::D2DLL_D2DIRECT3D,
-        D2TEMPLATE_DLL_FILES::D2DLL_D2GAME, D2TEMPLATE_DLL_FILES::D2DLL_D2GDI,
-        D2TEMPLATE_DLL_FILES::D2DLL_D2GFX, D2TEMPLATE_DLL_FILES::D2DLL_D2GLIDE,
-        D2TEMPLATE_DLL_FILES::D2DLL_D2LANG, D2TEMPLATE_DLL_FILES::D2DLL_D2LAUNCH,
-        D2TEMPLATE_DLL_FILES::D2DLL_D2MCPCLIENT, D2TEMPLATE_DLL_FILES::D2DLL_D2MULTI,
-        D2TEMPLATE_DLL_FILES::D2DLL_D2NET, D2TEMPLATE_DLL_FILES::D2DLL_D2SOUND,
-        D2TEMPLATE_DLL_FILES::D2DLL_D2WIN, D2TEMPLATE_DLL_FILES::D2DLL_FOG,
-        D2TEMPLATE_DLL_FILES::D2DLL_STORM
-    };
-
-    HMODULE dllAddress = dllHandles[dllFile];
-
-    if (dllAddress == nullptr) {
-        std::wstring_view moduleName = dllFilePaths.at(dllFile);
-
-        if (D2Version::isGameVersion114Plus()) {
-            if (redirectedDlls.count(dllFile) == 1) {
-                moduleName = L"Game.exe";
-            }
-        }
+    return (HMODULE) D2ModuleTable::getInstance().getModuleHandle(dllFile);
+}
+
+D2OffsetTable D2Offset::makeOffsetTable(const
+        std::unordered_map<GameVersion, long long int>& offsets) {
+    D2OffsetTable offsetTable = {};
+
+    for (const auto& offset : offsets) {
+        offsetTable.offsets[(int) offset.first] = offset.second;
+        offsetTable.versionMask |= 1U << (int) offset.first;
+    }
+
+    return offsetTable;
+}
+
+void D2Offset::computeCacheKey(std::string_view signaturePattern,
+                               int resultOffset) {
+    // The offsets are hashed in version order, so the key is the same in
+    // every run.
+    cacheKey = D2OffsetCache::hashBytes(&dllFile, sizeof(dllFile));
 
-        dllAddress = GetModuleHandleW(moduleName.data());
+    for (int i = 0; i < D2Version::GAME_VERSION_COUNT; i++) {
+        GameVersion gameVersion = (GameVersion) i;
 
-        if (dllAddress == nullptr) {
-            dllAddress = LoadLibraryW(moduleName.data());
+        if (!offsetTable.hasOffset(gameVersion)) {
+            continue;
         }
 
-        dllHandles.at(dllFile) = dllAddress;
+        cacheKey = D2OffsetCache::hashBytes(&gameVersion, sizeof(gameVersion),
+                                            cacheKey);
+        cacheKey = D2OffsetCache::hashBytes(&offsetTable.offsets[i],
+                                            sizeof(offsetTable.offsets[i]), cacheKey);
     }
 
-    return dllAddress;
+    cacheKey = D2OffsetCache::hashBytes(signaturePattern.data(),
+                                        signaturePattern.length(), cacheKey);
+    cacheKey = D2OffsetCache::hashBytes(&resultOffset, sizeof(resultOffset),
+                                        cacheKey);
 }
@@ -28,12 +28,20 @@
 #define _D2OFFSET_H
 
 #include <windows.h>
+#include <cstdint>
 
+#include <atomic>
+#include <initializer_list>
+#include <memory>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "D2Version.h"
 
+class D2Signature;
+
 enum class D2TEMPLATE_DLL_FILES
     : int {
     D2DLL_BINKW32,
@@ -61,19 +69,72 @@ enum class D2TEMPLATE_DLL_FILES
     D2DLL_STORM,
 };
 
+// The offsets of every version, indexed by GameVersion, so that looking one
+// up is a single array read.
+struct D2OffsetTable {
+    long long int offsets[D2Version::GAME_VERSION_COUNT];
+    // One bit per version that has an offset listed, since 0 is a valid
+    // offset.
+    uint32_t versionMask;
+
+    static constexpr D2OffsetTable make(
+        std::initializer_list<std::pair<GameVersion, long long int>> versionOffsets) {
+        D2OffsetTable offsetTable = {};
+
+        for (const auto& versionOffset : versionOffsets) {
+            offsetTable.offsets[(int) versionOffset.first] = versionOffset.second;
+            offsetTable.versionMask |= 1U << (int) versionOffset.first;
+        }
+
+        return offsetTable;
+    }
+
+    constexpr bool hasOffset(GameVersion gameVersion) const {
+        return ((versionMask >> (int) gameVersion) & 1) != 0;
+    }
+};
+
 class D2Offset {
 public:
     D2Offset(const D2TEMPLATE_DLL_FILES dllFile,
              const std::unordered_map<GameVersion, long long int>& offsets);
 
+    // The signature is only scanned for when the running version has no
+    // offset listed, so that unknown builds of the game can still be
+    // patched. See D2Signature for the pattern syntax.
+    D2Offset(const D2TEMPLATE_DLL_FILES dllFile,
+             const std::unordered_map<GameVersion, long long int>& offsets,
+             std::string_view signaturePattern, int resultOffset = 0);
+    D2Offset(const D2TEMPLATE_DLL_FILES dllFile, const D2OffsetTable& offsetTable);
+    D2Offset(const D2TEMPLATE_DLL_FILES dllFile, const D2OffsetTable& offsetTable,
+             std::string_view signaturePattern, int resultOffset = 0);
+    D2Offset(const D2Offset& d2Offset);
+    D2Offset& operator=(const D2Offset& d2Offset);
+
+    D2TEMPLATE_DLL_FILES getDllFile() const;
     long long int getCurrentOffset() const;
     DWORD getCurrentAddress() const;
 
+    static DWORD resolveAddress(D2TEMPLATE_DLL_FILES dllFile,
+                                long long int offset);
+    static HMODULE getDllAddress(D2TEMPLATE_DLL_FILES dllFile);
+
 private:
     D2TEMPLATE_DLL_FILES dllFile;
-    std::unordered_map<GameVersion, long long int> offsets;
+    D2OffsetTable offsetTable;
+    std::shared_ptr<const D2Signature> signature;
+    uint64_t cacheKey;
 
-    static HMODULE getDllAddress(D2TEMPLATE_DLL_FILES dllFile);
+    // The resolved address, tagged with the backend generation it was
+    // resolved in, so that the first lookup is the only one that does any
+    // work.
+    mutable std::atomic<uint64_t> resolvedAddress;
+
+    static D2OffsetTable makeOffsetTable(const
+                                         std::unordered_map<GameVersion, long long int>& offsets);
+
+    void computeCacheKey(std::string_view signaturePattern, int resultOffset);
+    DWORD findCurrentAddress() const;
 };
 
 #endif
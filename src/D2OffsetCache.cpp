@@ -0,0 +1,429 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2OffsetCache.cpp                                                       *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2OffsetCache class, which persists the addresses *
+ *   resolved for each Diablo II module between runs. The cache file is      *
+ *   mapped into memory and searched in place, so a run with a matching      *
+ *   cache does not resolve any offsets.                                     *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2OffsetCache.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#endif
+
+#include <cstdint>
+#include <cstring>
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "D2MappedFile.h"
+#include "D2Offset.h"
+#include "D2PEImage.h"
+#include "D2ProcessBackend.h"
+
+namespace {
+// Many clients may share one cache file, so each writes its own file and
+// replaces the cache with it in one step.
+#ifdef _WIN32
+bool writeFile(const std::wstring& filePath, const void* data, size_t size) {
+    std::wstring temporaryPath = filePath + L"." + std::to_wstring(
+                                     GetCurrentProcessId()) + L".tmp";
+
+    HANDLE cacheFile = CreateFileW(temporaryPath.c_str(), GENERIC_WRITE, 0,
+                                   nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (cacheFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    DWORD bytesWritten = 0;
+    BOOL writeResult = WriteFile(cacheFile, data, (DWORD) size, &bytesWritten,
+                                 nullptr);
+    CloseHandle(cacheFile);
+
+    if (!writeResult || bytesWritten != size
+            || !MoveFileExW(temporaryPath.c_str(), filePath.c_str(),
+                            MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileW(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+#else
+bool writeFile(const std::wstring& filePath, const void* data, size_t size) {
+    std::string narrowPath(filePath.begin(), filePath.end());
+    std::string temporaryPath = narrowPath + "." + std::to_string(getpid()) +
+                                ".tmp";
+
+    int fileDescriptor = ::open(temporaryPath.c_str(),
+                                O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fileDescriptor < 0) {
+        return false;
+    }
+
+    const uint8_t* remainingData = (const uint8_t*) data;
+    size_t remainingSize = size;
+
+    while (remainingSize > 0) {
+        ssize_t writtenSize = write(fileDescriptor, remainingData, remainingSize);
+
+        if (writtenSize <= 0) {
+            break;
+        }
+
+        remainingData += writtenSize;
+        remainingSize -= writtenSize;
+    }
+
+    if (::close(fileDescriptor) != 0 || remainingSize != 0
+            || std::rename(temporaryPath.c_str(), narrowPath.c_str()) != 0) {
+        unlink(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+#endif
+}
+
+bool D2OffsetCache::ModuleFingerprint::operator==(const ModuleFingerprint&
+        other) const {
+    return timeDateStamp == other.timeDateStamp && sizeOfImage == other.sizeOfImage
+           && headerHash == other.headerHash;
+}
+
+D2OffsetCache::D2OffsetCache(const std::wstring& cachePath) :
+    cachePath(cachePath), loaded(false), dirty(false) {
+}
+
+D2OffsetCache& D2OffsetCache::getInstance() {
+    static D2OffsetCache offsetCache(DEFAULT_CACHE_PATH);
+    return offsetCache;
+}
+
+bool D2OffsetCache::lookup(D2TEMPLATE_DLL_FILES dllFile, uint64_t key,
+                           DWORD& rva) {
+    std::lock_guard<std::mutex> cacheLock(cacheMutex);
+    ModuleState& moduleState = getModuleState(dllFile);
+
+    if (!moduleState.fingerprintValid) {
+        return false;
+    }
+
+    auto addedEntry = moduleState.addedEntries.find(key);
+
+    if (addedEntry != moduleState.addedEntries.cend()) {
+        rva = addedEntry->second;
+        return true;
+    }
+
+    if (moduleState.cachedRecord == nullptr) {
+        return false;
+    }
+
+    const CacheEntry* entries = getCachedEntries(*moduleState.cachedRecord);
+    const CacheEntry* entriesEnd = entries + moduleState.cachedRecord->entryCount;
+    const CacheEntry* entry = std::lower_bound(entries, entriesEnd, key,
+    [](const CacheEntry & cacheEntry, uint64_t searchKey) {
+        return cacheEntry.key < searchKey;
+    });
+
+    if (entry == entriesEnd || entry->key != key) {
+        return false;
+    }
+
+    rva = entry->rva;
+    return true;
+}
+
+void D2OffsetCache::store(D2TEMPLATE_DLL_FILES dllFile, uint64_t key,
+                          DWORD rva) {
+    std::lock_guard<std::mutex> cacheLock(cacheMutex);
+    ModuleState& moduleState = getModuleState(dllFile);
+
+    // Addresses outside of the module, such as forwarded exports, do not
+    // keep the same RVA between runs.
+    if (!moduleState.fingerprintValid
+            || rva >= moduleState.fingerprint.sizeOfImage) {
+        return;
+    }
+
+    moduleState.addedEntries[key] = rva;
+    dirty = true;
+}
+
+bool D2OffsetCache::save() {
+    std::lock_guard<std::mutex> cacheLock(cacheMutex);
+
+    if (!dirty) {
+        return true;
+    }
+
+    load();
+
+    // Collect the records to write, merging the entries of modules that were
+    // checked in this run and copying the others as they were.
+    struct PendingModule {
+        int32_t dllFile;
+        ModuleFingerprint fingerprint;
+        std::vector<CacheEntry> entries;
+    };
+
+    std::vector<PendingModule> pendingModules;
+    std::vector<D2TEMPLATE_DLL_FILES> writtenModules;
+
+    if (mappedFile.isOpen()) {
+        const FileHeader* header = (const FileHeader*) mappedFile.getData();
+        const ModuleRecord* records = (const ModuleRecord*)(header + 1);
+
+        for (uint32_t i = 0; i < header->moduleCount; i++) {
+            auto moduleState = moduleStates.find((D2TEMPLATE_DLL_FILES)
+                                                 records[i].dllFile);
+
+            if (moduleState != moduleStates.cend()
+                    && moduleState->second.fingerprintValid) {
+                continue;
+            }
+
+            const CacheEntry* entries = getCachedEntries(records[i]);
+            pendingModules.push_back({ records[i].dllFile, records[i].fingerprint,
+                                       std::vector<CacheEntry>(entries, entries + records[i].entryCount)
+                                     });
+        }
+    }
+
+    for (auto& moduleState : moduleStates) {
+        ModuleState& state = moduleState.second;
+
+        if (!state.fingerprintValid) {
+            continue;
+        }
+
+        PendingModule pendingModule = { (int32_t) moduleState.first, state.fingerprint, {} };
+
+        if (state.cachedRecord != nullptr) {
+            const CacheEntry* entries = getCachedEntries(*state.cachedRecord);
+
+            for (uint32_t i = 0; i < state.cachedRecord->entryCount; i++) {
+                if (state.addedEntries.count(entries[i].key) == 0) {
+                    state.addedEntries[entries[i].key] = entries[i].rva;
+                }
+            }
+        }
+
+        for (const auto& addedEntry : state.addedEntries) {
+            pendingModule.entries.push_back({ addedEntry.first, addedEntry.second, 0 });
+        }
+
+        std::sort(pendingModule.entries.begin(), pendingModule.entries.end(),
+        [](const CacheEntry & left, const CacheEntry & right) {
+            return left.key < right.key;
+        });
+
+        pendingModules.push_back(std::move(pendingModule));
+    }
+
+    // Every entry now lives in memory, so the mapping can be released
+    // before the file is replaced.
+    for (auto& moduleState : moduleStates) {
+        moduleState.second.cachedRecord = nullptr;
+    }
+
+    mappedFile.close();
+
+    std::vector<uint8_t> fileData(sizeof(FileHeader) + pendingModules.size() *
+                                  sizeof(ModuleRecord));
+    FileHeader header = { FILE_MAGIC, FILE_VERSION, (uint32_t) pendingModules.size(), 0 };
+    std::memcpy(fileData.data(), &header, sizeof(header));
+
+    for (size_t i = 0; i < pendingModules.size(); i++) {
+        const PendingModule& pendingModule = pendingModules[i];
+        ModuleRecord record = { pendingModule.dllFile, (uint32_t) pendingModule.entries.size(),
+                                (uint32_t) fileData.size(), 0, pendingModule.fingerprint
+                              };
+
+        std::memcpy(&fileData[sizeof(FileHeader) + i * sizeof(ModuleRecord)], &record,
+                    sizeof(record));
+
+        size_t entriesSize = pendingModule.entries.size() * sizeof(CacheEntry);
+        fileData.resize(fileData.size() + entriesSize);
+        std::memcpy(&fileData[record.entriesOffset], pendingModule.entries.data(),
+                    entriesSize);
+    }
+
+    if (!writeFile(cachePath, fileData.data(), fileData.size())) {
+        return false;
+    }
+
+    dirty = false;
+    return true;
+}
+
+bool D2OffsetCache::isDirty() const {
+    std::lock_guard<std::mutex> cacheLock(cacheMutex);
+    return dirty;
+}
+
+std::wstring D2OffsetCache::getCachePath() const {
+    return cachePath;
+}
+
+uint64_t D2OffsetCache::hashBytes(const void* data, size_t size,
+                                  uint64_t hash) {
+    const uint8_t* bytes = (const uint8_t*) data;
+
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * HASH_PRIME;
+    }
+
+    return hash;
+}
+
+void D2OffsetCache::load() {
+    if (loaded) {
+        return;
+    }
+
+    loaded = true;
+
+    if (!mappedFile.open(cachePath)) {
+        return;
+    }
+
+    // Reject files that were cut short or written by another version,
+    // rather than reading past the end of the mapping.
+    const uint8_t* data = mappedFile.getData();
+    size_t size = mappedFile.getSize();
+    const FileHeader* header = (const FileHeader*) data;
+
+    if (size < sizeof(FileHeader) || header->magic != FILE_MAGIC
+            || header->version != FILE_VERSION
+            || header->moduleCount > (size - sizeof(FileHeader)) / sizeof(ModuleRecord)) {
+        mappedFile.close();
+        return;
+    }
+
+    const ModuleRecord* records = (const ModuleRecord*)(header + 1);
+
+    for (uint32_t i = 0; i < header->moduleCount; i++) {
+        size_t entriesEnd = (size_t) records[i].entriesOffset +
+                            (size_t) records[i].entryCount * sizeof(CacheEntry);
+
+        if (records[i].entriesOffset % alignof(CacheEntry) != 0
+                || records[i].entryCount > size / sizeof(CacheEntry) || entriesEnd > size) {
+            mappedFile.close();
+            return;
+        }
+    }
+}
+
+D2OffsetCache::ModuleState& D2OffsetCache::getModuleState(
+    D2TEMPLATE_DLL_FILES dllFile) {
+    ModuleState& moduleState = moduleStates[dllFile];
+
+    if (moduleState.fingerprintRead) {
+        return moduleState;
+    }
+
+    load();
+
+    moduleState.fingerprintRead = true;
+    moduleState.fingerprintValid = readFingerprint(dllFile,
+                                   moduleState.fingerprint);
+    moduleState.cachedRecord = nullptr;
+
+    if (!moduleState.fingerprintValid || !mappedFile.isOpen()) {
+        return moduleState;
+    }
+
+    const FileHeader* header = (const FileHeader*) mappedFile.getData();
+    const ModuleRecord* records = (const ModuleRecord*)(header + 1);
+
+    for (uint32_t i = 0; i < header->moduleCount; i++) {
+        if (records[i].dllFile == (int32_t) dllFile
+                && records[i].fingerprint == moduleState.fingerprint) {
+            moduleState.cachedRecord = &records[i];
+            break;
+        }
+    }
+
+    // A module that changed is rebuilt from the entries resolved in this run.
+    if (moduleState.cachedRecord == nullptr) {
+        dirty = true;
+    }
+
+    return moduleState;
+}
+
+const D2OffsetCache::CacheEntry* D2OffsetCache::getCachedEntries(
+    const ModuleRecord& record) const {
+    return (const CacheEntry*)(mappedFile.getData() + record.entriesOffset);
+}
+
+bool D2OffsetCache::readFingerprint(D2TEMPLATE_DLL_FILES dllFile,
+                                    ModuleFingerprint& fingerprint) {
+    size_t moduleSize = 0;
+    const uint8_t* moduleData = D2ProcessBackend::getCurrent().getModuleImageView(
+                                    (uintptr_t) D2Offset::getDllAddress(dllFile), moduleSize);
+
+    if (moduleData == nullptr) {
+        return false;
+    }
+
+    D2PEImage image(moduleData, moduleSize, D2PEImageLayout::MAPPED);
+
+    if (!image.isValid()) {
+        return false;
+    }
+
+    // The image base in the headers may be rewritten by the loader, so only
+    // the entry point and the section table are hashed.
+    uint32_t entryPoint = image.getEntryPoint();
+    uint64_t headerHash = hashBytes(&entryPoint, sizeof(entryPoint));
+
+    for (const auto& section : image.getSections()) {
+        headerHash = hashBytes(section.name, sizeof(section.name), headerHash);
+        headerHash = hashBytes(&section.virtualAddress, sizeof(section.virtualAddress),
+                               headerHash);
+        headerHash = hashBytes(&section.virtualSize, sizeof(section.virtualSize),
+                               headerHash);
+        headerHash = hashBytes(&section.rawDataSize, sizeof(section.rawDataSize),
+                               headerHash);
+        headerHash = hashBytes(&section.characteristics,
+                               sizeof(section.characteristics), headerHash);
+    }
+
+    fingerprint.timeDateStamp = image.getTimeDateStamp();
+    fingerprint.sizeOfImage = image.getSizeOfImage();
+    fingerprint.headerHash = headerHash;
+    return true;
+}
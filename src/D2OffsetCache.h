@@ -0,0 +1,125 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2OffsetCache.h                                                         *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2OffsetCache class, which persists the          *
+ *   addresses resolved for each Diablo II module between runs, keyed by the *
+ *   fingerprint of the module.                                              *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2OFFSETCACHE_H
+#define _D2OFFSETCACHE_H
+
+#include <windows.h>
+#include <cstdint>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "D2MappedFile.h"
+#include "D2Offset.h"
+
+class D2OffsetCache {
+public:
+    static constexpr const wchar_t* DEFAULT_CACHE_PATH =
+        L"./SlashDiablo-Tools.cache";
+
+    static constexpr uint32_t FILE_MAGIC = 0x434F3244; // "D2OC"
+    static constexpr uint32_t FILE_VERSION = 1;
+
+    D2OffsetCache(const std::wstring& cachePath);
+
+    static D2OffsetCache& getInstance();
+
+    // Looks up the RVA stored for the key. Entries are only returned when
+    // the fingerprint of the loaded module matches the one they were saved
+    // with.
+    bool lookup(D2TEMPLATE_DLL_FILES dllFile, uint64_t key, DWORD& rva);
+    void store(D2TEMPLATE_DLL_FILES dllFile, uint64_t key, DWORD rva);
+
+    // Writes the cache back if anything was added. Modules whose fingerprint
+    // changed only keep the entries resolved in this run.
+    bool save();
+    bool isDirty() const;
+    std::wstring getCachePath() const;
+
+    static uint64_t hashBytes(const void* data, size_t size,
+                              uint64_t hash = HASH_OFFSET_BASIS);
+
+private:
+    static constexpr uint64_t HASH_OFFSET_BASIS = 0xCBF29CE484222325ULL;
+    static constexpr uint64_t HASH_PRIME = 0x00000100000001B3ULL;
+
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t moduleCount;
+        uint32_t reserved;
+    };
+
+    struct ModuleFingerprint {
+        uint32_t timeDateStamp;
+        uint32_t sizeOfImage;
+        uint64_t headerHash;
+
+        bool operator==(const ModuleFingerprint& other) const;
+    };
+
+    struct ModuleRecord {
+        int32_t dllFile;
+        uint32_t entryCount;
+        uint32_t entriesOffset;
+        uint32_t reserved;
+        ModuleFingerprint fingerprint;
+    };
+
+    // Entries are sorted by key, so they can be searched in place.
+    struct CacheEntry {
+        uint64_t key;
+        uint32_t rva;
+        uint32_t reserved;
+    };
+
+    struct ModuleState {
+        bool fingerprintRead;
+        bool fingerprintValid;
+        ModuleFingerprint fingerprint;
+        const ModuleRecord* cachedRecord;
+        std::unordered_map<uint64_t, DWORD> addedEntries;
+    };
+
+    std::wstring cachePath;
+    mutable std::mutex cacheMutex;
+    D2MappedFile mappedFile;
+    bool loaded;
+    bool dirty;
+    std::unordered_map<D2TEMPLATE_DLL_FILES, ModuleState> moduleStates;
+
+    void load();
+    ModuleState& getModuleState(D2TEMPLATE_DLL_FILES dllFile);
+    const CacheEntry* getCachedEntries(const ModuleRecord& record) const;
+
+    static bool readFingerprint(D2TEMPLATE_DLL_FILES dllFile,
+                                ModuleFingerprint& fingerprint);
+};
+
+#endif
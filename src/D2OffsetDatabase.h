@@ -0,0 +1,70 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2OffsetDatabase.h                                                      *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file is generated from D2Offsets.tsv by                            *
+ *   tools/generate_offset_database.py. Do not edit it by hand.              *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2OFFSETDATABASE_H
+#define _D2OFFSETDATABASE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "D2Offset.h"
+#include "D2Version.h"
+
+enum class D2OffsetId : int {
+    D2CLIENT_TemplatePatch,
+};
+
+namespace D2OffsetDatabase {
+static constexpr size_t OFFSET_COUNT = 1;
+
+inline constexpr const char* NAMES[OFFSET_COUNT] = {
+    "D2CLIENT_TemplatePatch",
+};
+
+inline constexpr D2TEMPLATE_DLL_FILES DLL_FILES[OFFSET_COUNT] = {
+    D2TEMPLATE_DLL_FILES::D2DLL_D2CLIENT,
+};
+
+// The first entry of every table belongs to GameVersion::INVALID.
+inline constexpr D2OffsetTable OFFSET_TABLES[OFFSET_COUNT] = {
+    // D2CLIENT_TemplatePatch
+    { { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 }, 0x00800 },
+};
+
+constexpr const char* getName(D2OffsetId offsetId) {
+    return NAMES[(int) offsetId];
+}
+
+constexpr D2TEMPLATE_DLL_FILES getDllFile(D2OffsetId offsetId) {
+    return DLL_FILES[(int) offsetId];
+}
+
+constexpr const D2OffsetTable& getOffsetTable(D2OffsetId offsetId) {
+    return OFFSET_TABLES[(int) offsetId];
+}
+}
+
+#endif
@@ -0,0 +1,490 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PEImage.cpp                                                           *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2PEImage class, which reads the headers and      *
+ *   section table of a PE image, either mapped in memory by the loader or   *
+ *   read as is from a file.                                                 *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2PEImage.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace {
+constexpr uint16_t DOS_SIGNATURE = 0x5A4D;
+constexpr uint32_t NT_SIGNATURE = 0x00004550;
+constexpr uint16_t PE32_MAGIC = 0x010B;
+
+constexpr size_t DOS_NEW_HEADER_OFFSET = 0x3C;
+constexpr size_t FILE_HEADER_OFFSET = 4;
+constexpr size_t OPTIONAL_HEADER_OFFSET = 24;
+constexpr size_t SECTION_HEADER_SIZE = 40;
+constexpr size_t EXPORT_DIRECTORY_SIZE = 40;
+constexpr size_t RESOURCE_DIRECTORY_SIZE = 16;
+constexpr size_t RESOURCE_ENTRY_SIZE = 8;
+constexpr size_t RESOURCE_DATA_ENTRY_SIZE = 16;
+constexpr size_t RELOCATION_BLOCK_HEADER_SIZE = 8;
+
+constexpr uint32_t RESOURCE_SUBDIRECTORY = 0x80000000;
+constexpr uint32_t RESOURCE_TYPE_VERSION = 16;
+constexpr uint32_t FIXED_FILE_INFO_SIGNATURE = 0xFEEF04BD;
+constexpr size_t FIXED_FILE_INFO_SIZE = 52;
+
+constexpr uint16_t RELOCATION_TYPE_ABSOLUTE = 0;
+
+bool readUInt16(const uint8_t* data, size_t size, size_t offset,
+                uint16_t& value) {
+    if (offset > size || size - offset < sizeof(value)) {
+        return false;
+    }
+
+    std::memcpy(&value, &data[offset], sizeof(value));
+    return true;
+}
+
+bool readUInt32(const uint8_t* data, size_t size, size_t offset,
+                uint32_t& value) {
+    if (offset > size || size - offset < sizeof(value)) {
+        return false;
+    }
+
+    std::memcpy(&value, &data[offset], sizeof(value));
+    return true;
+}
+}
+
+bool D2PESection::isExecutable() const {
+    return (characteristics & (D2PEImage::SECTION_EXECUTABLE |
+                               D2PEImage::SECTION_CODE)) != 0;
+}
+
+D2PEImage::D2PEImage(const uint8_t* imageData, size_t imageSize,
+                     D2PEImageLayout layout) : imageData(imageData), imageSize(imageSize),
+    layout(layout), valid(false), timeDateStamp(0), imageBase(0), sizeOfImage(0),
+    sizeOfHeaders(0), entryPoint(0), exportDirectoryRva(0),
+    exportDirectorySize(0), resourceDirectoryRva(0), resourceDirectorySize(0),
+    relocationDirectoryRva(0), relocationDirectorySize(0) {
+    valid = parseHeaders();
+}
+
+bool D2PEImage::isValid() const {
+    return valid;
+}
+
+D2PEImageLayout D2PEImage::getLayout() const {
+    return layout;
+}
+
+const uint8_t* D2PEImage::getImageData() const {
+    return imageData;
+}
+
+size_t D2PEImage::getImageDataSize() const {
+    return imageSize;
+}
+
+uint32_t D2PEImage::getTimeDateStamp() const {
+    return timeDateStamp;
+}
+
+uint32_t D2PEImage::getImageBase() const {
+    return imageBase;
+}
+
+uint32_t D2PEImage::getSizeOfImage() const {
+    return sizeOfImage;
+}
+
+uint32_t D2PEImage::getSizeOfHeaders() const {
+    return sizeOfHeaders;
+}
+
+uint32_t D2PEImage::getEntryPoint() const {
+    return entryPoint;
+}
+
+const std::vector<D2PESection>& D2PEImage::getSections() const {
+    return sections;
+}
+
+const D2PESection* D2PEImage::findSection(uint32_t rva) const {
+    for (const auto& section : sections) {
+        uint32_t sectionSize = std::max(section.virtualSize, section.rawDataSize);
+
+        if (rva >= section.virtualAddress
+                && rva - section.virtualAddress < sectionSize) {
+            return &section;
+        }
+    }
+
+    return nullptr;
+}
+
+bool D2PEImage::rvaToDataOffset(uint32_t rva, size_t size,
+                                size_t& dataOffset) const {
+    if (layout == D2PEImageLayout::MAPPED || rva < sizeOfHeaders) {
+        dataOffset = rva;
+    } else {
+        const D2PESection* section = findSection(rva);
+
+        if (section == nullptr) {
+            return false;
+        }
+
+        uint32_t sectionOffset = rva - section->virtualAddress;
+
+        if (sectionOffset > section->rawDataSize
+                || section->rawDataSize - sectionOffset < size) {
+            return false;
+        }
+
+        dataOffset = (size_t) section->rawDataOffset + sectionOffset;
+    }
+
+    return dataOffset <= imageSize && imageSize - dataOffset >= size;
+}
+
+const uint8_t* D2PEImage::getRvaData(uint32_t rva, size_t size) const {
+    size_t dataOffset;
+    return rvaToDataOffset(rva, size, dataOffset) ? &imageData[dataOffset] :
+           nullptr;
+}
+
+bool D2PEImage::readExports(std::vector<D2PEExport>& exports) const {
+    exports.clear();
+
+    if (exportDirectoryRva == 0) {
+        return true;
+    }
+
+    const uint8_t* exportDirectory = getRvaData(exportDirectoryRva,
+                                     EXPORT_DIRECTORY_SIZE);
+
+    if (exportDirectory == nullptr) {
+        return false;
+    }
+
+    uint32_t ordinalBase;
+    uint32_t functionCount;
+    uint32_t nameCount;
+    uint32_t functionsRva;
+    uint32_t namesRva;
+    uint32_t nameOrdinalsRva;
+
+    std::memcpy(&ordinalBase, &exportDirectory[16], sizeof(ordinalBase));
+    std::memcpy(&functionCount, &exportDirectory[20], sizeof(functionCount));
+    std::memcpy(&nameCount, &exportDirectory[24], sizeof(nameCount));
+    std::memcpy(&functionsRva, &exportDirectory[28], sizeof(functionsRva));
+    std::memcpy(&namesRva, &exportDirectory[32], sizeof(namesRva));
+    std::memcpy(&nameOrdinalsRva, &exportDirectory[36], sizeof(nameOrdinalsRva));
+
+    if (functionCount > 0xFFFF || nameCount > functionCount) {
+        return false;
+    }
+
+    const uint8_t* functions = getRvaData(functionsRva,
+                                          (size_t) functionCount * sizeof(uint32_t));
+    const uint8_t* names = getRvaData(namesRva,
+                                      (size_t) nameCount * sizeof(uint32_t));
+    const uint8_t* nameOrdinals = getRvaData(nameOrdinalsRva,
+                                  (size_t) nameCount * sizeof(uint16_t));
+
+    if ((functionCount > 0 && functions == nullptr)
+            || (nameCount > 0 && (names == nullptr || nameOrdinals == nullptr))) {
+        return false;
+    }
+
+    std::vector<size_t> exportIndices(functionCount, (size_t) - 1);
+
+    for (uint32_t i = 0; i < functionCount; i++) {
+        uint32_t functionRva;
+        std::memcpy(&functionRva, &functions[i * sizeof(uint32_t)],
+                    sizeof(functionRva));
+
+        if (functionRva == 0) {
+            continue;
+        }
+
+        bool forwarded = functionRva >= exportDirectoryRva
+                         && functionRva - exportDirectoryRva < exportDirectorySize;
+        exportIndices[i] = exports.size();
+        exports.push_back({ (uint16_t)(ordinalBase + i), functionRva, std::string(), forwarded });
+    }
+
+    for (uint32_t i = 0; i < nameCount; i++) {
+        uint32_t nameRva;
+        uint16_t functionIndex;
+        std::memcpy(&nameRva, &names[i * sizeof(uint32_t)], sizeof(nameRva));
+        std::memcpy(&functionIndex, &nameOrdinals[i * sizeof(uint16_t)],
+                    sizeof(functionIndex));
+
+        size_t nameOffset;
+
+        if (functionIndex >= functionCount
+                || !rvaToDataOffset(nameRva, 1, nameOffset)) {
+            return false;
+        }
+
+        // The name must be terminated inside of the image data.
+        const char* name = (const char*) &imageData[nameOffset];
+        const void* nameEnd = std::memchr(name, '\0', imageSize - nameOffset);
+
+        if (nameEnd == nullptr) {
+            return false;
+        }
+
+        if (exportIndices[functionIndex] != (size_t) - 1) {
+            exports[exportIndices[functionIndex]].name.assign(name,
+                    (const char*) nameEnd - name);
+        }
+    }
+
+    return true;
+}
+
+bool D2PEImage::readFileVersion(uint32_t& versionMS,
+                                uint32_t& versionLS) const {
+    if (resourceDirectoryRva == 0) {
+        return false;
+    }
+
+    const uint8_t* resources = getRvaData(resourceDirectoryRva,
+                                          resourceDirectorySize);
+
+    if (resources == nullptr) {
+        return false;
+    }
+
+    // The version resource is the first language of the first name of the
+    // version type. Only the type is searched for, the other two levels
+    // hold a single entry in every game file.
+    uint32_t directoryOffset = 0;
+
+    for (int level = 0; level < 3; level++) {
+        uint16_t namedCount;
+        uint16_t idCount;
+
+        if (!readUInt16(resources, resourceDirectorySize, directoryOffset + 12,
+                        namedCount)
+                || !readUInt16(resources, resourceDirectorySize, directoryOffset + 14,
+                               idCount)) {
+            return false;
+        }
+
+        size_t entries = directoryOffset + RESOURCE_DIRECTORY_SIZE;
+        size_t entryCount = (size_t) namedCount + idCount;
+        bool found = false;
+
+        for (size_t i = (level == 0) ? namedCount : 0; i < entryCount && !found;
+                i++) {
+            uint32_t id;
+            uint32_t dataOffset;
+
+            if (!readUInt32(resources, resourceDirectorySize,
+                            entries + i * RESOURCE_ENTRY_SIZE, id)
+                    || !readUInt32(resources, resourceDirectorySize,
+                                   entries + i * RESOURCE_ENTRY_SIZE + 4, dataOffset)) {
+                return false;
+            }
+
+            if (level == 0 && id != RESOURCE_TYPE_VERSION) {
+                continue;
+            }
+
+            // The last level points to the data entry, the others to the
+            // next directory.
+            if (((dataOffset & RESOURCE_SUBDIRECTORY) != 0) != (level < 2)) {
+                return false;
+            }
+
+            directoryOffset = dataOffset & ~RESOURCE_SUBDIRECTORY;
+            found = true;
+        }
+
+        if (!found) {
+            return false;
+        }
+    }
+
+    uint32_t versionRva;
+    uint32_t versionSize;
+
+    if (directoryOffset > resourceDirectorySize
+            || resourceDirectorySize - directoryOffset < RESOURCE_DATA_ENTRY_SIZE
+            || !readUInt32(resources, resourceDirectorySize, directoryOffset,
+                           versionRva)
+            || !readUInt32(resources, resourceDirectorySize, directoryOffset + 4,
+                           versionSize)) {
+        return false;
+    }
+
+    const uint8_t* version = getRvaData(versionRva, versionSize);
+
+    if (version == nullptr) {
+        return false;
+    }
+
+    // VS_FIXEDFILEINFO follows the key of the resource, aligned to 4 bytes.
+    for (size_t offset = 0; offset + FIXED_FILE_INFO_SIZE <= versionSize;
+            offset += sizeof(uint32_t)) {
+        uint32_t signature;
+        std::memcpy(&signature, &version[offset], sizeof(signature));
+
+        if (signature == FIXED_FILE_INFO_SIGNATURE) {
+            std::memcpy(&versionMS, &version[offset + 8], sizeof(versionMS));
+            std::memcpy(&versionLS, &version[offset + 12], sizeof(versionLS));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool D2PEImage::readRelocations(std::vector<uint32_t>& relocationRvas) const {
+    relocationRvas.clear();
+
+    if (relocationDirectoryRva == 0) {
+        return true;
+    }
+
+    const uint8_t* relocations = getRvaData(relocationDirectoryRva,
+                                            relocationDirectorySize);
+
+    if (relocations == nullptr) {
+        return false;
+    }
+
+    // The directory is a run of blocks, each a page RVA and the size of the
+    // block, followed by one 16-bit entry per fixup in the page.
+    size_t blockOffset = 0;
+
+    while (blockOffset + RELOCATION_BLOCK_HEADER_SIZE <= relocationDirectorySize) {
+        uint32_t pageRva;
+        uint32_t blockSize;
+
+        std::memcpy(&pageRva, &relocations[blockOffset], sizeof(pageRva));
+        std::memcpy(&blockSize, &relocations[blockOffset + 4], sizeof(blockSize));
+
+        if (blockSize < RELOCATION_BLOCK_HEADER_SIZE
+                || blockSize > relocationDirectorySize - blockOffset) {
+            return false;
+        }
+
+        for (size_t entryOffset = blockOffset + RELOCATION_BLOCK_HEADER_SIZE;
+                entryOffset + sizeof(uint16_t) <= blockOffset + blockSize;
+                entryOffset += sizeof(uint16_t)) {
+            uint16_t entry;
+            std::memcpy(&entry, &relocations[entryOffset], sizeof(entry));
+
+            // Absolute entries only pad the block to 4 bytes.
+            if ((entry >> 12) != RELOCATION_TYPE_ABSOLUTE) {
+                relocationRvas.push_back(pageRva + (entry & 0x0FFF));
+            }
+        }
+
+        blockOffset += blockSize;
+    }
+
+    std::sort(relocationRvas.begin(), relocationRvas.end());
+    return true;
+}
+
+bool D2PEImage::parseHeaders() {
+    uint16_t dosSignature;
+    uint32_t newHeaderOffset;
+    uint32_t ntSignature;
+
+    if (imageData == nullptr
+            || !readUInt16(imageData, imageSize, 0, dosSignature)
+            || dosSignature != DOS_SIGNATURE
+            || !readUInt32(imageData, imageSize, DOS_NEW_HEADER_OFFSET, newHeaderOffset)
+            || !readUInt32(imageData, imageSize, newHeaderOffset, ntSignature)
+            || ntSignature != NT_SIGNATURE) {
+        return false;
+    }
+
+    size_t fileHeader = (size_t) newHeaderOffset + FILE_HEADER_OFFSET;
+    size_t optionalHeader = (size_t) newHeaderOffset + OPTIONAL_HEADER_OFFSET;
+
+    uint16_t sectionCount;
+    uint16_t optionalHeaderSize;
+    uint16_t magic;
+
+    if (!readUInt16(imageData, imageSize, fileHeader + 2, sectionCount)
+            || !readUInt32(imageData, imageSize, fileHeader + 4, timeDateStamp)
+            || !readUInt16(imageData, imageSize, fileHeader + 16, optionalHeaderSize)
+            || !readUInt16(imageData, imageSize, optionalHeader, magic)
+            || magic != PE32_MAGIC
+            || !readUInt32(imageData, imageSize, optionalHeader + 16, entryPoint)
+            || !readUInt32(imageData, imageSize, optionalHeader + 28, imageBase)
+            || !readUInt32(imageData, imageSize, optionalHeader + 56, sizeOfImage)
+            || !readUInt32(imageData, imageSize, optionalHeader + 60, sizeOfHeaders)) {
+        return false;
+    }
+
+    // The export directory is the first data directory, the resource
+    // directory the third, and the relocation directory the sixth.
+    uint32_t directoryCount;
+
+    if (optionalHeaderSize >= 104
+            && readUInt32(imageData, imageSize, optionalHeader + 92, directoryCount)
+            && directoryCount > 0) {
+        readUInt32(imageData, imageSize, optionalHeader + 96, exportDirectoryRva);
+        readUInt32(imageData, imageSize, optionalHeader + 100, exportDirectorySize);
+
+        if (optionalHeaderSize >= 120 && directoryCount > 2) {
+            readUInt32(imageData, imageSize, optionalHeader + 112, resourceDirectoryRva);
+            readUInt32(imageData, imageSize, optionalHeader + 116, resourceDirectorySize);
+        }
+
+        if (optionalHeaderSize >= 144 && directoryCount > 5) {
+            readUInt32(imageData, imageSize, optionalHeader + 136, relocationDirectoryRva);
+            readUInt32(imageData, imageSize, optionalHeader + 140,
+                       relocationDirectorySize);
+        }
+    }
+
+    size_t sectionHeader = optionalHeader + optionalHeaderSize;
+
+    if (sectionHeader + (size_t) sectionCount * SECTION_HEADER_SIZE > imageSize) {
+        return false;
+    }
+
+    sections.resize(sectionCount);
+
+    for (size_t i = 0; i < sectionCount; i++) {
+        const uint8_t* header = &imageData[sectionHeader + i * SECTION_HEADER_SIZE];
+        D2PESection& section = sections[i];
+
+        std::memcpy(section.name, header, 8);
+        section.name[8] = '\0';
+        std::memcpy(&section.virtualSize, &header[8], sizeof(uint32_t));
+        std::memcpy(&section.virtualAddress, &header[12], sizeof(uint32_t));
+        std::memcpy(&section.rawDataSize, &header[16], sizeof(uint32_t));
+        std::memcpy(&section.rawDataOffset, &header[20], sizeof(uint32_t));
+        std::memcpy(&section.characteristics, &header[36], sizeof(uint32_t));
+    }
+
+    return true;
+}
@@ -0,0 +1,128 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PEImage.h                                                             *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2PEImage class, which reads the headers and     *
+ *   section table of a PE image. The image can either be mapped in memory   *
+ *   by the loader or read as is from a file, and nothing here depends on    *
+ *   Windows.                                                                *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2PEIMAGE_H
+#define _D2PEIMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class D2PEImageLayout : int {
+    MAPPED,
+    FILE
+};
+
+struct D2PESection {
+    char name[9];
+    uint32_t virtualAddress;
+    uint32_t virtualSize;
+    uint32_t rawDataOffset;
+    uint32_t rawDataSize;
+    uint32_t characteristics;
+
+    bool isExecutable() const;
+};
+
+struct D2PEExport {
+    uint16_t ordinal;
+    uint32_t rva;
+    std::string name;
+    // Forwarded exports point to a string naming another export instead of
+    // code.
+    bool forwarded;
+};
+
+class D2PEImage {
+public:
+    static constexpr uint32_t SECTION_EXECUTABLE = 0x20000000;
+    static constexpr uint32_t SECTION_CODE = 0x00000020;
+    static constexpr uint32_t SECTION_READABLE = 0x40000000;
+    static constexpr uint32_t SECTION_WRITABLE = 0x80000000;
+
+    D2PEImage(const uint8_t* imageData, size_t imageSize,
+              D2PEImageLayout layout);
+
+    bool isValid() const;
+    D2PEImageLayout getLayout() const;
+    const uint8_t* getImageData() const;
+    size_t getImageDataSize() const;
+
+    uint32_t getTimeDateStamp() const;
+    uint32_t getImageBase() const;
+    uint32_t getSizeOfImage() const;
+    uint32_t getSizeOfHeaders() const;
+    uint32_t getEntryPoint() const;
+
+    const std::vector<D2PESection>& getSections() const;
+    const D2PESection* findSection(uint32_t rva) const;
+
+    // Converts an RVA into an offset of the image data, which differs from
+    // the RVA when the image was read from a file. Returns false if the RVA
+    // has no data behind it.
+    bool rvaToDataOffset(uint32_t rva, size_t size, size_t& dataOffset) const;
+    const uint8_t* getRvaData(uint32_t rva, size_t size) const;
+
+    // Exports without a name are listed with an empty name. Returns false if
+    // the export directory is malformed.
+    bool readExports(std::vector<D2PEExport>& exports) const;
+
+    // Lists the RVA of every address the loader fixes up when the image is
+    // not loaded at its preferred base, sorted. Each fixup covers the four
+    // bytes of an address. Returns false if the relocations are malformed.
+    bool readRelocations(std::vector<uint32_t>& relocationRvas) const;
+
+    // Reads the file version from the fixed part of the version resource,
+    // without going through the rest of the resource. Returns false if the
+    // image has no version resource.
+    bool readFileVersion(uint32_t& versionMS, uint32_t& versionLS) const;
+
+private:
+    const uint8_t* imageData;
+    size_t imageSize;
+    D2PEImageLayout layout;
+    bool valid;
+
+    uint32_t timeDateStamp;
+    uint32_t imageBase;
+    uint32_t sizeOfImage;
+    uint32_t sizeOfHeaders;
+    uint32_t entryPoint;
+    uint32_t exportDirectoryRva;
+    uint32_t exportDirectorySize;
+    uint32_t resourceDirectoryRva;
+    uint32_t resourceDirectorySize;
+    uint32_t relocationDirectoryRva;
+    uint32_t relocationDirectorySize;
+    std::vector<D2PESection> sections;
+
+    bool parseHeaders();
+};
+
+#endif
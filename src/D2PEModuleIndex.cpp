@@ -0,0 +1,210 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PEModuleIndex.cpp                                                     *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2PEModuleIndex class, which copies the sections  *
+ *   and exports of a PE image into flat, sorted tables, so that they can be *
+ *   looked up without parsing the image again.                              *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2PEModuleIndex.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "D2PEImage.h"
+
+D2PEModuleIndex::D2PEModuleIndex() : valid(false), timeDateStamp(0),
+    sizeOfImage(0), codeStart(0), codeEnd(0), ordinalBase(0) {
+}
+
+D2PEModuleIndex::D2PEModuleIndex(const D2PEImage& image) : D2PEModuleIndex() {
+    std::vector<D2PEExport> exports;
+
+    if (!image.isValid() || !image.readExports(exports)) {
+        return;
+    }
+
+    timeDateStamp = image.getTimeDateStamp();
+    sizeOfImage = image.getSizeOfImage();
+
+    sections = image.getSections();
+    std::sort(sections.begin(), sections.end(), [](const D2PESection & left,
+    const D2PESection & right) {
+        return left.virtualAddress < right.virtualAddress;
+    });
+
+    const D2PESection* codeSection = nullptr;
+
+    for (const auto& section : sections) {
+        if (std::strcmp(section.name, ".text") == 0) {
+            codeSection = &section;
+            break;
+        }
+
+        if (codeSection == nullptr && section.isExecutable()) {
+            codeSection = &section;
+        }
+    }
+
+    if (codeSection != nullptr) {
+        codeStart = codeSection->virtualAddress;
+        codeEnd = codeSection->virtualAddress + std::max(codeSection->virtualSize,
+                  codeSection->rawDataSize);
+    }
+
+    if (!exports.empty()) {
+        // The exports are listed in ordinal order, so the table is dense.
+        ordinalBase = exports.front().ordinal;
+        ordinalRvas.assign((size_t)(exports.back().ordinal - ordinalBase) + 1, 0);
+
+        size_t nameSize = 0;
+
+        for (const auto& peExport : exports) {
+            ordinalRvas[peExport.ordinal - ordinalBase] = peExport.forwarded ?
+                    (peExport.rva | FORWARDED_BIT) : peExport.rva;
+            nameSize += peExport.name.length();
+        }
+
+        names.reserve(nameSize);
+
+        for (const auto& peExport : exports) {
+            if (peExport.name.empty()) {
+                continue;
+            }
+
+            namedExports.push_back({ (uint32_t) names.length(),
+                                     (uint32_t) peExport.name.length(), peExport.ordinal
+                                   });
+            names += peExport.name;
+        }
+
+        std::sort(namedExports.begin(), namedExports.end(),
+        [this](const NamedExport & left, const NamedExport & right) {
+            return getName(left) < getName(right);
+        });
+    }
+
+    valid = true;
+}
+
+bool D2PEModuleIndex::isValid() const {
+    return valid;
+}
+
+uint32_t D2PEModuleIndex::getTimeDateStamp() const {
+    return timeDateStamp;
+}
+
+uint32_t D2PEModuleIndex::getSizeOfImage() const {
+    return sizeOfImage;
+}
+
+uint32_t D2PEModuleIndex::getCodeStart() const {
+    return codeStart;
+}
+
+uint32_t D2PEModuleIndex::getCodeEnd() const {
+    return codeEnd;
+}
+
+bool D2PEModuleIndex::isCode(uint32_t rva) const {
+    return rva >= codeStart && rva < codeEnd;
+}
+
+const std::vector<D2PESection>& D2PEModuleIndex::getSections() const {
+    return sections;
+}
+
+const D2PESection* D2PEModuleIndex::findSection(uint32_t rva) const {
+    auto it = std::upper_bound(sections.cbegin(), sections.cend(), rva,
+    [](uint32_t value, const D2PESection & section) {
+        return value < section.virtualAddress;
+    });
+
+    if (it == sections.cbegin()) {
+        return nullptr;
+    }
+
+    const D2PESection& section = *(it - 1);
+    uint32_t sectionSize = std::max(section.virtualSize, section.rawDataSize);
+
+    return (rva - section.virtualAddress < sectionSize) ? &section : nullptr;
+}
+
+bool D2PEModuleIndex::findExport(uint16_t ordinal, uint32_t& rva) const {
+    if (ordinal < ordinalBase || (size_t)(ordinal - ordinalBase) >=
+            ordinalRvas.size()) {
+        return false;
+    }
+
+    uint32_t ordinalRva = ordinalRvas[ordinal - ordinalBase];
+
+    if (ordinalRva == 0 || (ordinalRva & FORWARDED_BIT) != 0) {
+        return false;
+    }
+
+    rva = ordinalRva;
+    return true;
+}
+
+bool D2PEModuleIndex::findExport(std::string_view name, uint32_t& rva) const {
+    auto it = std::lower_bound(namedExports.cbegin(), namedExports.cend(), name,
+    [this](const NamedExport & namedExport, std::string_view value) {
+        return getName(namedExport) < value;
+    });
+
+    if (it == namedExports.cend() || getName(*it) != name) {
+        return false;
+    }
+
+    return findExport(it->ordinal, rva);
+}
+
+bool D2PEModuleIndex::isForwarded(uint16_t ordinal) const {
+    if (ordinal < ordinalBase || (size_t)(ordinal - ordinalBase) >=
+            ordinalRvas.size()) {
+        return false;
+    }
+
+    return (ordinalRvas[ordinal - ordinalBase] & FORWARDED_BIT) != 0;
+}
+
+size_t D2PEModuleIndex::getExportCount() const {
+    size_t exportCount = 0;
+
+    for (uint32_t ordinalRva : ordinalRvas) {
+        if (ordinalRva != 0) {
+            exportCount++;
+        }
+    }
+
+    return exportCount;
+}
+
+std::string_view D2PEModuleIndex::getName(const NamedExport& namedExport)
+const {
+    return std::string_view(names).substr(namedExport.nameOffset,
+                                          namedExport.nameLength);
+}
@@ -0,0 +1,100 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PEModuleIndex.h                                                       *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2PEModuleIndex class, which copies the sections *
+ *   and exports of a PE image into flat, sorted tables, so that they can be *
+ *   looked up without parsing the image again.                              *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2PEMODULEINDEX_H
+#define _D2PEMODULEINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "D2PEImage.h"
+
+// The index does not refer to the image data once it is built, so it works
+// the same for a module mapped by the loader and for a file that has since
+// been closed. It is never changed after construction, and can be read from
+// any number of threads.
+class D2PEModuleIndex {
+public:
+    D2PEModuleIndex();
+    explicit D2PEModuleIndex(const D2PEImage& image);
+
+    bool isValid() const;
+    uint32_t getTimeDateStamp() const;
+    uint32_t getSizeOfImage() const;
+
+    // The bounds of the .text section, or of the first executable section if
+    // there is no .text section. Both are 0 if there is no code.
+    uint32_t getCodeStart() const;
+    uint32_t getCodeEnd() const;
+    bool isCode(uint32_t rva) const;
+
+    const std::vector<D2PESection>& getSections() const;
+    const D2PESection* findSection(uint32_t rva) const;
+
+    // Returns false if there is no such export, or if it is forwarded to
+    // another module, in which case only the loader can resolve it.
+    bool findExport(uint16_t ordinal, uint32_t& rva) const;
+    bool findExport(std::string_view name, uint32_t& rva) const;
+    bool isForwarded(uint16_t ordinal) const;
+
+    size_t getExportCount() const;
+
+private:
+    static constexpr uint32_t FORWARDED_BIT = 0x80000000;
+
+    struct NamedExport {
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        uint16_t ordinal;
+    };
+
+    bool valid;
+    uint32_t timeDateStamp;
+    uint32_t sizeOfImage;
+    uint32_t codeStart;
+    uint32_t codeEnd;
+
+    // Sorted by virtual address.
+    std::vector<D2PESection> sections;
+
+    // Indexed by ordinal minus the lowest ordinal. Forwarded exports have the
+    // forwarded bit set, and missing ones are 0.
+    uint16_t ordinalBase;
+    std::vector<uint32_t> ordinalRvas;
+
+    // Sorted by name. The names are stored one after another in a single
+    // string.
+    std::string names;
+    std::vector<NamedExport> namedExports;
+
+    std::string_view getName(const NamedExport& namedExport) const;
+};
+
+#endif
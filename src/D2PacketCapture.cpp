@@ -0,0 +1,119 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PacketCapture.cpp                                                     *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2PacketCapture class and its consumer thread.    *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2PacketCapture.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "D2PacketRing.h"
+
+D2PacketCapture::D2PacketCapture(size_t capacity, D2PacketRingPolicy policy) :
+    packetRing(capacity, policy), running(false), stopRequested(false) {
+}
+
+D2PacketCapture::~D2PacketCapture() {
+    stop();
+}
+
+bool D2PacketCapture::start(D2PacketCaptureHandler handler, void* context,
+                            size_t batchSize, unsigned int idleIntervalMilliseconds) {
+    std::lock_guard<std::mutex> consumerLock(consumerMutex);
+
+    if (consumerThread.joinable() || handler == nullptr || batchSize == 0) {
+        return false;
+    }
+
+    stopRequested.store(false, std::memory_order_relaxed);
+    packetRing.open();
+    consumerThread = std::thread(&D2PacketCapture::consume, this, handler,
+                                 context, batchSize, idleIntervalMilliseconds);
+    running.store(true, std::memory_order_release);
+    return true;
+}
+
+void D2PacketCapture::stop() {
+    std::lock_guard<std::mutex> consumerLock(consumerMutex);
+
+    if (!consumerThread.joinable()) {
+        return;
+    }
+
+    // New packets are refused first, so that the consumer can empty the ring.
+    running.store(false, std::memory_order_release);
+    packetRing.close();
+    stopRequested.store(true, std::memory_order_release);
+    consumerThread.join();
+}
+
+bool D2PacketCapture::isRunning() const {
+    return running.load(std::memory_order_acquire);
+}
+
+bool D2PacketCapture::capture(D2PacketDirection direction,
+                              const uint8_t* data, size_t size) {
+    if (!running.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    return packetRing.push(direction, getTimestamp(), data, size);
+}
+
+D2PacketRingCounters D2PacketCapture::getCounters() const {
+    return packetRing.getCounters();
+}
+
+uint64_t D2PacketCapture::getTimestamp() {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void D2PacketCapture::consume(D2PacketCaptureHandler handler, void* context,
+                              size_t batchSize, unsigned int idleIntervalMilliseconds) {
+    auto handlePacket = [handler, context](const D2CapturedPacket & packet) {
+        handler(packet, context);
+    };
+
+    // The consumer only sleeps once the ring was seen empty, so a steady
+    // stream is handled batch after batch without any wait.
+    while (true) {
+        if (packetRing.drain(handlePacket, batchSize) != 0) {
+            continue;
+        }
+
+        if (stopRequested.load(std::memory_order_acquire)) {
+            break;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(
+                                        idleIntervalMilliseconds));
+    }
+
+    // A producer may have pushed between the last drain and the stop.
+    while (packetRing.drain(handlePacket, batchSize) != 0) {
+    }
+}
@@ -0,0 +1,90 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PacketCapture.h                                                       *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Declares the D2PacketCapture class, which copies the packets of a       *
+ *   hooked network function into a ring, and hands them to a handler on its *
+ *   own consumer thread.                                                    *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2PACKETCAPTURE_H
+#define _D2PACKETCAPTURE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#include "D2PacketRing.h"
+#include "D2PacketTable.h"
+
+typedef void (*D2PacketCaptureHandler)(const D2CapturedPacket& packet,
+                                       void* context);
+
+// A capture has a single producer, so a hook that runs on more than one
+// thread needs a capture for each of them.
+class D2PacketCapture {
+public:
+    static constexpr size_t DEFAULT_BATCH_SIZE = 256;
+    // How long the consumer sleeps once the ring is empty.
+    static constexpr unsigned int DEFAULT_IDLE_INTERVAL = 1;
+
+    explicit D2PacketCapture(size_t capacity = D2PacketRing::DEFAULT_CAPACITY,
+                             D2PacketRingPolicy policy = D2PacketRingPolicy::DROP);
+    ~D2PacketCapture();
+
+    D2PacketCapture(const D2PacketCapture&) = delete;
+    D2PacketCapture& operator=(const D2PacketCapture&) = delete;
+
+    // Starts the consumer thread, which calls the handler for every captured
+    // packet. Returns false if it is already running.
+    bool start(D2PacketCaptureHandler handler, void* context,
+               size_t batchSize = DEFAULT_BATCH_SIZE,
+               unsigned int idleIntervalMilliseconds = DEFAULT_IDLE_INTERVAL);
+
+    // Stops capturing, and returns once the packets left in the ring were
+    // handled.
+    void stop();
+    bool isRunning() const;
+
+    // Called from the hooked function. Returns false if the packet was not
+    // captured.
+    bool capture(D2PacketDirection direction, const uint8_t* data, size_t size);
+
+    D2PacketRingCounters getCounters() const;
+
+    // Nanoseconds on a steady clock, as given to the handler.
+    static uint64_t getTimestamp();
+
+private:
+    D2PacketRing packetRing;
+    std::atomic<bool> running;
+
+    std::mutex consumerMutex;
+    std::thread consumerThread;
+    std::atomic<bool> stopRequested;
+
+    void consume(D2PacketCaptureHandler handler, void* context,
+                 size_t batchSize, unsigned int idleIntervalMilliseconds);
+};
+
+#endif
@@ -30,6 +30,8 @@
 #ifndef _D2PACKETDEF_H
 #define _D2PACKETDEF_H
 
+#include <cstdint>
+
 #pragma pack(1)
 
 /****************************************************************************
@@ -45,6 +47,12 @@ struct D2GSPacketClt03;
 struct D2GSPacketSrv01;
 struct D2GSPacketSrv02;
 struct D2GSPacketSrv03;
+struct D2GSPacketSrv5B;
+struct D2GSPacketSrv9C;
+struct D2GSPacketSrv9D;
+struct D2GSPacketSrvA8;
+struct D2GSPacketSrvAA;
+struct D2GSPacketSrvAC;
 
 /****************************************************************************
  *                                                                           *
@@ -52,11 +60,134 @@ struct D2GSPacketSrv03;
  *                                                                           *
  *****************************************************************************/
 
+// Walk to a location.
 struct D2GSPacketClt01
 {
-    //...
+    uint8_t nHeader;
+    uint16_t nX;
+    uint16_t nY;
+};
+
+// Walk to a unit.
+struct D2GSPacketClt02
+{
+    uint8_t nHeader;
+    uint32_t dwUnitType;
+    uint32_t dwUnitId;
+};
+
+// Run to a location.
+struct D2GSPacketClt03
+{
+    uint8_t nHeader;
+    uint16_t nX;
+    uint16_t nY;
+};
+
+// Game flags, sent when joining a game.
+struct D2GSPacketSrv01
+{
+    uint8_t nHeader;
+    uint8_t nDifficulty;
+    uint32_t dwArenaFlags;
+    uint8_t bExpansion;
+    uint8_t bLadder;
+};
+
+// The game finished loading.
+struct D2GSPacketSrv02
+{
+    uint8_t nHeader;
+};
+
+// Load an act.
+struct D2GSPacketSrv03
+{
+    uint8_t nHeader;
+    uint8_t nAct;
+    uint32_t dwMapId;
+    uint16_t nAreaId;
+    uint32_t dwUnknown;
+};
+
+// The packets below have a variable length, which they store in nLength.
+// Only the fields before the rest of the packet are declared.
+
+// A player joined the game. The character follows.
+struct D2GSPacketSrv5B
+{
+    uint8_t nHeader;
+    uint16_t nLength;
+    uint32_t dwPlayerId;
+};
+
+// An item in the world, or moved to or from the world. The bit fields of the
+// item follow.
+struct D2GSPacketSrv9C
+{
+    uint8_t nHeader;
+    uint8_t nAction;
+    uint8_t nLength;
+    uint8_t nCategory;
+    uint32_t dwItemId;
+};
+
+// An item owned by a unit. The bit fields of the item follow.
+struct D2GSPacketSrv9D
+{
+    uint8_t nHeader;
+    uint8_t nAction;
+    uint8_t nLength;
+    uint8_t nCategory;
+    uint32_t dwItemId;
+    uint8_t nOwnerType;
+    uint32_t dwOwnerId;
+};
+
+// Set a state on a unit. The stats of the state follow.
+struct D2GSPacketSrvA8
+{
+    uint8_t nHeader;
+    uint8_t nUnitType;
+    uint32_t dwUnitId;
+    uint8_t nLength;
+    uint8_t nState;
+};
+
+// Update the states of a unit. The states follow.
+struct D2GSPacketSrvAA
+{
+    uint8_t nHeader;
+    uint8_t nUnitType;
+    uint32_t dwUnitId;
+    uint8_t nLength;
 };
 
+// Assign an NPC. Its mode and other bit fields follow.
+struct D2GSPacketSrvAC
+{
+    uint8_t nHeader;
+    uint32_t dwUnitId;
+    uint16_t nUnitCode;
+    uint16_t nX;
+    uint16_t nY;
+    uint8_t nLife;
+    uint8_t nLength;
+};
+
+static_assert(sizeof(D2GSPacketClt01) == 5, "D2GSPacketClt01 must be packed");
+static_assert(sizeof(D2GSPacketClt02) == 9, "D2GSPacketClt02 must be packed");
+static_assert(sizeof(D2GSPacketClt03) == 5, "D2GSPacketClt03 must be packed");
+static_assert(sizeof(D2GSPacketSrv01) == 8, "D2GSPacketSrv01 must be packed");
+static_assert(sizeof(D2GSPacketSrv02) == 1, "D2GSPacketSrv02 must be packed");
+static_assert(sizeof(D2GSPacketSrv03) == 12, "D2GSPacketSrv03 must be packed");
+static_assert(sizeof(D2GSPacketSrv5B) == 7, "D2GSPacketSrv5B must be packed");
+static_assert(sizeof(D2GSPacketSrv9C) == 8, "D2GSPacketSrv9C must be packed");
+static_assert(sizeof(D2GSPacketSrv9D) == 13, "D2GSPacketSrv9D must be packed");
+static_assert(sizeof(D2GSPacketSrvA8) == 8, "D2GSPacketSrvA8 must be packed");
+static_assert(sizeof(D2GSPacketSrvAA) == 7, "D2GSPacketSrvAA must be packed");
+static_assert(sizeof(D2GSPacketSrvAC) == 13, "D2GSPacketSrvAC must be packed");
+
 // end of file --------------------------------------------------------------
 #pragma pack()
 #endif
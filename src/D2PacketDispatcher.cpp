@@ -0,0 +1,87 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PacketDispatcher.cpp                                                  *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Defines the D2PacketDispatcher class, which splits a buffer of D2GS     *
+ *   packets and routes each packet to the handler of its header byte in a   *
+ *   single pass.                                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2PacketDispatcher.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "D2PacketTable.h"
+
+D2PacketDispatcher::D2PacketDispatcher(D2PacketDirection direction) :
+    direction(direction),
+    lengthTable(D2PacketTable::getLengthTable(direction)), handlers() {
+}
+
+void D2PacketDispatcher::setRawHandler(uint8_t packetId, RawHandler handler) {
+    handlers[packetId] = { &invokeRaw, (void (*)()) handler };
+}
+
+void D2PacketDispatcher::clearHandler(uint8_t packetId) {
+    handlers[packetId] = { nullptr, nullptr };
+}
+
+D2PacketDispatchResult D2PacketDispatcher::dispatch(const uint8_t* buffer,
+        size_t size, void* context) const {
+    D2PacketDispatchResult result = { D2PacketStatus::COMPLETE, 0, 0 };
+
+    while (result.consumedSize < size) {
+        const uint8_t* packet = buffer + result.consumedSize;
+        size_t remainingSize = size - result.consumedSize;
+        size_t packetSize;
+
+        // Fixed packets are the common case, and need no call to be measured.
+        const D2PacketLength& packetLength = lengthTable[packet[0]];
+
+        if (packetLength.kind == D2PacketLengthKind::FIXED
+                && packetLength.size <= remainingSize) {
+            packetSize = packetLength.size;
+        } else {
+            D2PacketStatus status = D2PacketTable::getPacketLength(lengthTable,
+                                    packet, remainingSize, packetSize);
+
+            if (status != D2PacketStatus::COMPLETE) {
+                result.status = status;
+                break;
+            }
+        }
+
+        const HandlerEntry& handlerEntry = handlers[packet[0]];
+
+        if (handlerEntry.invoker != nullptr) {
+            handlerEntry.invoker(handlerEntry.handler, packet, packetSize, context);
+        }
+
+        result.packetCount++;
+        result.consumedSize += packetSize;
+    }
+
+    return result;
+}
+
+void D2PacketDispatcher::invokeRaw(void (*handler)(), const uint8_t* packet,
+                                   size_t size, void* context) {
+    ((RawHandler) handler)(packet, size, context);
+}
@@ -0,0 +1,101 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PacketDispatcher.h                                                    *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Declares the D2PacketDispatcher class, which splits a buffer of D2GS    *
+ *   packets and routes each packet to the handler of its header byte in a   *
+ *   single pass.                                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2PACKETDISPATCHER_H
+#define _D2PACKETDISPATCHER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "D2PacketDef.h"
+#include "D2PacketTable.h"
+
+struct D2PacketDispatchResult {
+    // COMPLETE once every byte was dispatched. Otherwise, the stream stopped
+    // at consumedSize, and a truncated packet is finished by the next buffer.
+    D2PacketStatus status;
+    size_t packetCount;
+    size_t consumedSize;
+};
+
+class D2PacketDispatcher {
+public:
+    typedef void (*RawHandler)(const uint8_t* packet, size_t size,
+                               void* context);
+
+    explicit D2PacketDispatcher(D2PacketDirection direction);
+
+    // Handlers are only given whole packets. Returns false if the packet does
+    // not travel in the direction of the dispatcher.
+    template<class T>
+    bool setHandler(void (*handler)(const T& packet, void* context)) {
+        if (D2PacketTraits<T>::DIRECTION != direction) {
+            return false;
+        }
+
+        handlers[D2PacketTraits<T>::PACKET_ID] = { &invokeTyped<T>, (void (*)()) handler };
+        return true;
+    }
+
+    void setRawHandler(uint8_t packetId, RawHandler handler);
+    void clearHandler(uint8_t packetId);
+
+    // Splits the buffer into packets with the length table, and calls the
+    // handler of each packet in turn. Packets without a handler are skipped.
+    D2PacketDispatchResult dispatch(const uint8_t* buffer, size_t size,
+                                    void* context) const;
+
+private:
+    typedef void (*Invoker)(void (*handler)(), const uint8_t* packet,
+                            size_t size, void* context);
+
+    // The handler is stored untyped, and cast back by the invoker that was
+    // stored along with it.
+    struct HandlerEntry {
+        Invoker invoker;
+        void (*handler)();
+    };
+
+    D2PacketDirection direction;
+    const D2PacketTable::LengthTable& lengthTable;
+    std::array<HandlerEntry, D2PacketTable::PACKET_ID_COUNT> handlers;
+
+    // The length table gives fixed packets exactly the size of their struct,
+    // and variable packets at least that size. The rest of a variable packet
+    // is reached through a D2PacketView or a raw handler.
+    template<class T>
+    static void invokeTyped(void (*handler)(), const uint8_t* packet, size_t,
+                            void* context) {
+        ((void (*)(const T&, void*)) handler)(*(const T*) packet, context);
+    }
+
+    static void invokeRaw(void (*handler)(), const uint8_t* packet, size_t size,
+                          void* context);
+};
+
+#endif
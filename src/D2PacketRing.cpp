@@ -0,0 +1,147 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PacketRing.cpp                                                        *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the producer side of the D2PacketRing class. Records  *
+ *   never wrap around the end of the buffer, which is skipped with a        *
+ *   padding record instead.                                                 *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2PacketRing.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+D2PacketRing::D2PacketRing(size_t capacity, D2PacketRingPolicy policy) :
+    producerState(), consumerState(), closed(false), capacity(RECORD_ALIGNMENT),
+    indexMask(0), policy(policy) {
+    size_t minimumCapacity = std::max(capacity, getRecordSize(MAX_PACKET_SIZE) * 2);
+
+    while (this->capacity < minimumCapacity) {
+        this->capacity <<= 1;
+    }
+
+    indexMask = this->capacity - 1;
+    storage.reset(new uint64_t[this->capacity / sizeof(uint64_t)]);
+    buffer = (uint8_t*) storage.get();
+}
+
+bool D2PacketRing::push(D2PacketDirection direction, uint64_t timestamp,
+                        const uint8_t* data, size_t size) {
+    if (size > MAX_PACKET_SIZE) {
+        increment(producerState.oversizedCount, 1);
+        return false;
+    }
+
+    size_t writeIndex = producerState.writeIndex.load(std::memory_order_relaxed);
+    size_t offset = writeIndex & indexMask;
+    size_t tailSize = capacity - offset;
+    size_t recordSize = getRecordSize(size);
+
+    // A record that does not fit before the end of the buffer starts over at
+    // its beginning, and the tail is given to a padding record.
+    size_t neededSize = (recordSize > tailSize) ? tailSize + recordSize :
+                        recordSize;
+
+    if (!hasRoom(writeIndex, neededSize) && !waitForRoom(writeIndex, neededSize)) {
+        increment(producerState.droppedCount, 1);
+        return false;
+    }
+
+    if (recordSize > tailSize) {
+        ((RecordHeader*) &buffer[offset])->size = PADDING_SIZE;
+        writeIndex += tailSize;
+        offset = 0;
+    }
+
+    RecordHeader* header = (RecordHeader*) &buffer[offset];
+    header->timestamp = timestamp;
+    header->size = (uint32_t) size;
+    header->direction = (uint8_t) direction;
+    std::memcpy(header + 1, data, size);
+
+    producerState.writeIndex.store(writeIndex + recordSize,
+                                   std::memory_order_release);
+    increment(producerState.pushedCount, 1);
+    return true;
+}
+
+void D2PacketRing::close() {
+    closed.store(true, std::memory_order_release);
+}
+
+void D2PacketRing::open() {
+    closed.store(false, std::memory_order_release);
+}
+
+bool D2PacketRing::isEmpty() const {
+    return consumerState.readIndex.load(std::memory_order_acquire) ==
+           producerState.writeIndex.load(std::memory_order_acquire);
+}
+
+size_t D2PacketRing::getCapacity() const {
+    return capacity;
+}
+
+D2PacketRingPolicy D2PacketRing::getPolicy() const {
+    return policy;
+}
+
+D2PacketRingCounters D2PacketRing::getCounters() const {
+    return {
+        producerState.pushedCount.load(std::memory_order_relaxed),
+        consumerState.poppedCount.load(std::memory_order_relaxed),
+        producerState.droppedCount.load(std::memory_order_relaxed),
+        producerState.blockedCount.load(std::memory_order_relaxed),
+        producerState.oversizedCount.load(std::memory_order_relaxed)
+    };
+}
+
+bool D2PacketRing::hasRoom(size_t writeIndex, size_t neededSize) {
+    if (writeIndex - producerState.cachedReadIndex + neededSize <= capacity) {
+        return true;
+    }
+
+    producerState.cachedReadIndex = consumerState.readIndex.load(
+                                        std::memory_order_acquire);
+    return writeIndex - producerState.cachedReadIndex + neededSize <= capacity;
+}
+
+bool D2PacketRing::waitForRoom(size_t writeIndex, size_t neededSize) {
+    if (policy == D2PacketRingPolicy::DROP) {
+        return false;
+    }
+
+    increment(producerState.blockedCount, 1);
+
+    while (!closed.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+
+        if (hasRoom(writeIndex, neededSize)) {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,195 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PacketRing.h                                                          *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Declares the D2PacketRing class, a preallocated single-producer,        *
+ *   single-consumer ring of packet records, which lets a hooked network     *
+ *   function hand its packets to a worker thread for the cost of a copy.    *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2PACKETRING_H
+#define _D2PACKETRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "D2PacketTable.h"
+
+// What the producer does when the ring has no room for a packet.
+enum class D2PacketRingPolicy : int {
+    // The packet is counted and thrown away, so the game never waits.
+    DROP,
+    // The producer yields until the consumer makes room, or the ring is
+    // closed.
+    BLOCK
+};
+
+// The data belongs to the ring, and is only valid during the handler call.
+struct D2CapturedPacket {
+    uint64_t timestamp;
+    D2PacketDirection direction;
+    const uint8_t* data;
+    size_t size;
+};
+
+struct D2PacketRingCounters {
+    uint64_t pushedCount;
+    uint64_t poppedCount;
+    uint64_t droppedCount;
+    // Pushes that had to wait for room under the BLOCK policy.
+    uint64_t blockedCount;
+    // Packets larger than MAX_PACKET_SIZE, which are always dropped.
+    uint64_t oversizedCount;
+};
+
+// Only one thread may push, and only one thread may drain. The indices only
+// ever grow, and each side keeps a cached copy of the other side's index,
+// so that the shared cache lines are only read when the ring looks full or
+// empty.
+class D2PacketRing {
+public:
+    static constexpr size_t MAX_PACKET_SIZE = 0x1000;
+    static constexpr size_t DEFAULT_CAPACITY = 0x100000;
+
+    // The capacity is rounded up to a power of two that holds at least two
+    // of the largest records.
+    explicit D2PacketRing(size_t capacity = DEFAULT_CAPACITY,
+                          D2PacketRingPolicy policy = D2PacketRingPolicy::DROP);
+
+    D2PacketRing(const D2PacketRing&) = delete;
+    D2PacketRing& operator=(const D2PacketRing&) = delete;
+
+    // Copies the packet into the ring, and publishes it with a single
+    // release store. Returns false if the packet was dropped.
+    bool push(D2PacketDirection direction, uint64_t timestamp,
+              const uint8_t* data, size_t size);
+
+    // Calls the handler for up to maxPackets packets, in the order they were
+    // pushed. The space is handed back to the producer once, after the batch.
+    // Returns the number of packets handled.
+    template<class F>
+    size_t drain(F handler, size_t maxPackets) {
+        size_t readIndex = consumerState.readIndex.load(std::memory_order_relaxed);
+        size_t packetCount = 0;
+
+        while (packetCount < maxPackets) {
+            if (readIndex == consumerState.cachedWriteIndex) {
+                consumerState.cachedWriteIndex = producerState.writeIndex.load(
+                                                     std::memory_order_acquire);
+
+                if (readIndex == consumerState.cachedWriteIndex) {
+                    break;
+                }
+            }
+
+            size_t offset = readIndex & indexMask;
+            const RecordHeader* header = (const RecordHeader*) &buffer[offset];
+
+            if (header->size == PADDING_SIZE) {
+                readIndex += capacity - offset;
+                continue;
+            }
+
+            handler(D2CapturedPacket { header->timestamp,
+                                       (D2PacketDirection) header->direction,
+                                       (const uint8_t*)(header + 1), header->size
+                                     });
+            readIndex += getRecordSize(header->size);
+            packetCount++;
+        }
+
+        if (readIndex != consumerState.readIndex.load(std::memory_order_relaxed)) {
+            consumerState.readIndex.store(readIndex, std::memory_order_release);
+        }
+
+        increment(consumerState.poppedCount, packetCount);
+        return packetCount;
+    }
+
+    // Closing the ring releases a blocked producer, which drops its packet.
+    // Packets already in the ring can still be drained.
+    void close();
+    void open();
+
+    bool isEmpty() const;
+    size_t getCapacity() const;
+    D2PacketRingPolicy getPolicy() const;
+    D2PacketRingCounters getCounters() const;
+
+private:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+    static constexpr size_t RECORD_ALIGNMENT = 16;
+    static constexpr uint32_t PADDING_SIZE = 0xFFFFFFFF;
+
+    struct RecordHeader {
+        uint64_t timestamp;
+        uint32_t size;
+        uint8_t direction;
+        uint8_t reserved[3];
+    };
+
+    static_assert(sizeof(RecordHeader) == RECORD_ALIGNMENT,
+                  "A record header must keep the records aligned");
+
+    // Only the producer writes to its state, and only the consumer to its
+    // own, so the counters are updated with plain loads and stores.
+    struct alignas(CACHE_LINE_SIZE) ProducerState {
+        std::atomic<size_t> writeIndex;
+        size_t cachedReadIndex;
+        std::atomic<uint64_t> pushedCount;
+        std::atomic<uint64_t> droppedCount;
+        std::atomic<uint64_t> blockedCount;
+        std::atomic<uint64_t> oversizedCount;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) ConsumerState {
+        std::atomic<size_t> readIndex;
+        size_t cachedWriteIndex;
+        std::atomic<uint64_t> poppedCount;
+    };
+
+    ProducerState producerState;
+    ConsumerState consumerState;
+    alignas(CACHE_LINE_SIZE) std::atomic<bool> closed;
+
+    size_t capacity;
+    size_t indexMask;
+    D2PacketRingPolicy policy;
+    std::unique_ptr<uint64_t[]> storage;
+    uint8_t* buffer;
+
+    static size_t getRecordSize(size_t packetSize) {
+        return (sizeof(RecordHeader) + packetSize + RECORD_ALIGNMENT - 1) &
+               ~(RECORD_ALIGNMENT - 1);
+    }
+
+    static void increment(std::atomic<uint64_t>& counter, uint64_t amount) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount,
+                      std::memory_order_relaxed);
+    }
+
+    bool hasRoom(size_t writeIndex, size_t neededSize);
+    bool waitForRoom(size_t writeIndex, size_t neededSize);
+};
+
+#endif
@@ -0,0 +1,104 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PacketTable.cpp                                                       *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Defines the functions that read the length of a D2GS packet from the    *
+ *   compile-time tables of packet lengths.                                  *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2PacketTable.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+D2PacketStatus D2PacketTable::getPacketLength(const LengthTable&
+        lengthTable, const uint8_t* buffer, size_t size, size_t& length) {
+    if (size == 0) {
+        return D2PacketStatus::TRUNCATED;
+    }
+
+    const D2PacketLength& packetLength = lengthTable[buffer[0]];
+
+    switch (packetLength.kind) {
+    case D2PacketLengthKind::FIXED:
+        length = packetLength.size;
+        break;
+
+    case D2PacketLengthKind::VARIABLE: {
+        if (size < packetLength.size) {
+            return D2PacketStatus::TRUNCATED;
+        }
+
+        length = 0;
+
+        for (size_t i = 0; i < packetLength.lengthSize; i++) {
+            length |= (size_t) buffer[packetLength.lengthOffset + i] << (i * 8);
+        }
+
+        // A length that does not even cover the length field would never
+        // move the stream forward.
+        if (length < packetLength.size) {
+            return D2PacketStatus::MALFORMED;
+        }
+
+        break;
+    }
+
+    case D2PacketLengthKind::COUNTED: {
+        if (size < packetLength.size) {
+            return D2PacketStatus::TRUNCATED;
+        }
+
+        size_t count = 0;
+
+        for (size_t i = 0; i < packetLength.lengthSize; i++) {
+            count |= (size_t) buffer[packetLength.lengthOffset + i] << (i * 8);
+        }
+
+        length = packetLength.size + count * packetLength.elementSize;
+        break;
+    }
+
+    case D2PacketLengthKind::TERMINATED: {
+        // The packet only ends at its last zero byte, so it is truncated
+        // until that byte is in the buffer.
+        length = packetLength.size;
+
+        for (size_t i = 0; i < packetLength.stringCount; i++) {
+            const void* terminator = (length < size) ? std::memchr(buffer + length, 0,
+                                     size - length) : nullptr;
+
+            if (terminator == nullptr) {
+                return D2PacketStatus::TRUNCATED;
+            }
+
+            length = (const uint8_t*) terminator - buffer + 1;
+        }
+
+        break;
+    }
+
+    default:
+        return D2PacketStatus::UNKNOWN_PACKET;
+    }
+
+    return (length <= size) ? D2PacketStatus::COMPLETE :
+           D2PacketStatus::TRUNCATED;
+}
@@ -0,0 +1,535 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PacketTable.h                                                         *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Declares the compile-time tables of the lengths of the D2GS packets,    *
+ *   indexed by their header byte, which tell where each packet of a stream  *
+ *   ends.                                                                   *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2PACKETTABLE_H
+#define _D2PACKETTABLE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+#include "D2PacketDef.h"
+
+enum class D2PacketDirection : int {
+    CLIENT_TO_SERVER,
+    SERVER_TO_CLIENT
+};
+
+enum class D2PacketLengthKind : uint8_t {
+    UNKNOWN,
+    FIXED,
+    // The packet stores its whole length.
+    VARIABLE,
+    // The packet stores how many elements of a fixed size follow its header.
+    COUNTED,
+    // The packet ends with strings, which each end with a zero byte.
+    TERMINATED
+};
+
+enum class D2PacketStatus : int {
+    COMPLETE,
+    // The buffer ends before the length of the packet is known, or before
+    // the packet ends.
+    TRUNCATED,
+    UNKNOWN_PACKET,
+    MALFORMED
+};
+
+struct D2PacketLength {
+    D2PacketLengthKind kind;
+    // The size of fixed packets, and the smallest size of the others, which
+    // covers their length or count field, or comes before their strings.
+    uint16_t size;
+    // Where variable packets store their whole length, and counted packets
+    // their count, in little endian.
+    uint8_t lengthOffset;
+    uint8_t lengthSize;
+    // The size of each element of counted packets.
+    uint8_t elementSize;
+    // How many strings end terminated packets.
+    uint8_t stringCount;
+};
+
+// Ties each packet struct to its header byte and direction.
+template<class T>
+struct D2PacketTraits;
+
+// Packets of a variable length specialize this with where they store their
+// whole length. Packets that do not are as long as their struct.
+template<class T>
+struct D2PacketLengthField {
+    static constexpr uint8_t OFFSET = 0;
+    static constexpr uint8_t SIZE = 0;
+};
+
+template<>
+struct D2PacketTraits<D2GSPacketClt01> {
+    static constexpr uint8_t PACKET_ID = 0x01;
+    static constexpr D2PacketDirection DIRECTION =
+        D2PacketDirection::CLIENT_TO_SERVER;
+};
+
+template<>
+struct D2PacketTraits<D2GSPacketClt02> {
+    static constexpr uint8_t PACKET_ID = 0x02;
+    static constexpr D2PacketDirection DIRECTION =
+        D2PacketDirection::CLIENT_TO_SERVER;
+};
+
+template<>
+struct D2PacketTraits<D2GSPacketClt03> {
+    static constexpr uint8_t PACKET_ID = 0x03;
+    static constexpr D2PacketDirection DIRECTION =
+        D2PacketDirection::CLIENT_TO_SERVER;
+};
+
+template<>
+struct D2PacketTraits<D2GSPacketSrv01> {
+    static constexpr uint8_t PACKET_ID = 0x01;
+    static constexpr D2PacketDirection DIRECTION =
+        D2PacketDirection::SERVER_TO_CLIENT;
+};
+
+template<>
+struct D2PacketTraits<D2GSPacketSrv02> {
+    static constexpr uint8_t PACKET_ID = 0x02;
+    static constexpr D2PacketDirection DIRECTION =
+        D2PacketDirection::SERVER_TO_CLIENT;
+};
+
+template<>
+struct D2PacketTraits<D2GSPacketSrv03> {
+    static constexpr uint8_t PACKET_ID = 0x03;
+    static constexpr D2PacketDirection DIRECTION =
+        D2PacketDirection::SERVER_TO_CLIENT;
+};
+
+template<>
+struct D2PacketTraits<D2GSPacketSrv5B> {
+    static constexpr uint8_t PACKET_ID = 0x5B;
+    static constexpr D2PacketDirection DIRECTION =
+        D2PacketDirection::SERVER_TO_CLIENT;
+};
+
+template<>
+struct D2PacketLengthField<D2GSPacketSrv5B> {
+    static constexpr uint8_t OFFSET = 1;
+    static constexpr uint8_t SIZE = 2;
+};
+
+template<>
+struct D2PacketTraits<D2GSPacketSrv9C> {
+    static constexpr uint8_t PACKET_ID = 0x9C;
+    static constexpr D2PacketDirection DIRECTION =
+        D2PacketDirection::SERVER_TO_CLIENT;
+};
+
+template<>
+struct D2PacketLengthField<D2GSPacketSrv9C> {
+    static constexpr uint8_t OFFSET = 2;
+    static constexpr uint8_t SIZE = 1;
+};
+
+template<>
+struct D2PacketTraits<D2GSPacketSrv9D> {
+    static constexpr uint8_t PACKET_ID = 0x9D;
+    static constexpr D2PacketDirection DIRECTION =
+        D2PacketDirection::SERVER_TO_CLIENT;
+};
+
+template<>
+struct D2PacketLengthField<D2GSPacketSrv9D> {
+    static constexpr uint8_t OFFSET = 2;
+    static constexpr uint8_t SIZE = 1;
+};
+
+template<>
+struct D2PacketTraits<D2GSPacketSrvA8> {
+    static constexpr uint8_t PACKET_ID = 0xA8;
+    static constexpr D2PacketDirection DIRECTION =
+        D2PacketDirection::SERVER_TO_CLIENT;
+};
+
+template<>
+struct D2PacketLengthField<D2GSPacketSrvA8> {
+    static constexpr uint8_t OFFSET = 6;
+    static constexpr uint8_t SIZE = 1;
+};
+
+template<>
+struct D2PacketTraits<D2GSPacketSrvAA> {
+    static constexpr uint8_t PACKET_ID = 0xAA;
+    static constexpr D2PacketDirection DIRECTION =
+        D2PacketDirection::SERVER_TO_CLIENT;
+};
+
+template<>
+struct D2PacketLengthField<D2GSPacketSrvAA> {
+    static constexpr uint8_t OFFSET = 6;
+    static constexpr uint8_t SIZE = 1;
+};
+
+template<>
+struct D2PacketTraits<D2GSPacketSrvAC> {
+    static constexpr uint8_t PACKET_ID = 0xAC;
+    static constexpr D2PacketDirection DIRECTION =
+        D2PacketDirection::SERVER_TO_CLIENT;
+};
+
+template<>
+struct D2PacketLengthField<D2GSPacketSrvAC> {
+    static constexpr uint8_t OFFSET = 12;
+    static constexpr uint8_t SIZE = 1;
+};
+
+namespace D2PacketTable {
+static constexpr size_t PACKET_ID_COUNT = 256;
+
+typedef std::array<D2PacketLength, PACKET_ID_COUNT> LengthTable;
+
+// The length of a packet that has no struct.
+struct D2PacketLengthRow {
+    uint8_t packetId;
+    D2PacketLength length;
+};
+
+constexpr D2PacketLength makeFixedLength(uint16_t size) {
+    return { D2PacketLengthKind::FIXED, size, 0, 0, 0, 0 };
+}
+
+constexpr D2PacketLength makeCountedLength(uint16_t size, uint8_t countOffset,
+        uint8_t countSize, uint8_t elementSize) {
+    return { D2PacketLengthKind::COUNTED, size, countOffset, countSize, elementSize, 0 };
+}
+
+constexpr D2PacketLength makeTerminatedLength(uint16_t size,
+        uint8_t stringCount) {
+    return { D2PacketLengthKind::TERMINATED, size, 0, 0, 0, stringCount };
+}
+
+// The packets of 1.13c that have no struct yet, by the size of their fields.
+// Packets whose layout is not known are left out.
+inline constexpr D2PacketLengthRow CLIENT_ROWS[] = {
+    { 0x04, makeFixedLength(9) },           // Run to a unit
+    { 0x05, makeFixedLength(5) },           // Left skill on a location
+    { 0x06, makeFixedLength(9) },           // Left skill on a unit
+    { 0x07, makeFixedLength(9) },           // Left skill on a unit, held
+    { 0x08, makeFixedLength(5) },           // Left skill on a location, held
+    { 0x09, makeFixedLength(9) },           // Left skill on a unit
+    { 0x0A, makeFixedLength(9) },           // Left skill on a unit, held
+    { 0x0C, makeFixedLength(5) },           // Right skill on a location
+    { 0x0D, makeFixedLength(9) },           // Right skill on a unit
+    { 0x0E, makeFixedLength(9) },           // Right skill on a unit, held
+    { 0x0F, makeFixedLength(5) },           // Right skill on a location, held
+    { 0x10, makeFixedLength(9) },           // Right skill on a unit
+    { 0x11, makeFixedLength(9) },           // Right skill on a unit, held
+    { 0x13, makeFixedLength(9) },           // Interact with a unit
+    { 0x14, makeTerminatedLength(3, 3) },   // Overhead message
+    { 0x15, makeTerminatedLength(3, 3) },   // Chat, then three strings
+    { 0x16, makeFixedLength(13) },          // Pick up an item
+    { 0x17, makeFixedLength(5) },           // Drop an item
+    { 0x18, makeFixedLength(17) },          // Item to a buffer
+    { 0x19, makeFixedLength(5) },           // Pick up a buffer item
+    { 0x1A, makeFixedLength(9) },           // Item to the body
+    { 0x1B, makeFixedLength(9) },           // Swap a two-handed item
+    { 0x1C, makeFixedLength(3) },           // Pick up a body item
+    { 0x1D, makeFixedLength(9) },           // Swap a body item
+    { 0x1E, makeFixedLength(9) },           // Swap a one-handed item
+    { 0x1F, makeFixedLength(17) },          // Swap a buffer item
+    { 0x20, makeFixedLength(13) },          // Use an item
+    { 0x21, makeFixedLength(9) },           // Stack items
+    { 0x22, makeFixedLength(5) },           // Unstack items
+    { 0x23, makeFixedLength(9) },           // Item to the belt
+    { 0x24, makeFixedLength(5) },           // Remove a belt item
+    { 0x25, makeFixedLength(9) },           // Swap a belt item
+    { 0x26, makeFixedLength(13) },          // Use a belt item
+    { 0x27, makeFixedLength(9) },           // Identify an item
+    { 0x28, makeFixedLength(9) },           // Socket an item
+    { 0x29, makeFixedLength(9) },           // Scroll to a book
+    { 0x2A, makeFixedLength(9) },           // Item to the cube
+    { 0x2F, makeFixedLength(9) },           // Talk to an NPC
+    { 0x30, makeFixedLength(9) },           // Stop talking to an NPC
+    { 0x31, makeFixedLength(9) },           // Quest message
+    { 0x32, makeFixedLength(17) },          // Buy from an NPC
+    { 0x33, makeFixedLength(17) },          // Sell to an NPC
+    { 0x34, makeFixedLength(5) },           // Identify with an NPC
+    { 0x35, makeFixedLength(17) },          // Repair
+    { 0x36, makeFixedLength(9) },           // Hire a mercenary
+    { 0x37, makeFixedLength(5) },           // Identify a gamble
+    { 0x38, makeFixedLength(13) },          // NPC menu action
+    { 0x39, makeFixedLength(5) },           // Buy life
+    { 0x3A, makeFixedLength(3) },           // Add a stat point
+    { 0x3B, makeFixedLength(3) },           // Add a skill point
+    { 0x3C, makeFixedLength(9) },           // Select a skill
+    { 0x3D, makeFixedLength(5) },           // Highlight a door
+    { 0x3E, makeFixedLength(5) },           // Activate an item
+    { 0x3F, makeFixedLength(3) },           // Play a sound
+    { 0x40, makeFixedLength(1) },           // Request quest data
+    { 0x41, makeFixedLength(1) },           // Resurrect
+    { 0x44, makeFixedLength(17) },          // Staff in orifice
+    { 0x45, makeFixedLength(9) },           // Change a town portal
+    { 0x46, makeFixedLength(13) },          // Mercenary interacts
+    { 0x47, makeFixedLength(13) },          // Move the mercenary
+    { 0x48, makeFixedLength(1) },           // Not busy
+    { 0x49, makeFixedLength(9) },           // Take a waypoint
+    { 0x4B, makeFixedLength(9) },           // Request a unit update
+    { 0x4C, makeFixedLength(5) },           // Transmute
+    { 0x4D, makeFixedLength(3) },           // Play an NPC message
+    { 0x4F, makeFixedLength(7) },           // Click a button
+    { 0x50, makeFixedLength(9) },           // Drop gold
+    { 0x51, makeFixedLength(9) },           // Bind a hotkey
+    { 0x53, makeFixedLength(1) },           // Stamina on
+    { 0x54, makeFixedLength(1) },           // Stamina off
+    { 0x58, makeFixedLength(3) },           // Quest completed
+    { 0x59, makeFixedLength(17) },          // Move a unit
+    { 0x5D, makeFixedLength(7) },           // Squelch or hostile
+    { 0x5E, makeFixedLength(6) },           // Party action
+    { 0x5F, makeFixedLength(5) },           // Update position
+    { 0x60, makeFixedLength(1) },           // Swap weapons
+    { 0x61, makeFixedLength(3) },           // Mercenary item
+    { 0x62, makeFixedLength(5) },           // Resurrect the mercenary
+    { 0x63, makeFixedLength(5) },           // Item to the belt, shifted
+    { 0x66, makeCountedLength(3, 1, 2, 1) }, // Warden response
+    { 0x68, makeFixedLength(37) },          // Game logon
+    { 0x69, makeFixedLength(1) },           // Leave the game
+    { 0x6A, makeFixedLength(1) },           // Request the game host
+    { 0x6B, makeFixedLength(1) },           // Join the game
+    { 0x6D, makeFixedLength(13) },          // Ping
+};
+
+inline constexpr D2PacketLengthRow SERVER_ROWS[] = {
+    { 0x00, makeFixedLength(1) },           // Game loading
+    { 0x04, makeFixedLength(1) },           // Load complete
+    { 0x05, makeFixedLength(1) },           // Unload complete
+    { 0x06, makeFixedLength(1) },           // Game exit
+    { 0x07, makeFixedLength(6) },           // Map reveal
+    { 0x08, makeFixedLength(6) },           // Map hide
+    { 0x09, makeFixedLength(11) },          // Assign level warp
+    { 0x0A, makeFixedLength(6) },           // Remove object
+    { 0x0B, makeFixedLength(6) },           // Game handshake
+    { 0x0C, makeFixedLength(9) },           // NPC hit
+    { 0x0D, makeFixedLength(13) },          // Player stop
+    { 0x0E, makeFixedLength(12) },          // Object state
+    { 0x0F, makeFixedLength(16) },          // Player move
+    { 0x10, makeFixedLength(16) },          // Player move to unit
+    { 0x11, makeFixedLength(8) },           // Report kill
+    { 0x12, makeFixedLength(26) },
+    { 0x13, makeFixedLength(14) },
+    { 0x14, makeFixedLength(18) },
+    { 0x15, makeFixedLength(11) },          // Reassign player
+    { 0x18, makeFixedLength(15) },          // Life and mana
+    { 0x19, makeFixedLength(2) },           // Small gold amount
+    { 0x1A, makeFixedLength(2) },           // Add experience, byte
+    { 0x1B, makeFixedLength(3) },           // Add experience, word
+    { 0x1C, makeFixedLength(5) },           // Add experience, dword
+    { 0x1D, makeFixedLength(3) },           // Base stat, byte
+    { 0x1E, makeFixedLength(4) },           // Base stat, word
+    { 0x1F, makeFixedLength(6) },           // Base stat, dword
+    { 0x20, makeFixedLength(10) },          // Unit stat
+    { 0x21, makeFixedLength(12) },          // Item oskill
+    { 0x22, makeFixedLength(12) },          // Item skill
+    { 0x23, makeFixedLength(13) },          // Set skill
+    { 0x24, makeFixedLength(90) },
+    { 0x25, makeFixedLength(90) },
+    { 0x26, makeTerminatedLength(10, 2) },  // Chat, then the name and the message
+    { 0x27, makeFixedLength(40) },          // NPC info
+    { 0x28, makeFixedLength(103) },         // Quest info
+    { 0x29, makeFixedLength(97) },          // Game quest info
+    { 0x2A, makeFixedLength(15) },          // NPC transaction
+    { 0x2C, makeFixedLength(8) },           // Play sound
+    { 0x3E, makeFixedLength(34) },          // Update item stats
+    { 0x3F, makeFixedLength(8) },           // Use stackable item
+    { 0x40, makeFixedLength(13) },
+    { 0x42, makeFixedLength(6) },           // Clear cursor
+    { 0x45, makeFixedLength(13) },
+    { 0x47, makeFixedLength(11) },          // Relator
+    { 0x48, makeFixedLength(11) },          // Relator
+    { 0x4C, makeFixedLength(16) },          // Unit uses a skill on a unit
+    { 0x4D, makeFixedLength(17) },          // Unit uses a skill
+    { 0x4E, makeFixedLength(7) },           // Mercenary for hire
+    { 0x4F, makeFixedLength(1) },           // Clear mercenary list
+    { 0x50, makeFixedLength(15) },          // Quest special
+    { 0x51, makeFixedLength(14) },          // Assign object
+    { 0x52, makeFixedLength(42) },          // Player quest info
+    { 0x53, makeFixedLength(10) },          // Darkness
+    { 0x54, makeFixedLength(3) },
+    { 0x57, makeFixedLength(14) },          // NPC enchants
+    { 0x58, makeFixedLength(7) },           // Open user interface
+    { 0x59, makeFixedLength(26) },          // Assign player
+    { 0x5A, makeFixedLength(40) },          // Event message
+    { 0x5C, makeFixedLength(5) },           // Player left
+    { 0x5D, makeFixedLength(6) },           // Quest item state
+    { 0x5E, makeFixedLength(38) },          // Game quest availability
+    { 0x5F, makeFixedLength(5) },
+    { 0x60, makeFixedLength(7) },           // Town portal state
+    { 0x61, makeFixedLength(2) },
+    { 0x62, makeFixedLength(7) },
+    { 0x63, makeFixedLength(21) },          // Waypoint menu
+    { 0x65, makeFixedLength(7) },           // Player kill count
+    { 0x66, makeFixedLength(7) },
+    { 0x67, makeFixedLength(16) },          // NPC move
+    { 0x68, makeFixedLength(21) },          // NPC move to unit
+    { 0x69, makeFixedLength(12) },          // NPC state
+    { 0x6A, makeFixedLength(12) },
+    { 0x6B, makeFixedLength(16) },          // NPC action
+    { 0x6C, makeFixedLength(16) },          // NPC attack
+    { 0x6D, makeFixedLength(10) },          // NPC stop
+    { 0x6E, makeFixedLength(1) },
+    { 0x6F, makeFixedLength(1) },
+    { 0x70, makeFixedLength(1) },
+    { 0x71, makeFixedLength(1) },
+    { 0x72, makeFixedLength(1) },
+    { 0x73, makeFixedLength(32) },
+    { 0x74, makeFixedLength(10) },          // Assign player corpse
+    { 0x75, makeFixedLength(13) },          // Party stats
+    { 0x76, makeFixedLength(6) },           // Player in proximity
+    { 0x77, makeFixedLength(2) },           // Button action
+    { 0x78, makeFixedLength(21) },          // Trade accepted
+    { 0x79, makeFixedLength(6) },           // Gold in trade
+    { 0x7A, makeFixedLength(13) },          // Pet action
+    { 0x7B, makeFixedLength(8) },           // Assign hotkey
+    { 0x7C, makeFixedLength(6) },           // Use scroll
+    { 0x7D, makeFixedLength(18) },          // Set item flags
+    { 0x7E, makeFixedLength(5) },
+    { 0x7F, makeFixedLength(10) },          // Ally party info
+    { 0x80, makeFixedLength(4) },
+    { 0x81, makeFixedLength(20) },          // Assign mercenary
+    { 0x82, makeFixedLength(29) },          // Portal ownership
+    { 0x89, makeFixedLength(2) },           // Unique event
+    { 0x8A, makeFixedLength(6) },           // NPC wants to interact
+    { 0x8B, makeFixedLength(6) },           // Party relationship
+    { 0x8C, makeFixedLength(11) },          // Player relationship
+    { 0x8D, makeFixedLength(7) },           // Assign player to party
+    { 0x8E, makeFixedLength(10) },          // Assign corpse
+    { 0x8F, makeFixedLength(33) },          // Pong
+    { 0x90, makeFixedLength(13) },          // Party automap info
+    { 0x91, makeFixedLength(26) },
+    { 0x92, makeFixedLength(6) },
+    { 0x93, makeFixedLength(8) },
+    { 0x94, makeCountedLength(6, 1, 1, 3) }, // Base skill levels, three bytes per skill
+    { 0x95, makeFixedLength(13) },          // Life, mana and position
+    { 0x96, makeFixedLength(9) },           // Walk verify
+    { 0x97, makeFixedLength(1) },           // Weapon switch
+    { 0x98, makeFixedLength(7) },
+    { 0x99, makeFixedLength(16) },          // Skill triggered
+    { 0x9A, makeFixedLength(17) },
+    { 0x9B, makeFixedLength(7) },
+    { 0x9E, makeFixedLength(7) },
+    { 0x9F, makeFixedLength(8) },
+    { 0xA0, makeFixedLength(10) },
+    { 0xA1, makeFixedLength(7) },
+    { 0xA2, makeFixedLength(8) },
+    { 0xA3, makeFixedLength(24) },          // Skill aura
+    { 0xA4, makeFixedLength(3) },
+    { 0xA5, makeFixedLength(8) },
+    { 0xA7, makeFixedLength(7) },           // Delayed state
+    { 0xA9, makeFixedLength(7) },           // End state
+    { 0xAB, makeFixedLength(7) },           // NPC heal
+    { 0xAE, makeCountedLength(3, 1, 2, 1) }, // Warden request
+    { 0xAF, makeFixedLength(2) },           // Connection info
+    { 0xB0, makeFixedLength(1) },           // Game terminated
+};
+
+template<class T>
+constexpr void addLength(LengthTable& lengthTable,
+                         D2PacketDirection direction) {
+    typedef D2PacketLengthField<T> LengthField;
+
+    static_assert(LengthField::OFFSET + LengthField::SIZE <= sizeof(T),
+                  "The length field must be part of the packet struct");
+
+    if (D2PacketTraits<T>::DIRECTION != direction) {
+        return;
+    }
+
+    lengthTable[D2PacketTraits<T>::PACKET_ID] = {
+        (LengthField::SIZE == 0) ? D2PacketLengthKind::FIXED : D2PacketLengthKind::VARIABLE,
+        (uint16_t) sizeof(T), LengthField::OFFSET, LengthField::SIZE, 0, 0
+    };
+}
+
+// Lists the length of every packet struct of a direction, and of every row.
+// Packets that are in neither stay unknown, as a stream cannot be split past
+// them.
+template<class... T, size_t N>
+constexpr LengthTable makeLengthTable(D2PacketDirection direction,
+                                      const D2PacketLengthRow (&rows)[N]) {
+    LengthTable lengthTable = {};
+
+    for (const D2PacketLengthRow& row : rows) {
+        lengthTable[row.packetId] = row.length;
+    }
+
+    (addLength<T>(lengthTable, direction), ...);
+    return lengthTable;
+}
+
+constexpr size_t countKnownLengths(const LengthTable& lengthTable) {
+    size_t count = 0;
+
+    for (const D2PacketLength& packetLength : lengthTable) {
+        if (packetLength.kind != D2PacketLengthKind::UNKNOWN) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+inline constexpr LengthTable CLIENT_LENGTHS = makeLengthTable<D2GSPacketClt01,
+                                              D2GSPacketClt02, D2GSPacketClt03>(D2PacketDirection::CLIENT_TO_SERVER,
+                                                      CLIENT_ROWS);
+
+inline constexpr LengthTable SERVER_LENGTHS = makeLengthTable<D2GSPacketSrv01,
+                                              D2GSPacketSrv02, D2GSPacketSrv03, D2GSPacketSrv5B, D2GSPacketSrv9C,
+                                              D2GSPacketSrv9D, D2GSPacketSrvA8, D2GSPacketSrvAA, D2GSPacketSrvAC>
+                                              (D2PacketDirection::SERVER_TO_CLIENT, SERVER_ROWS);
+
+// A packet given both a struct and a row, or two rows, is counted once.
+static_assert(countKnownLengths(CLIENT_LENGTHS) == std::size(CLIENT_ROWS) + 3,
+              "A client packet is listed twice");
+static_assert(countKnownLengths(SERVER_LENGTHS) == std::size(SERVER_ROWS) + 9,
+              "A server packet is listed twice");
+
+static_assert(CLIENT_LENGTHS[0x02].size == 9, "The client lengths are wrong");
+static_assert(SERVER_LENGTHS[0x03].size == 12, "The server lengths are wrong");
+static_assert(SERVER_LENGTHS[0x9C].kind == D2PacketLengthKind::VARIABLE
+              && SERVER_LENGTHS[0x9C].lengthOffset == 2, "The server lengths are wrong");
+static_assert(SERVER_LENGTHS[0x95].size == 13, "The server lengths are wrong");
+
+constexpr const LengthTable& getLengthTable(D2PacketDirection direction) {
+    return (direction == D2PacketDirection::CLIENT_TO_SERVER) ? CLIENT_LENGTHS :
+           SERVER_LENGTHS;
+}
+
+// Finds the length of the packet at the start of the buffer.
+D2PacketStatus getPacketLength(const LengthTable& lengthTable,
+                                     const uint8_t* buffer, size_t size, size_t& length);
+}
+
+#endif
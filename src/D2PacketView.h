@@ -0,0 +1,100 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PacketView.h                                                          *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Declares the D2PacketView class, a bounds-checked view of a D2GS packet *
+ *   inside of the buffer it was received in, which is never copied.         *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2PACKETVIEW_H
+#define _D2PACKETVIEW_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "D2PacketDef.h"
+#include "D2PacketTable.h"
+
+template<class T>
+class D2PacketView {
+public:
+    static_assert(alignof(T) == 1, "Packet structs must be packed");
+
+    D2PacketView() : packet(nullptr), size(0) {
+    }
+
+    // Returns an invalid view unless the buffer starts with a whole packet of
+    // the type. Bytes past the packet are left to the caller. The view of a
+    // variable packet covers the length it stores.
+    static D2PacketView parse(const uint8_t* buffer, size_t bufferSize) {
+        if (buffer == nullptr || bufferSize < sizeof(T)
+                || buffer[0] != D2PacketTraits<T>::PACKET_ID) {
+            return D2PacketView();
+        }
+
+        typedef D2PacketLengthField<T> LengthField;
+        size_t packetSize = sizeof(T);
+
+        if (LengthField::SIZE != 0) {
+            packetSize = 0;
+
+            for (size_t i = 0; i < LengthField::SIZE; i++) {
+                packetSize |= (size_t) buffer[LengthField::OFFSET + i] << (i * 8);
+            }
+
+            if (packetSize < sizeof(T) || packetSize > bufferSize) {
+                return D2PacketView();
+            }
+        }
+
+        return D2PacketView(buffer, packetSize);
+    }
+
+    bool isValid() const {
+        return packet != nullptr;
+    }
+
+    const T* operator->() const {
+        return packet;
+    }
+
+    const T& operator*() const {
+        return *packet;
+    }
+
+    const uint8_t* getData() const {
+        return (const uint8_t*) packet;
+    }
+
+    size_t getSize() const {
+        return size;
+    }
+
+private:
+    const T* packet;
+    size_t size;
+
+    D2PacketView(const uint8_t* buffer, size_t size) :
+        packet((const T*) buffer), size(size) {
+    }
+};
+
+#endif
@@ -18,7 +18,8 @@
  *---------------------------------------------------------------------------*
  *                                                                           *
  *   A convenience file to include all patch types and to declare the        *
- *   applyPatches functions to apply all patches in a vector.                *
+ *   applyPatches functions to apply all patches in a vector as a single     *
+ *   transaction.                                                            *
  *                                                                           *
  *****************************************************************************/
 
@@ -27,11 +28,23 @@
 #ifndef _D2PATCH_H
 #define _D2PATCH_H
 
+#include <windows.h>
+
 enum class OpCode : BYTE;
 
 #include "D2Patch/D2AnyPatch.h"
 #include "D2Patch/D2BasePatch.h"
+#include "D2Patch/D2DetourPatch.h"
+#include "D2Patch/D2HookChain.h"
+#include "D2Patch/D2HookProfiler.h"
+#include "D2Patch/D2HookRegistry.h"
+#include "D2Patch/D2HookSitePatch.h"
 #include "D2Patch/D2InterceptorPatch.h"
+#include "D2Patch/D2PatchDescriptor.h"
+#include "D2Patch/D2PatchGroup.h"
+#include "D2Patch/D2PatchIntervalIndex.h"
+#include "D2Patch/D2PatchJournal.h"
+#include "D2Patch/D2PatchTransaction.h"
 
 enum class OpCode : BYTE {
     NOP = 0x90,
@@ -43,16 +56,32 @@ namespace D2Patch {
 static constexpr long long int NO_PATCH = 0x4000000000000000;
 
 template<class T>
-bool applyPatches(const T patches) {
+bool applyPatches(const T& patches, D2PatchTransaction& transaction) {
     // For anyone encountering errors here:
     // The function only accepts containers of (smart) D2BasePatch pointers.
-    bool returnValue = true;
-
     for (const auto& patch : patches) {
-        returnValue = returnValue && patch->applyPatch();
+        transaction.addPatch(*patch);
     }
 
-    return returnValue;
+    // Either every patch is applied, or the game's code is left untouched.
+    return transaction.commit();
+}
+
+template<class T>
+bool applyPatches(const T& patches) {
+    D2PatchTransaction transaction;
+    return applyPatches(patches, transaction);
+}
+
+template<size_t N>
+bool applyPatches(const D2PatchDescriptor(&descriptors)[N],
+                  D2PatchTransaction& transaction) {
+    return applyPatchDescriptors(descriptors, N, transaction);
+}
+
+template<size_t N>
+bool applyPatches(const D2PatchDescriptor(&descriptors)[N]) {
+    return applyPatchDescriptors(descriptors, N);
 }
 }
 
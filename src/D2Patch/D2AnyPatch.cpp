@@ -39,57 +39,28 @@ D2AnyPatch::D2AnyPatch(const D2Offset& d2Offset, const OpCode opCode,
                                    (int)opCode, relative, patchSize) {
 }
 
-bool D2AnyPatch::applyPatch() const {
-    HANDLE gameHandle = GetCurrentProcess();
-
-    if ((getD2Offset().getCurrentOffset() & D2Patch::NO_PATCH) ==
-            D2Patch::NO_PATCH) {
-        return true;
-    }
-
-    DWORD dwAddress = getD2Offset().getCurrentAddress();
-
-    if (dwAddress == 0) {
-        return false;
-    }
-
+bool D2AnyPatch::buildPatchBuffer(DWORD address, BYTE* buffer) const {
     DWORD dwData = data;
 
     if (isRelative()) {
-        dwData = dwData - (dwAddress + sizeof(dwData));
+        dwData = dwData - (address + sizeof(dwData));
     }
 
-    LPVOID hAddress = (LPVOID) dwAddress;
-    DWORD dwOldPage;
-
-    bool nReturn;
-
     if (getPatchSize() > 0) {
-        std::unique_ptr<BYTE[]> buffer(new BYTE[getPatchSize()]);
-
         for (size_t i = 0; i < getPatchSize(); i++) {
             buffer[i] = (BYTE) dwData;
         }
-
-        VirtualProtect(hAddress, getPatchSize(), PAGE_EXECUTE_READWRITE, &dwOldPage);
-        nReturn = WriteProcessMemory(gameHandle, hAddress, buffer.get(), getPatchSize(),
-                                     0);
-        VirtualProtect(hAddress, getPatchSize(), dwOldPage, &dwOldPage);
     } else {
-        VirtualProtect(hAddress, sizeof(dwData), PAGE_EXECUTE_READWRITE,
-                       &dwOldPage);
-        nReturn = WriteProcessMemory(gameHandle, hAddress, &dwData,
-                                     sizeof(dwData), 0);
-        VirtualProtect(hAddress, sizeof(dwData), dwOldPage, &dwOldPage);
-    }
-
-    if (nReturn == 0) {
-        return false;
+        *((DWORD*) buffer) = dwData;
     }
 
     return true;
 }
 
+size_t D2AnyPatch::getWriteSize() const {
+    return (getPatchSize() > 0) ? getPatchSize() : sizeof(data);
+}
+
 bool D2AnyPatch::isRelative() const {
     return relative;
 }
@@ -40,7 +40,8 @@ public:
     D2AnyPatch(const D2Offset& d2Offset, const OpCode opCode, const bool relative,
             const size_t patchSize);
 
-    virtual bool applyPatch() const override;
+    virtual bool buildPatchBuffer(DWORD address, BYTE* buffer) const override;
+    virtual size_t getWriteSize() const override;
     bool isRelative() const;
 
 private:
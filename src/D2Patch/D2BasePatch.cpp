@@ -24,19 +24,59 @@
 
 #include "D2BasePatch.h"
 
-#include <memory>
-#include <vector>
-
 #include "../D2Offset.h"
+#include "../D2Patch.h"
+#include "D2PatchJournal.h"
+#include "D2PatchTransaction.h"
 
 D2BasePatch::D2BasePatch(const D2Offset& d2Offset,
                          const size_t patchSize) : d2Offset(d2Offset), patchSize(patchSize) {
 }
 
+bool D2BasePatch::applyPatch() {
+    // A single patch is written in the same suspended window as a patch set.
+    // A patch applied before is written back from its journal, rather than
+    // computing the relative addresses again.
+    D2PatchTransaction transaction;
+    transaction.addPatch(*this);
+    return transaction.commit();
+}
+
+bool D2BasePatch::revertPatch() {
+    D2PatchTransaction transaction;
+    transaction.addPatch(*this);
+    return transaction.revert();
+}
+
+bool D2BasePatch::reapplyPatch() {
+    return applyPatch();
+}
+
 const D2Offset& D2BasePatch::getD2Offset() const {
     return d2Offset;
 }
 
+D2PatchJournal& D2BasePatch::getJournal() {
+    return journal;
+}
+
+const D2PatchJournal& D2BasePatch::getJournal() const {
+    return journal;
+}
+
+bool D2BasePatch::isApplied() const {
+    return journal.isApplied();
+}
+
+bool D2BasePatch::isNoPatch() const {
+    return (getD2Offset().getCurrentOffset() & D2Patch::NO_PATCH) ==
+           D2Patch::NO_PATCH;
+}
+
 size_t D2BasePatch::getPatchSize() const {
     return patchSize;
 }
+
+size_t D2BasePatch::getWriteSize() const {
+    return patchSize;
+}
@@ -28,18 +28,28 @@
 #ifndef _D2BASEPATCH_H
 #define _D2BASEPATCH_H
 
+#include <windows.h>
 #include <memory>
 #include <vector>
 
 #include "../D2Offset.h"
+#include "D2PatchJournal.h"
 
 class D2BasePatch {
 public:
-    virtual bool applyPatch() const = 0;
+    virtual bool applyPatch();
+    bool revertPatch();
+    bool reapplyPatch();
+    virtual bool buildPatchBuffer(DWORD address, BYTE* buffer) const = 0;
 
     const D2Offset& getD2Offset() const;
+    D2PatchJournal& getJournal();
+    const D2PatchJournal& getJournal() const;
+    bool isApplied() const;
+    bool isNoPatch() const;
     bool isRelative() const;
     size_t getPatchSize() const;
+    virtual size_t getWriteSize() const;
 
 protected:
     D2BasePatch(const D2Offset& d2Offset, const size_t patchSize);
@@ -48,6 +58,7 @@ protected:
 private:
     D2Offset d2Offset;
     size_t patchSize;
+    D2PatchJournal journal;
 
     D2BasePatch() = delete;
 };
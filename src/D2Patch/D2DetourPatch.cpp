@@ -0,0 +1,122 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2DetourPatch.cpp                                                       *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2DetourPatch class, which redirects a Diablo II  *
+ *   function to a replacement function, while moving the instructions it    *
+ *   overwrites into a trampoline so that the original function can still be *
+ *   called.                                                                 *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2DetourPatch.h"
+
+#include <windows.h>
+
+#include "../D2Memory.h"
+#include "../D2Offset.h"
+#include "D2BasePatch.h"
+#include "D2GameStubArena.h"
+#include "D2HookProfiler.h"
+#include "D2X86Decoder.h"
+
+D2DetourPatch::D2DetourPatch(const D2Offset& d2Offset,
+                             void* const pDetour) : D2BasePatch(d2Offset, 0), pDetour(pDetour),
+    preparedAddress(0), trampolineAddress(0), relocatedLength(0) {
+}
+
+bool D2DetourPatch::buildPatchBuffer(DWORD address, BYTE* buffer) const {
+    if (!prepareTrampoline() || address != preparedAddress) {
+        return false;
+    }
+
+    // Jump to the detour, and fill the rest of the relocated instructions
+    // with NOP.
+    void* pTarget = D2HookProfiler::wrapTarget(getD2Offset().getDllFile(), address,
+                    pDetour);
+
+    buffer[0] = (BYTE) OpCode::JMP;
+    *((DWORD*) &buffer[1]) = (DWORD) pTarget - (address + JMP_SIZE);
+
+    for (size_t i = JMP_SIZE; i < relocatedLength; i++) {
+        buffer[i] = (BYTE) OpCode::NOP;
+    }
+
+    return true;
+}
+
+size_t D2DetourPatch::getWriteSize() const {
+    return prepareTrampoline() ? relocatedLength : 0;
+}
+
+void* D2DetourPatch::getOriginalFunction() const {
+    return prepareTrampoline() ? (void*) trampolineAddress : nullptr;
+}
+
+bool D2DetourPatch::prepareTrampoline() const {
+    if (trampolineAddress != 0) {
+        return true;
+    }
+
+    DWORD address = getD2Offset().getCurrentAddress();
+
+    if (address == 0) {
+        return false;
+    }
+
+    BYTE prologue[PROLOGUE_READ_SIZE];
+
+    if (!D2Memory::readMemory(address, prologue, sizeof(prologue))) {
+        return false;
+    }
+
+    D2TEMPLATE_DLL_FILES dllFile = getD2Offset().getDllFile();
+    BYTE* trampoline = (BYTE*) D2GameStubArena::allocateStub(dllFile,
+                       TRAMPOLINE_SIZE);
+
+    if (trampoline == nullptr) {
+        return false;
+    }
+
+    // Copy the instructions overwritten by the jump into the trampoline, then
+    // jump back to the first instruction that was left in place.
+    size_t sourceLength;
+    size_t trampolineLength;
+
+    if (!D2X86Decoder::relocateInstructions(prologue, address, sizeof(prologue),
+                                            JMP_SIZE, trampoline, (DWORD) trampoline, TRAMPOLINE_SIZE - JMP_SIZE,
+                                            sourceLength, trampolineLength)) {
+        D2GameStubArena::getInstance().sealStub((uintptr_t) trampoline,
+                TRAMPOLINE_SIZE);
+        D2GameStubArena::freeStub(dllFile, (DWORD) trampoline, TRAMPOLINE_SIZE);
+        return false;
+    }
+
+    trampoline[trampolineLength] = (BYTE) OpCode::JMP;
+    *((DWORD*) &trampoline[trampolineLength + 1]) = (address + sourceLength) -
+            ((DWORD) trampoline + trampolineLength + JMP_SIZE);
+
+    D2GameStubArena::getInstance().sealStub((uintptr_t) trampoline,
+            TRAMPOLINE_SIZE);
+    D2Memory::flushInstructionCache((DWORD) trampoline, TRAMPOLINE_SIZE);
+
+    preparedAddress = address;
+    relocatedLength = sourceLength;
+    trampolineAddress = (DWORD) trampoline;
+    return true;
+}
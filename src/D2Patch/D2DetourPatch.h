@@ -0,0 +1,69 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2DetourPatch.h                                                         *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2DetourPatch class, which redirects a Diablo II *
+ *   function to a replacement function, while moving the instructions it    *
+ *   overwrites into a trampoline so that the original function can still be *
+ *   called.                                                                 *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2DETOURPATCH_H
+#define _D2DETOURPATCH_H
+
+#include <windows.h>
+
+#include "D2BasePatch.h"
+#include "../D2Patch.h"
+#include "../D2Offset.h"
+
+class D2DetourPatch : public D2BasePatch {
+public:
+    D2DetourPatch(const D2Offset& d2Offset, void* const pDetour);
+    D2DetourPatch(D2DetourPatch&& d2DetourPatch) = default;
+
+    virtual bool buildPatchBuffer(DWORD address, BYTE* buffer) const override;
+    virtual size_t getWriteSize() const override;
+
+    void* getOriginalFunction() const;
+
+    template<class T>
+    T getOriginal() const {
+        return reinterpret_cast<T>(getOriginalFunction());
+    }
+
+private:
+    static constexpr size_t JMP_SIZE = 5;
+    static constexpr size_t PROLOGUE_READ_SIZE = 32;
+    static constexpr size_t TRAMPOLINE_SIZE = 64;
+
+    void* pDetour;
+
+    // The trampoline is built the first time the patch size is needed, since
+    // the size depends on the instructions found at the patched address.
+    mutable DWORD preparedAddress;
+    mutable DWORD trampolineAddress;
+    mutable size_t relocatedLength;
+
+    bool prepareTrampoline() const;
+};
+
+#endif
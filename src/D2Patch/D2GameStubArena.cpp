@@ -0,0 +1,165 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2GameStubArena.cpp                                                     *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the page allocator backed by the Windows virtual      *
+ *   memory functions, and the stub arena shared by every patch that needs   *
+ *   to generate code near a Diablo II module.                               *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2GameStubArena.h"
+
+#include <windows.h>
+#include <cstdint>
+
+#include "../D2Offset.h"
+#include "D2StubArena.h"
+
+D2VirtualPageAllocator::D2VirtualPageAllocator() {
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+
+    pageSize = systemInfo.dwPageSize;
+    allocationGranularity = systemInfo.dwAllocationGranularity;
+}
+
+size_t D2VirtualPageAllocator::getPageSize() const {
+    return pageSize;
+}
+
+size_t D2VirtualPageAllocator::getRegionSize() const {
+    return allocationGranularity;
+}
+
+uintptr_t D2VirtualPageAllocator::allocateNear(uintptr_t address,
+        size_t size) {
+    uintptr_t startAddress = address & ~(allocationGranularity - 1);
+
+    // Search above the module first, since the space right after an image
+    // is usually free, then search below it.
+    uintptr_t candidate = startAddress;
+
+    while (candidate - startAddress < MAX_SEARCH_DISTANCE) {
+        MEMORY_BASIC_INFORMATION memoryInfo;
+
+        if (VirtualQuery((LPCVOID) candidate, &memoryInfo, sizeof(memoryInfo)) == 0) {
+            break;
+        }
+
+        if (memoryInfo.State == MEM_FREE) {
+            uintptr_t regionAddress = tryAllocate(candidate, size);
+
+            if (regionAddress != 0) {
+                return regionAddress;
+            }
+        }
+
+        uintptr_t nextCandidate = ((uintptr_t) memoryInfo.BaseAddress +
+                                   memoryInfo.RegionSize + allocationGranularity - 1) & ~
+                                  (allocationGranularity - 1);
+
+        if (nextCandidate <= candidate) {
+            break;
+        }
+
+        candidate = nextCandidate;
+    }
+
+    candidate = startAddress;
+
+    while (candidate > allocationGranularity
+            && startAddress - candidate < MAX_SEARCH_DISTANCE) {
+        MEMORY_BASIC_INFORMATION memoryInfo;
+
+        if (VirtualQuery((LPCVOID)(candidate - 1), &memoryInfo,
+                         sizeof(memoryInfo)) == 0) {
+            break;
+        }
+
+        uintptr_t regionStart = (uintptr_t) memoryInfo.BaseAddress;
+
+        if (memoryInfo.State == MEM_FREE && candidate - regionStart >= size) {
+            uintptr_t regionAddress = tryAllocate((candidate - size) & ~
+                                                  (allocationGranularity - 1), size);
+
+            if (regionAddress != 0) {
+                return regionAddress;
+            }
+        }
+
+        uintptr_t allocationBase = (memoryInfo.State == MEM_FREE) ? regionStart :
+                                   (uintptr_t) memoryInfo.AllocationBase;
+        candidate = allocationBase & ~(allocationGranularity - 1);
+    }
+
+    // Nothing is free within the search distance, so take any address. It is
+    // still reachable with a rel32 displacement in a 32-bit process.
+    return tryAllocate(0, size);
+}
+
+bool D2VirtualPageAllocator::protect(uintptr_t address, size_t size,
+                                     D2PageProtection protection) {
+    DWORD newProtect;
+
+    switch (protection) {
+    case D2PageProtection::READ_WRITE:
+        newProtect = PAGE_READWRITE;
+        break;
+
+    case D2PageProtection::READ_EXECUTE:
+        newProtect = PAGE_EXECUTE_READ;
+        break;
+
+    default:
+        newProtect = PAGE_EXECUTE_READWRITE;
+        break;
+    }
+
+    DWORD oldProtect;
+    return VirtualProtect((LPVOID) address, size, newProtect,
+                          &oldProtect) != FALSE;
+}
+
+void D2VirtualPageAllocator::release(uintptr_t address, size_t size) {
+    VirtualFree((LPVOID) address, 0, MEM_RELEASE);
+}
+
+uintptr_t D2VirtualPageAllocator::tryAllocate(uintptr_t address,
+        size_t size) {
+    return (uintptr_t) VirtualAlloc((LPVOID) address, size,
+                                    MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+D2StubArena& D2GameStubArena::getInstance() {
+    static D2VirtualPageAllocator pageAllocator;
+    static D2StubArena stubArena(pageAllocator);
+    return stubArena;
+}
+
+DWORD D2GameStubArena::allocateStub(D2TEMPLATE_DLL_FILES dllFile,
+                                    size_t size) {
+    return (DWORD) getInstance().allocateStub((uintptr_t)
+            D2Offset::getDllAddress(dllFile), size);
+}
+
+void D2GameStubArena::freeStub(D2TEMPLATE_DLL_FILES dllFile,
+                               DWORD stubAddress, size_t size) {
+    getInstance().freeStub((uintptr_t) D2Offset::getDllAddress(dllFile),
+                           stubAddress, size);
+}
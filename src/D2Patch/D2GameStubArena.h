@@ -0,0 +1,68 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2GameStubArena.h                                                       *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the page allocator backed by the Windows virtual     *
+ *   memory functions, and the stub arena shared by every patch that needs   *
+ *   to generate code near a Diablo II module.                               *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2GAMESTUBARENA_H
+#define _D2GAMESTUBARENA_H
+
+#include <windows.h>
+#include <cstdint>
+
+#include "../D2Offset.h"
+#include "D2StubArena.h"
+
+class D2VirtualPageAllocator : public D2PageAllocator {
+public:
+    D2VirtualPageAllocator();
+
+    virtual size_t getPageSize() const override;
+    virtual size_t getRegionSize() const override;
+
+    virtual uintptr_t allocateNear(uintptr_t address, size_t size) override;
+    virtual bool protect(uintptr_t address, size_t size,
+                         D2PageProtection protection) override;
+    virtual void release(uintptr_t address, size_t size) override;
+
+private:
+    // The free regions near the module are only searched up to this
+    // distance, to bound the number of VirtualQuery calls. Beyond it any
+    // address will do, since a rel32 displacement reaches all of a 32-bit
+    // process.
+    static constexpr uintptr_t MAX_SEARCH_DISTANCE = 0x40000000;
+
+    size_t pageSize;
+    size_t allocationGranularity;
+
+    uintptr_t tryAllocate(uintptr_t address, size_t size);
+};
+
+namespace D2GameStubArena {
+D2StubArena& getInstance();
+DWORD allocateStub(D2TEMPLATE_DLL_FILES dllFile, size_t size);
+void freeStub(D2TEMPLATE_DLL_FILES dllFile, DWORD stubAddress, size_t size);
+}
+
+#endif
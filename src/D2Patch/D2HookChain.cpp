@@ -0,0 +1,54 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2HookChain.cpp                                                         *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the dispatchers of the D2HookChain record, which run  *
+ *   the handlers of a hook site each time its stub is entered.              *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2HookChain.h"
+
+#include <windows.h>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+void __stdcall D2HookChain::dispatchPre(const void* siteData,
+                                        D2HookContext* context) {
+    const D2HookChain* chain = ((const std::atomic<const D2HookChain*>*)
+                                siteData)->load(std::memory_order_acquire);
+    const D2HookHandler* handlers = chain->preHandlers.data();
+    size_t handlerCount = chain->preHandlers.size();
+
+    for (size_t i = 0; i < handlerCount; i++) {
+        handlers[i](context);
+    }
+}
+
+void __stdcall D2HookChain::dispatchPost(const void* siteData,
+        D2HookContext* context) {
+    const D2HookChain* chain = ((const std::atomic<const D2HookChain*>*)
+                                siteData)->load(std::memory_order_acquire);
+    const D2HookHandler* handlers = chain->postHandlers.data();
+    size_t handlerCount = chain->postHandlers.size();
+
+    for (size_t i = 0; i < handlerCount; i++) {
+        handlers[i](context);
+    }
+}
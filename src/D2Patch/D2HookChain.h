@@ -0,0 +1,53 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2HookChain.h                                                           *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2HookChain record, which holds the handlers of  *
+ *   one hook site in the order they run, and the dispatchers that the stub  *
+ *   of the site calls to run them.                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2HOOKCHAIN_H
+#define _D2HOOKCHAIN_H
+
+#include <windows.h>
+#include <atomic>
+#include <vector>
+
+struct D2HookContext;
+
+typedef void (__stdcall* D2HookHandler)(D2HookContext* context);
+
+// Published chains are never changed. A new chain is built for every change
+// and swapped in, so the stubs read the handlers without a lock.
+struct D2HookChain {
+    std::vector<D2HookHandler> preHandlers;
+    std::vector<D2HookHandler> postHandlers;
+
+    // The site data passed by the stub is the address of the atomic pointer
+    // to the chain of the site.
+    static void __stdcall dispatchPre(const void* siteData,
+                                      D2HookContext* context);
+    static void __stdcall dispatchPost(const void* siteData,
+                                       D2HookContext* context);
+};
+
+#endif
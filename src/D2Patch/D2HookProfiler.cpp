@@ -0,0 +1,314 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2HookProfiler.cpp                                                      *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the optional hook profiler. Every profiled target is  *
+ *   reached through a generated thunk that swaps the return address of the  *
+ *   call for a shared exit thunk, so the time spent in the target is        *
+ *   measured with RDTSC whatever its calling convention. Counts and log-    *
+ *   bucketed histograms are kept per thread, so that after its first call   *
+ *   a game thread never waits on a lock or shares a cache line.             *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2HookProfiler.h"
+
+#ifdef D2TEMPLATE_HOOK_PROFILING
+
+#include <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#include "../D2Memory.h"
+#include "../D2Offset.h"
+#include "../D2Patch.h"
+#include "D2GameStubArena.h"
+
+namespace {
+constexpr size_t CACHE_LINE_SIZE = 64;
+constexpr size_t ENTER_THUNK_SIZE = 32;
+constexpr size_t EXIT_THUNK_SIZE = 32;
+
+// Only the thread that owns the counters writes to them, so they are updated
+// with plain loads and stores, and read with relaxed loads by the snapshot.
+struct alignas(CACHE_LINE_SIZE) HookCounters {
+    std::atomic<uint64_t> callCount;
+    std::atomic<uint64_t> totalCycles;
+    std::atomic<uint64_t> buckets[D2HookProfiler::HISTOGRAM_BUCKETS];
+};
+
+struct ThreadCounters {
+    HookCounters hooks[D2HookProfiler::MAX_HOOKS];
+};
+
+struct CallFrame {
+    DWORD returnAddress;
+    uint32_t hookId;
+    uint64_t startCycles;
+};
+
+struct ShadowStack {
+    CallFrame frames[D2HookProfiler::MAX_CALL_DEPTH];
+    size_t depth;
+    ThreadCounters* counters;
+};
+
+struct ProfiledHook {
+    DWORD siteAddress;
+    DWORD targetAddress;
+    DWORD enterThunk;
+};
+
+struct ProfilerState {
+    std::mutex mutex;
+    std::vector<ProfiledHook> hooks;
+    std::vector<std::unique_ptr<ThreadCounters>> threadCounters;
+    DWORD exitThunk;
+};
+
+ProfilerState& getState() {
+    static ProfilerState state;
+    return state;
+}
+
+thread_local ShadowStack shadowStack;
+
+// Counters outlive their thread, so that its calls still show up in later
+// snapshots. The lock is only taken the first time a thread is profiled.
+ThreadCounters* getThreadCounters() {
+    if (shadowStack.counters == nullptr) {
+        ProfilerState& state = getState();
+        std::unique_ptr<ThreadCounters> counters(new ThreadCounters());
+
+        std::lock_guard<std::mutex> stateLock(state.mutex);
+        shadowStack.counters = counters.get();
+        state.threadCounters.push_back(std::move(counters));
+    }
+
+    return shadowStack.counters;
+}
+
+size_t getBucket(uint64_t cycles) {
+    size_t bucket = 0;
+
+    while (cycles > 1 && bucket < D2HookProfiler::HISTOGRAM_BUCKETS - 1) {
+        cycles >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+void increment(std::atomic<uint64_t>& counter, uint64_t amount) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount,
+                  std::memory_order_relaxed);
+}
+
+void __stdcall enterHook(uint32_t hookId, DWORD* returnSlot) {
+    // Calls nested deeper than the shadow stack are not profiled, and return
+    // to their caller directly.
+    if (shadowStack.depth == D2HookProfiler::MAX_CALL_DEPTH) {
+        return;
+    }
+
+    CallFrame& callFrame = shadowStack.frames[shadowStack.depth++];
+    callFrame.returnAddress = *returnSlot;
+    callFrame.hookId = hookId;
+    *returnSlot = getState().exitThunk;
+    callFrame.startCycles = __rdtsc();
+}
+
+DWORD __stdcall exitHook() {
+    uint64_t endCycles = __rdtsc();
+    const CallFrame& callFrame = shadowStack.frames[--shadowStack.depth];
+    uint64_t cycles = endCycles - callFrame.startCycles;
+
+    HookCounters& hookCounters = getThreadCounters()->hooks[callFrame.hookId];
+    increment(hookCounters.callCount, 1);
+    increment(hookCounters.totalCycles, cycles);
+    increment(hookCounters.buckets[getBucket(cycles)], 1);
+
+    return callFrame.returnAddress;
+}
+
+void writeRelative(BYTE* code, DWORD codeAddress, size_t offset,
+                   const void* target) {
+    *((DWORD*) &code[offset]) = (DWORD) target - (codeAddress + offset + sizeof(
+                                    DWORD));
+}
+
+// Saves the registers that can hold results, asks exitHook for the original
+// return address, and returns there.
+bool buildExitThunk(D2TEMPLATE_DLL_FILES dllFile, DWORD& exitThunk) {
+    static const BYTE EXIT_THUNK[] = {
+        0x83, 0xEC, 0x04,             // sub esp, 4
+        0x50,                         // push eax
+        0x52,                         // push edx
+        0x51,                         // push ecx
+        0xE8, 0x00, 0x00, 0x00, 0x00, // call exitHook
+        0x89, 0x44, 0x24, 0x0C,       // mov [esp + 12], eax
+        0x59,                         // pop ecx
+        0x5A,                         // pop edx
+        0x58,                         // pop eax
+        0xC3                          // ret
+    };
+
+    exitThunk = D2GameStubArena::allocateStub(dllFile, EXIT_THUNK_SIZE);
+
+    if (exitThunk == 0) {
+        return false;
+    }
+
+    BYTE* code = (BYTE*) exitThunk;
+    std::copy(std::begin(EXIT_THUNK), std::end(EXIT_THUNK), code);
+    writeRelative(code, exitThunk, 7, (const void*) &exitHook);
+    D2GameStubArena::getInstance().sealStub(exitThunk, EXIT_THUNK_SIZE);
+    return true;
+}
+
+// Saves the registers that can hold arguments, lets enterHook swap the
+// return address, and jumps to the target.
+DWORD buildEnterThunk(D2TEMPLATE_DLL_FILES dllFile, uint32_t hookId,
+                      void* target) {
+    static const BYTE ENTER_THUNK[] = {
+        0x50,                         // push eax
+        0x51,                         // push ecx
+        0x52,                         // push edx
+        0x8D, 0x44, 0x24, 0x0C,       // lea eax, [esp + 12]
+        0x50,                         // push eax
+        0x68, 0x00, 0x00, 0x00, 0x00, // push hookId
+        0xE8, 0x00, 0x00, 0x00, 0x00, // call enterHook
+        0x5A,                         // pop edx
+        0x59,                         // pop ecx
+        0x58,                         // pop eax
+        0xE9, 0x00, 0x00, 0x00, 0x00  // jmp target
+    };
+
+    DWORD enterThunk = D2GameStubArena::allocateStub(dllFile, ENTER_THUNK_SIZE);
+
+    if (enterThunk == 0) {
+        return 0;
+    }
+
+    BYTE* code = (BYTE*) enterThunk;
+    std::copy(std::begin(ENTER_THUNK), std::end(ENTER_THUNK), code);
+    *((DWORD*) &code[9]) = hookId;
+    writeRelative(code, enterThunk, 14, (const void*) &enterHook);
+    writeRelative(code, enterThunk, 22, target);
+    D2GameStubArena::getInstance().sealStub(enterThunk, ENTER_THUNK_SIZE);
+    return enterThunk;
+}
+
+uint64_t getPercentile(const uint64_t* buckets, uint64_t callCount,
+                       double percentile) {
+    if (callCount == 0) {
+        return 0;
+    }
+
+    uint64_t threshold = (uint64_t)(callCount * percentile);
+    uint64_t seenCount = 0;
+
+    for (size_t i = 0; i < D2HookProfiler::HISTOGRAM_BUCKETS; i++) {
+        seenCount += buckets[i];
+
+        if (seenCount > threshold) {
+            return (uint64_t) 2 << i;
+        }
+    }
+
+    return (uint64_t) 2 << (D2HookProfiler::HISTOGRAM_BUCKETS - 1);
+}
+}
+
+void* D2HookProfiler::wrapTarget(D2TEMPLATE_DLL_FILES dllFile,
+                                 DWORD siteAddress, void* target) {
+    ProfilerState& state = getState();
+    std::lock_guard<std::mutex> stateLock(state.mutex);
+
+    for (const auto& hook : state.hooks) {
+        if (hook.siteAddress == siteAddress && hook.targetAddress == (DWORD) target) {
+            return (void*) hook.enterThunk;
+        }
+    }
+
+    if (state.hooks.size() == MAX_HOOKS
+            || (state.exitThunk == 0 && !buildExitThunk(dllFile, state.exitThunk))) {
+        return target;
+    }
+
+    DWORD enterThunk = buildEnterThunk(dllFile, (uint32_t) state.hooks.size(),
+                                       target);
+
+    if (enterThunk == 0) {
+        return target;
+    }
+
+    D2Memory::flushInstructionCache(0, 0);
+    state.hooks.push_back({ siteAddress, (DWORD) target, enterThunk });
+    return (void*) enterThunk;
+}
+
+std::vector<D2HookProfile> D2HookProfiler::takeSnapshot(
+    D2HookProfileOrder order) {
+    ProfilerState& state = getState();
+    std::lock_guard<std::mutex> stateLock(state.mutex);
+    std::vector<D2HookProfile> profiles;
+
+    for (size_t hookId = 0; hookId < state.hooks.size(); hookId++) {
+        D2HookProfile profile = { (uint32_t) hookId, state.hooks[hookId].siteAddress,
+                                  state.hooks[hookId].targetAddress, 0, 0, 0
+                                };
+        uint64_t buckets[HISTOGRAM_BUCKETS] = {};
+
+        for (const auto& threadCounters : state.threadCounters) {
+            const HookCounters& hookCounters = threadCounters->hooks[hookId];
+
+            profile.callCount += hookCounters.callCount.load(std::memory_order_relaxed);
+            profile.totalCycles += hookCounters.totalCycles.load(
+                                       std::memory_order_relaxed);
+
+            for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+                buckets[i] += hookCounters.buckets[i].load(std::memory_order_relaxed);
+            }
+        }
+
+        profile.p99Cycles = getPercentile(buckets, profile.callCount, 0.99);
+        profiles.push_back(profile);
+    }
+
+    std::sort(profiles.begin(), profiles.end(), [order](const D2HookProfile & left,
+    const D2HookProfile & right) {
+        return (order == D2HookProfileOrder::TOTAL_CYCLES) ?
+               left.totalCycles > right.totalCycles : left.p99Cycles > right.p99Cycles;
+    });
+
+    return profiles;
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2HookProfiler.h                                                        *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the optional hook profiler, which counts the calls   *
+ *   made to every interceptor and detour target and measures how long they  *
+ *   take. It is only built when D2TEMPLATE_HOOK_PROFILING is defined, and   *
+ *   costs nothing otherwise.                                                *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2HOOKPROFILER_H
+#define _D2HOOKPROFILER_H
+
+#include <windows.h>
+
+#include "../D2Offset.h"
+
+#ifdef D2TEMPLATE_HOOK_PROFILING
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct D2HookProfile {
+    uint32_t hookId;
+    DWORD siteAddress;
+    DWORD targetAddress;
+    uint64_t callCount;
+    uint64_t totalCycles;
+    // The upper bound of the histogram bucket holding the 99th percentile.
+    uint64_t p99Cycles;
+};
+
+enum class D2HookProfileOrder : int {
+    TOTAL_CYCLES,
+    P99_CYCLES
+};
+
+namespace D2HookProfiler {
+static constexpr size_t MAX_HOOKS = 256;
+static constexpr size_t HISTOGRAM_BUCKETS = 40;
+static constexpr size_t MAX_CALL_DEPTH = 256;
+
+// Returns a thunk that times every call made to the target through the site,
+// or the target itself if no thunk could be made. The site must be entered
+// by a call, with the return address on top of the stack. Wrapping the same
+// site and target again returns the same thunk, so that patches can be
+// rebuilt without using up hooks.
+void* wrapTarget(D2TEMPLATE_DLL_FILES dllFile, DWORD siteAddress,
+                 void* target);
+
+// Merges the counters of every thread without stopping them. A call that is
+// being recorded while the snapshot is taken may be missed.
+std::vector<D2HookProfile> takeSnapshot(D2HookProfileOrder order);
+}
+
+#else
+
+namespace D2HookProfiler {
+inline void* wrapTarget(D2TEMPLATE_DLL_FILES, DWORD, void* target) {
+    return target;
+}
+}
+
+#endif
+
+#endif
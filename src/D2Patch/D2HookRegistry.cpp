@@ -0,0 +1,177 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2HookRegistry.cpp                                                      *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2HookRegistry class, which lets any number of    *
+ *   handlers subscribe to the same site in the game's code. Each site gets  *
+ *   one generated stub, which calls the handlers through flat arrays that   *
+ *   are swapped atomically when handlers are added or removed.              *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2HookRegistry.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../D2Offset.h"
+#include "D2HookChain.h"
+#include "D2HookSitePatch.h"
+#include "D2PatchTransaction.h"
+
+namespace {
+// The sites are recorded under this owner in the interval index.
+constexpr char OWNER_NAME[] = "D2HookRegistry";
+}
+
+D2HookRegistry::D2HookRegistry() : nextSubscriptionId(1) {
+}
+
+D2HookRegistry& D2HookRegistry::getInstance() {
+    static D2HookRegistry hookRegistry;
+    return hookRegistry;
+}
+
+D2HookRegistry::SubscriptionId D2HookRegistry::subscribe(
+    const D2Offset& site, D2HookPhase phase, int priority,
+    D2HookHandler handler) {
+    DWORD address = site.getCurrentAddress();
+
+    if (address == 0 || handler == nullptr) {
+        return INVALID_SUBSCRIPTION;
+    }
+
+    std::lock_guard<std::mutex> registryLock(registryMutex);
+    HookSite* hookSite = findSite(address);
+
+    if (hookSite == nullptr) {
+        std::unique_ptr<HookSite> newSite(new HookSite());
+        newSite->address = address;
+        newSite->chain = nullptr;
+        newSite->sitePatch.reset(new D2HookSitePatch(site, &newSite->chain,
+                                 &D2HookChain::dispatchPre, &D2HookChain::dispatchPost));
+
+        hookSite = newSite.get();
+        sites.push_back(std::move(newSite));
+    }
+
+    SubscriptionId subscriptionId = nextSubscriptionId++;
+    hookSite->subscriptions.push_back({ subscriptionId, phase, priority, handler });
+
+    // Publish the handlers before the site is patched, so that the stub
+    // never runs without a chain.
+    publishChain(*hookSite);
+
+    if (!hookSite->sitePatch->isApplied() && !writeSite(*hookSite, true)) {
+        hookSite->subscriptions.pop_back();
+        publishChain(*hookSite);
+        return INVALID_SUBSCRIPTION;
+    }
+
+    return subscriptionId;
+}
+
+bool D2HookRegistry::unsubscribe(SubscriptionId subscriptionId) {
+    std::lock_guard<std::mutex> registryLock(registryMutex);
+
+    for (auto& hookSite : sites) {
+        auto subscription = std::find_if(hookSite->subscriptions.begin(),
+        hookSite->subscriptions.end(), [subscriptionId](const Subscription & existing) {
+            return existing.subscriptionId == subscriptionId;
+        });
+
+        if (subscription == hookSite->subscriptions.end()) {
+            continue;
+        }
+
+        // The site is restored before its last handler is removed, so that
+        // the handler is kept, along with the chain that runs it, if the site
+        // cannot be restored. The stub stays allocated, since a thread may
+        // still be inside of it, and is reused if the site is subscribed to
+        // again.
+        if (hookSite->subscriptions.size() == 1 && !writeSite(*hookSite, false)) {
+            return false;
+        }
+
+        hookSite->subscriptions.erase(subscription);
+        publishChain(*hookSite);
+        return true;
+    }
+
+    return false;
+}
+
+size_t D2HookRegistry::getHandlerCount(const D2Offset& site) const {
+    DWORD address = site.getCurrentAddress();
+    std::lock_guard<std::mutex> registryLock(registryMutex);
+    HookSite* hookSite = findSite(address);
+
+    return (hookSite != nullptr) ? hookSite->subscriptions.size() : 0;
+}
+
+D2HookRegistry::HookSite* D2HookRegistry::findSite(DWORD address) const {
+    for (const auto& hookSite : sites) {
+        if (hookSite->address == address) {
+            return hookSite.get();
+        }
+    }
+
+    return nullptr;
+}
+
+bool D2HookRegistry::writeSite(HookSite& site, bool applied) {
+    // Subscriptions change while the game is running, so the site is written
+    // with the other threads suspended, and never while one of them is
+    // running the instructions that the jump displaces.
+    D2PatchTransaction transaction;
+    transaction.setOwner(OWNER_NAME);
+    transaction.addPatch(*site.sitePatch);
+
+    return applied ? transaction.commit() : transaction.revert();
+}
+
+void D2HookRegistry::publishChain(HookSite& site) {
+    std::vector<Subscription> sortedSubscriptions = site.subscriptions;
+    std::stable_sort(sortedSubscriptions.begin(), sortedSubscriptions.end(),
+    [](const Subscription & left, const Subscription & right) {
+        return left.priority < right.priority;
+    });
+
+    std::unique_ptr<D2HookChain> chain(new D2HookChain());
+
+    for (const auto& subscription : sortedSubscriptions) {
+        if (subscription.phase == D2HookPhase::PRE) {
+            chain->preHandlers.push_back(subscription.handler);
+        }
+    }
+
+    for (auto it = sortedSubscriptions.crbegin(); it != sortedSubscriptions.crend();
+            ++it) {
+        if (it->phase == D2HookPhase::POST) {
+            chain->postHandlers.push_back(it->handler);
+        }
+    }
+
+    site.chain.store(chain.get(), std::memory_order_release);
+    site.chains.push_back(std::move(chain));
+}
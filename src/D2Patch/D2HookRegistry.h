@@ -0,0 +1,98 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2HookRegistry.h                                                        *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2HookRegistry class, which lets any number of   *
+ *   handlers subscribe to the same site in the game's code.                 *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2HOOKREGISTRY_H
+#define _D2HOOKREGISTRY_H
+
+#include <windows.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "../D2Offset.h"
+#include "D2HookChain.h"
+#include "D2HookSitePatch.h"
+
+enum class D2HookPhase : int {
+    // Runs before the instructions at the site.
+    PRE,
+    // Runs after the instructions at the site, such as after a hooked call
+    // returned its value in eax.
+    POST
+};
+
+class D2HookRegistry {
+public:
+    typedef uint32_t SubscriptionId;
+
+    static constexpr SubscriptionId INVALID_SUBSCRIPTION = 0;
+
+    static D2HookRegistry& getInstance();
+
+    // Pre handlers run from the lowest priority value to the highest, and
+    // post handlers in the reverse order, so that each handler wraps the ones
+    // after it. Handlers of equal priority run in the order they were added.
+    // The site is patched with the first subscription.
+    SubscriptionId subscribe(const D2Offset& site, D2HookPhase phase,
+                             int priority, D2HookHandler handler);
+    // The site is restored once its last handler is removed.
+    bool unsubscribe(SubscriptionId subscriptionId);
+
+    size_t getHandlerCount(const D2Offset& site) const;
+
+private:
+    struct Subscription {
+        SubscriptionId subscriptionId;
+        D2HookPhase phase;
+        int priority;
+        D2HookHandler handler;
+    };
+
+    struct HookSite {
+        DWORD address;
+        std::atomic<const D2HookChain*> chain;
+        std::vector<Subscription> subscriptions;
+        std::unique_ptr<D2HookSitePatch> sitePatch;
+
+        // A thread may still be running a chain that was swapped out, so
+        // retired chains are kept for as long as the registry exists.
+        std::vector<std::unique_ptr<D2HookChain>> chains;
+    };
+
+    mutable std::mutex registryMutex;
+    std::vector<std::unique_ptr<HookSite>> sites;
+    SubscriptionId nextSubscriptionId;
+
+    D2HookRegistry();
+
+    HookSite* findSite(DWORD address) const;
+    bool writeSite(HookSite& site, bool applied);
+    void publishChain(HookSite& site);
+};
+
+#endif
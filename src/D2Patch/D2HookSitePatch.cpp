@@ -0,0 +1,161 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2HookSitePatch.cpp                                                     *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2HookSitePatch class, which redirects a site in  *
+ *   the game's code to a generated stub that calls the hook dispatchers     *
+ *   around the instructions it displaced.                                   *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2HookSitePatch.h"
+
+#include <windows.h>
+
+#include "../D2Memory.h"
+#include "../D2Offset.h"
+#include "../D2Patch.h"
+#include "D2BasePatch.h"
+#include "D2GameStubArena.h"
+#include "D2X86Decoder.h"
+
+namespace {
+constexpr BYTE PUSHFD = 0x9C;
+constexpr BYTE PUSHAD = 0x60;
+constexpr BYTE POPAD = 0x61;
+constexpr BYTE POPFD = 0x9D;
+constexpr BYTE PUSH_ESP = 0x54;
+constexpr BYTE PUSH_IMM32 = 0x68;
+
+// PUSHFD, PUSHAD, PUSH ESP, PUSH imm32, CALL rel32, POPAD, POPFD
+constexpr size_t DISPATCHER_CALL_SIZE = 15;
+
+// Emits the code that saves every register, calls the dispatcher with the
+// site data and the saved registers, and loads the registers back.
+size_t emitDispatcherCall(BYTE* stub, DWORD stubAddress, const void* siteData,
+                          D2HookDispatcher dispatcher) {
+    size_t length = 0;
+
+    stub[length++] = PUSHFD;
+    stub[length++] = PUSHAD;
+    stub[length++] = PUSH_ESP;
+    stub[length++] = PUSH_IMM32;
+    *((DWORD*) &stub[length]) = (DWORD) siteData;
+    length += sizeof(DWORD);
+    stub[length++] = (BYTE) OpCode::CALL;
+    *((DWORD*) &stub[length]) = (DWORD) dispatcher - (stubAddress + length +
+                                sizeof(DWORD));
+    length += sizeof(DWORD);
+    stub[length++] = POPAD;
+    stub[length++] = POPFD;
+
+    return length;
+}
+}
+
+D2HookSitePatch::D2HookSitePatch(const D2Offset& d2Offset,
+                                 const void* siteData, D2HookDispatcher preDispatcher,
+                                 D2HookDispatcher postDispatcher) : D2BasePatch(d2Offset, 0),
+    siteData(siteData), preDispatcher(preDispatcher),
+    postDispatcher(postDispatcher), preparedAddress(0), stubAddress(0),
+    relocatedLength(0) {
+}
+
+bool D2HookSitePatch::buildPatchBuffer(DWORD address, BYTE* buffer) const {
+    if (!prepareStub() || address != preparedAddress) {
+        return false;
+    }
+
+    // Jump to the stub, and fill the rest of the displaced instructions with
+    // NOP.
+    buffer[0] = (BYTE) OpCode::JMP;
+    *((DWORD*) &buffer[1]) = stubAddress - (address + JMP_SIZE);
+
+    for (size_t i = JMP_SIZE; i < relocatedLength; i++) {
+        buffer[i] = (BYTE) OpCode::NOP;
+    }
+
+    return true;
+}
+
+size_t D2HookSitePatch::getWriteSize() const {
+    return prepareStub() ? relocatedLength : 0;
+}
+
+DWORD D2HookSitePatch::getStubAddress() const {
+    return prepareStub() ? stubAddress : 0;
+}
+
+bool D2HookSitePatch::prepareStub() const {
+    if (stubAddress != 0) {
+        return true;
+    }
+
+    DWORD address = getD2Offset().getCurrentAddress();
+
+    if (address == 0) {
+        return false;
+    }
+
+    BYTE site[SITE_READ_SIZE];
+
+    if (!D2Memory::readMemory(address, site, sizeof(site))) {
+        return false;
+    }
+
+    D2TEMPLATE_DLL_FILES dllFile = getD2Offset().getDllFile();
+    DWORD stub = D2GameStubArena::allocateStub(dllFile, STUB_SIZE);
+
+    if (stub == 0) {
+        return false;
+    }
+
+    BYTE* stubCode = (BYTE*) stub;
+    size_t stubLength = emitDispatcherCall(stubCode, stub, siteData,
+                                           preDispatcher);
+
+    // The displaced instructions run between the two dispatcher calls, and
+    // the stub then jumps back to the first instruction left in place.
+    size_t sourceLength;
+    size_t displacedLength;
+
+    if (!D2X86Decoder::relocateInstructions(site, address, sizeof(site), JMP_SIZE,
+                                            &stubCode[stubLength], stub + stubLength,
+                                            STUB_SIZE - stubLength - DISPATCHER_CALL_SIZE - JMP_SIZE, sourceLength,
+                                            displacedLength)) {
+        D2GameStubArena::getInstance().sealStub(stub, STUB_SIZE);
+        D2GameStubArena::freeStub(dllFile, stub, STUB_SIZE);
+        return false;
+    }
+
+    stubLength += displacedLength;
+    stubLength += emitDispatcherCall(&stubCode[stubLength], stub + stubLength,
+                                     siteData, postDispatcher);
+
+    stubCode[stubLength] = (BYTE) OpCode::JMP;
+    *((DWORD*) &stubCode[stubLength + 1]) = (address + sourceLength) -
+                                            (stub + stubLength + JMP_SIZE);
+
+    D2GameStubArena::getInstance().sealStub(stub, STUB_SIZE);
+    D2Memory::flushInstructionCache(stub, STUB_SIZE);
+
+    preparedAddress = address;
+    relocatedLength = sourceLength;
+    stubAddress = stub;
+    return true;
+}
@@ -0,0 +1,85 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2HookSitePatch.h                                                       *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2HookSitePatch class, which redirects a site in *
+ *   the game's code to a generated stub that calls the hook dispatchers     *
+ *   around the instructions it displaced.                                   *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2HOOKSITEPATCH_H
+#define _D2HOOKSITEPATCH_H
+
+#include <windows.h>
+
+#include "D2BasePatch.h"
+#include "../D2Offset.h"
+
+// The registers saved by the stub, in the order PUSHFD and PUSHAD leave them
+// on the stack. Handlers may change any of them except esp, and the changes
+// are loaded back when the stub continues.
+struct D2HookContext {
+    DWORD edi;
+    DWORD esi;
+    DWORD ebp;
+    DWORD esp;
+    DWORD ebx;
+    DWORD edx;
+    DWORD ecx;
+    DWORD eax;
+    DWORD eflags;
+};
+
+typedef void (__stdcall* D2HookDispatcher)(const void* siteData,
+        D2HookContext* context);
+
+class D2HookSitePatch : public D2BasePatch {
+public:
+    // The stub passes siteData to the pre dispatcher before the displaced
+    // instructions run, and to the post dispatcher after they ran.
+    D2HookSitePatch(const D2Offset& d2Offset, const void* siteData,
+                    D2HookDispatcher preDispatcher, D2HookDispatcher postDispatcher);
+    D2HookSitePatch(D2HookSitePatch&& d2HookSitePatch) = default;
+
+    virtual bool buildPatchBuffer(DWORD address, BYTE* buffer) const override;
+    virtual size_t getWriteSize() const override;
+
+    DWORD getStubAddress() const;
+
+private:
+    static constexpr size_t JMP_SIZE = 5;
+    static constexpr size_t SITE_READ_SIZE = 32;
+    static constexpr size_t STUB_SIZE = 128;
+
+    const void* siteData;
+    D2HookDispatcher preDispatcher;
+    D2HookDispatcher postDispatcher;
+
+    // The stub is generated the first time the patch size is needed, since
+    // the size depends on the instructions found at the patched address.
+    mutable DWORD preparedAddress;
+    mutable DWORD stubAddress;
+    mutable size_t relocatedLength;
+
+    bool prepareStub() const;
+};
+
+#endif
@@ -30,6 +30,7 @@
 
 #include "../D2Offset.h"
 #include "D2BasePatch.h"
+#include "D2HookProfiler.h"
 
 D2InterceptorPatch::D2InterceptorPatch(const D2Offset& d2Offset,
                                        const OpCode& opCode, void* const pFunc,
@@ -37,34 +38,20 @@ D2InterceptorPatch::D2InterceptorPatch(const D2Offset& d2Offset,
     pFunc(pFunc) {
 }
 
-bool D2InterceptorPatch::applyPatch() const {
-    HANDLE gameHandle = GetCurrentProcess();
-
-    // Do not patch if the no patch flag is set.
-    if ((getD2Offset().getCurrentOffset() & D2Patch::NO_PATCH) ==
-            D2Patch::NO_PATCH) {
-        return true;
-    }
-
-    // Grab the address for the correct version.
-    LPVOID targetAddress = (LPVOID) getD2Offset().getCurrentAddress();
-
-    if (targetAddress == 0) {
-        return false;
-    }
-
-    // Get the relative address of the function pointer. Add one due to opcode.
-    void* pRelativeFunc = (void*)((size_t) pFunc - ((DWORD)targetAddress + sizeof(
-                                      pFunc) + 1));
-
+bool D2InterceptorPatch::buildPatchBuffer(DWORD address, BYTE* buffer) const {
     // Cannot patch a function call with less than 5 bytes.
     if (getPatchSize() < 5) {
         return false;
     }
 
-    // Create the buffer that will store the patch code, and the fill the rest
-    // with NOP.
-    std::unique_ptr<BYTE[]> buffer(new BYTE[getPatchSize()]);
+    // Only calls can be profiled, since the profiler needs a return address.
+    void* pTarget = (getOpCode() == OpCode::CALL) ? D2HookProfiler::wrapTarget(
+                        getD2Offset().getDllFile(), address, pFunc) : pFunc;
+
+    // Get the relative address of the function pointer. Add one due to opcode.
+    void* pRelativeFunc = (void*)((size_t) pTarget - (address + sizeof(pFunc) + 1));
+
+    // Fill the buffer with the patch code, and the fill the rest with NOP.
     buffer[0] = (int) getOpCode();
     *((void**)&buffer[1]) = pRelativeFunc;
 
@@ -72,18 +59,6 @@ bool D2InterceptorPatch::applyPatch() const {
         buffer[i] = (BYTE) OpCode::NOP;
     }
 
-    // Write the patch into the game's memory region.
-    DWORD oldProtect;
-    VirtualProtect(targetAddress, getPatchSize(), PAGE_EXECUTE_READWRITE,
-                   &oldProtect);
-    bool writeSuccess = WriteProcessMemory(gameHandle, targetAddress,
-                                           buffer.get(), getPatchSize(), nullptr);
-    VirtualProtect(targetAddress, getPatchSize(), oldProtect, &oldProtect);
-
-    if (!writeSuccess) {
-        return false;
-    }
-
     return true;
 }
 
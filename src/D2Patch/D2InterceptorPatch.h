@@ -40,7 +40,7 @@ public:
                        void* const pFunc, const size_t patchSize);
     D2InterceptorPatch(D2InterceptorPatch&& d2InterceptorPatch) = default;
 
-    virtual bool applyPatch() const override;
+    virtual bool buildPatchBuffer(DWORD address, BYTE* buffer) const override;
     OpCode getOpCode() const;
 
 private:
@@ -0,0 +1,97 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PatchDescriptor.cpp                                                   *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the functions used by the D2PatchDescriptor record    *
+ *   that only depend on the record itself, so that they can also be used by *
+ *   tools that patch the game files offline.                                *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2PatchDescriptor.h"
+
+#include <windows.h>
+#include <cstddef>
+#include <cstdint>
+
+#include "../D2Patch.h"
+#include "../D2Version.h"
+
+long long int D2PatchDescriptor::getOffset(GameVersion gameVersion) const {
+    return offsetTable.offsets[(int) gameVersion];
+}
+
+bool D2PatchDescriptor::isNoPatch(GameVersion gameVersion) const {
+    return (getOffset(gameVersion) & D2Patch::NO_PATCH) == D2Patch::NO_PATCH;
+}
+
+size_t D2PatchDescriptor::getWriteSize() const {
+    if (kind == D2PatchKind::ANY && patchSize == 0) {
+        return sizeof(data);
+    }
+
+    return patchSize;
+}
+
+bool D2PatchDescriptor::isValid(DWORD address) const {
+    if (address == 0) {
+        return false;
+    }
+
+    // Cannot patch a function call with less than 5 bytes.
+    if (kind == D2PatchKind::INTERCEPTOR && patchSize < 5) {
+        return false;
+    }
+
+    return true;
+}
+
+void D2PatchDescriptor::fillPatchBuffer(DWORD address, size_t start,
+                                        BYTE* buffer, size_t count) const {
+    fillPatchBuffer(address, (DWORD)(uintptr_t) pFunc, start, buffer, count);
+}
+
+void D2PatchDescriptor::fillPatchBuffer(DWORD address, DWORD targetAddress,
+                                        size_t start, BYTE* buffer, size_t count) const {
+    DWORD dwData = data;
+
+    if (kind == D2PatchKind::INTERCEPTOR) {
+        // Get the relative address of the target. Add one due to opcode.
+        dwData = targetAddress - (address + sizeof(DWORD) + 1);
+    } else if (relative) {
+        dwData = dwData - (address + sizeof(dwData));
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        size_t index = start + i;
+
+        if (kind == D2PatchKind::INTERCEPTOR) {
+            if (index == 0) {
+                buffer[i] = (BYTE) data;
+            } else if (index <= sizeof(DWORD)) {
+                buffer[i] = (BYTE)(dwData >> ((index - 1) * 8));
+            } else {
+                buffer[i] = (BYTE) OpCode::NOP;
+            }
+        } else if (patchSize > 0) {
+            buffer[i] = (BYTE) dwData;
+        } else {
+            buffer[i] = (BYTE)(dwData >> (index * 8));
+        }
+    }
+}
@@ -0,0 +1,140 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PatchDescriptor.h                                                     *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2PatchDescriptor record, which describes a      *
+ *   patch as constant data so that a patch table can be built at compile    *
+ *   time and applied without any allocation.                                *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2PATCHDESCRIPTOR_H
+#define _D2PATCHDESCRIPTOR_H
+
+#include <windows.h>
+#include <initializer_list>
+#include <utility>
+
+#include "../D2Offset.h"
+#include "../D2OffsetDatabase.h"
+#include "../D2Version.h"
+
+enum class OpCode : BYTE;
+
+class D2PatchTransaction;
+
+enum class D2PatchKind : int {
+    ANY,
+    INTERCEPTOR
+};
+
+typedef void (*D2PatchFunction)();
+
+struct D2PatchDescriptor {
+    D2PatchKind kind;
+    D2TEMPLATE_DLL_FILES dllFile;
+    D2OffsetTable offsetTable;
+
+    // The data written by ANY patches, or the opcode of INTERCEPTOR patches.
+    DWORD data;
+    bool relative;
+    D2PatchFunction pFunc;
+    size_t patchSize;
+
+    static constexpr D2PatchDescriptor makeAnyPatch(
+        D2TEMPLATE_DLL_FILES dllFile, const D2OffsetTable& offsetTable,
+        DWORD data, bool relative, size_t patchSize) {
+        return { D2PatchKind::ANY, dllFile, offsetTable, data, relative, nullptr,
+                 patchSize };
+    }
+
+    static constexpr D2PatchDescriptor makeAnyPatch(
+        D2TEMPLATE_DLL_FILES dllFile,
+        std::initializer_list<std::pair<GameVersion, long long int>> offsets,
+        DWORD data, bool relative, size_t patchSize) {
+        return makeAnyPatch(dllFile, D2OffsetTable::make(offsets), data, relative,
+                            patchSize);
+    }
+
+    static constexpr D2PatchDescriptor makeAnyPatch(
+        D2TEMPLATE_DLL_FILES dllFile,
+        std::initializer_list<std::pair<GameVersion, long long int>> offsets,
+        OpCode opCode, bool relative, size_t patchSize) {
+        return makeAnyPatch(dllFile, offsets, (DWORD) opCode, relative, patchSize);
+    }
+
+    // Takes the offsets and DLL listed in D2Offsets.tsv.
+    static constexpr D2PatchDescriptor makeAnyPatch(D2OffsetId offsetId,
+            OpCode opCode, bool relative, size_t patchSize) {
+        return makeAnyPatch(D2OffsetDatabase::getDllFile(offsetId),
+                            D2OffsetDatabase::getOffsetTable(offsetId), (DWORD) opCode, relative,
+                            patchSize);
+    }
+
+    static constexpr D2PatchDescriptor makeInterceptorPatch(
+        D2TEMPLATE_DLL_FILES dllFile, const D2OffsetTable& offsetTable,
+        OpCode opCode, D2PatchFunction pFunc, size_t patchSize) {
+        return { D2PatchKind::INTERCEPTOR, dllFile, offsetTable, (DWORD) opCode,
+                 false, pFunc, patchSize };
+    }
+
+    static constexpr D2PatchDescriptor makeInterceptorPatch(
+        D2TEMPLATE_DLL_FILES dllFile,
+        std::initializer_list<std::pair<GameVersion, long long int>> offsets,
+        OpCode opCode, D2PatchFunction pFunc, size_t patchSize) {
+        return makeInterceptorPatch(dllFile, D2OffsetTable::make(offsets), opCode,
+                                    pFunc, patchSize);
+    }
+
+    static constexpr D2PatchDescriptor makeInterceptorPatch(D2OffsetId offsetId,
+            OpCode opCode, D2PatchFunction pFunc, size_t patchSize) {
+        return makeInterceptorPatch(D2OffsetDatabase::getDllFile(offsetId),
+                                    D2OffsetDatabase::getOffsetTable(offsetId), opCode, pFunc, patchSize);
+    }
+
+    long long int getOffset(GameVersion gameVersion) const;
+    bool isNoPatch(GameVersion gameVersion) const;
+
+    long long int getCurrentOffset() const;
+    DWORD getCurrentAddress() const;
+    bool isNoPatch() const;
+    size_t getWriteSize() const;
+
+    bool isValid(DWORD address) const;
+    void fillPatchBuffer(DWORD address, size_t start, BYTE* buffer,
+                         size_t count) const;
+    // INTERCEPTOR patches call or jump to the target address instead of
+    // their function, such as a thunk wrapping it.
+    void fillPatchBuffer(DWORD address, DWORD targetAddress, size_t start,
+                         BYTE* buffer, size_t count) const;
+};
+
+namespace D2Patch {
+// The descriptors are committed as one transaction, which keeps their
+// original bytes so that it can revert them. Unlike the loop over the table,
+// the commit is not free of allocation: its buffers are reserved once from
+// the size of the table, and the thread snapshot and the interval index
+// allocate their own, all before the other threads are suspended.
+bool applyPatchDescriptors(const D2PatchDescriptor* descriptors, size_t count,
+                           D2PatchTransaction& transaction);
+bool applyPatchDescriptors(const D2PatchDescriptor* descriptors, size_t count);
+}
+
+#endif
@@ -0,0 +1,72 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PatchDescriptorApply.cpp                                              *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the functions used by the D2PatchDescriptor record to *
+ *   resolve it in the running game, and the functions that apply a table of *
+ *   patch descriptors as one D2PatchTransaction.                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2PatchDescriptor.h"
+
+#include <windows.h>
+#include <cstddef>
+
+#include "../D2Offset.h"
+#include "../D2Version.h"
+#include "D2PatchTransaction.h"
+
+long long int D2PatchDescriptor::getCurrentOffset() const {
+    return getOffset(D2Version::getGameVersion());
+}
+
+DWORD D2PatchDescriptor::getCurrentAddress() const {
+    return D2Offset::resolveAddress(dllFile, getCurrentOffset());
+}
+
+bool D2PatchDescriptor::isNoPatch() const {
+    return isNoPatch(D2Version::getGameVersion());
+}
+
+bool D2Patch::applyPatchDescriptors(const D2PatchDescriptor* descriptors,
+                                    size_t count, D2PatchTransaction& transaction) {
+    // The table is constant, so the storage of the whole commit is sized and
+    // allocated once from it, rather than grown descriptor by descriptor.
+    size_t bufferSize = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        bufferSize += descriptors[i].getWriteSize();
+    }
+
+    transaction.reserve(count, bufferSize);
+
+    for (size_t i = 0; i < count; i++) {
+        transaction.addDescriptor(descriptors[i]);
+    }
+
+    // Either every descriptor is applied, or the game's code is left
+    // untouched.
+    return transaction.commit();
+}
+
+bool D2Patch::applyPatchDescriptors(const D2PatchDescriptor* descriptors,
+                                    size_t count) {
+    D2PatchTransaction transaction;
+    return applyPatchDescriptors(descriptors, count, transaction);
+}
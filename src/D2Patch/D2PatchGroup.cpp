@@ -0,0 +1,87 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PatchGroup.cpp                                                        *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2PatchGroup class, which is used to enable and   *
+ *   disable a named set of patches while the game is running.               *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2PatchGroup.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "D2BasePatch.h"
+#include "D2PatchTransaction.h"
+
+D2PatchGroup::D2PatchGroup(std::string_view name,
+                           const std::vector<std::shared_ptr<D2BasePatch>>& patches) : name(name),
+    patches(patches), enabled(false) {
+}
+
+bool D2PatchGroup::enable() {
+    // Patches that are already applied are skipped, and patches that were
+    // applied before are written back from their journals.
+    D2PatchTransaction transaction;
+    transaction.setOwner(name);
+
+    for (const auto& patch : patches) {
+        transaction.addPatch(*patch);
+    }
+
+    enabled = transaction.commit();
+    return enabled;
+}
+
+bool D2PatchGroup::disable() {
+    // The transaction reverts in the reverse order, so that overlapping
+    // patches end up with the bytes that were there before the group was
+    // enabled.
+    D2PatchTransaction transaction;
+
+    for (const auto& patch : patches) {
+        transaction.addPatch(*patch);
+    }
+
+    if (!transaction.revert()) {
+        return false;
+    }
+
+    enabled = false;
+    return true;
+}
+
+bool D2PatchGroup::setEnabled(bool enabled) {
+    return enabled ? enable() : disable();
+}
+
+bool D2PatchGroup::isEnabled() const {
+    return enabled;
+}
+
+const std::string& D2PatchGroup::getName() const {
+    return name;
+}
+
+const std::vector<std::shared_ptr<D2BasePatch>>& D2PatchGroup::getPatches()
+const {
+    return patches;
+}
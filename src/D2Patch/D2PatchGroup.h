@@ -0,0 +1,56 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PatchGroup.h                                                          *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2PatchGroup class, which is used to enable and  *
+ *   disable a named set of patches while the game is running.               *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2PATCHGROUP_H
+#define _D2PATCHGROUP_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "D2BasePatch.h"
+
+class D2PatchGroup {
+public:
+    D2PatchGroup(std::string_view name,
+                 const std::vector<std::shared_ptr<D2BasePatch>>& patches);
+
+    bool enable();
+    bool disable();
+    bool setEnabled(bool enabled);
+
+    bool isEnabled() const;
+    const std::string& getName() const;
+    const std::vector<std::shared_ptr<D2BasePatch>>& getPatches() const;
+
+private:
+    std::string name;
+    std::vector<std::shared_ptr<D2BasePatch>> patches;
+    bool enabled;
+};
+
+#endif
@@ -0,0 +1,365 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PatchIntervalIndex.cpp                                                *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2PatchIntervalIndex class, which keeps track of  *
+ *   the byte ranges written by every applied patch in a sorted array, so    *
+ *   that overlapping patches are caught when they are applied instead of    *
+ *   corrupting each other.                                                  *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2PatchIntervalIndex.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+#include "D2PatchIntervalStore.h"
+
+D2PatchIntervalIndex::D2PatchIntervalIndex() :
+    overlapPolicy(D2PatchOverlapPolicy::REJECT) {
+}
+
+D2PatchIntervalIndex& D2PatchIntervalIndex::getInstance() {
+    static D2PatchIntervalIndex intervalIndex;
+    return intervalIndex;
+}
+
+bool D2PatchIntervalIndex::isShared() const {
+    return store.isShared();
+}
+
+uint32_t D2PatchIntervalIndex::getOwnerId(std::string_view ownerName) {
+    std::lock_guard<D2PatchIntervalStore> storeLock(store);
+    return store.getOwnerId(ownerName);
+}
+
+std::string D2PatchIntervalIndex::getOwnerName(uint32_t ownerId) const {
+    std::lock_guard<D2PatchIntervalStore> storeLock(store);
+    return store.getOwnerName(ownerId);
+}
+
+void D2PatchIntervalIndex::setOverlapPolicy(D2PatchOverlapPolicy
+        overlapPolicy) {
+    std::lock_guard<D2PatchIntervalStore> storeLock(store);
+    this->overlapPolicy = overlapPolicy;
+}
+
+D2PatchOverlapPolicy D2PatchIntervalIndex::getOverlapPolicy() const {
+    std::lock_guard<D2PatchIntervalStore> storeLock(store);
+    return overlapPolicy;
+}
+
+bool D2PatchIntervalIndex::findOverlap(uint32_t start, uint32_t end,
+                                       D2PatchInterval& overlap) const {
+    std::lock_guard<D2PatchIntervalStore> storeLock(store);
+    size_t overlapIndex = findFirstOverlap(start, end);
+
+    if (overlapIndex == store.getIntervalCount()) {
+        return false;
+    }
+
+    overlap = store.getIntervals()[overlapIndex];
+    return true;
+}
+
+bool D2PatchIntervalIndex::findOwner(uint32_t address,
+                                     D2PatchInterval& owner) const {
+    return findOverlap(address, address + 1, owner);
+}
+
+bool D2PatchIntervalIndex::insert(const D2PatchInterval& interval,
+                                  std::vector<D2PatchConflict>& conflicts) {
+    std::lock_guard<D2PatchIntervalStore> storeLock(store);
+    conflicts.clear();
+
+    if (interval.start >= interval.end) {
+        return true;
+    }
+
+    const D2PatchInterval* intervals = store.getIntervals();
+    size_t intervalCount = store.getIntervalCount();
+    size_t first = findFirstOverlap(interval.start, interval.end);
+
+    for (size_t i = first; i < intervalCount && intervals[i].start < interval.end;
+            i++) {
+        conflicts.push_back({ std::max(interval.start, intervals[i].start),
+                              std::min(interval.end, intervals[i].end), intervals[i], interval
+                            });
+    }
+
+    if (!conflicts.empty()) {
+        if (overlapPolicy == D2PatchOverlapPolicy::REJECT
+                || intervalCount + 2 > D2PatchIntervalStore::MAX_INTERVALS) {
+            return false;
+        }
+
+        overwrite(interval);
+        return true;
+    }
+
+    // Only the intervals after the new one are moved.
+    size_t position = std::lower_bound(intervals, intervals + intervalCount,
+                                       interval.start, [](const D2PatchInterval & existing, uint32_t address) {
+        return existing.start < address;
+    }) - intervals;
+
+    return store.replace(position, position, &interval, 1);
+}
+
+bool D2PatchIntervalIndex::insertBatch(const std::vector<D2PatchInterval>&
+                                       incomingIntervals, std::vector<D2PatchConflict>& conflicts) {
+    std::lock_guard<D2PatchIntervalStore> storeLock(store);
+    conflicts.clear();
+
+    findConflicts(incomingIntervals, conflicts);
+
+    if (!conflicts.empty()) {
+        // Each overwrite adds at most two intervals, when it splits one.
+        if (overlapPolicy == D2PatchOverlapPolicy::REJECT
+                || store.getIntervalCount() + incomingIntervals.size() * 2 >
+                D2PatchIntervalStore::MAX_INTERVALS) {
+            return false;
+        }
+
+        // Overwrite the intervals one at a time in the order they were given,
+        // so that the last patch owns the bytes, as it does in memory.
+        for (const auto& interval : incomingIntervals) {
+            overwrite(interval);
+        }
+
+        return true;
+    }
+
+    std::vector<D2PatchInterval> sortedIntervals;
+    sortedIntervals.reserve(incomingIntervals.size());
+
+    for (const auto& interval : incomingIntervals) {
+        if (interval.start < interval.end) {
+            sortedIntervals.push_back(interval);
+        }
+    }
+
+    auto compareStart = [](const D2PatchInterval & left,
+    const D2PatchInterval & right) {
+        return left.start < right.start;
+    };
+
+    std::sort(sortedIntervals.begin(), sortedIntervals.end(), compareStart);
+
+    const D2PatchInterval* intervals = store.getIntervals();
+    size_t intervalCount = store.getIntervalCount();
+
+    std::vector<D2PatchInterval> mergedIntervals;
+    mergedIntervals.reserve(intervalCount + sortedIntervals.size());
+    std::merge(intervals, intervals + intervalCount, sortedIntervals.cbegin(),
+               sortedIntervals.cend(), std::back_inserter(mergedIntervals), compareStart);
+
+    return store.replace(0, intervalCount, mergedIntervals.data(),
+                         mergedIntervals.size());
+}
+
+size_t D2PatchIntervalIndex::remove(const void* patch) {
+    return remove(std::vector<const void*>({ patch }));
+}
+
+size_t D2PatchIntervalIndex::remove(const void* patch, uint32_t start,
+                                    uint32_t end) {
+    std::lock_guard<D2PatchIntervalStore> storeLock(store);
+    D2PatchInterval* intervals = store.getIntervals();
+    size_t intervalCount = store.getIntervalCount();
+    size_t first = findFirstOverlap(start, end);
+    size_t last = first;
+
+    while (last < intervalCount && intervals[last].start < end) {
+        last++;
+    }
+
+    D2PatchInterval* rangeEnd = std::remove_if(&intervals[first],
+                                &intervals[last], [patch](const D2PatchInterval & interval) {
+        return interval.patch == patch;
+    });
+
+    size_t keptEnd = rangeEnd - intervals;
+    store.replace(keptEnd, last, nullptr, 0);
+    return last - keptEnd;
+}
+
+size_t D2PatchIntervalIndex::remove(const std::vector<const void*>& patches) {
+    std::lock_guard<D2PatchIntervalStore> storeLock(store);
+    std::unordered_set<const void*> removedPatches(patches.cbegin(),
+            patches.cend());
+
+    D2PatchInterval* intervals = store.getIntervals();
+    size_t previousCount = store.getIntervalCount();
+    D2PatchInterval* intervalsEnd = std::remove_if(intervals,
+                                    intervals + previousCount,
+    [&removedPatches](const D2PatchInterval & interval) {
+        return removedPatches.count(interval.patch) != 0;
+    });
+
+    store.truncate(intervalsEnd - intervals);
+    return previousCount - store.getIntervalCount();
+}
+
+void D2PatchIntervalIndex::clear() {
+    std::lock_guard<D2PatchIntervalStore> storeLock(store);
+    store.truncate(0);
+}
+
+size_t D2PatchIntervalIndex::getIntervalCount() const {
+    std::lock_guard<D2PatchIntervalStore> storeLock(store);
+    return store.getIntervalCount();
+}
+
+std::vector<D2PatchInterval> D2PatchIntervalIndex::getIntervals() const {
+    std::lock_guard<D2PatchIntervalStore> storeLock(store);
+    const D2PatchInterval* intervals = store.getIntervals();
+    return std::vector<D2PatchInterval>(intervals,
+                                        intervals + store.getIntervalCount());
+}
+
+size_t D2PatchIntervalIndex::findFirstOverlap(uint32_t start,
+        uint32_t end) const {
+    const D2PatchInterval* intervals = store.getIntervals();
+    const D2PatchInterval* intervalsEnd = intervals + store.getIntervalCount();
+
+    // The first interval that ends after the start is the only candidate,
+    // since the intervals are sorted and do not overlap.
+    const D2PatchInterval* candidate = std::upper_bound(intervals, intervalsEnd,
+                                       start, [](uint32_t address, const D2PatchInterval & interval) {
+        return address < interval.end;
+    });
+
+    if (candidate == intervalsEnd || candidate->start >= end || start >= end) {
+        return store.getIntervalCount();
+    }
+
+    return candidate - intervals;
+}
+
+void D2PatchIntervalIndex::findConflicts(const std::vector<D2PatchInterval>&
+        incomingIntervals, std::vector<D2PatchConflict>& conflicts) const {
+    const D2PatchInterval* intervals = store.getIntervals();
+    size_t intervalCount = store.getIntervalCount();
+    std::vector<size_t> sortedIndices;
+    sortedIndices.reserve(incomingIntervals.size());
+
+    for (size_t i = 0; i < incomingIntervals.size(); i++) {
+        const D2PatchInterval& interval = incomingIntervals[i];
+
+        if (interval.start >= interval.end) {
+            continue;
+        }
+
+        sortedIndices.push_back(i);
+
+        for (size_t j = findFirstOverlap(interval.start, interval.end);
+                j < intervalCount && intervals[j].start < interval.end; j++) {
+            conflicts.push_back({ std::max(interval.start, intervals[j].start),
+                                  std::min(interval.end, intervals[j].end), intervals[j], interval
+                                });
+        }
+    }
+
+    // Sweep the batch in address order, comparing each interval with the
+    // one that reaches the furthest so far.
+    std::sort(sortedIndices.begin(), sortedIndices.end(),
+    [&incomingIntervals](size_t left, size_t right) {
+        return (incomingIntervals[left].start != incomingIntervals[right].start) ?
+               incomingIntervals[left].start < incomingIntervals[right].start : left < right;
+    });
+
+    const D2PatchInterval* furthestInterval = nullptr;
+
+    for (size_t sortedIndex : sortedIndices) {
+        const D2PatchInterval& interval = incomingIntervals[sortedIndex];
+
+        if (furthestInterval != nullptr && interval.start < furthestInterval->end) {
+            conflicts.push_back({ interval.start, std::min(interval.end, furthestInterval->end),
+                                  *furthestInterval, interval
+                                });
+        }
+
+        if (furthestInterval == nullptr || interval.end > furthestInterval->end) {
+            furthestInterval = &interval;
+        }
+    }
+}
+
+void D2PatchIntervalIndex::overwrite(const D2PatchInterval& interval) {
+    if (interval.start >= interval.end) {
+        return;
+    }
+
+    const D2PatchInterval* intervals = store.getIntervals();
+    size_t intervalCount = store.getIntervalCount();
+    size_t first = findFirstOverlap(interval.start, interval.end);
+    size_t last = first;
+    std::vector<D2PatchInterval> remainders;
+
+    // Keep the parts of the overlapped intervals that lie outside of the new
+    // interval.
+    for (; last < intervalCount && intervals[last].start < interval.end;
+            last++) {
+        const D2PatchInterval& overlapped = intervals[last];
+
+        if (overlapped.start < interval.start) {
+            remainders.push_back({ overlapped.start, interval.start, overlapped.patch, overlapped.ownerId });
+        }
+
+        if (overlapped.end > interval.end) {
+            remainders.push_back({ interval.end, overlapped.end, overlapped.patch, overlapped.ownerId });
+        }
+    }
+
+    if (first == intervalCount) {
+        // Nothing overlaps, so find where the interval goes.
+        first = std::lower_bound(intervals, intervals + intervalCount,
+                                 interval.start, [](const D2PatchInterval & existing, uint32_t address) {
+            return existing.start < address;
+        }) - intervals;
+        last = first;
+    }
+
+    std::vector<D2PatchInterval> replacement;
+
+    for (const auto& remainder : remainders) {
+        if (remainder.start < interval.start) {
+            replacement.push_back(remainder);
+        }
+    }
+
+    replacement.push_back(interval);
+
+    for (const auto& remainder : remainders) {
+        if (remainder.start >= interval.end) {
+            replacement.push_back(remainder);
+        }
+    }
+
+    // The batch was checked to fit before the first overwrite.
+    store.replace(first, last, replacement.data(), replacement.size());
+}
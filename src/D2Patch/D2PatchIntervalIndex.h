@@ -0,0 +1,121 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PatchIntervalIndex.h                                                  *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2PatchIntervalIndex class, which keeps track of *
+ *   the byte ranges written by every applied patch and the owner of each    *
+ *   range, across every module of the process built on this template.     *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2PATCHINTERVALINDEX_H
+#define _D2PATCHINTERVALINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "D2PatchIntervalStore.h"
+
+// A range of bytes [start, end) written by a patch.
+struct D2PatchInterval {
+    uint32_t start;
+    uint32_t end;
+    const void* patch;
+    uint32_t ownerId;
+};
+
+// The part of an incoming interval that overlaps one already in the index,
+// or another interval of the same batch.
+struct D2PatchConflict {
+    uint32_t start;
+    uint32_t end;
+    D2PatchInterval existing;
+    D2PatchInterval incoming;
+};
+
+enum class D2PatchOverlapPolicy : int {
+    // Overlapping patches are refused, and nothing is inserted.
+    REJECT,
+    // Overlaps are reported, and the last patch takes over the bytes it
+    // overlaps. Ownership is not handed back when that patch is removed.
+    REPORT
+};
+
+// The intervals and owner names are kept in a D2PatchIntervalStore, so on
+// Windows the patches of other plugins are checked as well. The overlap
+// policy only applies to the patches of this module.
+class D2PatchIntervalIndex {
+public:
+    static constexpr uint32_t DEFAULT_OWNER_ID = 0;
+
+    D2PatchIntervalIndex();
+
+    static D2PatchIntervalIndex& getInstance();
+
+    bool isShared() const;
+
+    uint32_t getOwnerId(std::string_view ownerName);
+    std::string getOwnerName(uint32_t ownerId) const;
+
+    void setOverlapPolicy(D2PatchOverlapPolicy overlapPolicy);
+    D2PatchOverlapPolicy getOverlapPolicy() const;
+
+    // Both run in O(log n).
+    bool findOverlap(uint32_t start, uint32_t end, D2PatchInterval& overlap) const;
+    bool findOwner(uint32_t address, D2PatchInterval& owner) const;
+
+    // Every interval of the batch is checked before any is inserted, so a
+    // rejected batch leaves the index unchanged. Conflicts are reported under
+    // both policies. Each check takes O(log n), and a batch without conflicts
+    // is merged in one pass. A batch that does not fit in the store is
+    // refused without conflicts. A single interval is placed by binary search,
+    // and only the intervals after it are moved.
+    bool insert(const D2PatchInterval& interval,
+                std::vector<D2PatchConflict>& conflicts);
+    bool insertBatch(const std::vector<D2PatchInterval>& incomingIntervals,
+                     std::vector<D2PatchConflict>& conflicts);
+
+    size_t remove(const void* patch);
+    // Only looks at the intervals that overlap [start, end), so it runs in
+    // O(log n) plus the intervals moved after them.
+    size_t remove(const void* patch, uint32_t start, uint32_t end);
+    size_t remove(const std::vector<const void*>& patches);
+    // Removes the intervals of every module.
+    void clear();
+
+    size_t getIntervalCount() const;
+    std::vector<D2PatchInterval> getIntervals() const;
+
+private:
+    // The intervals of the store are sorted by start. They never overlap, so
+    // they are sorted by end as well.
+    mutable D2PatchIntervalStore store;
+    D2PatchOverlapPolicy overlapPolicy;
+
+    size_t findFirstOverlap(uint32_t start, uint32_t end) const;
+    void findConflicts(const std::vector<D2PatchInterval>& incomingIntervals,
+                       std::vector<D2PatchConflict>& conflicts) const;
+    void overwrite(const D2PatchInterval& interval);
+};
+
+#endif
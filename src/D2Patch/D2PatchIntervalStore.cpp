@@ -0,0 +1,250 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PatchIntervalStore.cpp                                                *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2PatchIntervalStore class, which holds the       *
+ *   intervals and owner names of the D2PatchIntervalIndex in a block of     *
+ *   memory that every module of the process opens by name.                  *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2PatchIntervalStore.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+#include "D2PatchIntervalIndex.h"
+
+namespace {
+constexpr uint32_t BLOCK_MAGIC = 0x49503244; // "D2PI"
+constexpr uint32_t BLOCK_VERSION = 1;
+}
+
+// Modules built from another version of the template may lay the block out
+// differently, so they only share it when the magic, version and size match.
+struct D2PatchIntervalStore::Block {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t blockSize;
+    uint32_t intervalCount;
+    uint32_t ownerCount;
+    char ownerNames[MAX_OWNERS][MAX_OWNER_NAME_SIZE];
+    D2PatchInterval intervals[MAX_INTERVALS];
+};
+
+D2PatchIntervalStore::D2PatchIntervalStore() : block(nullptr)
+#ifdef _WIN32
+    , mappingHandle(nullptr), mutexHandle(nullptr)
+#endif
+{
+    if (openSharedBlock()) {
+        return;
+    }
+
+    privateBlock.reset(new Block());
+    privateBlock->magic = BLOCK_MAGIC;
+    privateBlock->version = BLOCK_VERSION;
+    privateBlock->blockSize = (uint32_t) sizeof(Block);
+    privateBlock->ownerCount = 1;
+    block = privateBlock.get();
+}
+
+D2PatchIntervalStore::~D2PatchIntervalStore() {
+    closeSharedBlock();
+}
+
+bool D2PatchIntervalStore::isShared() const {
+    return privateBlock == nullptr;
+}
+
+D2PatchInterval* D2PatchIntervalStore::getIntervals() {
+    return block->intervals;
+}
+
+const D2PatchInterval* D2PatchIntervalStore::getIntervals() const {
+    return block->intervals;
+}
+
+size_t D2PatchIntervalStore::getIntervalCount() const {
+    return block->intervalCount;
+}
+
+bool D2PatchIntervalStore::replace(size_t first, size_t last,
+                                   const D2PatchInterval* replacement, size_t replacementCount) {
+    size_t intervalCount = block->intervalCount;
+
+    if (intervalCount - (last - first) + replacementCount > MAX_INTERVALS) {
+        return false;
+    }
+
+    D2PatchInterval* intervals = block->intervals;
+    std::memmove(&intervals[first + replacementCount], &intervals[last],
+                 (intervalCount - last) * sizeof(D2PatchInterval));
+    std::copy(replacement, replacement + replacementCount, &intervals[first]);
+
+    block->intervalCount = (uint32_t)(intervalCount - (last - first) +
+                                      replacementCount);
+    return true;
+}
+
+void D2PatchIntervalStore::truncate(size_t intervalCount) {
+    block->intervalCount = (uint32_t) std::min<size_t>(intervalCount,
+                           block->intervalCount);
+}
+
+uint32_t D2PatchIntervalStore::getOwnerId(std::string_view ownerName) {
+    ownerName = ownerName.substr(0, MAX_OWNER_NAME_SIZE - 1);
+
+    for (uint32_t i = 0; i < block->ownerCount; i++) {
+        if (ownerName == block->ownerNames[i]) {
+            return i;
+        }
+    }
+
+    if (block->ownerCount == MAX_OWNERS) {
+        return 0;
+    }
+
+    char* ownerNameCopy = block->ownerNames[block->ownerCount];
+    std::memcpy(ownerNameCopy, ownerName.data(), ownerName.size());
+    ownerNameCopy[ownerName.size()] = '\0';
+    return block->ownerCount++;
+}
+
+std::string D2PatchIntervalStore::getOwnerName(uint32_t ownerId) const {
+    return (ownerId < block->ownerCount) ? std::string(block->ownerNames[ownerId])
+           : std::string();
+}
+
+#ifdef _WIN32
+
+void D2PatchIntervalStore::lock() {
+    if (mutexHandle != nullptr) {
+        // An abandoned mutex is still acquired. The block is left as the
+        // thread that died wrote it.
+        WaitForSingleObject(mutexHandle, INFINITE);
+    } else {
+        privateMutex.lock();
+    }
+}
+
+void D2PatchIntervalStore::unlock() {
+    if (mutexHandle != nullptr) {
+        ReleaseMutex(mutexHandle);
+    } else {
+        privateMutex.unlock();
+    }
+}
+
+bool D2PatchIntervalStore::openSharedBlock() {
+    // Local names are already private to the session, and the process ID
+    // keeps two games of one session apart.
+    std::wstring blockName = L"Local\\D2PatchIntervals-" + std::to_wstring(
+                                 GetCurrentProcessId());
+
+    mutexHandle = CreateMutexW(nullptr, FALSE, (blockName + L"-Lock").c_str());
+
+    if (mutexHandle == nullptr) {
+        return false;
+    }
+
+    // The view is zeroed when the mapping is created, so the first module to
+    // lock it finds no magic and sets up the header.
+    mappingHandle = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr,
+                                       PAGE_READWRITE, 0, (DWORD) sizeof(Block), blockName.c_str());
+
+    if (mappingHandle != nullptr) {
+        block = (Block*) MapViewOfFile(mappingHandle, FILE_MAP_WRITE, 0, 0,
+                                       sizeof(Block));
+    }
+
+    if (block == nullptr) {
+        closeSharedBlock();
+        return false;
+    }
+
+    lock();
+
+    if (block->magic == 0) {
+        block->magic = BLOCK_MAGIC;
+        block->version = BLOCK_VERSION;
+        block->blockSize = (uint32_t) sizeof(Block);
+        block->ownerCount = 1;
+    }
+
+    bool isCompatible = block->magic == BLOCK_MAGIC
+                        && block->version == BLOCK_VERSION && block->blockSize == sizeof(Block);
+    unlock();
+
+    if (!isCompatible) {
+        closeSharedBlock();
+        return false;
+    }
+
+    return true;
+}
+
+void D2PatchIntervalStore::closeSharedBlock() {
+    if (block != nullptr && privateBlock == nullptr) {
+        UnmapViewOfFile(block);
+    }
+
+    if (mappingHandle != nullptr) {
+        CloseHandle(mappingHandle);
+    }
+
+    if (mutexHandle != nullptr) {
+        CloseHandle(mutexHandle);
+    }
+
+    if (privateBlock == nullptr) {
+        block = nullptr;
+    }
+
+    mappingHandle = nullptr;
+    mutexHandle = nullptr;
+}
+
+#else
+
+void D2PatchIntervalStore::lock() {
+    privateMutex.lock();
+}
+
+void D2PatchIntervalStore::unlock() {
+    privateMutex.unlock();
+}
+
+bool D2PatchIntervalStore::openSharedBlock() {
+    return false;
+}
+
+void D2PatchIntervalStore::closeSharedBlock() {
+}
+
+#endif
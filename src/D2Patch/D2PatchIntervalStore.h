@@ -0,0 +1,98 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PatchIntervalStore.h                                                  *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2PatchIntervalStore class, which holds the      *
+ *   intervals and owner names of the D2PatchIntervalIndex in memory shared  *
+ *   by every module of the process.                                         *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2PATCHINTERVALSTORE_H
+#define _D2PATCHINTERVALSTORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+struct D2PatchInterval;
+
+// Every plugin built on this template links its own copy of the index. On
+// Windows, the copies open one block of memory named after the process, so
+// that a plugin sees the patches of the others. Elsewhere, or when the block
+// cannot be opened, the store is private to the module.
+//
+// Patches are only compared by address, which is unique in the process. A
+// module must remove its patches from the store before it is unloaded.
+class D2PatchIntervalStore {
+public:
+    static constexpr size_t MAX_INTERVALS = 131072;
+    static constexpr size_t MAX_OWNERS = 256;
+
+    // Longer owner names are cut short.
+    static constexpr size_t MAX_OWNER_NAME_SIZE = 64;
+
+    D2PatchIntervalStore();
+    ~D2PatchIntervalStore();
+
+    D2PatchIntervalStore(const D2PatchIntervalStore&) = delete;
+    D2PatchIntervalStore& operator=(const D2PatchIntervalStore&) = delete;
+
+    // Every other function must be called with the store locked. The lock of
+    // a shared store is held against every module of the process.
+    void lock();
+    void unlock();
+
+    bool isShared() const;
+
+    D2PatchInterval* getIntervals();
+    const D2PatchInterval* getIntervals() const;
+    size_t getIntervalCount() const;
+
+    // Replaces the intervals [first, last) with the given ones. Fails without
+    // changing anything when the store would be full.
+    bool replace(size_t first, size_t last, const D2PatchInterval* replacement,
+                 size_t replacementCount);
+    void truncate(size_t intervalCount);
+
+    // Returns 0, the default owner, once the table of owners is full.
+    uint32_t getOwnerId(std::string_view ownerName);
+    std::string getOwnerName(uint32_t ownerId) const;
+
+private:
+    struct Block;
+
+    Block* block;
+    std::unique_ptr<Block> privateBlock;
+    std::mutex privateMutex;
+
+#ifdef _WIN32
+    void* mappingHandle;
+    void* mutexHandle;
+#endif
+
+    bool openSharedBlock();
+    void closeSharedBlock();
+};
+
+#endif
@@ -0,0 +1,94 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PatchJournal.cpp                                                      *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2PatchJournal class, which keeps the original    *
+ *   bytes overwritten by a patch along with the patch bytes, so that the    *
+ *   patch can be reverted and reapplied while the game is running.          *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2PatchJournal.h"
+
+#include <windows.h>
+#include <cstring>
+#include <memory>
+
+D2PatchJournal::D2PatchJournal() : address(0), size(0), recorded(false),
+    applied(false), inlineBytes() {
+}
+
+void D2PatchJournal::record(DWORD address, const BYTE* originalBytes,
+                            const BYTE* patchedBytes, size_t size) {
+    this->address = address;
+    this->size = size;
+    this->recorded = true;
+    this->applied = true;
+
+    BYTE* journalBytes = inlineBytes;
+
+    if (size > INLINE_SIZE) {
+        bytes.reset(new BYTE[size * 2]);
+        journalBytes = bytes.get();
+    } else {
+        bytes.reset();
+    }
+
+    std::memcpy(&journalBytes[0], originalBytes, size);
+    std::memcpy(&journalBytes[size], patchedBytes, size);
+}
+
+void D2PatchJournal::clear() {
+    address = 0;
+    size = 0;
+    recorded = false;
+    applied = false;
+    bytes.reset();
+}
+
+bool D2PatchJournal::isRecorded() const {
+    return recorded;
+}
+
+bool D2PatchJournal::isApplied() const {
+    return applied;
+}
+
+void D2PatchJournal::setApplied(bool applied) {
+    this->applied = applied;
+}
+
+DWORD D2PatchJournal::getAddress() const {
+    return address;
+}
+
+size_t D2PatchJournal::getSize() const {
+    return size;
+}
+
+const BYTE* D2PatchJournal::getOriginalBytes() const {
+    return &getBytes()[0];
+}
+
+const BYTE* D2PatchJournal::getPatchedBytes() const {
+    return &getBytes()[size];
+}
+
+const BYTE* D2PatchJournal::getBytes() const {
+    return (bytes != nullptr) ? bytes.get() : inlineBytes;
+}
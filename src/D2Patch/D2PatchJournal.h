@@ -0,0 +1,69 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PatchJournal.h                                                        *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2PatchJournal class, which keeps the original   *
+ *   bytes overwritten by a patch along with the patch bytes, so that the    *
+ *   patch can be reverted and reapplied while the game is running.          *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2PATCHJOURNAL_H
+#define _D2PATCHJOURNAL_H
+
+#include <windows.h>
+#include <memory>
+
+class D2PatchJournal {
+public:
+    D2PatchJournal();
+    D2PatchJournal(D2PatchJournal&& d2PatchJournal) = default;
+
+    void record(DWORD address, const BYTE* originalBytes,
+                const BYTE* patchedBytes, size_t size);
+    void clear();
+
+    bool isRecorded() const;
+    bool isApplied() const;
+    void setApplied(bool applied);
+
+    DWORD getAddress() const;
+    size_t getSize() const;
+    const BYTE* getOriginalBytes() const;
+    const BYTE* getPatchedBytes() const;
+
+private:
+    // Most patches write a CALL or JMP, whose journal fits in the object.
+    static constexpr size_t INLINE_SIZE = 8;
+
+    DWORD address;
+    size_t size;
+    bool recorded;
+    bool applied;
+
+    // The original bytes followed by the patched bytes, in inlineBytes unless
+    // the patch is longer than INLINE_SIZE.
+    std::unique_ptr<BYTE[]> bytes;
+    BYTE inlineBytes[INLINE_SIZE * 2];
+
+    const BYTE* getBytes() const;
+};
+
+#endif
@@ -0,0 +1,589 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PatchTransaction.cpp                                                  *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2PatchTransaction class, which applies a set of  *
+ *   patches as a single unit, grouping the writes by page and restoring the *
+ *   original code if any of the writes fail.                                *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2PatchTransaction.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "../D2Memory.h"
+#include "../D2Patch.h"
+#include "D2BasePatch.h"
+#include "D2HookProfiler.h"
+#include "D2PatchDescriptor.h"
+#include "D2PatchIntervalIndex.h"
+#include "D2PatchJournal.h"
+#include "D2ThreadSuspender.h"
+
+namespace {
+double getElapsedMicroseconds(std::chrono::steady_clock::time_point startTime) {
+    std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - startTime;
+    return elapsed.count();
+}
+}
+
+D2PatchTransaction::D2PatchTransaction() : workerCount(1),
+    ownerId(D2PatchIntervalIndex::DEFAULT_OWNER_ID), commitWindowMicroseconds(0),
+    suspendedThreadCount(0) {
+}
+
+void D2PatchTransaction::addPatch(D2BasePatch& patch) {
+    patches.push_back({ &patch, nullptr, D2PatchJournal() });
+}
+
+void D2PatchTransaction::addDescriptor(const D2PatchDescriptor& descriptor) {
+    patches.push_back({ nullptr, &descriptor, D2PatchJournal() });
+}
+
+void D2PatchTransaction::reserve(size_t patchCount, size_t bufferSize) {
+    patchCount += patches.size();
+    bufferSize += patchBuffers.size();
+
+    patches.reserve(patchCount);
+    preparedPatches.reserve(patchCount);
+    patchBuffers.reserve(bufferSize);
+    writeRuns.reserve(patchCount);
+    writeBatches.reserve(patchCount);
+    batchReports.reserve(patchCount);
+    runPatchedBytes.reserve(bufferSize);
+    runOriginalBytes.reserve(bufferSize);
+}
+
+bool D2PatchTransaction::commit() {
+    conflicts.clear();
+
+    // Resolve every patch before anything is written, so that a patch with a
+    // bad address cannot leave the game half-patched.
+    if (!preparePatches()) {
+        return false;
+    }
+
+    // Patches that overlap each other or an applied patch are caught here,
+    // before they can silently overwrite each other.
+    if (!registerIntervals()) {
+        return false;
+    }
+
+    buildWriteRuns(false);
+    buildWriteBatches();
+
+    if (!writeSuspended()) {
+        unregisterIntervals();
+        return false;
+    }
+
+    recordJournals();
+    return true;
+}
+
+bool D2PatchTransaction::revert() {
+    prepareRevert();
+    buildWriteRuns(true);
+    buildWriteBatches();
+
+    // The original bytes are written in the same window as a commit, so that
+    // no thread runs a half-restored instruction, and the patched bytes are
+    // put back if any write fails.
+    if (!writeSuspended()) {
+        return false;
+    }
+
+    unregisterIntervals();
+
+    for (const auto& preparedPatch : preparedPatches) {
+        getJournal(preparedPatch.patchIndex).setApplied(false);
+    }
+
+    return true;
+}
+
+void D2PatchTransaction::setWorkerCount(size_t workerCount) {
+    this->workerCount = std::max<size_t>(workerCount, 1);
+}
+
+void D2PatchTransaction::setOwner(std::string_view ownerName) {
+    ownerId = D2PatchIntervalIndex::getInstance().getOwnerId(ownerName);
+}
+
+const std::vector<D2PatchConflict>& D2PatchTransaction::getConflicts() const {
+    return conflicts;
+}
+
+const std::vector<D2PatchTransaction::BatchReport>&
+D2PatchTransaction::getBatchReports() const {
+    return batchReports;
+}
+
+double D2PatchTransaction::getCommitWindowMicroseconds() const {
+    return commitWindowMicroseconds;
+}
+
+size_t D2PatchTransaction::getSuspendedThreadCount() const {
+    return suspendedThreadCount;
+}
+
+size_t D2PatchTransaction::getPatchCount() const {
+    return patches.size();
+}
+
+const void* D2PatchTransaction::getPatchOwner(size_t patchIndex) const {
+    const PatchEntry& patchEntry = patches[patchIndex];
+    return (patchEntry.patch != nullptr) ? (const void*) patchEntry.patch :
+           (const void*) patchEntry.descriptor;
+}
+
+D2PatchJournal& D2PatchTransaction::getJournal(size_t patchIndex) {
+    PatchEntry& patchEntry = patches[patchIndex];
+    return (patchEntry.patch != nullptr) ? patchEntry.patch->getJournal() :
+           patchEntry.descriptorJournal;
+}
+
+bool D2PatchTransaction::preparePatches() {
+    preparedPatches.clear();
+    patchBuffers.clear();
+
+    // Reserve the buffer of every patch first, so that the patches can then
+    // be built concurrently into their own part of the buffer.
+    std::vector<size_t> pendingPatches;
+    pendingPatches.reserve(patches.size());
+
+    for (size_t i = 0; i < patches.size(); i++) {
+        const PatchEntry& patchEntry = patches[i];
+        const D2PatchJournal& journal = getJournal(i);
+
+        // A patch that was applied before is written again from its journal,
+        // instead of computing the relative addresses again.
+        if (journal.isRecorded()) {
+            if (journal.isApplied()) {
+                continue;
+            }
+
+            size_t bufferOffset = patchBuffers.size();
+            patchBuffers.insert(patchBuffers.end(), journal.getPatchedBytes(),
+                                journal.getPatchedBytes() + journal.getSize());
+
+            preparedPatches.push_back({ i, journal.getAddress(), bufferOffset, journal.getSize() });
+            continue;
+        }
+
+        // Do not patch if the no patch flag is set.
+        bool isNoPatch = (patchEntry.patch != nullptr) ? patchEntry.patch->isNoPatch() :
+                         patchEntry.descriptor->isNoPatch();
+
+        if (isNoPatch) {
+            continue;
+        }
+
+        size_t writeSize = (patchEntry.patch != nullptr) ?
+                           patchEntry.patch->getWriteSize() : patchEntry.descriptor->getWriteSize();
+
+        if (writeSize == 0) {
+            return false;
+        }
+
+        size_t bufferOffset = patchBuffers.size();
+        patchBuffers.resize(bufferOffset + writeSize);
+
+        pendingPatches.push_back(preparedPatches.size());
+        preparedPatches.push_back({ i, 0, bufferOffset, writeSize });
+    }
+
+    std::atomic<bool> prepareFailed(false);
+
+    auto preparePatchRange = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last && !prepareFailed; i++) {
+            PreparedPatch& preparedPatch = preparedPatches[pendingPatches[i]];
+            const PatchEntry& patchEntry = patches[preparedPatch.patchIndex];
+            BYTE* patchBuffer = &patchBuffers[preparedPatch.bufferOffset];
+
+            if (patchEntry.patch != nullptr) {
+                const D2BasePatch& patch = *patchEntry.patch;
+                preparedPatch.address = patch.getD2Offset().getCurrentAddress();
+
+                if (preparedPatch.address == 0
+                        || !patch.buildPatchBuffer(preparedPatch.address, patchBuffer)) {
+                    prepareFailed = true;
+                }
+            } else {
+                const D2PatchDescriptor& descriptor = *patchEntry.descriptor;
+                preparedPatch.address = descriptor.getCurrentAddress();
+
+                if (!descriptor.isValid(preparedPatch.address)) {
+                    prepareFailed = true;
+                } else {
+                    DWORD targetAddress = (DWORD)(uintptr_t) descriptor.pFunc;
+
+                    // Only calls can be profiled, since the profiler needs a
+                    // return address.
+                    if (descriptor.kind == D2PatchKind::INTERCEPTOR
+                            && descriptor.data == (DWORD) OpCode::CALL) {
+                        targetAddress = (DWORD)(uintptr_t) D2HookProfiler::wrapTarget(
+                                            descriptor.dllFile, preparedPatch.address, (void*) descriptor.pFunc);
+                    }
+
+                    descriptor.fillPatchBuffer(preparedPatch.address, targetAddress, 0,
+                                               patchBuffer, preparedPatch.writeSize);
+                }
+            }
+        }
+    };
+
+    size_t threadCount = std::min(workerCount, pendingPatches.size());
+    std::vector<std::thread> workerThreads;
+
+    for (size_t i = 1; i < threadCount; i++) {
+        workerThreads.emplace_back(preparePatchRange,
+                                   pendingPatches.size() * i / threadCount,
+                                   pendingPatches.size() * (i + 1) / threadCount);
+    }
+
+    preparePatchRange(0, (threadCount > 1) ? pendingPatches.size() / threadCount :
+                      pendingPatches.size());
+
+    for (auto& workerThread : workerThreads) {
+        workerThread.join();
+    }
+
+    if (prepareFailed) {
+        return false;
+    }
+
+    sortPreparedPatches();
+    return true;
+}
+
+void D2PatchTransaction::prepareRevert() {
+    preparedPatches.clear();
+    patchBuffers.clear();
+
+    // The original bytes of every applied patch are written back, like the
+    // bytes of a patch being committed.
+    for (size_t i = 0; i < patches.size(); i++) {
+        const D2PatchJournal& journal = getJournal(i);
+
+        if (!journal.isApplied()) {
+            continue;
+        }
+
+        size_t bufferOffset = patchBuffers.size();
+        patchBuffers.insert(patchBuffers.end(), journal.getOriginalBytes(),
+                            journal.getOriginalBytes() + journal.getSize());
+
+        preparedPatches.push_back({ i, journal.getAddress(), bufferOffset, journal.getSize() });
+    }
+
+    sortPreparedPatches();
+}
+
+void D2PatchTransaction::sortPreparedPatches() {
+    std::sort(preparedPatches.begin(), preparedPatches.end(),
+    [](const PreparedPatch & left, const PreparedPatch & right) {
+        return (left.address != right.address) ? left.address < right.address :
+               left.patchIndex < right.patchIndex;
+    });
+}
+
+bool D2PatchTransaction::registerIntervals() {
+    std::vector<D2PatchInterval> intervals;
+    intervals.reserve(preparedPatches.size());
+
+    for (const auto& preparedPatch : preparedPatches) {
+        intervals.push_back({ preparedPatch.address,
+                              (uint32_t)(preparedPatch.address + preparedPatch.writeSize),
+                              getPatchOwner(preparedPatch.patchIndex), ownerId
+                            });
+    }
+
+    // A single patch, such as a D2BasePatch applied on its own, is inserted
+    // without merging the whole index.
+    D2PatchIntervalIndex& intervalIndex = D2PatchIntervalIndex::getInstance();
+
+    if (intervals.size() == 1) {
+        return intervalIndex.insert(intervals[0], conflicts);
+    }
+
+    return intervalIndex.insertBatch(intervals, conflicts);
+}
+
+void D2PatchTransaction::unregisterIntervals() {
+    if (preparedPatches.empty()) {
+        return;
+    }
+
+    if (preparedPatches.size() == 1) {
+        const PreparedPatch& preparedPatch = preparedPatches[0];
+        D2PatchIntervalIndex::getInstance().remove(getPatchOwner(
+                    preparedPatch.patchIndex), preparedPatch.address,
+                (uint32_t)(preparedPatch.address + preparedPatch.writeSize));
+        return;
+    }
+
+    std::vector<const void*> preparedPatchPointers;
+
+    for (const auto& preparedPatch : preparedPatches) {
+        preparedPatchPointers.push_back(getPatchOwner(preparedPatch.patchIndex));
+    }
+
+    D2PatchIntervalIndex::getInstance().remove(preparedPatchPointers);
+}
+
+void D2PatchTransaction::buildWriteRuns(bool reverting) {
+    writeRuns.clear();
+    runPatchedBytes.clear();
+
+    // Merge patches that touch or overlap into contiguous runs. The bytes of
+    // every run are kept in one buffer, in which only the last run grows.
+    for (size_t i = 0; i < preparedPatches.size(); i++) {
+        const PreparedPatch& preparedPatch = preparedPatches[i];
+        DWORD patchEnd = preparedPatch.address + preparedPatch.writeSize;
+
+        if (!writeRuns.empty()) {
+            WriteRun& lastRun = writeRuns.back();
+            DWORD runEnd = lastRun.address + lastRun.size;
+
+            if (preparedPatch.address <= runEnd) {
+                if (patchEnd > runEnd) {
+                    lastRun.size = patchEnd - lastRun.address;
+                    runPatchedBytes.resize(lastRun.byteOffset + lastRun.size);
+                }
+
+                lastRun.patchCount++;
+                continue;
+            }
+        }
+
+        writeRuns.push_back({ preparedPatch.address, i, 1, runPatchedBytes.size(), preparedPatch.writeSize });
+        runPatchedBytes.resize(runPatchedBytes.size() + preparedPatch.writeSize);
+    }
+
+    // Overlapping patches are copied in the order they were added, so the
+    // result is the same as applying them one after another. Their original
+    // bytes are copied in the reverse order, so that the first patch restores
+    // the bytes that were there before any of them.
+    std::vector<size_t> runPatches;
+    runPatches.reserve(preparedPatches.size());
+
+    for (const auto& writeRun : writeRuns) {
+        runPatches.clear();
+
+        for (size_t i = 0; i < writeRun.patchCount; i++) {
+            runPatches.push_back(writeRun.firstPatch + i);
+        }
+
+        std::sort(runPatches.begin(), runPatches.end(), [this,
+        reverting](size_t left, size_t right) {
+            size_t leftIndex = preparedPatches[left].patchIndex;
+            size_t rightIndex = preparedPatches[right].patchIndex;
+            return reverting ? leftIndex > rightIndex : leftIndex < rightIndex;
+        });
+
+        for (size_t runPatch : runPatches) {
+            const PreparedPatch& preparedPatch = preparedPatches[runPatch];
+            std::memcpy(&runPatchedBytes[writeRun.byteOffset + preparedPatch.address -
+                                                             writeRun.address],
+                        &patchBuffers[preparedPatch.bufferOffset],
+                        preparedPatch.writeSize);
+        }
+    }
+
+    runOriginalBytes.resize(runPatchedBytes.size());
+}
+
+void D2PatchTransaction::buildWriteBatches() {
+    writeBatches.clear();
+
+    // Runs that share a page are written under the same protection change.
+    DWORD lastPage = 0;
+
+    for (size_t i = 0; i < writeRuns.size(); i++) {
+        const WriteRun& writeRun = writeRuns[i];
+        DWORD firstRunPage = D2Memory::getPageStart(writeRun.address);
+
+        if (!writeBatches.empty() && firstRunPage <= lastPage) {
+            writeBatches.back().runCount++;
+        } else {
+            writeBatches.push_back({ i, 1 });
+        }
+
+        lastPage = D2Memory::getPageStart(writeRun.address +
+                                          writeRun.size - 1);
+    }
+}
+
+bool D2PatchTransaction::writeSuspended() {
+    batchReports.clear();
+    commitWindowMicroseconds = 0;
+    suspendedThreadCount = 0;
+
+    if (writeRuns.empty()) {
+        return true;
+    }
+
+    // Everything that can be done while the game is running is done before
+    // the other threads are suspended, so the window only holds the writes
+    // themselves. Nothing may be allocated inside of the window, since a
+    // suspended thread could be holding the heap lock.
+    std::vector<D2Memory::PageProtection> oldProtections;
+    std::vector<D2ThreadSuspender::AddressRange> busyRanges;
+    busyRanges.reserve(writeRuns.size());
+
+    for (const auto& writeRun : writeRuns) {
+        busyRanges.push_back({ writeRun.address, writeRun.size });
+    }
+
+    batchReports.reserve(writeBatches.size());
+
+    if (!readOriginalBytes(oldProtections)) {
+        D2Memory::restoreProtection(oldProtections);
+        return false;
+    }
+
+    D2ThreadSuspender threadSuspender;
+
+    if (!threadSuspender.suspend(busyRanges)) {
+        threadSuspender.resume();
+        D2Memory::restoreProtection(oldProtections);
+        return false;
+    }
+
+    auto commitStartTime = std::chrono::steady_clock::now();
+
+    bool writeSuccess = true;
+    size_t runsWritten = 0;
+
+    for (const auto& writeBatch : writeBatches) {
+        if (!this->writeBatch(writeBatch, runsWritten)) {
+            rollback(runsWritten);
+            writeSuccess = false;
+            break;
+        }
+    }
+
+    D2Memory::flushInstructionCache(0, 0);
+
+    commitWindowMicroseconds = getElapsedMicroseconds(commitStartTime);
+    suspendedThreadCount = threadSuspender.getSuspendedCount();
+
+    threadSuspender.resume();
+    D2Memory::restoreProtection(oldProtections);
+    return writeSuccess;
+}
+
+bool D2PatchTransaction::readOriginalBytes(
+    std::vector<D2Memory::PageProtection>& oldProtections) {
+    for (const auto& writeBatch : writeBatches) {
+        const WriteRun& firstRun = writeRuns[writeBatch.firstRun];
+        const WriteRun& lastRun = writeRuns[writeBatch.firstRun + writeBatch.runCount
+                                            - 1];
+        DWORD batchStart = firstRun.address;
+        size_t batchSize = lastRun.address + lastRun.size - batchStart;
+
+        if (!D2Memory::unprotectMemory(batchStart, batchSize, oldProtections)) {
+            return false;
+        }
+
+        for (size_t i = 0; i < writeBatch.runCount; i++) {
+            WriteRun& writeRun = writeRuns[writeBatch.firstRun + i];
+
+            if (!D2Memory::readMemory(writeRun.address,
+                                      &runOriginalBytes[writeRun.byteOffset], writeRun.size)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool D2PatchTransaction::writeBatch(const WriteBatch& writeBatch,
+                                    size_t& runsWritten) {
+    auto startTime = std::chrono::steady_clock::now();
+
+    const WriteRun& firstRun = writeRuns[writeBatch.firstRun];
+    const WriteRun& lastRun = writeRuns[writeBatch.firstRun + writeBatch.runCount
+                                        - 1];
+    DWORD batchStart = firstRun.address;
+    size_t batchSize = lastRun.address + lastRun.size - batchStart;
+    size_t patchCount = 0;
+
+    for (size_t i = 0; i < writeBatch.runCount; i++) {
+        const WriteRun& writeRun = writeRuns[writeBatch.firstRun + i];
+
+        // A failed write may still have modified part of the run, so it is
+        // counted as written in order to have it restored on rollback.
+        runsWritten++;
+
+        if (!D2Memory::writeUnprotectedMemory(writeRun.address,
+                                              &runPatchedBytes[writeRun.byteOffset], writeRun.size)) {
+            return false;
+        }
+
+        patchCount += writeRun.patchCount;
+    }
+
+    batchReports.push_back({ batchStart, batchSize, writeBatch.runCount,
+                             patchCount, getElapsedMicroseconds(startTime) });
+
+    return true;
+}
+
+void D2PatchTransaction::rollback(size_t runsWritten) {
+    // Restore the runs in the reverse order they were written. The pages are
+    // still writable at this point.
+    while (runsWritten > 0) {
+        runsWritten--;
+
+        const WriteRun& writeRun = writeRuns[runsWritten];
+        D2Memory::writeUnprotectedMemory(writeRun.address,
+                                         &runOriginalBytes[writeRun.byteOffset], writeRun.size);
+    }
+}
+
+void D2PatchTransaction::recordJournals() {
+    for (const auto& writeRun : writeRuns) {
+        for (size_t i = 0; i < writeRun.patchCount; i++) {
+            const PreparedPatch& preparedPatch = preparedPatches[writeRun.firstPatch +
+                                                 i];
+            D2PatchJournal& journal = getJournal(preparedPatch.patchIndex);
+
+            if (journal.isRecorded()) {
+                journal.setApplied(true);
+                continue;
+            }
+
+            size_t runOffset = preparedPatch.address - writeRun.address;
+            journal.record(preparedPatch.address,
+                           &runOriginalBytes[writeRun.byteOffset + runOffset],
+                           &patchBuffers[preparedPatch.bufferOffset], preparedPatch.writeSize);
+        }
+    }
+}
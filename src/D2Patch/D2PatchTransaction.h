@@ -0,0 +1,144 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PatchTransaction.h                                                    *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2PatchTransaction class, which applies a set of *
+ *   patches as a single unit, grouping the writes by page and restoring the *
+ *   original code if any of the writes fail.                                *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2PATCHTRANSACTION_H
+#define _D2PATCHTRANSACTION_H
+
+#include <windows.h>
+#include <string_view>
+#include <vector>
+
+#include "../D2Memory.h"
+#include "D2BasePatch.h"
+#include "D2PatchDescriptor.h"
+#include "D2PatchIntervalIndex.h"
+#include "D2PatchJournal.h"
+
+class D2PatchTransaction {
+public:
+    struct BatchReport {
+        DWORD startAddress;
+        size_t batchSize;
+        size_t runCount;
+        size_t patchCount;
+        double elapsedMicroseconds;
+    };
+
+    D2PatchTransaction();
+
+    void addPatch(D2BasePatch& patch);
+    void addDescriptor(const D2PatchDescriptor& descriptor);
+    // Makes room for this many more patches writing this many bytes in all,
+    // so that adding and committing them does not grow any buffer.
+    void reserve(size_t patchCount, size_t bufferSize);
+    bool commit();
+    // Writes back the original bytes of every patch and descriptor of the
+    // transaction that is applied, in the same suspended window as a commit.
+    // If a write fails, the patched bytes are restored and every patch stays
+    // applied.
+    bool revert();
+
+    // Patches are prepared on this many threads. Do not use more than one
+    // while the loader lock is held, such as from DllMain, since the worker
+    // threads cannot start until it is released.
+    void setWorkerCount(size_t workerCount);
+
+    // The owner is recorded with the range of every patch in the interval
+    // index, so that overlapping patches can be traced back to their source.
+    void setOwner(std::string_view ownerName);
+    const std::vector<D2PatchConflict>& getConflicts() const;
+
+    // Reports on the last commit or revert.
+    const std::vector<BatchReport>& getBatchReports() const;
+    double getCommitWindowMicroseconds() const;
+    size_t getSuspendedThreadCount() const;
+    size_t getPatchCount() const;
+
+private:
+    // Either a patch or a descriptor. Descriptors are read-only, so their
+    // journal is kept here instead.
+    struct PatchEntry {
+        D2BasePatch* patch;
+        const D2PatchDescriptor* descriptor;
+        D2PatchJournal descriptorJournal;
+    };
+
+    struct PreparedPatch {
+        size_t patchIndex;
+        DWORD address;
+        size_t bufferOffset;
+        size_t writeSize;
+    };
+
+    // The bytes of a run are kept at the same offset in runPatchedBytes, the
+    // bytes to write, and runOriginalBytes, the bytes found there before the
+    // write, which are put back on rollback.
+    struct WriteRun {
+        DWORD address;
+        size_t firstPatch;
+        size_t patchCount;
+        size_t byteOffset;
+        size_t size;
+    };
+
+    struct WriteBatch {
+        size_t firstRun;
+        size_t runCount;
+    };
+
+    std::vector<PatchEntry> patches;
+    std::vector<PreparedPatch> preparedPatches;
+    std::vector<BYTE> patchBuffers;
+    std::vector<WriteRun> writeRuns;
+    std::vector<BYTE> runPatchedBytes;
+    std::vector<BYTE> runOriginalBytes;
+    std::vector<WriteBatch> writeBatches;
+    std::vector<BatchReport> batchReports;
+    std::vector<D2PatchConflict> conflicts;
+
+    size_t workerCount;
+    uint32_t ownerId;
+    double commitWindowMicroseconds;
+    size_t suspendedThreadCount;
+
+    const void* getPatchOwner(size_t patchIndex) const;
+    D2PatchJournal& getJournal(size_t patchIndex);
+    bool preparePatches();
+    void prepareRevert();
+    void sortPreparedPatches();
+    bool registerIntervals();
+    void unregisterIntervals();
+    void buildWriteRuns(bool reverting);
+    void buildWriteBatches();
+    bool writeSuspended();
+    bool readOriginalBytes(std::vector<D2Memory::PageProtection>& oldProtections);
+    bool writeBatch(const WriteBatch& writeBatch, size_t& runsWritten);
+    void rollback(size_t runsWritten);
+    void recordJournals();
+};
+
+#endif
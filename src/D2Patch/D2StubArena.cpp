@@ -0,0 +1,248 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2StubArena.cpp                                                         *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2StubArena class, which hands out executable     *
+ *   memory for generated code such as trampolines, close to the module the  *
+ *   code is used from.                                                      *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2StubArena.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+D2StubArena::D2StubArena(D2PageAllocator& pageAllocator) : pageAllocator(
+        pageAllocator), stubCount(0) {
+}
+
+D2StubArena::~D2StubArena() {
+    for (const auto& modulePool : modulePools) {
+        for (const auto& region : modulePool.regions) {
+            pageAllocator.release(region.address, pageAllocator.getRegionSize());
+        }
+    }
+}
+
+uintptr_t D2StubArena::allocateStub(uintptr_t moduleAddress, size_t size) {
+    if (size == 0 || size > MAX_STUB_SIZE
+            || MAX_STUB_SIZE > pageAllocator.getRegionSize()) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> arenaLock(arenaMutex);
+
+    size_t slotSize = (size + STUB_ALIGNMENT - 1) & ~(STUB_ALIGNMENT - 1);
+    size_t sizeClass = slotSize / STUB_ALIGNMENT - 1;
+    ModulePool& modulePool = getModulePool(moduleAddress);
+
+    // Reuse a freed slot of the same size before taking new memory.
+    std::vector<uintptr_t>& freeList = modulePool.freeLists[sizeClass];
+
+    if (!freeList.empty()) {
+        uintptr_t stubAddress = freeList.back();
+
+        if (!openPages(stubAddress, size)) {
+            return 0;
+        }
+
+        freeList.pop_back();
+        stubCount++;
+        return stubAddress;
+    }
+
+    Region* region = modulePool.regions.empty() ? nullptr :
+                     &modulePool.regions.back();
+
+    if (region == nullptr
+            || region->bumpOffset + slotSize > pageAllocator.getRegionSize()) {
+        uintptr_t regionAddress = pageAllocator.allocateNear(moduleAddress,
+                                  pageAllocator.getRegionSize());
+
+        if (regionAddress == 0) {
+            return 0;
+        }
+
+        size_t pageCount = pageAllocator.getRegionSize() / pageAllocator.getPageSize();
+        modulePool.regions.push_back({ regionAddress, 0,
+                                       std::vector<PageState>(pageCount, PageState{ 0, false }) });
+        region = &modulePool.regions.back();
+    }
+
+    uintptr_t stubAddress = region->address + region->bumpOffset;
+
+    if (!openPages(stubAddress, size)) {
+        return 0;
+    }
+
+    region->bumpOffset += slotSize;
+    stubCount++;
+    return stubAddress;
+}
+
+void D2StubArena::freeStub(uintptr_t moduleAddress, uintptr_t stubAddress,
+                           size_t size) {
+    if (size == 0 || size > MAX_STUB_SIZE) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> arenaLock(arenaMutex);
+
+    size_t slotSize = (size + STUB_ALIGNMENT - 1) & ~(STUB_ALIGNMENT - 1);
+    getModulePool(moduleAddress).freeLists[slotSize / STUB_ALIGNMENT - 1].push_back(
+        stubAddress);
+    stubCount--;
+}
+
+bool D2StubArena::unsealStub(uintptr_t stubAddress, size_t size) {
+    std::lock_guard<std::mutex> arenaLock(arenaMutex);
+    return openPages(stubAddress, size);
+}
+
+bool D2StubArena::sealStub(uintptr_t stubAddress, size_t size) {
+    std::lock_guard<std::mutex> arenaLock(arenaMutex);
+    return closePages(stubAddress, size);
+}
+
+D2StubArena::Usage D2StubArena::getUsage() const {
+    std::lock_guard<std::mutex> arenaLock(arenaMutex);
+
+    Usage usage = { modulePools.size(), 0, 0, 0, 0, stubCount };
+
+    for (const auto& modulePool : modulePools) {
+        usage.regionCount += modulePool.regions.size();
+
+        for (const auto& region : modulePool.regions) {
+            usage.reservedBytes += pageAllocator.getRegionSize();
+            usage.allocatedBytes += region.bumpOffset;
+        }
+
+        for (size_t i = 0; i < SIZE_CLASS_COUNT; i++) {
+            usage.freeListBytes += modulePool.freeLists[i].size() * (i + 1) *
+                                   STUB_ALIGNMENT;
+        }
+    }
+
+    usage.allocatedBytes -= usage.freeListBytes;
+    return usage;
+}
+
+D2StubArena::ModulePool& D2StubArena::getModulePool(uintptr_t moduleAddress) {
+    for (auto& modulePool : modulePools) {
+        if (modulePool.moduleAddress == moduleAddress) {
+            return modulePool;
+        }
+    }
+
+    modulePools.emplace_back();
+    modulePools.back().moduleAddress = moduleAddress;
+    return modulePools.back();
+}
+
+D2StubArena::Region* D2StubArena::findRegion(uintptr_t address) {
+    for (auto& modulePool : modulePools) {
+        for (auto& region : modulePool.regions) {
+            if (address >= region.address
+                    && address < region.address + pageAllocator.getRegionSize()) {
+                return &region;
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+bool D2StubArena::openPages(uintptr_t address, size_t size) {
+    size_t pageSize = pageAllocator.getPageSize();
+    Region* region = findRegion(address);
+
+    if (region == nullptr) {
+        return false;
+    }
+
+    size_t firstIndex = (address - region->address) / pageSize;
+    size_t lastIndex = (address + size - 1 - region->address) / pageSize;
+
+    for (size_t i = firstIndex; i <= lastIndex; i++) {
+        PageState& pageState = region->pageStates[i];
+
+        // Fresh pages are already writable. Pages that were sealed may hold
+        // stubs that are running, so they are kept executable while written.
+        if (pageState.writerCount == 0 && pageState.executable
+                && !pageAllocator.protect(region->address + i * pageSize, pageSize,
+                                          D2PageProtection::READ_WRITE_EXECUTE)) {
+            if (i > firstIndex) {
+                closePages(region->address + firstIndex * pageSize,
+                           (i - firstIndex) * pageSize);
+            }
+
+            return false;
+        }
+
+        pageState.writerCount++;
+    }
+
+    return true;
+}
+
+bool D2StubArena::closePages(uintptr_t address, size_t size) {
+    size_t pageSize = pageAllocator.getPageSize();
+    Region* region = findRegion(address);
+
+    if (region == nullptr) {
+        return false;
+    }
+
+    size_t firstIndex = (address - region->address) / pageSize;
+    size_t lastIndex = (address + size - 1 - region->address) / pageSize;
+    bool sealSuccess = true;
+
+    // Pages that other stubs are still being written to are skipped, and
+    // each run of pages left without writers is protected in one call.
+    for (size_t runStart = firstIndex; runStart <= lastIndex;) {
+        PageState& pageState = region->pageStates[runStart];
+
+        if (pageState.writerCount == 0 || --pageState.writerCount > 0) {
+            runStart++;
+            continue;
+        }
+
+        size_t runEnd = runStart + 1;
+
+        while (runEnd <= lastIndex && region->pageStates[runEnd].writerCount == 1) {
+            region->pageStates[runEnd].writerCount = 0;
+            runEnd++;
+        }
+
+        if (pageAllocator.protect(region->address + runStart * pageSize,
+                                  (runEnd - runStart) * pageSize, D2PageProtection::READ_EXECUTE)) {
+            for (size_t i = runStart; i < runEnd; i++) {
+                region->pageStates[i].executable = true;
+            }
+        } else {
+            sealSuccess = false;
+        }
+
+        runStart = runEnd;
+    }
+
+    return sealSuccess;
+}
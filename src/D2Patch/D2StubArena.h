@@ -0,0 +1,129 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2StubArena.h                                                           *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2StubArena class, which hands out executable    *
+ *   memory for generated code such as trampolines, close to the module the  *
+ *   code is used from. The memory itself comes from a D2PageAllocator, so   *
+ *   the pooling logic does not depend on Windows.                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2STUBARENA_H
+#define _D2STUBARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+enum class D2PageProtection : int {
+    READ_WRITE,
+    READ_EXECUTE,
+    READ_WRITE_EXECUTE
+};
+
+class D2PageAllocator {
+public:
+    virtual ~D2PageAllocator() = default;
+
+    virtual size_t getPageSize() const = 0;
+    virtual size_t getRegionSize() const = 0;
+
+    // Reserves and commits a read-write region as close as possible to the
+    // given address. Returns 0 on failure.
+    virtual uintptr_t allocateNear(uintptr_t address, size_t size) = 0;
+    virtual bool protect(uintptr_t address, size_t size,
+                         D2PageProtection protection) = 0;
+    virtual void release(uintptr_t address, size_t size) = 0;
+};
+
+class D2StubArena {
+public:
+    struct Usage {
+        size_t moduleCount;
+        size_t regionCount;
+        size_t reservedBytes;
+        size_t allocatedBytes;
+        size_t freeListBytes;
+        size_t stubCount;
+    };
+
+    static constexpr size_t STUB_ALIGNMENT = 16;
+    static constexpr size_t MAX_STUB_SIZE = 256;
+
+    explicit D2StubArena(D2PageAllocator& pageAllocator);
+    ~D2StubArena();
+
+    // The stub is writable until it is sealed, and must be sealed before it
+    // is freed.
+    uintptr_t allocateStub(uintptr_t moduleAddress, size_t size);
+    void freeStub(uintptr_t moduleAddress, uintptr_t stubAddress, size_t size);
+
+    // Makes a stub that was already sealed writable again. Its pages stay
+    // executable, since other stubs on them may be running.
+    bool unsealStub(uintptr_t stubAddress, size_t size);
+
+    // Ends the writes to a stub. Its pages are made executable and read-only
+    // once no other stub on them is still being written, so that a caller
+    // never seals the page of a stub another thread is still building.
+    // Stubs that are all written before any of them is sealed only change
+    // the protection of each page once.
+    bool sealStub(uintptr_t stubAddress, size_t size);
+
+    Usage getUsage() const;
+
+private:
+    static constexpr size_t SIZE_CLASS_COUNT = MAX_STUB_SIZE / STUB_ALIGNMENT;
+
+    struct PageState {
+        // The number of stubs on the page that are allocated or unsealed,
+        // and not sealed yet.
+        uint32_t writerCount;
+        bool executable;
+    };
+
+    struct Region {
+        uintptr_t address;
+        size_t bumpOffset;
+        std::vector<PageState> pageStates;
+    };
+
+    struct ModulePool {
+        uintptr_t moduleAddress;
+        std::vector<Region> regions;
+        std::vector<uintptr_t> freeLists[SIZE_CLASS_COUNT];
+    };
+
+    D2PageAllocator& pageAllocator;
+    std::vector<ModulePool> modulePools;
+    size_t stubCount;
+    mutable std::mutex arenaMutex;
+
+    ModulePool& getModulePool(uintptr_t moduleAddress);
+    Region* findRegion(uintptr_t address);
+    bool openPages(uintptr_t address, size_t size);
+    bool closePages(uintptr_t address, size_t size);
+
+    D2StubArena(const D2StubArena&) = delete;
+    D2StubArena& operator=(const D2StubArena&) = delete;
+};
+
+#endif
@@ -0,0 +1,150 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2ThreadSuspender.cpp                                                   *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2ThreadSuspender class, which suspends every     *
+ *   other thread of the game while code is being replaced.                  *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2ThreadSuspender.h"
+
+#include <windows.h>
+#include <cstddef>
+#include <vector>
+
+#ifdef _WIN32
+#include <tlhelp32.h>
+
+D2ThreadSuspender::~D2ThreadSuspender() {
+    resume();
+}
+
+bool D2ThreadSuspender::suspend(const std::vector<AddressRange>& busyRanges) {
+    // A thread stopped in the middle of the code being replaced would resume
+    // on a partially written instruction, so let it run a bit and try again.
+    for (int i = 0; i < MAX_SUSPEND_ATTEMPTS; i++) {
+        if (suspendOnce(busyRanges)) {
+            return true;
+        }
+
+        resume();
+        Sleep(1);
+    }
+
+    return false;
+}
+
+void D2ThreadSuspender::resume() {
+    for (HANDLE threadHandle : suspendedThreads) {
+        ResumeThread(threadHandle);
+        CloseHandle(threadHandle);
+    }
+
+    suspendedThreads.clear();
+}
+
+size_t D2ThreadSuspender::getSuspendedCount() const {
+    return suspendedThreads.size();
+}
+
+bool D2ThreadSuspender::suspendOnce(const std::vector<AddressRange>&
+                                    busyRanges) {
+    // The threads are listed, and the room for their handles reserved,
+    // before the first one is suspended. Nothing may be allocated after
+    // that, since a suspended thread could be holding the heap lock.
+    threadIds.clear();
+
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+
+    if (snapshot == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    DWORD processId = GetCurrentProcessId();
+    DWORD threadId = GetCurrentThreadId();
+
+    THREADENTRY32 threadEntry;
+    threadEntry.dwSize = sizeof(threadEntry);
+
+    for (BOOL hasEntry = Thread32First(snapshot, &threadEntry); hasEntry;
+            hasEntry = Thread32Next(snapshot, &threadEntry)) {
+        if (threadEntry.th32OwnerProcessID == processId
+                && threadEntry.th32ThreadID != threadId) {
+            threadIds.push_back(threadEntry.th32ThreadID);
+        }
+    }
+
+    CloseHandle(snapshot);
+    suspendedThreads.reserve(threadIds.size());
+
+    bool threadsIdle = true;
+
+    for (DWORD suspendedThreadId : threadIds) {
+        HANDLE threadHandle = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT,
+                                         FALSE, suspendedThreadId);
+
+        // The thread has exited since the snapshot was taken.
+        if (threadHandle == nullptr) {
+            continue;
+        }
+
+        if (SuspendThread(threadHandle) == (DWORD) - 1) {
+            CloseHandle(threadHandle);
+            continue;
+        }
+
+        suspendedThreads.push_back(threadHandle);
+
+        // A thread whose position is unknown could be inside of the code
+        // being replaced, so it is treated as busy.
+        CONTEXT threadContext;
+        threadContext.ContextFlags = CONTEXT_CONTROL;
+
+        if (!GetThreadContext(threadHandle, &threadContext)) {
+            threadsIdle = false;
+            continue;
+        }
+
+        for (const auto& busyRange : busyRanges) {
+            if (threadContext.Eip >= busyRange.address
+                    && threadContext.Eip < busyRange.address + busyRange.size) {
+                threadsIdle = false;
+            }
+        }
+    }
+
+    return threadsIdle;
+}
+#else
+// Elsewhere the patches are only applied to an emulated process, which has
+// no threads of its own to stop.
+D2ThreadSuspender::~D2ThreadSuspender() {
+}
+
+bool D2ThreadSuspender::suspend(const std::vector<AddressRange>&) {
+    return true;
+}
+
+void D2ThreadSuspender::resume() {
+}
+
+size_t D2ThreadSuspender::getSuspendedCount() const {
+    return suspendedThreads.size();
+}
+#endif
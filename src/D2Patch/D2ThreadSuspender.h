@@ -0,0 +1,61 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2ThreadSuspender.h                                                     *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2ThreadSuspender class, which suspends every    *
+ *   other thread of the game while code is being replaced.                  *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2THREADSUSPENDER_H
+#define _D2THREADSUSPENDER_H
+
+#include <windows.h>
+#include <cstddef>
+#include <vector>
+
+class D2ThreadSuspender {
+public:
+    struct AddressRange {
+        DWORD address;
+        size_t size;
+    };
+
+    D2ThreadSuspender() = default;
+    ~D2ThreadSuspender();
+
+    bool suspend(const std::vector<AddressRange>& busyRanges);
+    void resume();
+
+    size_t getSuspendedCount() const;
+
+private:
+    static constexpr int MAX_SUSPEND_ATTEMPTS = 16;
+
+    std::vector<DWORD> threadIds;
+    std::vector<HANDLE> suspendedThreads;
+
+    bool suspendOnce(const std::vector<AddressRange>& busyRanges);
+
+    D2ThreadSuspender(const D2ThreadSuspender&) = delete;
+    D2ThreadSuspender& operator=(const D2ThreadSuspender&) = delete;
+};
+
+#endif
@@ -0,0 +1,449 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2X86Decoder.cpp                                                        *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the x86 instruction length decoder and the relocator  *
+ *   used to move the first instructions of a function into a trampoline.    *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2X86Decoder.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+enum OpcodeFlags : uint16_t {
+    NONE = 0,
+    M = 1 << 0,     // ModRM byte follows
+    I8 = 1 << 1,    // 8-bit immediate
+    IZ = 1 << 2,    // 16 or 32-bit immediate, depending on operand size
+    I16 = 1 << 3,   // 16-bit immediate
+    R8 = 1 << 4,    // 8-bit relative branch
+    RZ = 1 << 5,    // 16 or 32-bit relative branch
+    MO = 1 << 6,    // memory offset, depending on address size
+    FP = 1 << 7,    // far pointer
+    G3 = 1 << 8,    // group 3, immediate only for TEST
+    P = 1 << 9,     // prefix
+    X = 1 << 10     // invalid or unsupported
+};
+
+constexpr uint16_t ONE_BYTE_OPCODES[256] = {
+    /*       0       1       2       3       4       5       6       7       8       9       A       B       C       D       E       F */
+    /* 0 */  M,      M,      M,      M,      I8,     IZ,     NONE,   NONE,   M,      M,      M,      M,      I8,     IZ,     NONE,   X,
+    /* 1 */  M,      M,      M,      M,      I8,     IZ,     NONE,   NONE,   M,      M,      M,      M,      I8,     IZ,     NONE,   NONE,
+    /* 2 */  M,      M,      M,      M,      I8,     IZ,     P,      NONE,   M,      M,      M,      M,      I8,     IZ,     P,      NONE,
+    /* 3 */  M,      M,      M,      M,      I8,     IZ,     P,      NONE,   M,      M,      M,      M,      I8,     IZ,     P,      NONE,
+    /* 4 */  NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,
+    /* 5 */  NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,
+    /* 6 */  NONE,   NONE,   M,      M,      P,      P,      P,      P,      IZ,     M | IZ, I8,     M | I8, NONE,   NONE,   NONE,   NONE,
+    /* 7 */  R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,     R8,
+    /* 8 */  M | I8, M | IZ, M | I8, M | I8, M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+    /* 9 */  NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   FP,     NONE,   NONE,   NONE,   NONE,   NONE,
+    /* A */  MO,     MO,     MO,     MO,     NONE,   NONE,   NONE,   NONE,   I8,     IZ,     NONE,   NONE,   NONE,   NONE,   NONE,   NONE,
+    /* B */  I8,     I8,     I8,     I8,     I8,     I8,     I8,     I8,     IZ,     IZ,     IZ,     IZ,     IZ,     IZ,     IZ,     IZ,
+    /* C */  M | I8, M | I8, I16,    NONE,   M,      M,      M | I8, M | IZ, I16 | I8, NONE, I16,    NONE,   NONE,   I8,     NONE,   NONE,
+    /* D */  M,      M,      M,      M,      I8,     I8,     NONE,   NONE,   M,      M,      M,      M,      M,      M,      M,      M,
+    /* E */  R8,     R8,     R8,     R8,     I8,     I8,     I8,     I8,     RZ,     RZ,     FP,     R8,     NONE,   NONE,   NONE,   NONE,
+    /* F */  P,      NONE,   P,      P,      NONE,   NONE,   M | G3, M | G3, NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   M,      M
+};
+
+constexpr uint16_t TWO_BYTE_OPCODES[256] = {
+    /*       0       1       2       3       4       5       6       7       8       9       A       B       C       D       E       F */
+    /* 0 */  M,      M,      M,      M,      X,      NONE,   NONE,   NONE,   NONE,   NONE,   X,      NONE,   X,      M,      NONE,   M | I8,
+    /* 1 */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+    /* 2 */  M,      M,      M,      M,      X,      X,      X,      X,      M,      M,      M,      M,      M,      M,      M,      M,
+    /* 3 */  NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   X,      NONE,   M,      X,      M | I8, X,      X,      X,      X,      X,
+    /* 4 */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+    /* 5 */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+    /* 6 */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+    /* 7 */  M | I8, M | I8, M | I8, M | I8, M,      M,      M,      NONE,   M,      M,      X,      X,      M,      M,      M,      M,
+    /* 8 */  RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,     RZ,
+    /* 9 */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+    /* A */  NONE,   NONE,   NONE,   M,      M | I8, M,      X,      X,      NONE,   NONE,   NONE,   M,      M | I8, M,      M,      M,
+    /* B */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M | I8, M,      M,      M,      M,      M,
+    /* C */  M,      M,      M | I8, M,      M | I8, M | I8, M | I8, M,      NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,   NONE,
+    /* D */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+    /* E */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,
+    /* F */  M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M,      M
+};
+
+// Returns the number of bytes taken by the ModRM byte, the SIB byte and the
+// displacement, or 0 if they do not fit.
+size_t getModRMLength(const uint8_t* code, size_t available,
+                      bool addressSize16) {
+    if (available < 1) {
+        return 0;
+    }
+
+    uint8_t modRM = code[0];
+    uint8_t mod = modRM >> 6;
+    uint8_t rm = modRM & 7;
+    size_t length = 1;
+
+    if (mod == 3) {
+        return length;
+    }
+
+    if (addressSize16) {
+        if (mod == 0 && rm == 6) {
+            length += 2;
+        } else if (mod == 1) {
+            length += 1;
+        } else if (mod == 2) {
+            length += 2;
+        }
+    } else {
+        if (rm == 4) {
+            if (available < 2) {
+                return 0;
+            }
+
+            length += 1;
+
+            if (mod == 0 && (code[1] & 7) == 5) {
+                length += 4;
+            }
+        } else if (mod == 0 && rm == 5) {
+            length += 4;
+        }
+
+        if (mod == 1) {
+            length += 1;
+        } else if (mod == 2) {
+            length += 4;
+        }
+    }
+
+    return (length <= available) ? length : 0;
+}
+
+void writeInt32(uint8_t* destination, int32_t value) {
+    std::memcpy(destination, &value, sizeof(value));
+}
+}
+
+bool D2X86Decoder::decodeInstruction(const uint8_t* code, size_t available,
+                                     D2X86Instruction& instruction) {
+    std::memset(&instruction, 0, sizeof(instruction));
+
+    if (available > MAX_INSTRUCTION_LENGTH) {
+        available = MAX_INSTRUCTION_LENGTH;
+    }
+
+    bool operandSize16 = false;
+    bool addressSize16 = false;
+    size_t position = 0;
+
+    while (position < available && (ONE_BYTE_OPCODES[code[position]] & P)) {
+        if (code[position] == 0x66) {
+            operandSize16 = true;
+        } else if (code[position] == 0x67) {
+            addressSize16 = true;
+        }
+
+        position++;
+    }
+
+    if (position >= available) {
+        return false;
+    }
+
+    instruction.opcodeOffset = position;
+    uint16_t flags;
+
+    if (code[position] == 0x0F) {
+        position++;
+
+        if (position >= available) {
+            return false;
+        }
+
+        instruction.twoByteOpcode = true;
+        instruction.opcode = code[position];
+        flags = TWO_BYTE_OPCODES[code[position]];
+
+        // Three byte opcodes: 0F 38 xx takes a ModRM byte, and 0F 3A xx takes
+        // a ModRM byte and an 8-bit immediate.
+        if (code[position] == 0x38 || code[position] == 0x3A) {
+            position++;
+
+            if (position >= available) {
+                return false;
+            }
+        }
+    } else {
+        instruction.opcode = code[position];
+        flags = ONE_BYTE_OPCODES[code[position]];
+    }
+
+    position++;
+
+    if (flags & X) {
+        return false;
+    }
+
+    uint8_t modRMReg = 0;
+
+    if (flags & M) {
+        size_t modRMLength = getModRMLength(&code[position], available - position,
+                                            addressSize16);
+
+        if (modRMLength == 0) {
+            return false;
+        }
+
+        modRMReg = (code[position] >> 3) & 7;
+        position += modRMLength;
+    }
+
+    size_t immediateSize = 0;
+
+    if (flags & I8) {
+        immediateSize += 1;
+    }
+
+    if (flags & I16) {
+        immediateSize += 2;
+    }
+
+    if (flags & IZ) {
+        immediateSize += operandSize16 ? 2 : 4;
+    }
+
+    if (flags & MO) {
+        immediateSize += addressSize16 ? 2 : 4;
+    }
+
+    if (flags & FP) {
+        immediateSize += operandSize16 ? 4 : 6;
+    }
+
+    if ((flags & G3) && modRMReg <= 1) {
+        immediateSize += (instruction.opcode == 0xF6) ? 1 : (operandSize16 ? 2 : 4);
+    }
+
+    if (flags & (R8 | RZ)) {
+        instruction.displacementOffset = position;
+        instruction.displacementSize = (flags & R8) ? 1 : (operandSize16 ? 2 : 4);
+        immediateSize += instruction.displacementSize;
+
+        if (flags & R8) {
+            if (instruction.opcode == 0xEB) {
+                instruction.branchKind = D2X86BranchKind::JMP_REL8;
+            } else if (instruction.opcode >= 0xE0 && instruction.opcode <= 0xE3) {
+                instruction.branchKind = D2X86BranchKind::LOOP_REL8;
+            } else {
+                instruction.branchKind = D2X86BranchKind::JCC_REL8;
+            }
+        } else if (instruction.twoByteOpcode) {
+            instruction.branchKind = D2X86BranchKind::JCC_REL32;
+        } else if (instruction.opcode == 0xE8) {
+            instruction.branchKind = D2X86BranchKind::CALL_REL32;
+        } else {
+            instruction.branchKind = D2X86BranchKind::JMP_REL32;
+        }
+    }
+
+    position += immediateSize;
+
+    if (position > available) {
+        return false;
+    }
+
+    instruction.length = position;
+
+    if (!instruction.twoByteOpcode) {
+        switch (instruction.opcode) {
+        case 0xC2: case 0xC3: case 0xCA: case 0xCB: case 0xCF:
+        case 0xE9: case 0xEA: case 0xEB:
+            instruction.terminator = true;
+            break;
+
+        case 0xFF:
+            instruction.terminator = (modRMReg == 4 || modRMReg == 5);
+            break;
+        }
+    }
+
+    return true;
+}
+
+int32_t D2X86Decoder::getBranchDisplacement(const uint8_t* code,
+        const D2X86Instruction& instruction) {
+    const uint8_t* displacement = &code[instruction.displacementOffset];
+
+    switch (instruction.displacementSize) {
+    case 1:
+        return (int8_t) displacement[0];
+
+    case 2: {
+        int16_t displacement16;
+        std::memcpy(&displacement16, displacement, sizeof(displacement16));
+        return displacement16;
+    }
+
+    default: {
+        int32_t displacement32;
+        std::memcpy(&displacement32, displacement, sizeof(displacement32));
+        return displacement32;
+    }
+    }
+}
+
+bool D2X86Decoder::relocateInstructions(const uint8_t* source,
+                                        uint32_t sourceAddress, size_t sourceAvailable, size_t minimumLength,
+                                        uint8_t* destination, uint32_t destinationAddress,
+                                        size_t destinationCapacity, size_t& sourceLength,
+                                        size_t& destinationLength) {
+    static constexpr size_t MAX_RELOCATED_INSTRUCTIONS = 16;
+
+    D2X86Instruction instructions[MAX_RELOCATED_INSTRUCTIONS];
+    size_t sourceOffsets[MAX_RELOCATED_INSTRUCTIONS];
+    size_t destinationOffsets[MAX_RELOCATED_INSTRUCTIONS];
+    size_t instructionCount = 0;
+
+    // First pass: decode the instructions, and work out where each of them
+    // ends up once the short branches are widened.
+    size_t sourceOffset = 0;
+    size_t destinationOffset = 0;
+
+    while (sourceOffset < minimumLength) {
+        if (instructionCount == MAX_RELOCATED_INSTRUCTIONS) {
+            return false;
+        }
+
+        D2X86Instruction& instruction = instructions[instructionCount];
+
+        if (!decodeInstruction(&source[sourceOffset], sourceAvailable - sourceOffset,
+                               instruction)) {
+            return false;
+        }
+
+        // Branches with a 16-bit displacement cannot be widened safely.
+        if (instruction.branchKind != D2X86BranchKind::NONE
+                && instruction.displacementSize == 2) {
+            return false;
+        }
+
+        sourceOffsets[instructionCount] = sourceOffset;
+        destinationOffsets[instructionCount] = destinationOffset;
+        instructionCount++;
+
+        sourceOffset += instruction.length;
+
+        switch (instruction.branchKind) {
+        case D2X86BranchKind::JMP_REL8:
+            destinationOffset += 5;
+            break;
+
+        case D2X86BranchKind::JCC_REL8:
+            destinationOffset += 6;
+            break;
+
+        case D2X86BranchKind::LOOP_REL8:
+            // LOOP/JECXZ have no rel32 form: loop +2, jmp short +5, jmp rel32.
+            destinationOffset += instruction.opcodeOffset + 9;
+            break;
+
+        default:
+            destinationOffset += instruction.length;
+            break;
+        }
+
+        // The function ends before enough bytes were found, so the bytes
+        // after it may belong to something else.
+        if (instruction.terminator && sourceOffset < minimumLength) {
+            return false;
+        }
+    }
+
+    if (destinationOffset > destinationCapacity) {
+        return false;
+    }
+
+    // Second pass: emit the instructions. Branches that land inside the
+    // copied bytes are pointed at the matching relocated instruction.
+    for (size_t i = 0; i < instructionCount; i++) {
+        const D2X86Instruction& instruction = instructions[i];
+        const uint8_t* sourceInstruction = &source[sourceOffsets[i]];
+        uint8_t* destinationInstruction = &destination[destinationOffsets[i]];
+
+        if (instruction.branchKind == D2X86BranchKind::NONE) {
+            std::memcpy(destinationInstruction, sourceInstruction, instruction.length);
+            continue;
+        }
+
+        uint32_t targetAddress = sourceAddress + sourceOffsets[i] + instruction.length +
+                                 getBranchDisplacement(sourceInstruction, instruction);
+
+        if (targetAddress >= sourceAddress
+                && targetAddress < sourceAddress + sourceOffset) {
+            size_t target = 0;
+
+            while (target < instructionCount
+                    && sourceAddress + sourceOffsets[target] != targetAddress) {
+                target++;
+            }
+
+            // The branch lands in the middle of a copied instruction.
+            if (target == instructionCount) {
+                return false;
+            }
+
+            targetAddress = destinationAddress + destinationOffsets[target];
+        }
+
+        uint32_t instructionAddress = destinationAddress + destinationOffsets[i];
+
+        switch (instruction.branchKind) {
+        case D2X86BranchKind::JMP_REL8:
+            destinationInstruction[0] = 0xE9;
+            writeInt32(&destinationInstruction[1], targetAddress - (instructionAddress + 5));
+            break;
+
+        case D2X86BranchKind::JCC_REL8:
+            destinationInstruction[0] = 0x0F;
+            destinationInstruction[1] = 0x80 | (instruction.opcode & 0x0F);
+            writeInt32(&destinationInstruction[2], targetAddress - (instructionAddress + 6));
+            break;
+
+        case D2X86BranchKind::LOOP_REL8:
+            std::memcpy(destinationInstruction, sourceInstruction,
+                        instruction.opcodeOffset + 1);
+            destinationInstruction[instruction.opcodeOffset + 1] = 0x02;
+            destinationInstruction[instruction.opcodeOffset + 2] = 0xEB;
+            destinationInstruction[instruction.opcodeOffset + 3] = 0x05;
+            destinationInstruction[instruction.opcodeOffset + 4] = 0xE9;
+            writeInt32(&destinationInstruction[instruction.opcodeOffset + 5],
+                       targetAddress - (instructionAddress + instruction.opcodeOffset + 9));
+            break;
+
+        default:
+            std::memcpy(destinationInstruction, sourceInstruction, instruction.length);
+            writeInt32(&destinationInstruction[instruction.displacementOffset],
+                       targetAddress - (instructionAddress + instruction.length));
+            break;
+        }
+    }
+
+    sourceLength = sourceOffset;
+    destinationLength = destinationOffset;
+    return true;
+}
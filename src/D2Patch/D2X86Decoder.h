@@ -0,0 +1,79 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2X86Decoder.h                                                          *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the x86 instruction length decoder and the relocator *
+ *   used to move the first instructions of a function into a trampoline.    *
+ *   Neither depends on Windows, so they can be used on raw byte buffers on  *
+ *   any platform.                                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2X86DECODER_H
+#define _D2X86DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum class D2X86BranchKind : int {
+    NONE,
+    JMP_REL8,
+    JCC_REL8,
+    LOOP_REL8,
+    JMP_REL32,
+    CALL_REL32,
+    JCC_REL32
+};
+
+struct D2X86Instruction {
+    size_t length;
+    size_t opcodeOffset;
+    bool twoByteOpcode;
+    uint8_t opcode;
+    D2X86BranchKind branchKind;
+
+    // The position and size of the relative displacement of a branch.
+    size_t displacementOffset;
+    size_t displacementSize;
+
+    // Set for instructions after which execution never falls through, such
+    // as RET or an unconditional JMP.
+    bool terminator;
+};
+
+namespace D2X86Decoder {
+static constexpr size_t MAX_INSTRUCTION_LENGTH = 15;
+
+bool decodeInstruction(const uint8_t* code, size_t available,
+                       D2X86Instruction& instruction);
+int32_t getBranchDisplacement(const uint8_t* code,
+                              const D2X86Instruction& instruction);
+
+// Copies whole instructions from source until at least minimumLength bytes
+// are covered, rewriting every relative branch so that it still reaches the
+// same target from the destination address. Short branches are widened to
+// their rel32 forms, so the copy may be longer than the source.
+bool relocateInstructions(const uint8_t* source, uint32_t sourceAddress,
+                          size_t sourceAvailable, size_t minimumLength, uint8_t* destination,
+                          uint32_t destinationAddress, size_t destinationCapacity,
+                          size_t& sourceLength, size_t& destinationLength);
+}
+
+#endif
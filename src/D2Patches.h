@@ -31,16 +31,14 @@
 #ifndef _D2PATCHES_H
 #define _D2PATCHES_H
 
-#include <memory>
-#include <vector>
-
 #include "D2Patch.h"
 #include "DLLmain.h"
 
-static const std::vector<std::shared_ptr<D2BasePatch>> gptTemplatePatches = {
-    std::make_shared<D2AnyPatch>(D2Offset(D2TEMPLATE_DLL_FILES::D2DLL_D2CLIENT, {
-        {GameVersion::VERSION_113c, 0},
-    }), OpCode::NOP, false, 0),
+// Patches are declared as constant records, so the table is built by the
+// compiler and needs no allocation or initialization before DllAttach runs.
+inline constexpr D2PatchDescriptor gptTemplatePatches[] = {
+    D2PatchDescriptor::makeAnyPatch(D2OffsetId::D2CLIENT_TemplatePatch,
+                                    OpCode::NOP, false, 0),
 };
 
 // end of file --------------------------------------------------------------
@@ -0,0 +1,122 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2Pointer.cpp                                                           *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2Pointer class, which holds a single pointer     *
+ *   declared in D2Ptrs.h, and the D2PointerTable class, which resolves      *
+ *   every declared pointer once for the whole process.                      *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2Pointer.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "D2Offset.h"
+#include "D2SymbolTable.h"
+
+D2PointerBase::D2PointerBase(const char* name, D2SymbolType type,
+                             D2TEMPLATE_DLL_FILES dllFile,
+                             const D2OffsetTable& offsetTable) : name(name),
+    d2Offset(dllFile, offsetTable), address(0) {
+    D2PointerTable::getInstance().registerPointer(*this);
+    D2SymbolTable::getInstance().registerSymbol(name, type, d2Offset);
+}
+
+DWORD D2PointerBase::resolve() const {
+    DWORD currentAddress = address.load(std::memory_order_acquire);
+
+    if (currentAddress != 0) {
+        return currentAddress;
+    }
+
+    // Two threads may both resolve the pointer, but they get the same address.
+    currentAddress = d2Offset.getCurrentAddress();
+
+    if (currentAddress != 0) {
+        address.store(currentAddress, std::memory_order_release);
+    }
+
+    return currentAddress;
+}
+
+const char* D2PointerBase::getName() const {
+    return name;
+}
+
+const D2Offset& D2PointerBase::getD2Offset() const {
+    return d2Offset;
+}
+
+D2PointerTable::D2PointerTable() : lastResolveStats() {
+}
+
+D2PointerTable& D2PointerTable::getInstance() {
+    static D2PointerTable instance;
+    return instance;
+}
+
+void D2PointerTable::registerPointer(const D2PointerBase& pointer) {
+    std::lock_guard<std::mutex> tableLock(tableMutex);
+    pointers.push_back(&pointer);
+}
+
+D2PointerResolveStats D2PointerTable::resolveAll() {
+    std::lock_guard<std::mutex> tableLock(tableMutex);
+    auto startTime = std::chrono::steady_clock::now();
+
+    // Resolving the pointers of one module after another keeps the module
+    // lookups and the offset cache records hot.
+    std::vector<const D2PointerBase*> sortedPointers(pointers);
+    std::stable_sort(sortedPointers.begin(), sortedPointers.end(),
+    [](const D2PointerBase * left, const D2PointerBase * right) {
+        return left->getD2Offset().getDllFile() < right->getD2Offset().getDllFile();
+    });
+
+    D2PointerResolveStats resolveStats = { sortedPointers.size(), 0, 0, 0 };
+
+    for (const auto& pointer : sortedPointers) {
+        if (pointer->resolve() != 0) {
+            resolveStats.resolvedCount++;
+        } else {
+            resolveStats.failedCount++;
+        }
+    }
+
+    resolveStats.elapsedMicroseconds = (uint64_t)
+                                       std::chrono::duration_cast<std::chrono::microseconds>(
+                                           std::chrono::steady_clock::now() - startTime).count();
+
+    lastResolveStats = resolveStats;
+    return resolveStats;
+}
+
+D2PointerResolveStats D2PointerTable::getLastResolveStats() {
+    std::lock_guard<std::mutex> tableLock(tableMutex);
+    return lastResolveStats;
+}
+
+size_t D2PointerTable::getPointerCount() {
+    std::lock_guard<std::mutex> tableLock(tableMutex);
+    return pointers.size();
+}
@@ -0,0 +1,132 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2Pointer.h                                                             *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2Pointer class, which holds a single pointer    *
+ *   declared in D2Ptrs.h, and the D2PointerTable class, which resolves      *
+ *   every declared pointer once for the whole process.                      *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2POINTER_H
+#define _D2POINTER_H
+
+#include <windows.h>
+#include <cstddef>
+#include <cstdint>
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "D2Offset.h"
+#include "D2SymbolTable.h"
+#include "D2Version.h"
+
+#if defined(__GNUC__)
+#define D2POINTER_LIKELY(condition) __builtin_expect(!!(condition), 1)
+#else
+#define D2POINTER_LIKELY(condition) (condition)
+#endif
+
+class D2PointerBase {
+public:
+    // Only registers the pointer. Nothing is resolved until the pointer is
+    // first used or the table is resolved, so that construction can safely
+    // happen during static initialization.
+    D2PointerBase(const char* name, D2SymbolType type,
+                  D2TEMPLATE_DLL_FILES dllFile,
+                  const D2OffsetTable& offsetTable);
+
+    D2PointerBase(const D2PointerBase&) = delete;
+    D2PointerBase& operator=(const D2PointerBase&) = delete;
+
+    DWORD getAddress() const {
+        DWORD currentAddress = address.load(std::memory_order_acquire);
+
+        if (D2POINTER_LIKELY(currentAddress != 0)) {
+            return currentAddress;
+        }
+
+        return resolve();
+    }
+
+    // Resolves the address again if it is not known yet. Returns 0 if it
+    // could not be resolved.
+    DWORD resolve() const;
+
+    const char* getName() const;
+    const D2Offset& getD2Offset() const;
+
+private:
+    const char* name;
+    D2Offset d2Offset;
+    mutable std::atomic<DWORD> address;
+};
+
+// T is the type the pointer is used as, such as a function pointer type, a
+// pointer to a variable, or DWORD.
+template<class T>
+class D2Pointer : public D2PointerBase {
+public:
+    using D2PointerBase::D2PointerBase;
+
+    operator T() const {
+        return (T)(uintptr_t) getAddress();
+    }
+
+    T operator->() const {
+        return (T)(uintptr_t) getAddress();
+    }
+
+    T get() const {
+        return (T)(uintptr_t) getAddress();
+    }
+};
+
+struct D2PointerResolveStats {
+    size_t pointerCount;
+    size_t resolvedCount;
+    size_t failedCount;
+    uint64_t elapsedMicroseconds;
+};
+
+class D2PointerTable {
+public:
+    static D2PointerTable& getInstance();
+
+    void registerPointer(const D2PointerBase& pointer);
+
+    // Resolves every pointer that is not resolved yet in one pass, grouped by
+    // module. Pointers that are used before this still resolve themselves.
+    D2PointerResolveStats resolveAll();
+
+    D2PointerResolveStats getLastResolveStats();
+    size_t getPointerCount();
+
+private:
+    std::mutex tableMutex;
+    std::vector<const D2PointerBase*> pointers;
+    D2PointerResolveStats lastResolveStats;
+
+    D2PointerTable();
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2ProcessBackend.cpp                                                    *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the functions shared by every process backend, and    *
+ *   the selection of the backend used by the patch, offset and version      *
+ *   code.                                                                   *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2ProcessBackend.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "D2PEImage.h"
+
+#ifdef _WIN32
+#include "D2Win32Process.h"
+#else
+#include "D2EmulatedProcess.h"
+#endif
+
+namespace {
+std::atomic<D2ProcessBackend*> currentBackend(nullptr);
+std::atomic<uint32_t> backendGeneration(1);
+
+D2ProcessBackend& getDefaultBackend() {
+#ifdef _WIN32
+    static D2Win32Process defaultBackend;
+#else
+    // There is no game to attach to, so an empty process stands in for it.
+    static D2EmulatedProcess defaultBackend;
+#endif
+    return defaultBackend;
+}
+}
+
+D2ProcessBackend& D2ProcessBackend::getCurrent() {
+    D2ProcessBackend* backend = currentBackend.load(std::memory_order_acquire);
+    return (backend != nullptr) ? *backend : getDefaultBackend();
+}
+
+void D2ProcessBackend::setCurrent(D2ProcessBackend* backend) {
+    currentBackend.store(backend, std::memory_order_release);
+    backendGeneration.fetch_add(1, std::memory_order_acq_rel);
+}
+
+uint32_t D2ProcessBackend::getGeneration() {
+    return backendGeneration.load(std::memory_order_acquire);
+}
+
+bool D2ProcessBackend::isReadable(uint32_t protection) {
+    return (protection & (PROTECTION_READONLY | PROTECTION_READWRITE |
+                          PROTECTION_EXECUTE_READ | PROTECTION_EXECUTE_READWRITE)) != 0;
+}
+
+bool D2ProcessBackend::isWritable(uint32_t protection) {
+    return (protection & (PROTECTION_READWRITE | PROTECTION_EXECUTE_READWRITE))
+           != 0;
+}
+
+bool D2ProcessBackend::writeUnprotectedMemory(uintptr_t address,
+        const void* buffer, size_t size) {
+    return writeMemory(address, buffer, size);
+}
+
+const uint8_t* D2ProcessBackend::getModuleImageView(uintptr_t moduleHandle,
+        size_t& imageSize) const {
+    // The headers of an image fit in its first page.
+    const uint8_t* headers = getMemoryView(moduleHandle, getPageSize());
+
+    if (headers == nullptr) {
+        return nullptr;
+    }
+
+    D2PEImage headerImage(headers, getPageSize(), D2PEImageLayout::MAPPED);
+
+    if (!headerImage.isValid()) {
+        return nullptr;
+    }
+
+    imageSize = headerImage.getSizeOfImage();
+    return getMemoryView(moduleHandle, imageSize);
+}
@@ -0,0 +1,100 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2ProcessBackend.h                                                      *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2ProcessBackend interface, through which the    *
+ *   patch, offset and version code access the memory and modules of the     *
+ *   game process.                                                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2PROCESSBACKEND_H
+#define _D2PROCESSBACKEND_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+struct D2MemoryRegion {
+    uintptr_t baseAddress;
+    size_t regionSize;
+    uint32_t protection;
+    bool committed;
+};
+
+class D2ProcessBackend {
+public:
+    // Page protections use the values of the Windows PAGE_* constants.
+    static constexpr uint32_t PROTECTION_NOACCESS = 0x01;
+    static constexpr uint32_t PROTECTION_READONLY = 0x02;
+    static constexpr uint32_t PROTECTION_READWRITE = 0x04;
+    static constexpr uint32_t PROTECTION_EXECUTE = 0x10;
+    static constexpr uint32_t PROTECTION_EXECUTE_READ = 0x20;
+    static constexpr uint32_t PROTECTION_EXECUTE_READWRITE = 0x40;
+
+    virtual ~D2ProcessBackend() = default;
+
+    // The Windows backend is used unless another one is set. Passing nullptr
+    // restores it. The backend must not be changed while patches are applied.
+    static D2ProcessBackend& getCurrent();
+    static void setCurrent(D2ProcessBackend* backend);
+    // Changes every time the backend is set, so that addresses resolved in
+    // another backend can be told apart. It starts at 1.
+    static uint32_t getGeneration();
+
+    static bool isReadable(uint32_t protection);
+    static bool isWritable(uint32_t protection);
+
+    virtual size_t getPageSize() const = 0;
+
+    virtual bool readMemory(uintptr_t address, void* buffer, size_t size) = 0;
+    virtual bool writeMemory(uintptr_t address, const void* buffer,
+                             size_t size) = 0;
+    // Only called on memory that was made writable beforehand, so that the
+    // backend can skip any checks it can afford to.
+    virtual bool writeUnprotectedMemory(uintptr_t address, const void* buffer,
+                                        size_t size);
+
+    virtual bool protectMemory(uintptr_t address, size_t size,
+                               uint32_t protection, uint32_t& oldProtection) = 0;
+    virtual bool queryMemory(uintptr_t address, D2MemoryRegion& region) const = 0;
+    virtual void flushInstructionCache(uintptr_t address, size_t size) = 0;
+
+    // Returns a pointer through which the range can be read directly, or
+    // nullptr if it is not contiguous in this process.
+    virtual const uint8_t* getMemoryView(uintptr_t address, size_t size) const = 0;
+    // Returns a view of a whole mapped PE image, or nullptr if the headers
+    // found at the handle are not valid.
+    const uint8_t* getModuleImageView(uintptr_t moduleHandle,
+                                      size_t& imageSize) const;
+
+    virtual uintptr_t getModuleHandle(std::wstring_view moduleName) = 0;
+    virtual uintptr_t loadModule(std::wstring_view moduleName) = 0;
+    virtual uintptr_t getProcAddress(uintptr_t moduleHandle, uint16_t ordinal) = 0;
+    virtual uintptr_t getProcAddress(uintptr_t moduleHandle,
+                                     std::string_view procName) = 0;
+
+    // Reads the fixed file version of a file, as split by the version
+    // resource into its most and least significant halves.
+    virtual bool getFileVersion(std::wstring_view filePath, uint32_t& versionMS,
+                                uint32_t& versionLS) = 0;
+};
+
+#endif
@@ -35,6 +35,9 @@
 #define _D2PTRS_H
 
 #include "D2Offset.h"
+#include "D2OffsetDatabase.h"
+#include "D2Pointer.h"
+#include "D2SymbolTable.h"
 #include "D2Version.h"
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -43,19 +46,32 @@
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 #define ESCAPE_PARENTHESES(...) __VA_ARGS__
 
+// Each pointer is an inline variable, so there is a single copy of it in the
+// whole process however many files include this header. It is resolved on
+// first use, or by D2PointerTable::resolveAll, whichever comes first.
 #define D2FUNC(DLL, NAME, RETURN, CONV, ARGS, OFFSETS) \
     typedef RETURN (CONV * DLL##_##NAME##_t) ARGS; \
-    static D2Offset DLL##_##NAME##_FUNC_OFFSET (D2TEMPLATE_DLL_FILES::D2DLL_##DLL, { ESCAPE_PARENTHESES OFFSETS }); \
-    static DLL##_##NAME##_t DLL##_##NAME = (DLL##_##NAME##_t)(DLL##_##NAME##_FUNC_OFFSET.getCurrentAddress());
+    inline D2Pointer<DLL##_##NAME##_t> DLL##_##NAME (#DLL "_" #NAME, D2SymbolType::FUNCTION, D2TEMPLATE_DLL_FILES::D2DLL_##DLL, D2OffsetTable::make({ ESCAPE_PARENTHESES OFFSETS }));
 
 #define D2VAR(DLL, NAME, TYPE, OFFSETS) \
     typedef TYPE DLL##_##NAME##_vt; \
-    static D2Offset DLL##_##NAME##_VAR_OFFSET (D2TEMPLATE_DLL_FILES::D2DLL_##DLL, { ESCAPE_PARENTHESES OFFSETS }); \
-    static DLL##_##NAME##_vt * DLL##_##NAME = (DLL##_##NAME##_vt *)(DLL##_##NAME##_VAR_OFFSET.getCurrentAddress());
+    inline D2Pointer<DLL##_##NAME##_vt *> DLL##_##NAME (#DLL "_" #NAME, D2SymbolType::VARIABLE, D2TEMPLATE_DLL_FILES::D2DLL_##DLL, D2OffsetTable::make({ ESCAPE_PARENTHESES OFFSETS }));
 
 #define D2PTR(DLL, NAME, OFFSETS) \
-    static D2Offset DLL##_##NAME##_PTR_OFFSET (D2TEMPLATE_DLL_FILES::D2DLL_##DLL, { ESCAPE_PARENTHESES OFFSETS }); \
-    static DWORD DLL##_##NAME = (DLL##_##NAME##_PTR_OFFSET.getCurrentAddress());
+    inline D2Pointer<DWORD> DLL##_##NAME (#DLL "_" #NAME, D2SymbolType::POINTER, D2TEMPLATE_DLL_FILES::D2DLL_##DLL, D2OffsetTable::make({ ESCAPE_PARENTHESES OFFSETS }));
+
+// The same, for pointers whose offsets are listed in D2Offsets.tsv under the
+// given DLL and name.
+#define D2FUNC_DB(DLL, NAME, RETURN, CONV, ARGS) \
+    typedef RETURN (CONV * DLL##_##NAME##_t) ARGS; \
+    inline D2Pointer<DLL##_##NAME##_t> DLL##_##NAME (#DLL "_" #NAME, D2SymbolType::FUNCTION, D2TEMPLATE_DLL_FILES::D2DLL_##DLL, D2OffsetDatabase::getOffsetTable(D2OffsetId::DLL##_##NAME));
+
+#define D2VAR_DB(DLL, NAME, TYPE) \
+    typedef TYPE DLL##_##NAME##_vt; \
+    inline D2Pointer<DLL##_##NAME##_vt *> DLL##_##NAME (#DLL "_" #NAME, D2SymbolType::VARIABLE, D2TEMPLATE_DLL_FILES::D2DLL_##DLL, D2OffsetDatabase::getOffsetTable(D2OffsetId::DLL##_##NAME));
+
+#define D2PTR_DB(DLL, NAME) \
+    inline D2Pointer<DWORD> DLL##_##NAME (#DLL "_" #NAME, D2SymbolType::POINTER, D2TEMPLATE_DLL_FILES::D2DLL_##DLL, D2OffsetDatabase::getOffsetTable(D2OffsetId::DLL##_##NAME));
 
 
 /*********************************************************************************
@@ -0,0 +1,119 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2SignatureResolver.cpp                                                 *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the functions used to resolve the signatures of       *
+ *   offsets that have no known address for the running version of Diablo    *
+ *   II, scanning each module once for every signature registered with it.   *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2SignatureResolver.h"
+
+#include <windows.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "D2Offset.h"
+#include "D2PEImage.h"
+#include "D2ProcessBackend.h"
+#include "D2SignatureScanner.h"
+
+namespace {
+struct ResolverState {
+    std::mutex mutex;
+    std::unordered_map<D2TEMPLATE_DLL_FILES, std::vector<std::shared_ptr<const D2Signature>>>
+    pendingSignatures;
+    // The signatures are held, so that the address of one that is destroyed
+    // cannot be taken by a new one and find its RVA.
+    std::unordered_map<std::shared_ptr<const D2Signature>, DWORD> resolvedRvas;
+};
+
+// Offsets are declared as globals, so the state is created on first use.
+ResolverState& getState() {
+    static ResolverState state;
+    return state;
+}
+
+void scanModule(ResolverState& state, D2TEMPLATE_DLL_FILES dllFile) {
+    std::vector<std::shared_ptr<const D2Signature>> signatures;
+    signatures.swap(state.pendingSignatures[dllFile]);
+
+    std::vector<const D2Signature*> signaturePointers;
+    std::vector<uint32_t> rvas(signatures.size(), 0);
+
+    for (const auto& signature : signatures) {
+        signaturePointers.push_back(signature.get());
+    }
+
+    size_t moduleSize = 0;
+    const uint8_t* moduleData = D2ProcessBackend::getCurrent().getModuleImageView(
+                                    (uintptr_t) D2Offset::getDllAddress(dllFile), moduleSize);
+
+    if (moduleData != nullptr) {
+        D2PEImage image(moduleData, moduleSize, D2PEImageLayout::MAPPED);
+
+        if (image.isValid()) {
+            D2SignatureScanner::scanImage(image, signaturePointers.data(),
+                                          signaturePointers.size(), rvas.data());
+        }
+    }
+
+    for (size_t i = 0; i < signatures.size(); i++) {
+        state.resolvedRvas[signatures[i]] = rvas[i];
+    }
+}
+}
+
+void D2SignatureResolver::registerSignature(D2TEMPLATE_DLL_FILES dllFile,
+        const std::shared_ptr<const D2Signature>& signature) {
+    ResolverState& state = getState();
+    std::lock_guard<std::mutex> stateLock(state.mutex);
+
+    state.pendingSignatures[dllFile].push_back(signature);
+}
+
+DWORD D2SignatureResolver::resolveRva(D2TEMPLATE_DLL_FILES dllFile,
+                                      const std::shared_ptr<const D2Signature>& signature) {
+    ResolverState& state = getState();
+    std::lock_guard<std::mutex> stateLock(state.mutex);
+
+    auto resolvedRva = state.resolvedRvas.find(signature);
+
+    if (resolvedRva != state.resolvedRvas.cend()) {
+        return resolvedRva->second;
+    }
+
+    // The signature may have been created after the module was scanned.
+    auto& pendingSignatures = state.pendingSignatures[dllFile];
+    bool isPending = false;
+
+    for (const auto& pendingSignature : pendingSignatures) {
+        isPending = isPending || (pendingSignature == signature);
+    }
+
+    if (!isPending) {
+        pendingSignatures.push_back(signature);
+    }
+
+    scanModule(state, dllFile);
+    return state.resolvedRvas[signature];
+}
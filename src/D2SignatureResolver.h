@@ -0,0 +1,50 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2SignatureResolver.h                                                   *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the functions used to resolve the signatures of      *
+ *   offsets that have no known address for the running version of Diablo    *
+ *   II.                                                                     *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2SIGNATURERESOLVER_H
+#define _D2SIGNATURERESOLVER_H
+
+#include <windows.h>
+
+#include <memory>
+
+#include "D2Offset.h"
+#include "D2SignatureScanner.h"
+
+namespace D2SignatureResolver {
+// Signatures are registered up front, so that the first lookup in a module
+// scans its code once for all of them.
+void registerSignature(D2TEMPLATE_DLL_FILES dllFile,
+                       const std::shared_ptr<const D2Signature>& signature);
+
+// Returns the RVA of the signature in the loaded module, or 0 if it could not
+// be found.
+DWORD resolveRva(D2TEMPLATE_DLL_FILES dllFile,
+                 const std::shared_ptr<const D2Signature>& signature);
+}
+
+#endif
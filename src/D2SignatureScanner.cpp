@@ -0,0 +1,375 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2SignatureScanner.cpp                                                  *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2Signature class and the scanner used to find    *
+ *   many signatures in a single pass over the code of a module, comparing   *
+ *   an anchor byte of every signature against a whole block of code at once *
+ *   with SSE2 or AVX2.                                                      *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2SignatureScanner.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "D2PEImage.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define D2_SCAN_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define D2_SCAN_SSE2
+#endif
+
+namespace {
+#if defined(D2_SCAN_AVX2)
+constexpr size_t BLOCK_SIZE = 32;
+
+uint32_t findByteInBlock(const uint8_t* block, uint8_t value) {
+    __m256i blockData = _mm256_loadu_si256((const __m256i*) block);
+    __m256i needle = _mm256_set1_epi8((char) value);
+    return (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(blockData, needle));
+}
+#elif defined(D2_SCAN_SSE2)
+constexpr size_t BLOCK_SIZE = 16;
+
+uint32_t findByteInBlock(const uint8_t* block, uint8_t value) {
+    __m128i blockData = _mm_loadu_si128((const __m128i*) block);
+    __m128i needle = _mm_set1_epi8((char) value);
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(blockData, needle));
+}
+#else
+constexpr size_t BLOCK_SIZE = 8;
+
+uint32_t findByteInBlock(const uint8_t* block, uint8_t value) {
+    uint32_t matchMask = 0;
+
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        matchMask |= (uint32_t)(block[i] == value) << i;
+    }
+
+    return matchMask;
+}
+#endif
+
+int getLowestBit(uint32_t value) {
+    int bit = 0;
+
+    while ((value & 1) == 0) {
+        value >>= 1;
+        bit++;
+    }
+
+    return bit;
+}
+
+int parseHexDigit(char digit) {
+    if (digit >= '0' && digit <= '9') {
+        return digit - '0';
+    } else if (digit >= 'a' && digit <= 'f') {
+        return digit - 'a' + 10;
+    } else if (digit >= 'A' && digit <= 'F') {
+        return digit - 'A' + 10;
+    }
+
+    return -1;
+}
+
+// Bytes that are found everywhere in x86 code, and make poor anchors.
+bool isCommonCodeByte(uint8_t value) {
+    switch (value) {
+    case 0x00: case 0x04: case 0x0F: case 0x24: case 0x44: case 0x45:
+    case 0x50: case 0x51: case 0x52: case 0x53: case 0x55: case 0x56:
+    case 0x57: case 0x5D: case 0x5E: case 0x5F: case 0x83: case 0x85:
+    case 0x89: case 0x8B: case 0x90: case 0xC0: case 0xC3: case 0xCC:
+    case 0xE8: case 0xFF:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+struct AnchorGroup {
+    uint8_t anchorByte;
+    size_t pendingCount;
+    std::vector<size_t> signatureIndices;
+};
+}
+
+D2Signature::D2Signature(std::string_view pattern,
+                         int32_t resultOffset) : resultOffset(resultOffset), anchorIndex(0),
+    valid(false) {
+    size_t position = 0;
+
+    while (position < pattern.length()) {
+        if (pattern[position] == ' ') {
+            position++;
+            continue;
+        }
+
+        size_t tokenEnd = pattern.find(' ', position);
+
+        if (tokenEnd == std::string_view::npos) {
+            tokenEnd = pattern.length();
+        }
+
+        std::string_view token = pattern.substr(position, tokenEnd - position);
+        position = tokenEnd;
+
+        if (token == "?" || token == "??") {
+            bytes.push_back(0);
+            mask.push_back(0);
+            continue;
+        }
+
+        if (token.length() != 2 || parseHexDigit(token[0]) < 0
+                || parseHexDigit(token[1]) < 0) {
+            bytes.clear();
+            return;
+        }
+
+        bytes.push_back((uint8_t)((parseHexDigit(token[0]) << 4) | parseHexDigit(
+                                      token[1])));
+        mask.push_back(0xFF);
+    }
+
+    // Anchor the search on the least common byte that is not a wildcard.
+    bool anchorFound = false;
+
+    for (size_t i = 0; i < bytes.size(); i++) {
+        if (mask[i] == 0) {
+            continue;
+        }
+
+        if (!anchorFound || (isCommonCodeByte(bytes[anchorIndex])
+                             && !isCommonCodeByte(bytes[i]))) {
+            anchorIndex = i;
+            anchorFound = true;
+        }
+    }
+
+    valid = anchorFound;
+}
+
+bool D2Signature::isValid() const {
+    return valid;
+}
+
+size_t D2Signature::getLength() const {
+    return bytes.size();
+}
+
+const uint8_t* D2Signature::getBytes() const {
+    return bytes.data();
+}
+
+const uint8_t* D2Signature::getMask() const {
+    return mask.data();
+}
+
+int32_t D2Signature::getResultOffset() const {
+    return resultOffset;
+}
+
+size_t D2Signature::getAnchorIndex() const {
+    return anchorIndex;
+}
+
+uint8_t D2Signature::getAnchorByte() const {
+    return bytes[anchorIndex];
+}
+
+bool D2Signature::matches(const uint8_t* data) const {
+    size_t i = 0;
+
+#if defined(D2_SCAN_AVX2) || defined(D2_SCAN_SSE2)
+
+    for (; i + 16 <= bytes.size(); i += 16) {
+        __m128i dataBlock = _mm_loadu_si128((const __m128i*) &data[i]);
+        __m128i maskBlock = _mm_loadu_si128((const __m128i*) &mask[i]);
+        __m128i bytesBlock = _mm_loadu_si128((const __m128i*) &bytes[i]);
+        __m128i maskedData = _mm_and_si128(dataBlock, maskBlock);
+
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(maskedData, bytesBlock)) != 0xFFFF) {
+            return false;
+        }
+    }
+
+#endif
+
+    for (; i < bytes.size(); i++) {
+        if ((data[i] & mask[i]) != bytes[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+size_t D2SignatureScanner::scan(const uint8_t* data, size_t size,
+                                const D2Signature* const* signatures, size_t signatureCount,
+                                size_t* results) {
+    std::vector<AnchorGroup> anchorGroups;
+    size_t pendingCount = 0;
+
+    for (size_t i = 0; i < signatureCount; i++) {
+        results[i] = NOT_FOUND;
+
+        if (!signatures[i]->isValid() || signatures[i]->getLength() > size) {
+            continue;
+        }
+
+        AnchorGroup* anchorGroup = nullptr;
+
+        for (auto& existingGroup : anchorGroups) {
+            if (existingGroup.anchorByte == signatures[i]->getAnchorByte()) {
+                anchorGroup = &existingGroup;
+            }
+        }
+
+        if (anchorGroup == nullptr) {
+            anchorGroups.push_back({ signatures[i]->getAnchorByte(), 0, {} });
+            anchorGroup = &anchorGroups.back();
+        }
+
+        anchorGroup->signatureIndices.push_back(i);
+        anchorGroup->pendingCount++;
+        pendingCount++;
+    }
+
+    size_t foundCount = 0;
+
+    auto checkCandidate = [&](AnchorGroup & anchorGroup, size_t anchorPosition) {
+        for (size_t signatureIndex : anchorGroup.signatureIndices) {
+            const D2Signature& signature = *signatures[signatureIndex];
+
+            if (results[signatureIndex] != NOT_FOUND
+                    || anchorPosition < signature.getAnchorIndex()) {
+                continue;
+            }
+
+            size_t matchPosition = anchorPosition - signature.getAnchorIndex();
+
+            if (matchPosition + signature.getLength() > size
+                    || !signature.matches(&data[matchPosition])) {
+                continue;
+            }
+
+            results[signatureIndex] = matchPosition;
+            anchorGroup.pendingCount--;
+            foundCount++;
+        }
+    };
+
+    size_t position = 0;
+
+    for (; position + BLOCK_SIZE <= size && foundCount < pendingCount;
+            position += BLOCK_SIZE) {
+        for (auto& anchorGroup : anchorGroups) {
+            if (anchorGroup.pendingCount == 0) {
+                continue;
+            }
+
+            uint32_t matchMask = findByteInBlock(&data[position], anchorGroup.anchorByte);
+
+            while (matchMask != 0) {
+                checkCandidate(anchorGroup, position + getLowestBit(matchMask));
+                matchMask &= matchMask - 1;
+            }
+        }
+    }
+
+    for (; position < size && foundCount < pendingCount; position++) {
+        for (auto& anchorGroup : anchorGroups) {
+            if (anchorGroup.pendingCount != 0
+                    && data[position] == anchorGroup.anchorByte) {
+                checkCandidate(anchorGroup, position);
+            }
+        }
+    }
+
+    return foundCount;
+}
+
+size_t D2SignatureScanner::scanImage(const D2PEImage& image,
+                                     const D2Signature* const* signatures, size_t signatureCount,
+                                     uint32_t* resultRvas) {
+    std::vector<size_t> results(signatureCount);
+    std::vector<const D2Signature*> pendingSignatures;
+    std::vector<size_t> pendingIndices;
+    size_t foundCount = 0;
+
+    for (size_t i = 0; i < signatureCount; i++) {
+        resultRvas[i] = 0;
+        pendingSignatures.push_back(signatures[i]);
+        pendingIndices.push_back(i);
+    }
+
+    for (const auto& section : image.getSections()) {
+        if (!section.isExecutable() || pendingSignatures.empty()) {
+            continue;
+        }
+
+        uint32_t sectionSize = (image.getLayout() == D2PEImageLayout::MAPPED) ?
+                               section.virtualSize : std::min(section.virtualSize, section.rawDataSize);
+
+        if (sectionSize == 0) {
+            sectionSize = section.rawDataSize;
+        }
+
+        const uint8_t* sectionData = image.getRvaData(section.virtualAddress,
+                                     sectionSize);
+
+        if (sectionData == nullptr) {
+            continue;
+        }
+
+        results.resize(pendingSignatures.size());
+        scan(sectionData, sectionSize, pendingSignatures.data(),
+             pendingSignatures.size(), results.data());
+
+        // Only the signatures that were not found are looked for in the
+        // following sections.
+        size_t stillPending = 0;
+
+        for (size_t i = 0; i < pendingSignatures.size(); i++) {
+            if (results[i] == NOT_FOUND) {
+                pendingSignatures[stillPending] = pendingSignatures[i];
+                pendingIndices[stillPending] = pendingIndices[i];
+                stillPending++;
+                continue;
+            }
+
+            resultRvas[pendingIndices[i]] = section.virtualAddress + (uint32_t) results[i] +
+                                            pendingSignatures[i]->getResultOffset();
+            foundCount++;
+        }
+
+        pendingSignatures.resize(stillPending);
+        pendingIndices.resize(stillPending);
+    }
+
+    return foundCount;
+}
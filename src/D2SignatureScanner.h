@@ -0,0 +1,80 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2SignatureScanner.h                                                    *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2Signature class, which describes a byte        *
+ *   pattern with wildcards, and the scanner used to find many signatures in *
+ *   a single pass over the code of a module.                                *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2SIGNATURESCANNER_H
+#define _D2SIGNATURESCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "D2PEImage.h"
+
+class D2Signature {
+public:
+    // The pattern is a list of hex bytes separated by spaces, where "?" or
+    // "??" matches any byte, e.g. "8B 0D ?? ?? ?? ?? 85 C9". The result
+    // offset is added to the position of the match.
+    D2Signature(std::string_view pattern, int32_t resultOffset = 0);
+
+    bool isValid() const;
+    size_t getLength() const;
+    const uint8_t* getBytes() const;
+    const uint8_t* getMask() const;
+    int32_t getResultOffset() const;
+
+    size_t getAnchorIndex() const;
+    uint8_t getAnchorByte() const;
+
+    bool matches(const uint8_t* data) const;
+
+private:
+    std::vector<uint8_t> bytes;
+    std::vector<uint8_t> mask;
+    int32_t resultOffset;
+    size_t anchorIndex;
+    bool valid;
+};
+
+namespace D2SignatureScanner {
+static constexpr size_t NOT_FOUND = (size_t) - 1;
+
+// Finds the first match of every signature in one pass over the data. The
+// offset of each match is stored in results, or NOT_FOUND. Returns the
+// number of signatures found.
+size_t scan(const uint8_t* data, size_t size,
+            const D2Signature* const* signatures, size_t signatureCount,
+            size_t* results);
+
+// Scans the executable sections of the image, storing the RVA of each match
+// with its result offset applied, or 0 if the signature was not found.
+size_t scanImage(const D2PEImage& image, const D2Signature* const* signatures,
+                 size_t signatureCount, uint32_t* resultRvas);
+}
+
+#endif
@@ -0,0 +1,245 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2SymbolTable.cpp                                                       *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2SymbolTable class, which maps addresses inside  *
+ *   of the game's libraries back to the pointers declared in D2Ptrs.h, so   *
+ *   that crash addresses and profiler samples can be given a name.          *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2SymbolTable.h"
+
+#include <windows.h>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "D2ModuleTable.h"
+#include "D2Offset.h"
+#include "D2ProcessBackend.h"
+
+namespace {
+constexpr size_t NO_SYMBOL = (size_t) - 1;
+}
+
+D2SymbolTable::D2SymbolTable() : dirty(false), builtGeneration(0) {
+}
+
+D2SymbolTable& D2SymbolTable::getInstance() {
+    static D2SymbolTable instance;
+    return instance;
+}
+
+bool D2SymbolTable::registerSymbol(const char* name, D2SymbolType type,
+                                   const D2Offset& d2Offset) {
+    std::lock_guard<std::mutex> tableLock(tableMutex);
+    registrations.push_back({ name, type, &d2Offset });
+    dirty = true;
+    return true;
+}
+
+D2SymbolizedAddress D2SymbolTable::symbolize(DWORD address) {
+    std::lock_guard<std::mutex> tableLock(tableMutex);
+    update();
+    return makeResult(findIndex(address), address);
+}
+
+void D2SymbolTable::symbolize(const DWORD* sampleAddresses, size_t count,
+                              D2SymbolizedAddress* results) {
+    std::lock_guard<std::mutex> tableLock(tableMutex);
+    update();
+
+    // Samples tend to come in runs from the same function, so the previous
+    // symbol is tried before searching.
+    size_t lastIndex = NO_SYMBOL;
+    DWORD lastEnd = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        DWORD address = sampleAddresses[i];
+
+        if (lastIndex == NO_SYMBOL || address < addresses[lastIndex]
+                || address >= lastEnd) {
+            lastIndex = findIndex(address);
+
+            if (lastIndex != NO_SYMBOL) {
+                size_t next = lastIndex + 1;
+                lastEnd = (next < symbols.size()) ? std::min(addresses[next],
+                          symbols[lastIndex].moduleEnd) : symbols[lastIndex].moduleEnd;
+            }
+        }
+
+        results[i] = makeResult(lastIndex, address);
+    }
+}
+
+size_t D2SymbolTable::formatAddress(DWORD address, char* buffer,
+                                    size_t bufferSize) {
+    if (bufferSize == 0) {
+        return 0;
+    }
+
+    D2SymbolizedAddress symbolizedAddress = symbolize(address);
+    int written;
+
+    if (symbolizedAddress.name == nullptr) {
+        written = std::snprintf(buffer, bufferSize, "0x%08lX",
+                                (unsigned long) address);
+    } else {
+        written = std::snprintf(buffer, bufferSize, "%s+0x%lX",
+                                symbolizedAddress.name,
+                                (unsigned long) symbolizedAddress.displacement);
+    }
+
+    if (written < 0) {
+        buffer[0] = '\0';
+        return 0;
+    }
+
+    return std::min((size_t) written, bufferSize - 1);
+}
+
+void D2SymbolTable::rebuild() {
+    std::lock_guard<std::mutex> tableLock(tableMutex);
+    build();
+}
+
+size_t D2SymbolTable::getSymbolCount() {
+    std::lock_guard<std::mutex> tableLock(tableMutex);
+    update();
+    return symbols.size();
+}
+
+void D2SymbolTable::update() {
+    if (dirty || builtGeneration != D2ProcessBackend::getGeneration()) {
+        build();
+        return;
+    }
+
+    // A symbol may not resolve because its module is not loaded yet, and
+    // trying again may load it, so the retries are spaced out.
+    if (pendingRegistrations.empty()
+            || std::chrono::steady_clock::now() - lastRetryTime < RETRY_INTERVAL) {
+        return;
+    }
+
+    retryPending();
+}
+
+void D2SymbolTable::build() {
+    symbols.clear();
+    addresses.clear();
+    pendingRegistrations.clear();
+
+    for (size_t i = 0; i < registrations.size(); i++) {
+        if (!addSymbol(registrations[i])) {
+            pendingRegistrations.push_back(i);
+        }
+    }
+
+    sortSymbols();
+
+    dirty = false;
+    builtGeneration = D2ProcessBackend::getGeneration();
+    lastRetryTime = std::chrono::steady_clock::now();
+}
+
+void D2SymbolTable::retryPending() {
+    size_t previousCount = symbols.size();
+
+    pendingRegistrations.erase(std::remove_if(pendingRegistrations.begin(),
+    pendingRegistrations.end(), [this](size_t registrationIndex) {
+        return addSymbol(registrations[registrationIndex]);
+    }), pendingRegistrations.end());
+
+    if (symbols.size() != previousCount) {
+        sortSymbols();
+    }
+
+    lastRetryTime = std::chrono::steady_clock::now();
+}
+
+bool D2SymbolTable::addSymbol(const Registration& registration) {
+    DWORD address = registration.d2Offset->getCurrentAddress();
+
+    if (address == 0) {
+        return false;
+    }
+
+    D2TEMPLATE_DLL_FILES dllFile = registration.d2Offset->getDllFile();
+    const D2Module* module = D2ModuleTable::getInstance().getModule(dllFile);
+    DWORD moduleEnd = (module != nullptr) ? (DWORD)(module->handle +
+                      module->index.getSizeOfImage()) : 0;
+
+    // Ordinal imports may resolve outside of the module, and those are
+    // bounded by nothing but the next symbol.
+    DWORD end = (address < moduleEnd) ? moduleEnd : 0xFFFFFFFF;
+    symbols.push_back({ registration.name, dllFile, registration.type, address, end });
+    return true;
+}
+
+void D2SymbolTable::sortSymbols() {
+    // A symbol that was registered more than once is only listed once.
+    std::sort(symbols.begin(), symbols.end(), [](const D2Symbol & left,
+    const D2Symbol & right) {
+        if (left.address != right.address) {
+            return left.address < right.address;
+        }
+
+        return std::strcmp(left.name, right.name) < 0;
+    });
+
+    symbols.erase(std::unique(symbols.begin(), symbols.end(),
+    [](const D2Symbol & left, const D2Symbol & right) {
+        return left.address == right.address
+               && std::strcmp(left.name, right.name) == 0;
+    }), symbols.end());
+
+    addresses.clear();
+    addresses.reserve(symbols.size());
+
+    for (const auto& symbol : symbols) {
+        addresses.push_back(symbol.address);
+    }
+}
+
+size_t D2SymbolTable::findIndex(DWORD address) const {
+    auto it = std::upper_bound(addresses.cbegin(), addresses.cend(), address);
+
+    if (it == addresses.cbegin()) {
+        return NO_SYMBOL;
+    }
+
+    size_t symbolIndex = (it - addresses.cbegin()) - 1;
+    return (address < symbols[symbolIndex].moduleEnd) ? symbolIndex : NO_SYMBOL;
+}
+
+D2SymbolizedAddress D2SymbolTable::makeResult(size_t symbolIndex,
+        DWORD address) const {
+    if (symbolIndex == NO_SYMBOL) {
+        return { nullptr, {}, {}, 0, 0 };
+    }
+
+    const D2Symbol& symbol = symbols[symbolIndex];
+    return { symbol.name, symbol.dllFile, symbol.type, symbol.address, address - symbol.address };
+}
@@ -0,0 +1,134 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2SymbolTable.h                                                         *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2SymbolTable class, which maps addresses inside *
+ *   of the game's libraries back to the pointers declared in D2Ptrs.h, so   *
+ *   that crash addresses and profiler samples can be given a name.          *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2SYMBOLTABLE_H
+#define _D2SYMBOLTABLE_H
+
+#include <windows.h>
+#include <cstddef>
+#include <cstdint>
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "D2Offset.h"
+
+enum class D2SymbolType : int {
+    FUNCTION,
+    VARIABLE,
+    POINTER
+};
+
+struct D2Symbol {
+    const char* name;
+    D2TEMPLATE_DLL_FILES dllFile;
+    D2SymbolType type;
+    DWORD address;
+    // The end of the image that holds the symbol, so that addresses past the
+    // last symbol of a module are not attributed to it.
+    DWORD moduleEnd;
+};
+
+// Holds copies rather than a pointer into the table, so that it stays valid
+// when the table is rebuilt. The name is the one given to registerSymbol.
+struct D2SymbolizedAddress {
+    // Null if no symbol precedes the address in the same module, in which
+    // case the other fields are zero.
+    const char* name;
+    D2TEMPLATE_DLL_FILES dllFile;
+    D2SymbolType type;
+    DWORD symbolAddress;
+    DWORD displacement;
+};
+
+class D2SymbolTable {
+public:
+    // Symbols whose module was not loaded yet are retried at most this often.
+    static constexpr std::chrono::milliseconds RETRY_INTERVAL =
+        std::chrono::milliseconds(1000);
+
+    static D2SymbolTable& getInstance();
+
+    // The name must outlive the table, which string literals do. The offset
+    // is only resolved when the table is next built. Always returns true, so
+    // that it can be used to initialize a static variable.
+    bool registerSymbol(const char* name, D2SymbolType type,
+                        const D2Offset& d2Offset);
+
+    // Finds the nearest symbol at or before the address.
+    D2SymbolizedAddress symbolize(DWORD address);
+
+    // Symbolizes a whole buffer of addresses under a single lock, without
+    // allocating.
+    void symbolize(const DWORD* sampleAddresses, size_t count,
+                   D2SymbolizedAddress* results);
+
+    // Writes "NAME+0xDISPLACEMENT", or the bare address if it has no symbol.
+    // Returns the number of characters written, not counting the terminator.
+    size_t formatAddress(DWORD address, char* buffer, size_t bufferSize);
+
+    // Resolves every registered symbol again, for instance after a module
+    // was reloaded. The table is also rebuilt when the process backend
+    // changes.
+    void rebuild();
+
+    size_t getSymbolCount();
+
+private:
+    struct Registration {
+        const char* name;
+        D2SymbolType type;
+        const D2Offset* d2Offset;
+    };
+
+    std::mutex tableMutex;
+    std::vector<Registration> registrations;
+    bool dirty;
+
+    // The registrations that did not resolve when the table was built.
+    std::vector<size_t> pendingRegistrations;
+    uint32_t builtGeneration;
+    std::chrono::steady_clock::time_point lastRetryTime;
+
+    // The addresses are kept apart from the symbols, so that the binary
+    // search only touches the cache lines that hold addresses.
+    std::vector<DWORD> addresses;
+    std::vector<D2Symbol> symbols;
+
+    D2SymbolTable();
+
+    void update();
+    void build();
+    void retryPending();
+    bool addSymbol(const Registration& registration);
+    void sortSymbols();
+    size_t findIndex(DWORD address) const;
+    D2SymbolizedAddress makeResult(size_t symbolIndex, DWORD address) const;
+};
+
+#endif
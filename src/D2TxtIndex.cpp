@@ -0,0 +1,428 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2TxtIndex.cpp                                                          *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2TxtIndex class. Pilots are searched for the     *
+ *   largest buckets first, while most of the slots are still free.          *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2TxtIndex.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "D2MappedFile.h"
+#include "D2TxtTable.h"
+
+namespace {
+constexpr uint64_t HASH_OFFSET_BASIS = 0xCBF29CE484222325ULL;
+constexpr uint64_t HASH_PRIME = 0x00000100000001B3ULL;
+constexpr uint64_t GOLDEN_RATIO = 0x9E3779B97F4A7C15ULL;
+
+// The finalizer of MurmurHash3, which spreads every bit of the key over the
+// whole result.
+uint64_t mix(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xFF51AFD7ED558CCDULL;
+    value ^= value >> 33;
+    value *= 0xC4CEB9FE1A85EC53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+#ifdef _WIN32
+bool writeFile(const std::wstring& filePath, const void* data, size_t size) {
+    std::wstring temporaryPath = filePath + L"." + std::to_wstring(
+                                     GetCurrentProcessId()) + L".tmp";
+
+    HANDLE indexFile = CreateFileW(temporaryPath.c_str(), GENERIC_WRITE, 0,
+                                   nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (indexFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    DWORD bytesWritten = 0;
+    BOOL writeResult = WriteFile(indexFile, data, (DWORD) size, &bytesWritten,
+                                 nullptr);
+    CloseHandle(indexFile);
+
+    if (!writeResult || bytesWritten != size
+            || !MoveFileExW(temporaryPath.c_str(), filePath.c_str(),
+                            MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileW(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+#else
+bool writeFile(const std::wstring& filePath, const void* data, size_t size) {
+    std::string narrowPath(filePath.begin(), filePath.end());
+    std::string temporaryPath = narrowPath + "." + std::to_string(getpid()) +
+                                ".tmp";
+
+    int fileDescriptor = ::open(temporaryPath.c_str(),
+                                O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fileDescriptor < 0) {
+        return false;
+    }
+
+    const uint8_t* remainingData = (const uint8_t*) data;
+    size_t remainingSize = size;
+
+    while (remainingSize > 0) {
+        ssize_t writtenSize = write(fileDescriptor, remainingData, remainingSize);
+
+        if (writtenSize <= 0) {
+            break;
+        }
+
+        remainingData += writtenSize;
+        remainingSize -= writtenSize;
+    }
+
+    if (::close(fileDescriptor) != 0 || remainingSize != 0
+            || std::rename(temporaryPath.c_str(), narrowPath.c_str()) != 0) {
+        unlink(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+#endif
+}
+
+D2TxtIndex::D2TxtIndex() : fileHeader(nullptr), pilots(nullptr),
+    slots(nullptr), imageSize(0) {
+}
+
+bool D2TxtIndex::build(const uint64_t* keys, const uint32_t* values,
+                       size_t count, uint64_t sourceHash) {
+    clear();
+
+    if (count > MAX_KEY_COUNT) {
+        return false;
+    }
+
+    // The stable sort keeps the first of the keys that are listed twice.
+    std::vector<uint32_t> keyOrder(count);
+    std::iota(keyOrder.begin(), keyOrder.end(), 0);
+    std::stable_sort(keyOrder.begin(), keyOrder.end(), [keys](uint32_t left,
+    uint32_t right) {
+        return keys[left] < keys[right];
+    });
+
+    keyOrder.erase(std::unique(keyOrder.begin(), keyOrder.end(),
+    [keys](uint32_t left, uint32_t right) {
+        return keys[left] == keys[right];
+    }), keyOrder.end());
+
+    std::vector<uint64_t> uniqueKeys;
+    uniqueKeys.reserve(keyOrder.size());
+
+    for (uint32_t keyIndex : keyOrder) {
+        uniqueKeys.push_back(keys[keyIndex]);
+    }
+
+    uint32_t keyCount = (uint32_t) uniqueKeys.size();
+    uint32_t bucketCount = (uint32_t) std::max<size_t>(1,
+                           (keyCount + KEYS_PER_BUCKET - 1) / KEYS_PER_BUCKET);
+    std::vector<uint32_t> bucketPilots;
+    std::vector<uint32_t> keySlots;
+    uint64_t seed = 0;
+    bool placed = false;
+
+    for (size_t attempt = 0; attempt < MAX_SEED_ATTEMPTS && !placed; attempt++) {
+        seed = mix((attempt + 1) * GOLDEN_RATIO);
+        placed = place(uniqueKeys, seed, bucketCount, bucketPilots, keySlots);
+    }
+
+    if (!placed) {
+        return false;
+    }
+
+    size_t slotsOffset = getSlotsOffset(bucketCount);
+    size_t size = slotsOffset + keyCount * sizeof(Slot);
+    ownedImage.assign((size + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+    uint8_t* image = (uint8_t*) ownedImage.data();
+
+    FileHeader header = { FILE_MAGIC, FILE_VERSION, keyCount, bucketCount, seed, sourceHash };
+    std::memcpy(image, &header, sizeof(header));
+    std::memcpy(&image[sizeof(header)], bucketPilots.data(),
+                bucketCount * sizeof(uint32_t));
+
+    Slot* imageSlots = (Slot*) &image[slotsOffset];
+
+    for (size_t i = 0; i < keyCount; i++) {
+        imageSlots[keySlots[i]] = { uniqueKeys[i], values[keyOrder[i]], 0 };
+    }
+
+    return attach(image, size);
+}
+
+bool D2TxtIndex::buildCodeIndex(D2TxtTable& table, size_t column,
+                                uint64_t sourceHash) {
+    if (column >= table.getColumnCount()) {
+        clear();
+        return false;
+    }
+
+    const std::vector<uint32_t>& codes = table.getCodeColumn(column);
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> rows;
+
+    for (size_t row = 0; row < codes.size(); row++) {
+        if (codes[row] != 0) {
+            keys.push_back(codes[row]);
+            rows.push_back((uint32_t) row);
+        }
+    }
+
+    return build(keys.data(), rows.data(), keys.size(), sourceHash);
+}
+
+bool D2TxtIndex::buildNameIndex(D2TxtTable& table, size_t column,
+                                uint64_t sourceHash) {
+    if (column >= table.getColumnCount()) {
+        clear();
+        return false;
+    }
+
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> rows;
+
+    for (size_t row = 0; row < table.getRowCount(); row++) {
+        std::string_view name = table.getCell(row, column);
+
+        if (!name.empty()) {
+            keys.push_back(hashName(name));
+            rows.push_back((uint32_t) row);
+        }
+    }
+
+    return build(keys.data(), rows.data(), keys.size(), sourceHash);
+}
+
+bool D2TxtIndex::save(const std::wstring& filePath) const {
+    return isValid() && writeFile(filePath, fileHeader, imageSize);
+}
+
+bool D2TxtIndex::load(const std::wstring& filePath, uint64_t sourceHash) {
+    clear();
+
+    if (!mappedFile.open(filePath)
+            || !attach(mappedFile.getData(), mappedFile.getSize())
+            || (sourceHash != 0 && fileHeader->sourceHash != sourceHash)) {
+        clear();
+        return false;
+    }
+
+    return true;
+}
+
+void D2TxtIndex::clear() {
+    ownedImage.clear();
+    mappedFile.close();
+    fileHeader = nullptr;
+    pilots = nullptr;
+    slots = nullptr;
+    imageSize = 0;
+}
+
+bool D2TxtIndex::isValid() const {
+    return fileHeader != nullptr;
+}
+
+size_t D2TxtIndex::getKeyCount() const {
+    return isValid() ? fileHeader->keyCount : 0;
+}
+
+size_t D2TxtIndex::getSize() const {
+    return imageSize;
+}
+
+uint64_t D2TxtIndex::getSourceHash() const {
+    return isValid() ? fileHeader->sourceHash : 0;
+}
+
+uint32_t D2TxtIndex::find(uint64_t key) const {
+    if (getKeyCount() == 0) {
+        return NOT_FOUND;
+    }
+
+    uint64_t keyHash = hashKey(key, fileHeader->seed);
+    uint32_t pilot = pilots[getBucket(keyHash, fileHeader->bucketCount)];
+    const Slot& slot = slots[getSlot(keyHash, pilot, fileHeader->keyCount)];
+
+    return (slot.key == key) ? slot.value : NOT_FOUND;
+}
+
+uint64_t D2TxtIndex::hashName(std::string_view name) {
+    uint64_t hash = HASH_OFFSET_BASIS;
+
+    for (char c : name) {
+        hash = (hash ^ (uint8_t) c) * HASH_PRIME;
+    }
+
+    return hash;
+}
+
+size_t D2TxtIndex::getSlotsOffset(size_t bucketCount) {
+    size_t pilotsEnd = sizeof(FileHeader) + bucketCount * sizeof(uint32_t);
+    return (pilotsEnd + alignof(Slot) - 1) & ~(alignof(Slot) - 1);
+}
+
+uint64_t D2TxtIndex::hashKey(uint64_t key, uint64_t seed) {
+    return mix(key ^ seed);
+}
+
+// Both map the high bits of a hash onto the range by multiplying, which is
+// much cheaper than a division.
+uint32_t D2TxtIndex::getBucket(uint64_t keyHash, uint32_t bucketCount) {
+    return (uint32_t)(((keyHash >> 32) * bucketCount) >> 32);
+}
+
+uint32_t D2TxtIndex::getSlot(uint64_t keyHash, uint32_t pilot,
+                             uint32_t keyCount) {
+    return (uint32_t)(((mix(keyHash ^ (pilot * GOLDEN_RATIO)) >> 32) * keyCount)
+                      >> 32);
+}
+
+bool D2TxtIndex::attach(const uint8_t* image, size_t size) {
+    if (size < sizeof(FileHeader)) {
+        return false;
+    }
+
+    const FileHeader* header = (const FileHeader*) image;
+
+    if (header->magic != FILE_MAGIC || header->version != FILE_VERSION
+            || header->keyCount > MAX_KEY_COUNT || header->bucketCount == 0
+            || header->bucketCount > MAX_KEY_COUNT
+            || size < getSlotsOffset(header->bucketCount) + header->keyCount * sizeof(
+                Slot)) {
+        return false;
+    }
+
+    fileHeader = header;
+    pilots = (const uint32_t*) &image[sizeof(FileHeader)];
+    slots = (const Slot*) &image[getSlotsOffset(header->bucketCount)];
+    imageSize = getSlotsOffset(header->bucketCount) + header->keyCount * sizeof(
+                    Slot);
+    return true;
+}
+
+bool D2TxtIndex::place(const std::vector<uint64_t>& keys, uint64_t seed,
+                       uint32_t bucketCount, std::vector<uint32_t>& bucketPilots,
+                       std::vector<uint32_t>& keySlots) const {
+    uint32_t keyCount = (uint32_t) keys.size();
+    std::vector<uint64_t> keyHashes(keyCount);
+    std::vector<uint32_t> bucketStarts(bucketCount + 1, 0);
+
+    for (uint32_t i = 0; i < keyCount; i++) {
+        keyHashes[i] = hashKey(keys[i], seed);
+        bucketStarts[getBucket(keyHashes[i], bucketCount) + 1]++;
+    }
+
+    std::partial_sum(bucketStarts.begin(), bucketStarts.end(),
+                     bucketStarts.begin());
+
+    // The keys of each bucket, one bucket after the other.
+    std::vector<uint32_t> bucketKeys(keyCount);
+    std::vector<uint32_t> bucketFill(bucketStarts.begin(), bucketStarts.end() - 1);
+
+    for (uint32_t i = 0; i < keyCount; i++) {
+        bucketKeys[bucketFill[getBucket(keyHashes[i], bucketCount)]++] = i;
+    }
+
+    std::vector<uint32_t> bucketOrder(bucketCount);
+    std::iota(bucketOrder.begin(), bucketOrder.end(), 0);
+    std::stable_sort(bucketOrder.begin(), bucketOrder.end(),
+    [&bucketStarts](uint32_t left, uint32_t right) {
+        return bucketStarts[left + 1] - bucketStarts[left] >
+               bucketStarts[right + 1] - bucketStarts[right];
+    });
+
+    std::vector<bool> takenSlots(keyCount, false);
+    std::vector<uint32_t> candidateSlots;
+
+    bucketPilots.assign(bucketCount, 0);
+    keySlots.assign(keyCount, 0);
+
+    for (uint32_t bucket : bucketOrder) {
+        const uint32_t* bucketKey = bucketKeys.data() + bucketStarts[bucket];
+        uint32_t bucketSize = bucketStarts[bucket + 1] - bucketStarts[bucket];
+
+        // The buckets are sorted by size, so the rest are empty.
+        if (bucketSize == 0) {
+            break;
+        }
+
+        bool placed = false;
+
+        for (uint32_t pilot = 0; pilot <= MAX_PILOT && !placed; pilot++) {
+            candidateSlots.clear();
+
+            for (uint32_t i = 0; i < bucketSize; i++) {
+                uint32_t slot = getSlot(keyHashes[bucketKey[i]], pilot, keyCount);
+
+                if (takenSlots[slot] || std::find(candidateSlots.begin(),
+                                                  candidateSlots.end(), slot) != candidateSlots.end()) {
+                    break;
+                }
+
+                candidateSlots.push_back(slot);
+            }
+
+            if (candidateSlots.size() != bucketSize) {
+                continue;
+            }
+
+            for (uint32_t i = 0; i < bucketSize; i++) {
+                keySlots[bucketKey[i]] = candidateSlots[i];
+                takenSlots[candidateSlots[i]] = true;
+            }
+
+            bucketPilots[bucket] = pilot;
+            placed = true;
+        }
+
+        // Keys whose hashes are the same cannot be told apart by any pilot.
+        if (!placed) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,132 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2TxtIndex.h                                                            *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Declares the D2TxtIndex class, a minimal perfect hash from the codes or *
+ *   names of a .txt data table to its rows, which can be saved next to the  *
+ *   table and used straight from the mapped file.                           *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2TXTINDEX_H
+#define _D2TXTINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "D2MappedFile.h"
+#include "D2TxtTable.h"
+
+// Keys are hashed into buckets of about four, and each bucket is given a
+// pilot, the first number that sends all of its keys to free slots once mixed
+// into their hash. A lookup is one hash, one pilot and one slot, whatever the
+// number of keys. Codes are their packed value, and names their 64-bit FNV-1a
+// hash, so two names could in theory share a key.
+class D2TxtIndex {
+public:
+    static constexpr uint32_t NOT_FOUND = 0xFFFFFFFF;
+    static constexpr size_t MAX_KEY_COUNT = 0xFFFF;
+
+    D2TxtIndex();
+
+    D2TxtIndex(const D2TxtIndex&) = delete;
+    D2TxtIndex& operator=(const D2TxtIndex&) = delete;
+
+    // Keys that are listed more than once keep their first value. The source
+    // hash is saved with the index, to tell which table it was built from.
+    bool build(const uint64_t* keys, const uint32_t* values, size_t count,
+               uint64_t sourceHash = 0);
+
+    // Maps the codes or names of the column to their row. Empty cells are
+    // left out.
+    bool buildCodeIndex(D2TxtTable& table, size_t column, uint64_t sourceHash = 0);
+    bool buildNameIndex(D2TxtTable& table, size_t column, uint64_t sourceHash = 0);
+
+    bool save(const std::wstring& filePath) const;
+
+    // Maps the file, and looks keys up in the mapping itself. Fails if the
+    // source hash is not zero, and not the one the index was built with.
+    bool load(const std::wstring& filePath, uint64_t sourceHash = 0);
+    void clear();
+
+    bool isValid() const;
+    size_t getKeyCount() const;
+    size_t getSize() const;
+    uint64_t getSourceHash() const;
+
+    uint32_t find(uint64_t key) const;
+
+    uint32_t findCode(std::string_view code) const {
+        return find(D2TxtTable::packCode(code));
+    }
+
+    uint32_t findName(std::string_view name) const {
+        return find(hashName(name));
+    }
+
+    static uint64_t hashName(std::string_view name);
+
+private:
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t keyCount;
+        uint32_t bucketCount;
+        uint64_t seed;
+        uint64_t sourceHash;
+    };
+
+    struct Slot {
+        uint64_t key;
+        uint32_t value;
+        uint32_t reserved;
+    };
+
+    static constexpr uint32_t FILE_MAGIC = 0x48503244;
+    static constexpr uint32_t FILE_VERSION = 1;
+    static constexpr size_t KEYS_PER_BUCKET = 4;
+    static constexpr size_t MAX_SEED_ATTEMPTS = 32;
+    static constexpr uint32_t MAX_PILOT = 0xFFFFFF;
+
+    // A built index is kept in the layout of the file, so that lookups do
+    // not care where it came from.
+    std::vector<uint64_t> ownedImage;
+    D2MappedFile mappedFile;
+
+    const FileHeader* fileHeader;
+    const uint32_t* pilots;
+    const Slot* slots;
+    size_t imageSize;
+
+    static size_t getSlotsOffset(size_t bucketCount);
+    static uint64_t hashKey(uint64_t key, uint64_t seed);
+    static uint32_t getBucket(uint64_t keyHash, uint32_t bucketCount);
+    static uint32_t getSlot(uint64_t keyHash, uint32_t pilot, uint32_t keyCount);
+
+    bool attach(const uint8_t* image, size_t size);
+    bool place(const std::vector<uint64_t>& keys, uint64_t seed,
+               uint32_t bucketCount, std::vector<uint32_t>& bucketPilots,
+               std::vector<uint32_t>& keySlots) const;
+};
+
+#endif
@@ -0,0 +1,70 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2TxtSchemas.h                                                          *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Declares the schemas that tie the columns of the .txt data tables to    *
+ *   the fields of the records declared in D2DataTables.h.                   *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2TXTSCHEMAS_H
+#define _D2TXTSCHEMAS_H
+
+#include <cstddef>
+
+#include "D2DataTables.h"
+#include "D2TxtTable.h"
+
+// The column each table is looked up by, and whether it holds codes or names.
+struct D2TxtKeyColumn {
+    const char* fileName;
+    const char* columnName;
+    D2TxtColumnType type;
+};
+
+namespace D2TxtSchemas {
+inline constexpr D2TxtField MONSTATS_FIELDS[] = {
+    { "hcIdx", D2TxtColumnType::INT, offsetof(D2MonstatsTXT, nId), sizeof(D2MonstatsTXT::nId) },
+    { "Code", D2TxtColumnType::CODE, offsetof(D2MonstatsTXT, dwCode), sizeof(D2MonstatsTXT::dwCode) },
+};
+
+inline constexpr D2TxtSchema MONSTATS = {
+    "MonStats.txt", MONSTATS_FIELDS, sizeof(MONSTATS_FIELDS) / sizeof(MONSTATS_FIELDS[0]),
+    sizeof(D2MonstatsTXT)
+};
+
+inline constexpr const D2TxtSchema* SCHEMAS[] = {
+    &MONSTATS,
+};
+
+inline constexpr D2TxtKeyColumn KEY_COLUMNS[] = {
+    { "Armor.txt", "code", D2TxtColumnType::CODE },
+    { "ItemStatCost.txt", "Stat", D2TxtColumnType::STRING },
+    { "Levels.txt", "Name", D2TxtColumnType::STRING },
+    { "Misc.txt", "code", D2TxtColumnType::CODE },
+    { "MonStats.txt", "Id", D2TxtColumnType::STRING },
+    { "Skills.txt", "skill", D2TxtColumnType::STRING },
+    { "TreasureClassEx.txt", "Treasure Class", D2TxtColumnType::STRING },
+    { "UniqueItems.txt", "index", D2TxtColumnType::STRING },
+    { "Weapons.txt", "code", D2TxtColumnType::CODE },
+};
+}
+
+#endif
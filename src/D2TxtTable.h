@@ -0,0 +1,122 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2TxtTable.h                                                            *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   Declares the D2TxtTable class, which maps one of the game's tab-        *
+ *   separated .txt data tables, splits it into cells in a single pass, and  *
+ *   decodes its columns into typed arrays the first time they are used.     *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2TXTTABLE_H
+#define _D2TXTTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "D2MappedFile.h"
+
+enum class D2TxtColumnType : uint8_t {
+    // Decimal numbers, where an empty cell is zero.
+    INT,
+    // Codes of up to four characters, packed by D2TxtTable::packCode.
+    CODE,
+    // Copied as a NUL-padded array of characters.
+    STRING
+};
+
+// Tells where the value of a column is stored in a record. Numbers are
+// truncated to the size of their field.
+struct D2TxtField {
+    const char* columnName;
+    D2TxtColumnType type;
+    uint16_t recordOffset;
+    uint16_t fieldSize;
+};
+
+struct D2TxtSchema {
+    const char* fileName;
+    const D2TxtField* fields;
+    size_t fieldCount;
+    size_t recordSize;
+};
+
+// The cells point into the mapped file, and stay valid until it is closed.
+// Tables are not meant to be shared between threads.
+class D2TxtTable {
+public:
+    static constexpr size_t NOT_FOUND = (size_t) - 1;
+
+    D2TxtTable();
+
+    D2TxtTable(const D2TxtTable&) = delete;
+    D2TxtTable& operator=(const D2TxtTable&) = delete;
+
+    // The first line names the columns. Every other line that is not empty
+    // is a row, and is cut or padded to the number of columns.
+    bool load(const std::wstring& filePath);
+    void close();
+
+    bool isLoaded() const;
+    size_t getRowCount() const;
+    size_t getColumnCount() const;
+
+    std::string_view getColumnName(size_t column) const;
+    size_t findColumn(std::string_view columnName) const;
+    std::string_view getCell(size_t row, size_t column) const;
+
+    // The arrays are decoded on the first call, and hold one value per row.
+    const std::vector<int32_t>& getIntColumn(size_t column);
+    const std::vector<uint32_t>& getCodeColumn(size_t column);
+
+    // Packs the rows into records of the schema, one after the other.
+    // Returns false if a column of the schema is missing.
+    bool buildRecords(const D2TxtSchema& schema, std::vector<uint8_t>& records);
+
+    // The characters are stored in order, in little endian, and codes shorter
+    // than four characters are padded with spaces, as the game does. An empty
+    // code is zero.
+    static uint32_t packCode(std::string_view code);
+    static int32_t parseInt(std::string_view cell);
+
+private:
+    struct Cell {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    D2MappedFile mappedFile;
+    std::vector<std::string_view> columnNames;
+    // The cells of every row, row after row, without the header.
+    std::vector<Cell> cells;
+    size_t rowCount;
+
+    std::vector<std::unique_ptr<std::vector<int32_t>>> intColumns;
+    std::vector<std::unique_ptr<std::vector<uint32_t>>> codeColumns;
+
+    void split(const char* data, size_t size);
+    void addRow(size_t rowFirstCell);
+};
+
+#endif
@@ -25,15 +25,83 @@
 #include "D2Version.h"
 
 #include <windows.h>
-#include <memory>
+#include <cstddef>
+#include <cstdint>
 #include <sstream>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "D2PEImage.h"
+#include "D2ProcessBackend.h"
+#include "D2VersionCache.h"
+#include "D2VersionDetector.h"
+
+namespace {
+GameVersion getFileGameVersion(std::wstring_view filePath) {
+    uint32_t versionMS;
+    uint32_t versionLS;
+
+    if (!D2ProcessBackend::getCurrent().getFileVersion(filePath, versionMS,
+            versionLS)) {
+        return GameVersion::INVALID;
+    }
+
+    return D2VersionDetector::getGameVersion(versionMS, versionLS);
+}
+
+// Identifies the build from the loaded Game.exe, and only reads the version
+// of the file on disk when Game.exe cannot be fingerprinted.
+GameVersion determineGameVersion() {
+    D2ProcessBackend& backend = D2ProcessBackend::getCurrent();
+    uintptr_t gameHandle = backend.getModuleHandle(L"Game.exe");
+    size_t imageSize = 0;
+    const uint8_t* imageData = (gameHandle != 0) ? backend.getModuleImageView(
+                                   gameHandle, imageSize) : nullptr;
+
+    if (imageData == nullptr) {
+        return getFileGameVersion(L"Game.exe");
+    }
+
+    D2PEImage image(imageData, imageSize, D2PEImageLayout::MAPPED);
+    D2VersionFingerprint fingerprint;
+
+    if (!D2VersionDetector::computeFingerprint(image, fingerprint)) {
+        return getFileGameVersion(L"Game.exe");
+    }
+
+    // Known builds are found by their fingerprint alone, so that a repacked
+    // Game.exe whose version resource was stripped is still identified.
+    GameVersion gameVersion = D2VersionDetector::findKnownVersion(fingerprint);
+
+    if (gameVersion != GameVersion::INVALID) {
+        return gameVersion;
+    }
+
+    // Other builds are remembered by their fingerprint, so that the version
+    // resource is only read the first time they are run.
+    D2VersionCache& versionCache = D2VersionCache::getInstance();
+
+    if (versionCache.lookup(fingerprint, gameVersion)) {
+        return gameVersion;
+    }
+
+    gameVersion = D2VersionDetector::findResourceVersion(image);
+
+    if (gameVersion == GameVersion::INVALID) {
+        gameVersion = getFileGameVersion(L"Game.exe");
+    }
+
+    if (gameVersion != GameVersion::INVALID) {
+        versionCache.store(fingerprint, gameVersion);
+    }
+
+    return gameVersion;
+}
+}
+
 GameVersion D2Version::getGameVersion() {
-    static GameVersion gameVersion = getGameVersion(determineVersionString(
-                                         L"Game.exe"));
+    static GameVersion gameVersion = determineGameVersion();
     return gameVersion;
 }
 
@@ -80,40 +148,23 @@ Glide3xVersion D2Version::getGlide3xVersion(std::string_view versionString) {
            Glide3xVersion::INVALID;
 }
 
-// Taken from StackOverflow user crashmstr
 std::string D2Version::determineVersionString(std::wstring_view filePath) {
-    DWORD verHandle = 0;
-    UINT size = 0;
-    LPBYTE lpBuffer = nullptr;
-    DWORD verSize = GetFileVersionInfoSizeW(filePath.data(), &verHandle);
-
-    std::string returnValue;
-
-    if (verSize != 0) {
-        std::unique_ptr<WCHAR[]> verData(new WCHAR[verSize]);
-
-        if (GetFileVersionInfoW(filePath.data(), verHandle, verSize, verData.get())) {
-            if (VerQueryValueW(verData.get(), L"\\", (VOID FAR * FAR*)&lpBuffer, &size)) {
-                if (size > 0) {
-                    VS_FIXEDFILEINFO* verInfo = (VS_FIXEDFILEINFO*)lpBuffer;
-
-                    if (verInfo->dwSignature == 0xfeef04bd) {
-                        // Doesn't matter if you are on 32 bit or 64 bit,
-                        // DWORD is always 32 bits, so first two revision numbers
-                        // come from dwFileVersionMS, last two come from dwFileVersionLS
-                        std::ostringstream stringStream;
-
-                        stringStream << ((verInfo->dwFileVersionMS >> 16) & 0xffff) << ".";
-                        stringStream << ((verInfo->dwFileVersionMS >> 0) & 0xffff) << ".";
-                        stringStream << ((verInfo->dwFileVersionLS >> 16) & 0xffff) << ".";
-                        stringStream << ((verInfo->dwFileVersionLS >> 0) & 0xffff);
-
-                        returnValue = stringStream.str();
-                    }
-                }
-            }
-        }
+    uint32_t versionMS;
+    uint32_t versionLS;
+
+    if (!D2ProcessBackend::getCurrent().getFileVersion(filePath, versionMS,
+            versionLS)) {
+        return std::string();
     }
 
-    return returnValue;
+    // The first two revision numbers come from the most significant half,
+    // and the last two from the least significant half.
+    std::ostringstream stringStream;
+
+    stringStream << ((versionMS >> 16) & 0xffff) << ".";
+    stringStream << ((versionMS >> 0) & 0xffff) << ".";
+    stringStream << ((versionLS >> 16) & 0xffff) << ".";
+    stringStream << ((versionLS >> 0) & 0xffff);
+
+    return stringStream.str();
 }
@@ -49,6 +49,8 @@ enum class Glide3xVersion : int {
 };
 
 namespace D2Version {
+static constexpr int GAME_VERSION_COUNT = (int) GameVersion::VERSION_114d + 1;
+
 GameVersion getGameVersion();
 GameVersion getGameVersion(std::string_view versionString);
 bool isGameVersion114Plus();
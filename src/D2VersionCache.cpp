@@ -0,0 +1,203 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2VersionCache.cpp                                                      *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2VersionCache class, which remembers between     *
+ *   runs the builds of the game that were identified by their version       *
+ *   resource.                                                               *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2VersionCache.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdio>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "D2MappedFile.h"
+#include "D2Version.h"
+#include "D2VersionDetector.h"
+
+namespace {
+// Many clients may share one cache file, so each writes its own file and
+// replaces the cache with it in one step.
+#ifdef _WIN32
+bool writeFile(const std::wstring& filePath, const void* data, size_t size) {
+    std::wstring temporaryPath = filePath + L"." + std::to_wstring(
+                                     GetCurrentProcessId()) + L".tmp";
+
+    HANDLE cacheFile = CreateFileW(temporaryPath.c_str(), GENERIC_WRITE, 0,
+                                   nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (cacheFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    DWORD bytesWritten = 0;
+    BOOL writeResult = WriteFile(cacheFile, data, (DWORD) size, &bytesWritten,
+                                 nullptr);
+    CloseHandle(cacheFile);
+
+    if (!writeResult || bytesWritten != size
+            || !MoveFileExW(temporaryPath.c_str(), filePath.c_str(),
+                            MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileW(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+#else
+bool writeFile(const std::wstring& filePath, const void* data, size_t size) {
+    std::string narrowPath(filePath.begin(), filePath.end());
+    std::string temporaryPath = narrowPath + "." + std::to_string(getpid()) +
+                                ".tmp";
+
+    int fileDescriptor = ::open(temporaryPath.c_str(),
+                                O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fileDescriptor < 0) {
+        return false;
+    }
+
+    const uint8_t* remainingData = (const uint8_t*) data;
+    size_t remainingSize = size;
+
+    while (remainingSize > 0) {
+        ssize_t writtenSize = write(fileDescriptor, remainingData, remainingSize);
+
+        if (writtenSize <= 0) {
+            break;
+        }
+
+        remainingData += writtenSize;
+        remainingSize -= writtenSize;
+    }
+
+    if (::close(fileDescriptor) != 0 || remainingSize != 0
+            || std::rename(temporaryPath.c_str(), narrowPath.c_str()) != 0) {
+        unlink(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+#endif
+}
+
+D2VersionCache::D2VersionCache(const std::wstring& cachePath) :
+    cachePath(cachePath) {
+}
+
+D2VersionCache& D2VersionCache::getInstance() {
+    static D2VersionCache versionCache(DEFAULT_CACHE_PATH);
+    return versionCache;
+}
+
+bool D2VersionCache::lookup(const D2VersionFingerprint& fingerprint,
+                            GameVersion& gameVersion) const {
+    CacheEntry entries[MAX_ENTRIES];
+    size_t entryCount;
+
+    if (!readEntries(entries, entryCount)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < entryCount; i++) {
+        if (entries[i].fingerprint == fingerprint) {
+            gameVersion = (GameVersion) entries[i].gameVersion;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool D2VersionCache::store(const D2VersionFingerprint& fingerprint,
+                           GameVersion gameVersion) {
+    CacheEntry entries[MAX_ENTRIES];
+    size_t entryCount;
+
+    if (!readEntries(entries, entryCount)) {
+        entryCount = 0;
+    }
+
+    // The new entry goes first, and replaces any entry of the same build.
+    CacheEntry* entriesEnd = std::remove_if(entries, entries + entryCount,
+    [&fingerprint](const CacheEntry & entry) {
+        return entry.fingerprint == fingerprint;
+    });
+
+    entryCount = std::min((size_t)(entriesEnd - entries), MAX_ENTRIES - 1);
+    std::copy_backward(entries, entries + entryCount, entries + entryCount + 1);
+    entries[0] = { fingerprint, (int32_t) gameVersion, 0 };
+    entryCount++;
+
+    FileHeader header = { FILE_MAGIC, FILE_VERSION, (uint32_t) entryCount, 0 };
+    uint8_t fileData[sizeof(FileHeader) + sizeof(entries)];
+    size_t fileSize = sizeof(header) + entryCount * sizeof(CacheEntry);
+    std::memcpy(fileData, &header, sizeof(header));
+    std::memcpy(&fileData[sizeof(header)], entries,
+                entryCount * sizeof(CacheEntry));
+
+    return writeFile(cachePath, fileData, fileSize);
+}
+
+std::wstring D2VersionCache::getCachePath() const {
+    return cachePath;
+}
+
+bool D2VersionCache::readEntries(CacheEntry* entries,
+                                 size_t& entryCount) const {
+    D2MappedFile mappedFile;
+
+    if (!mappedFile.open(cachePath)) {
+        return false;
+    }
+
+    // Reject files that were cut short or written by another version.
+    const uint8_t* data = mappedFile.getData();
+    size_t size = mappedFile.getSize();
+    FileHeader header;
+
+    if (size < sizeof(header)) {
+        return false;
+    }
+
+    std::memcpy(&header, data, sizeof(header));
+
+    if (header.magic != FILE_MAGIC || header.version != FILE_VERSION
+            || header.entryCount > MAX_ENTRIES
+            || header.entryCount > (size - sizeof(header)) / sizeof(CacheEntry)) {
+        return false;
+    }
+
+    entryCount = header.entryCount;
+    std::memcpy(entries, &data[sizeof(header)], entryCount * sizeof(CacheEntry));
+    return true;
+}
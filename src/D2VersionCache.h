@@ -0,0 +1,78 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2VersionCache.h                                                        *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2VersionCache class, which remembers between    *
+ *   runs the builds of the game that were identified by their version       *
+ *   resource, keyed by the fingerprint of their Game.exe.                   *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2VERSIONCACHE_H
+#define _D2VERSIONCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "D2Version.h"
+#include "D2VersionDetector.h"
+
+class D2VersionCache {
+public:
+    static constexpr const wchar_t* DEFAULT_CACHE_PATH =
+        L"./SlashDiablo-Tools.versions";
+
+    static constexpr uint32_t FILE_MAGIC = 0x43563244; // "D2VC"
+    static constexpr uint32_t FILE_VERSION = 1;
+
+    // Only the most recently stored builds are kept.
+    static constexpr size_t MAX_ENTRIES = 16;
+
+    D2VersionCache(const std::wstring& cachePath);
+
+    static D2VersionCache& getInstance();
+
+    bool lookup(const D2VersionFingerprint& fingerprint,
+                GameVersion& gameVersion) const;
+    bool store(const D2VersionFingerprint& fingerprint, GameVersion gameVersion);
+
+    std::wstring getCachePath() const;
+
+private:
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t reserved;
+    };
+
+    struct CacheEntry {
+        D2VersionFingerprint fingerprint;
+        int32_t gameVersion;
+        uint32_t reserved;
+    };
+
+    std::wstring cachePath;
+
+    bool readEntries(CacheEntry* entries, size_t& entryCount) const;
+};
+
+#endif
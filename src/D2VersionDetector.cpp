@@ -0,0 +1,158 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2VersionDetector.cpp                                                   *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the functions that identify the build of the game     *
+ *   from the image of Game.exe, by its fingerprint or by its version        *
+ *   resource.                                                               *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2VersionDetector.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "D2PEImage.h"
+#include "D2Version.h"
+#include "D2VersionFingerprintDatabase.h"
+
+namespace {
+constexpr uint64_t HASH_OFFSET_BASIS = 0xCBF29CE484222325ULL;
+constexpr uint64_t HASH_PRIME = 0x00000100000001B3ULL;
+
+struct FileVersion {
+    uint32_t versionMS;
+    uint32_t versionLS;
+    GameVersion gameVersion;
+};
+
+constexpr FileVersion FILE_VERSIONS[] = {
+    { 0x00010000, 0x00070000, GameVersion::VERSION_107 },
+    { 0x00010000, 0x0008001C, GameVersion::VERSION_108 },
+    { 0x00010000, 0x00090013, GameVersion::VERSION_109 },
+    { 0x00010000, 0x00090014, GameVersion::VERSION_109b },
+    { 0x00010000, 0x00090015, GameVersion::VERSION_109c },
+    { 0x00010000, 0x00090016, GameVersion::VERSION_109d },
+    { 0x00010000, 0x000A0027, GameVersion::VERSION_110 },
+    { 0x00010000, 0x000B002D, GameVersion::VERSION_111 },
+    { 0x00010000, 0x000B002E, GameVersion::VERSION_111b },
+    { 0x00010000, 0x000C0031, GameVersion::VERSION_112 },
+    { 0x00010000, 0x000D003C, GameVersion::VERSION_113c },
+    { 0x00010000, 0x000D0040, GameVersion::VERSION_113d },
+    { 0x0001000E, 0x00000040, GameVersion::VERSION_114a },
+    { 0x0001000E, 0x00010044, GameVersion::VERSION_114b },
+    { 0x0001000E, 0x00020046, GameVersion::VERSION_114c },
+    { 0x0001000E, 0x00030047, GameVersion::VERSION_114d }
+};
+
+constexpr bool isSorted(const D2KnownBuild* knownBuilds, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        if (!(knownBuilds[i - 1].fingerprint < knownBuilds[i].fingerprint)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static_assert(isSorted(D2VersionFingerprintDatabase::KNOWN_BUILDS.data(),
+                       D2VersionFingerprintDatabase::KNOWN_BUILDS.size()),
+              "The known builds must be sorted and unique");
+
+bool hashRange(const D2PEImage& image, uint32_t rva, size_t size,
+               uint64_t& hash) {
+    const uint8_t* data = image.getRvaData(rva, size);
+
+    if (data == nullptr) {
+        return false;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * HASH_PRIME;
+    }
+
+    return true;
+}
+}
+
+bool D2VersionDetector::computeFingerprint(const D2PEImage& image,
+        D2VersionFingerprint& fingerprint) {
+    if (!image.isValid()) {
+        return false;
+    }
+
+    const auto& sections = image.getSections();
+    auto codeSection = std::find_if(sections.cbegin(), sections.cend(),
+    [](const D2PESection & section) {
+        return section.isExecutable();
+    });
+
+    uint64_t codeHash = HASH_OFFSET_BASIS;
+
+    if (codeSection == sections.cend()
+            || !hashRange(image, image.getEntryPoint(), ENTRY_POINT_HASH_SIZE, codeHash)
+            || !hashRange(image, codeSection->virtualAddress, CODE_START_HASH_SIZE,
+                          codeHash)) {
+        return false;
+    }
+
+    fingerprint = { image.getTimeDateStamp(), image.getSizeOfImage(),
+                    image.getEntryPoint(), 0, codeHash
+                  };
+    return true;
+}
+
+GameVersion D2VersionDetector::findKnownVersion(const D2VersionFingerprint&
+        fingerprint) {
+    const auto& knownBuilds = D2VersionFingerprintDatabase::KNOWN_BUILDS;
+    auto knownBuild = std::lower_bound(knownBuilds.cbegin(), knownBuilds.cend(),
+                                       fingerprint, [](const D2KnownBuild & entry,
+    const D2VersionFingerprint & searchFingerprint) {
+        return entry.fingerprint < searchFingerprint;
+    });
+
+    if (knownBuild == knownBuilds.cend() || !(knownBuild->fingerprint == fingerprint)) {
+        return GameVersion::INVALID;
+    }
+
+    return knownBuild->gameVersion;
+}
+
+GameVersion D2VersionDetector::getGameVersion(uint32_t versionMS,
+        uint32_t versionLS) {
+    for (const auto& fileVersion : FILE_VERSIONS) {
+        if (fileVersion.versionMS == versionMS && fileVersion.versionLS == versionLS) {
+            return fileVersion.gameVersion;
+        }
+    }
+
+    return GameVersion::INVALID;
+}
+
+GameVersion D2VersionDetector::findResourceVersion(const D2PEImage& image) {
+    uint32_t versionMS;
+    uint32_t versionLS;
+
+    if (!image.readFileVersion(versionMS, versionLS)) {
+        return GameVersion::INVALID;
+    }
+
+    return getGameVersion(versionMS, versionLS);
+}
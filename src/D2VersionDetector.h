@@ -0,0 +1,91 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2VersionDetector.h                                                     *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the functions that identify the build of the game    *
+ *   from the image of Game.exe, by a fingerprint of its headers and code,   *
+ *   or by the version in its version resource.                              *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2VERSIONDETECTOR_H
+#define _D2VERSIONDETECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "D2PEImage.h"
+#include "D2Version.h"
+
+// Modded builds often strip or rewrite the version resource, but keep the
+// headers and code of the build they were made from. The fingerprint also
+// keys the version cache.
+struct D2VersionFingerprint {
+    uint32_t timeDateStamp;
+    uint32_t sizeOfImage;
+    uint32_t entryPoint;
+    uint32_t reserved;
+    uint64_t codeHash;
+
+    constexpr bool operator==(const D2VersionFingerprint& other) const {
+        return timeDateStamp == other.timeDateStamp && sizeOfImage == other.sizeOfImage
+               && entryPoint == other.entryPoint && codeHash == other.codeHash;
+    }
+
+    constexpr bool operator<(const D2VersionFingerprint& other) const {
+        if (timeDateStamp != other.timeDateStamp) {
+            return timeDateStamp < other.timeDateStamp;
+        }
+
+        if (sizeOfImage != other.sizeOfImage) {
+            return sizeOfImage < other.sizeOfImage;
+        }
+
+        if (entryPoint != other.entryPoint) {
+            return entryPoint < other.entryPoint;
+        }
+
+        return codeHash < other.codeHash;
+    }
+};
+
+struct D2KnownBuild {
+    D2VersionFingerprint fingerprint;
+    GameVersion gameVersion;
+};
+
+namespace D2VersionDetector {
+// The code ranges hashed into the fingerprint, which are the same in a file
+// and in the loaded image, as Game.exe is never relocated.
+static constexpr size_t ENTRY_POINT_HASH_SIZE = 64;
+static constexpr size_t CODE_START_HASH_SIZE = 256;
+
+bool computeFingerprint(const D2PEImage& image,
+                        D2VersionFingerprint& fingerprint);
+
+// Searches the builds listed in D2VersionFingerprints.tsv. Returns INVALID
+// for builds that are not listed.
+GameVersion findKnownVersion(const D2VersionFingerprint& fingerprint);
+
+GameVersion getGameVersion(uint32_t versionMS, uint32_t versionLS);
+GameVersion findResourceVersion(const D2PEImage& image);
+}
+
+#endif
@@ -0,0 +1,40 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2VersionFingerprintDatabase.h                                          *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file is generated from D2VersionFingerprints.tsv by                *
+ *   tools/generate_version_fingerprints.py. Do not edit it by hand.         *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2VERSIONFINGERPRINTDATABASE_H
+#define _D2VERSIONFINGERPRINTDATABASE_H
+
+#include <array>
+
+#include "D2Version.h"
+#include "D2VersionDetector.h"
+
+namespace D2VersionFingerprintDatabase {
+inline constexpr std::array<D2KnownBuild, 0> KNOWN_BUILDS = {{
+}};
+}
+
+#endif
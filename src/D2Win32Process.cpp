@@ -0,0 +1,158 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2Win32Process.cpp                                                      *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file defines the D2Win32Process class, the process backend that    *
+ *   accesses the memory and modules of the running game through the Windows *
+ *   API.                                                                    *
+ *                                                                           *
+ *****************************************************************************/
+
+#include "D2Win32Process.h"
+
+#include <windows.h>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "D2ProcessBackend.h"
+
+D2Win32Process::D2Win32Process() {
+    SYSTEM_INFO systemInfo;
+    GetSystemInfo(&systemInfo);
+
+    pageSize = systemInfo.dwPageSize;
+}
+
+size_t D2Win32Process::getPageSize() const {
+    return pageSize;
+}
+
+bool D2Win32Process::readMemory(uintptr_t address, void* buffer,
+                                size_t size) {
+    return ReadProcessMemory(GetCurrentProcess(), (LPCVOID) address, buffer,
+                             size, nullptr) != FALSE;
+}
+
+bool D2Win32Process::writeMemory(uintptr_t address, const void* buffer,
+                                 size_t size) {
+    return WriteProcessMemory(GetCurrentProcess(), (LPVOID) address, buffer,
+                              size, nullptr) != FALSE;
+}
+
+bool D2Win32Process::writeUnprotectedMemory(uintptr_t address,
+        const void* buffer, size_t size) {
+    // The pages are already writable, so a plain copy is enough and avoids a
+    // system call per write.
+    std::memcpy((void*) address, buffer, size);
+    return true;
+}
+
+bool D2Win32Process::protectMemory(uintptr_t address, size_t size,
+                                   uint32_t protection, uint32_t& oldProtection) {
+    DWORD oldProtect;
+
+    if (!VirtualProtect((LPVOID) address, size, protection, &oldProtect)) {
+        return false;
+    }
+
+    oldProtection = oldProtect;
+    return true;
+}
+
+bool D2Win32Process::queryMemory(uintptr_t address,
+                                 D2MemoryRegion& region) const {
+    MEMORY_BASIC_INFORMATION memoryInfo;
+
+    if (VirtualQuery((LPCVOID) address, &memoryInfo, sizeof(memoryInfo)) == 0) {
+        return false;
+    }
+
+    region.baseAddress = (uintptr_t) memoryInfo.BaseAddress;
+    region.regionSize = memoryInfo.RegionSize;
+    region.protection = memoryInfo.Protect;
+    region.committed = memoryInfo.State == MEM_COMMIT;
+    return true;
+}
+
+void D2Win32Process::flushInstructionCache(uintptr_t address, size_t size) {
+    FlushInstructionCache(GetCurrentProcess(), (LPCVOID) address, size);
+}
+
+const uint8_t* D2Win32Process::getMemoryView(uintptr_t address,
+        size_t size) const {
+    return (const uint8_t*) address;
+}
+
+uintptr_t D2Win32Process::getModuleHandle(std::wstring_view moduleName) {
+    std::wstring moduleNameString(moduleName);
+    return (uintptr_t) GetModuleHandleW(moduleNameString.c_str());
+}
+
+uintptr_t D2Win32Process::loadModule(std::wstring_view moduleName) {
+    std::wstring moduleNameString(moduleName);
+    return (uintptr_t) LoadLibraryW(moduleNameString.c_str());
+}
+
+uintptr_t D2Win32Process::getProcAddress(uintptr_t moduleHandle,
+        uint16_t ordinal) {
+    return (uintptr_t) GetProcAddress((HMODULE) moduleHandle,
+                                      (LPCSTR)(uintptr_t) ordinal);
+}
+
+uintptr_t D2Win32Process::getProcAddress(uintptr_t moduleHandle,
+        std::string_view procName) {
+    std::string procNameString(procName);
+    return (uintptr_t) GetProcAddress((HMODULE) moduleHandle,
+                                      procNameString.c_str());
+}
+
+// Taken from StackOverflow user crashmstr
+bool D2Win32Process::getFileVersion(std::wstring_view filePath,
+                                    uint32_t& versionMS, uint32_t& versionLS) {
+    std::wstring filePathString(filePath);
+    DWORD verHandle = 0;
+    UINT size = 0;
+    LPBYTE lpBuffer = nullptr;
+    DWORD verSize = GetFileVersionInfoSizeW(filePathString.c_str(), &verHandle);
+
+    if (verSize == 0) {
+        return false;
+    }
+
+    std::unique_ptr<WCHAR[]> verData(new WCHAR[verSize]);
+
+    if (!GetFileVersionInfoW(filePathString.c_str(), verHandle, verSize,
+                             verData.get())
+            || !VerQueryValueW(verData.get(), L"\\", (VOID FAR * FAR*)&lpBuffer, &size)
+            || size == 0) {
+        return false;
+    }
+
+    VS_FIXEDFILEINFO* verInfo = (VS_FIXEDFILEINFO*)lpBuffer;
+
+    if (verInfo->dwSignature != 0xfeef04bd) {
+        return false;
+    }
+
+    versionMS = verInfo->dwFileVersionMS;
+    versionLS = verInfo->dwFileVersionLS;
+    return true;
+}
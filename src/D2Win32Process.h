@@ -0,0 +1,71 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2Win32Process.h                                                        *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file declares the D2Win32Process class, the process backend that   *
+ *   accesses the memory and modules of the running game through the Windows *
+ *   API.                                                                    *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2WIN32PROCESS_H
+#define _D2WIN32PROCESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "D2ProcessBackend.h"
+
+class D2Win32Process : public D2ProcessBackend {
+public:
+    D2Win32Process();
+
+    virtual size_t getPageSize() const override;
+
+    virtual bool readMemory(uintptr_t address, void* buffer, size_t size) override;
+    virtual bool writeMemory(uintptr_t address, const void* buffer,
+                             size_t size) override;
+    virtual bool writeUnprotectedMemory(uintptr_t address, const void* buffer,
+                                        size_t size) override;
+
+    virtual bool protectMemory(uintptr_t address, size_t size,
+                               uint32_t protection, uint32_t& oldProtection) override;
+    virtual bool queryMemory(uintptr_t address,
+                             D2MemoryRegion& region) const override;
+    virtual void flushInstructionCache(uintptr_t address, size_t size) override;
+    virtual const uint8_t* getMemoryView(uintptr_t address,
+                                         size_t size) const override;
+
+    virtual uintptr_t getModuleHandle(std::wstring_view moduleName) override;
+    virtual uintptr_t loadModule(std::wstring_view moduleName) override;
+    virtual uintptr_t getProcAddress(uintptr_t moduleHandle,
+                                     uint16_t ordinal) override;
+    virtual uintptr_t getProcAddress(uintptr_t moduleHandle,
+                                     std::string_view procName) override;
+
+    virtual bool getFileVersion(std::wstring_view filePath, uint32_t& versionMS,
+                                uint32_t& versionLS) override;
+
+private:
+    size_t pageSize;
+};
+
+#endif
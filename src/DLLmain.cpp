@@ -27,6 +27,11 @@
 #define _D2VARS_H
 
 #include "DLLmain.h"
+
+#include <cwchar>
+
+#include "D2OffsetCache.h"
+#include "D2Pointer.h"
 #include "D2Patch.h"
 #include "D2Patches.h"
 
@@ -66,6 +71,34 @@ bool __fastcall D2TEMPLATE_GetDebugPrivilege() {
     return true;
 }
 
+// Runs once DllMain has returned and released the loader lock, under which
+// writing a file may deadlock. The thread holds a reference to the DLL, so
+// that it cannot be unloaded while the file is written.
+DWORD __stdcall D2TEMPLATE_SaveOffsetCache(LPVOID lpParameter) {
+    D2OffsetCache::getInstance().save();
+    FreeLibraryAndExitThread((HMODULE) lpParameter, 0);
+    return 0;
+}
+
+void __fastcall D2TEMPLATE_StartOffsetCacheSave() {
+    HMODULE hModule;
+
+    if (GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS,
+                           (LPCWSTR) &D2TEMPLATE_SaveOffsetCache, &hModule) == 0) {
+        return;
+    }
+
+    HANDLE hThread = CreateThread(nullptr, 0, &D2TEMPLATE_SaveOffsetCache,
+                                  hModule, 0, nullptr);
+
+    if (hThread == nullptr) {
+        FreeLibrary(hModule);
+        return;
+    }
+
+    CloseHandle(hThread);
+}
+
 bool __stdcall DllAttach() {
     D2TEMPLATE_GetDebugPrivilege();
 
@@ -76,7 +109,37 @@ bool __stdcall DllAttach() {
         return false;
     }
 
-    D2Patch::applyPatches(gptTemplatePatches);
+    // Resolve every pointer from D2Ptrs.h in one pass, now that the game
+    // version can be checked.
+    D2PointerResolveStats resolveStats =
+        D2PointerTable::getInstance().resolveAll();
+
+    wchar_t resolveMessage[128];
+    swprintf(resolveMessage, sizeof(resolveMessage) / sizeof(resolveMessage[0]),
+             L"D2Template: resolved %u of %u pointers in %u us\n",
+             (unsigned int) resolveStats.resolvedCount,
+             (unsigned int) resolveStats.pointerCount,
+             (unsigned int) resolveStats.elapsedMicroseconds);
+    OutputDebugStringW(resolveMessage);
+
+    // The patch table is written in one window with the other threads
+    // suspended, and is left untouched if any of it fails.
+    D2PatchTransaction patchTransaction;
+    bool patchSuccess = D2Patch::applyPatches(gptTemplatePatches,
+                        patchTransaction);
+
+    wchar_t patchMessage[128];
+    swprintf(patchMessage, sizeof(patchMessage) / sizeof(patchMessage[0]),
+             L"D2Template: %s %u patches in a %u us commit window\n",
+             patchSuccess ? L"applied" : L"failed to apply",
+             (unsigned int) patchTransaction.getPatchCount(),
+             (unsigned int) patchTransaction.getCommitWindowMicroseconds());
+    OutputDebugStringW(patchMessage);
+
+    // Offsets resolved while patching are kept for the next run. The file is
+    // written from another thread, since DllAttach runs under the loader
+    // lock.
+    D2TEMPLATE_StartOffsetCacheSave();
 
     return true;
 }
@@ -0,0 +1,347 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2CaptureReplay.cpp                                                     *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   A command line tool that streams a packet capture back through the      *
+ *   packet dispatchers, at the speed it was captured at or as fast as       *
+ *   possible, to measure the handlers on the same traffic every time.       *
+ *                                                                           *
+ *****************************************************************************/
+
+// Building on Linux, from the root of the repository:
+//
+//   g++ -std=c++17 -O2 -Itools/compat -Isrc tools/D2CaptureReplay/D2CaptureReplay.cpp
+//       src/D2CaptureReader.cpp src/D2CaptureWriter.cpp src/D2MappedFile.cpp
+//       src/D2PacketDispatcher.cpp src/D2PacketTable.cpp -o d2capturereplay
+//
+// Usage:
+//
+//   d2capturereplay info <capture>
+//   d2capturereplay replay [--original-speed] [--iterations <count>]
+//       [--from <milliseconds>] [--opcode <id>] <capture>
+//   d2capturereplay generate <packet count> <capture>
+//
+// The start of a replay is counted from the first record of the capture.
+// Generated captures hold the declared packets of both directions, and are
+// meant for measuring the replay itself.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+#include <vector>
+
+#include "D2CaptureFormat.h"
+#include "D2CaptureReader.h"
+#include "D2CaptureWriter.h"
+#include "D2PacketDef.h"
+#include "D2PacketDispatcher.h"
+#include "D2PacketTable.h"
+
+namespace {
+constexpr uint64_t NANOSECONDS_PER_MILLISECOND = 1000000;
+
+struct ReplayOptions {
+    bool originalSpeed;
+    size_t iterations;
+    uint64_t fromMilliseconds;
+    int opcode;
+};
+
+// Gives the handlers something to do with each field, so that the reads are
+// not optimized away.
+struct ReplayContext {
+    uint64_t checksum;
+    size_t rawPacketCount;
+};
+
+void onClt01(const D2GSPacketClt01& packet, void* context) {
+    ((ReplayContext*) context)->checksum += packet.nX ^ packet.nY;
+}
+
+void onClt02(const D2GSPacketClt02& packet, void* context) {
+    ((ReplayContext*) context)->checksum += packet.dwUnitType ^ packet.dwUnitId;
+}
+
+void onClt03(const D2GSPacketClt03& packet, void* context) {
+    ((ReplayContext*) context)->checksum += packet.nX + packet.nY;
+}
+
+void onSrv01(const D2GSPacketSrv01& packet, void* context) {
+    ((ReplayContext*) context)->checksum += packet.dwArenaFlags + packet.nDifficulty;
+}
+
+void onSrv02(const D2GSPacketSrv02& packet, void* context) {
+    ((ReplayContext*) context)->checksum += packet.nHeader;
+}
+
+void onSrv03(const D2GSPacketSrv03& packet, void* context) {
+    ((ReplayContext*) context)->checksum += packet.dwMapId ^ packet.nAreaId;
+}
+
+void onRawPacket(const uint8_t*, size_t, void* context) {
+    ((ReplayContext*) context)->rawPacketCount++;
+}
+
+// Packets without a struct are still counted, through a raw handler.
+void setHandlers(D2PacketDispatcher& clientDispatcher,
+                 D2PacketDispatcher& serverDispatcher) {
+    for (size_t i = 0; i < D2PacketTable::PACKET_ID_COUNT; i++) {
+        clientDispatcher.setRawHandler((uint8_t) i, &onRawPacket);
+        serverDispatcher.setRawHandler((uint8_t) i, &onRawPacket);
+    }
+
+    clientDispatcher.setHandler(&onClt01);
+    clientDispatcher.setHandler(&onClt02);
+    clientDispatcher.setHandler(&onClt03);
+    serverDispatcher.setHandler(&onSrv01);
+    serverDispatcher.setHandler(&onSrv02);
+    serverDispatcher.setHandler(&onSrv03);
+}
+
+int printInfo(const D2CaptureReader& captureReader) {
+    uint64_t opcodeCounts[2][D2CaptureFormat::OPCODE_COUNT] = {};
+    uint64_t lastTimestamp = captureReader.getStartTimestamp();
+
+    captureReader.forEachRecord(0, D2CaptureReader::ANY_OPCODE,
+    [&](const D2CaptureRecord & record) {
+        opcodeCounts[(int) record.direction][record.opcode]++;
+        lastTimestamp = std::max(lastTimestamp, record.timestamp);
+    });
+
+    std::printf("%llu records over %.3f seconds, %zu index entries%s\n",
+                (unsigned long long) captureReader.getRecordCount(),
+                (lastTimestamp - captureReader.getStartTimestamp()) / 1e9,
+                captureReader.getIndexEntries().size(),
+                captureReader.isFinished() ? "" : ", unfinished");
+
+    for (int direction = 0; direction < 2; direction++) {
+        for (size_t opcode = 0; opcode < D2CaptureFormat::OPCODE_COUNT; opcode++) {
+            if (opcodeCounts[direction][opcode] != 0) {
+                std::printf("%s 0x%02zX %llu\n", (direction == 0) ? "client" : "server",
+                            opcode, (unsigned long long) opcodeCounts[direction][opcode]);
+            }
+        }
+    }
+
+    return 0;
+}
+
+int replay(const D2CaptureReader& captureReader, const ReplayOptions& options) {
+    D2PacketDispatcher clientDispatcher(D2PacketDirection::CLIENT_TO_SERVER);
+    D2PacketDispatcher serverDispatcher(D2PacketDirection::SERVER_TO_CLIENT);
+    setHandlers(clientDispatcher, serverDispatcher);
+
+    uint64_t fromTimestamp = captureReader.getStartTimestamp() +
+                             options.fromMilliseconds * NANOSECONDS_PER_MILLISECOND;
+    ReplayContext context = {};
+    size_t packetCount = 0;
+    size_t byteCount = 0;
+    size_t failedCount = 0;
+    uint64_t maxLateness = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < options.iterations; i++) {
+        auto iterationStart = std::chrono::steady_clock::now();
+
+        packetCount += captureReader.forEachRecord(fromTimestamp, options.opcode,
+        [&](const D2CaptureRecord & record) {
+            if (options.originalSpeed) {
+                auto dueTime = iterationStart + std::chrono::nanoseconds(
+                                   record.timestamp - fromTimestamp);
+                std::this_thread::sleep_until(dueTime);
+
+                uint64_t lateness = (uint64_t) std::chrono::duration_cast
+                                    <std::chrono::nanoseconds>(std::chrono::steady_clock::now() - dueTime).count();
+                maxLateness = std::max(maxLateness, lateness);
+            }
+
+            const D2PacketDispatcher& dispatcher = (record.direction ==
+                                                    D2PacketDirection::CLIENT_TO_SERVER) ? clientDispatcher : serverDispatcher;
+
+            if (dispatcher.dispatch(record.data, record.size,
+                                    &context).status != D2PacketStatus::COMPLETE) {
+                failedCount++;
+            }
+
+            byteCount += record.size;
+        });
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() -
+                                            start;
+
+    if (packetCount == 0) {
+        std::fputs("No records were replayed\n", stderr);
+        return 1;
+    }
+
+    std::printf("%zu packets, %zu bytes, %zu iterations in %.3f seconds\n",
+                packetCount, byteCount, options.iterations, elapsed.count());
+    std::printf("%.1f million packets per second, %.1f MB per second\n",
+                packetCount / elapsed.count() / 1e6, byteCount / elapsed.count() / 1e6);
+
+    if (options.originalSpeed) {
+        std::printf("At most %.3f milliseconds late\n",
+                    maxLateness / (double) NANOSECONDS_PER_MILLISECOND);
+    }
+
+    // Records that are truncated or unknown to the length tables.
+    if (failedCount != 0) {
+        std::printf("%zu packets could not be dispatched whole\n", failedCount);
+    }
+
+    std::printf("Checksum %016llX\n", (unsigned long long)(context.checksum +
+                context.rawPacketCount));
+    return 0;
+}
+
+// Alternates between bursts of client and server packets, a millisecond
+// apart on average.
+int generate(size_t packetCount, const std::filesystem::path& capturePath) {
+    D2CaptureWriter captureWriter;
+
+    if (!captureWriter.open(capturePath.wstring())) {
+        std::fprintf(stderr, "%s: could not be created\n", capturePath.string().c_str());
+        return 1;
+    }
+
+    uint32_t state = 0x2545F491;
+    uint64_t timestamp = 0;
+    uint8_t packet[D2PacketTable::PACKET_ID_COUNT];
+
+    for (size_t i = 0; i < packetCount; i++) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+
+        D2PacketDirection direction = ((i / 16) % 2 == 0) ?
+                                      D2PacketDirection::CLIENT_TO_SERVER : D2PacketDirection::SERVER_TO_CLIENT;
+        const D2PacketTable::LengthTable& lengthTable = D2PacketTable::getLengthTable(
+                    direction);
+
+        // The declared packets of both directions use the first few opcodes.
+        uint8_t packetId = (uint8_t)(1 + state % 3);
+        size_t packetSize = lengthTable[packetId].size;
+        packet[0] = packetId;
+
+        for (size_t j = 1; j < packetSize; j++) {
+            packet[j] = (uint8_t)(state >> (j % 4 * 8));
+        }
+
+        timestamp += (state >> 8) % (2 * NANOSECONDS_PER_MILLISECOND);
+
+        if (!captureWriter.write(timestamp, direction, packet, packetSize)) {
+            std::fprintf(stderr, "%s: could not be written\n", capturePath.string().c_str());
+            return 1;
+        }
+    }
+
+    if (!captureWriter.close()) {
+        std::fprintf(stderr, "%s: could not be closed\n", capturePath.string().c_str());
+        return 1;
+    }
+
+    return 0;
+}
+
+bool openCapture(const std::filesystem::path& capturePath,
+                 D2CaptureReader& captureReader) {
+    if (!captureReader.open(capturePath.wstring())) {
+        std::fprintf(stderr, "%s: not a readable capture\n",
+                     capturePath.string().c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void printUsage() {
+    std::fputs("Usage: d2capturereplay info <capture>\n"
+               "       d2capturereplay replay [--original-speed] [--iterations <count>]\n"
+               "           [--from <milliseconds>] [--opcode <id>] <capture>\n"
+               "       d2capturereplay generate <packet count> <capture>\n", stderr);
+}
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        printUsage();
+        return 2;
+    }
+
+    D2CaptureReader captureReader;
+
+    if (std::strcmp(argv[1], "info") == 0 && argc == 3) {
+        return openCapture(argv[2], captureReader) ? printInfo(captureReader) : 1;
+    }
+
+    if (std::strcmp(argv[1], "generate") == 0 && argc == 4) {
+        size_t packetCount = std::strtoul(argv[2], nullptr, 10);
+
+        if (packetCount == 0) {
+            printUsage();
+            return 2;
+        }
+
+        return generate(packetCount, argv[3]);
+    }
+
+    if (std::strcmp(argv[1], "replay") != 0) {
+        printUsage();
+        return 2;
+    }
+
+    ReplayOptions options = { false, 1, 0, D2CaptureReader::ANY_OPCODE };
+    int argument = 2;
+
+    for (; argument < argc - 1; argument++) {
+        if (std::strcmp(argv[argument], "--original-speed") == 0) {
+            options.originalSpeed = true;
+        } else if (std::strcmp(argv[argument], "--iterations") == 0
+                   && argument + 2 < argc) {
+            options.iterations = std::strtoul(argv[++argument], nullptr, 10);
+        } else if (std::strcmp(argv[argument], "--from") == 0
+                   && argument + 2 < argc) {
+            options.fromMilliseconds = std::strtoull(argv[++argument], nullptr, 10);
+        } else if (std::strcmp(argv[argument], "--opcode") == 0
+                   && argument + 2 < argc) {
+            options.opcode = (int) std::strtoul(argv[++argument], nullptr, 0);
+        } else {
+            break;
+        }
+    }
+
+    if (argument != argc - 1 || options.iterations == 0
+            || options.opcode >= (int) D2CaptureFormat::OPCODE_COUNT) {
+        printUsage();
+        return 2;
+    }
+
+    if (!openCapture(argv[argument], captureReader)) {
+        return 1;
+    }
+
+    return replay(captureReader, options);
+}
@@ -0,0 +1,153 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2HookDispatchBench.cpp                                                 *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   A command line tool that measures the cost of running the handlers of a *
+ *   hook site through its dispatchers, for chains of up to 8 handlers per   *
+ *   phase.                                                                  *
+ *                                                                           *
+ *****************************************************************************/
+
+// Building on Linux, from the root of the repository:
+//
+//   g++ -std=c++17 -O2 -Itools/compat -Isrc tools/D2HookDispatchBench/D2HookDispatchBench.cpp
+//       src/D2Patch/D2HookChain.cpp -o d2hookdispatchbench
+//
+// Usage:
+//
+//   d2hookdispatchbench [--iterations <count>]
+//
+// Each call runs the pre and the post dispatcher of a site, as its stub
+// does around the displaced instructions. The same handlers are also called
+// directly from an array, which is the least a chain can cost. The time of
+// the stub itself, saving and loading the registers, is not included.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "D2Patch/D2HookChain.h"
+#include "D2Patch/D2HookSitePatch.h"
+
+namespace {
+constexpr size_t DEFAULT_ITERATIONS = 10000000;
+constexpr size_t MAX_HANDLERS = 8;
+constexpr size_t CHAIN_LENGTHS[] = { 0, 1, 8 };
+
+// Each handler depends on the result of the one before it, so that the
+// order they ran in shows up in eax.
+template<DWORD N>
+void __stdcall mixHandler(D2HookContext* context) {
+    context->eax = context->eax * 3 + N;
+}
+
+const D2HookHandler HANDLERS[MAX_HANDLERS] = {
+    &mixHandler<1>, &mixHandler<2>, &mixHandler<3>, &mixHandler<4>,
+    &mixHandler<5>, &mixHandler<6>, &mixHandler<7>, &mixHandler<8>
+};
+
+DWORD runDirectly(size_t handlerCount, size_t iterations) {
+    // The array is read through a volatile pointer, so that the calls are
+    // not inlined.
+    const D2HookHandler* volatile handlers = HANDLERS;
+    D2HookContext context = {};
+
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        for (size_t i = 0; i < handlerCount; i++) {
+            handlers[i](&context);
+        }
+
+        for (size_t i = handlerCount; i > 0; i--) {
+            handlers[i - 1](&context);
+        }
+    }
+
+    return context.eax;
+}
+
+DWORD runChain(size_t handlerCount, size_t iterations) {
+    D2HookChain chain;
+    chain.preHandlers.assign(HANDLERS, HANDLERS + handlerCount);
+    chain.postHandlers.assign(chain.preHandlers.rbegin(),
+                              chain.preHandlers.rend());
+
+    std::atomic<const D2HookChain*> siteChain(&chain);
+    D2HookContext context = {};
+
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        D2HookChain::dispatchPre(&siteChain, &context);
+        D2HookChain::dispatchPost(&siteChain, &context);
+    }
+
+    return context.eax;
+}
+
+double measure(DWORD (*run)(size_t, size_t), size_t handlerCount,
+               size_t iterations, DWORD& result) {
+    auto start = std::chrono::steady_clock::now();
+    result = run(handlerCount, iterations);
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+void printUsage() {
+    std::fputs("Usage: d2hookdispatchbench [--iterations <count>]\n", stderr);
+}
+}
+
+int main(int argc, char** argv) {
+    size_t iterations = DEFAULT_ITERATIONS;
+
+    if (argc == 3 && std::strcmp(argv[1], "--iterations") == 0) {
+        iterations = std::strtoul(argv[2], nullptr, 10);
+    } else if (argc != 1) {
+        iterations = 0;
+    }
+
+    if (iterations == 0) {
+        printUsage();
+        return 2;
+    }
+
+    std::printf("%8s %12s %12s %12s\n", "handlers", "direct ns", "chain ns",
+                "overhead ns");
+
+    for (size_t handlerCount : CHAIN_LENGTHS) {
+        DWORD directResult;
+        DWORD chainResult;
+        double directNanoseconds = measure(&runDirectly, handlerCount, iterations,
+                                           directResult);
+        double chainNanoseconds = measure(&runChain, handlerCount, iterations,
+                                          chainResult);
+
+        if (directResult != chainResult) {
+            std::fprintf(stderr, "The chain of %zu handlers ran them out of order\n",
+                         handlerCount);
+            return 1;
+        }
+
+        std::printf("%8zu %12.2f %12.2f %12.2f\n", handlerCount, directNanoseconds,
+                    chainNanoseconds, chainNanoseconds - directNanoseconds);
+    }
+
+    return 0;
+}
@@ -0,0 +1,530 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PacketBench.cpp                                                       *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   A command line tool that measures how many D2GS packets the dispatcher  *
+ *   splits and routes per second, over a capture, a recorded stream or a    *
+ *   generated one.                                                          *
+ *                                                                           *
+ *****************************************************************************/
+
+// Building on Linux, from the root of the repository:
+//
+//   g++ -std=c++17 -O2 -Itools/compat -Isrc tools/D2PacketBench/D2PacketBench.cpp
+//       src/D2CaptureReader.cpp src/D2MappedFile.cpp src/D2PacketDispatcher.cpp
+//       src/D2PacketTable.cpp -o d2packetbench
+//
+// Usage:
+//
+//   d2packetbench test
+//   d2packetbench [--iterations <count>] <client|server> [capture or stream file]
+//
+// The test command checks the lengths read from the tables and the packets
+// split by the dispatcher, and exits with 1 if any check fails.
+//
+// A capture written by D2CaptureWriter holds one packet per record, so the
+// length the table gives each of them is checked against the record first.
+// The opcodes the table does not know, or gives another length, are listed,
+// and only the records that match are joined into the measured stream.
+//
+// A stream file holds the packets of one direction back to back, as they are
+// given to the game. Server packets must already be decompressed. Without a
+// file, a stream of the declared packets is generated. Generated packets have
+// their real header bytes and length fields, but random contents, so they
+// only measure the splitting and routing, not real game traffic.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "D2CaptureReader.h"
+#include "D2PacketDef.h"
+#include "D2PacketDispatcher.h"
+#include "D2PacketTable.h"
+#include "D2PacketView.h"
+
+namespace {
+constexpr size_t DEFAULT_ITERATIONS = 100;
+constexpr size_t GENERATED_PACKET_COUNT = 1 << 20;
+constexpr size_t MAX_GENERATED_BODY_SIZE = 64;
+
+// Gives the handlers something to do with each field, so that the reads are
+// not optimized away.
+struct BenchContext {
+    uint64_t checksum;
+    size_t rawPacketCount;
+};
+
+void onClt01(const D2GSPacketClt01& packet, void* context) {
+    ((BenchContext*) context)->checksum += packet.nX ^ packet.nY;
+}
+
+void onClt02(const D2GSPacketClt02& packet, void* context) {
+    ((BenchContext*) context)->checksum += packet.dwUnitType ^ packet.dwUnitId;
+}
+
+void onClt03(const D2GSPacketClt03& packet, void* context) {
+    ((BenchContext*) context)->checksum += packet.nX + packet.nY;
+}
+
+void onSrv01(const D2GSPacketSrv01& packet, void* context) {
+    ((BenchContext*) context)->checksum += packet.dwArenaFlags + packet.nDifficulty;
+}
+
+void onSrv02(const D2GSPacketSrv02& packet, void* context) {
+    ((BenchContext*) context)->checksum += packet.nHeader;
+}
+
+void onSrv03(const D2GSPacketSrv03& packet, void* context) {
+    ((BenchContext*) context)->checksum += packet.dwMapId ^ packet.nAreaId;
+}
+
+void onSrv5B(const D2GSPacketSrv5B& packet, void* context) {
+    ((BenchContext*) context)->checksum += packet.dwPlayerId + packet.nLength;
+}
+
+void onSrv9C(const D2GSPacketSrv9C& packet, void* context) {
+    ((BenchContext*) context)->checksum += packet.dwItemId ^ packet.nAction;
+}
+
+void onSrv9D(const D2GSPacketSrv9D& packet, void* context) {
+    ((BenchContext*) context)->checksum += packet.dwItemId ^ packet.dwOwnerId;
+}
+
+void onSrvA8(const D2GSPacketSrvA8& packet, void* context) {
+    ((BenchContext*) context)->checksum += packet.dwUnitId + packet.nState;
+}
+
+void onSrvAA(const D2GSPacketSrvAA& packet, void* context) {
+    ((BenchContext*) context)->checksum += packet.dwUnitId + packet.nUnitType;
+}
+
+void onSrvAC(const D2GSPacketSrvAC& packet, void* context) {
+    ((BenchContext*) context)->checksum += packet.dwUnitId ^ packet.nUnitCode;
+}
+
+void onRawPacket(const uint8_t*, size_t, void* context) {
+    ((BenchContext*) context)->rawPacketCount++;
+}
+
+void registerHandlers(D2PacketDispatcher& dispatcher,
+                      D2PacketDirection direction) {
+    // Packets without a struct are still counted, through a raw handler.
+    for (size_t i = 0; i < D2PacketTable::PACKET_ID_COUNT; i++) {
+        dispatcher.setRawHandler((uint8_t) i, &onRawPacket);
+    }
+
+    if (direction == D2PacketDirection::CLIENT_TO_SERVER) {
+        dispatcher.setHandler(&onClt01);
+        dispatcher.setHandler(&onClt02);
+        dispatcher.setHandler(&onClt03);
+    } else {
+        dispatcher.setHandler(&onSrv01);
+        dispatcher.setHandler(&onSrv02);
+        dispatcher.setHandler(&onSrv03);
+        dispatcher.setHandler(&onSrv5B);
+        dispatcher.setHandler(&onSrv9C);
+        dispatcher.setHandler(&onSrv9D);
+        dispatcher.setHandler(&onSrvA8);
+        dispatcher.setHandler(&onSrvAA);
+        dispatcher.setHandler(&onSrvAC);
+    }
+}
+
+uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Appends one packet with random fields. Variable and counted packets get a
+// random body, and their length or count field is set to cover it. The
+// strings of terminated packets get random lengths.
+void appendPacket(std::vector<uint8_t>& stream, uint8_t packetId,
+                  const D2PacketLength& packetLength, uint32_t& state) {
+    size_t length = packetLength.size;
+    size_t field = 0;
+
+    if (packetLength.kind == D2PacketLengthKind::VARIABLE) {
+        length += nextRandom(state) % MAX_GENERATED_BODY_SIZE;
+        field = length;
+    } else if (packetLength.kind == D2PacketLengthKind::COUNTED) {
+        field = nextRandom(state) % (MAX_GENERATED_BODY_SIZE /
+                                     packetLength.elementSize);
+        length += field * packetLength.elementSize;
+    }
+
+    size_t start = stream.size();
+    stream.push_back(packetId);
+
+    for (size_t i = 1; i < length; i++) {
+        stream.push_back((uint8_t) nextRandom(state));
+    }
+
+    for (size_t i = 0; i < packetLength.lengthSize; i++) {
+        stream[start + packetLength.lengthOffset + i] = (uint8_t)(field >> (i * 8));
+    }
+
+    for (size_t i = 0; i < packetLength.stringCount; i++) {
+        size_t stringLength = nextRandom(state) % MAX_GENERATED_BODY_SIZE;
+
+        for (size_t j = 0; j < stringLength; j++) {
+            stream.push_back((uint8_t)(1 + nextRandom(state) % 255));
+        }
+
+        stream.push_back(0);
+    }
+}
+
+// Picks the declared packets of the direction at random.
+std::vector<uint8_t> generateStream(D2PacketDirection direction) {
+    const D2PacketTable::LengthTable& lengthTable = D2PacketTable::getLengthTable(
+                direction);
+    std::vector<uint8_t> packetIds;
+
+    for (size_t i = 0; i < lengthTable.size(); i++) {
+        if (lengthTable[i].kind != D2PacketLengthKind::UNKNOWN) {
+            packetIds.push_back((uint8_t) i);
+        }
+    }
+
+    std::vector<uint8_t> stream;
+    uint32_t state = 0x2545F491;
+
+    for (size_t i = 0; i < GENERATED_PACKET_COUNT; i++) {
+        uint8_t packetId = packetIds[nextRandom(state) % packetIds.size()];
+        appendPacket(stream, packetId, lengthTable[packetId], state);
+    }
+
+    return stream;
+}
+
+bool readStream(const char* filePath, std::vector<uint8_t>& stream) {
+    std::ifstream streamFile(filePath, std::ios::binary);
+
+    if (!streamFile) {
+        return false;
+    }
+
+    stream.assign(std::istreambuf_iterator<char>(streamFile),
+                  std::istreambuf_iterator<char>());
+    return !streamFile.bad();
+}
+
+// Joins the records of the direction whose length the table agrees with.
+// Returns false if the file is not a capture.
+bool readCapture(const char* filePath, D2PacketDirection direction,
+                 std::vector<uint8_t>& stream) {
+    D2CaptureReader captureReader;
+    std::string path(filePath);
+
+    if (!captureReader.open(std::wstring(path.begin(), path.end()))) {
+        return false;
+    }
+
+    const D2PacketTable::LengthTable& lengthTable = D2PacketTable::getLengthTable(
+                direction);
+    std::array<size_t, D2PacketTable::PACKET_ID_COUNT> unknownCounts = {};
+    std::array<size_t, D2PacketTable::PACKET_ID_COUNT> mismatchCounts = {};
+    size_t recordCount = 0;
+
+    captureReader.forEachRecord(0, D2CaptureReader::ANY_OPCODE,
+    [&](const D2CaptureRecord & record) {
+        if (record.direction != direction) {
+            return;
+        }
+
+        recordCount++;
+        size_t length = 0;
+        D2PacketStatus status = D2PacketTable::getPacketLength(lengthTable,
+                                record.data, record.size, length);
+
+        if (status == D2PacketStatus::UNKNOWN_PACKET) {
+            unknownCounts[record.opcode]++;
+        } else if (status != D2PacketStatus::COMPLETE || length != record.size) {
+            mismatchCounts[record.opcode]++;
+        } else {
+            stream.insert(stream.end(), record.data, record.data + record.size);
+        }
+    });
+
+    std::printf("%zu records of the direction in the capture\n", recordCount);
+
+    for (size_t i = 0; i < D2PacketTable::PACKET_ID_COUNT; i++) {
+        if (unknownCounts[i] != 0) {
+            std::printf("Opcode %02zX is not in the table, %zu records left out\n", i,
+                        unknownCounts[i]);
+        }
+
+        if (mismatchCounts[i] != 0) {
+            std::printf("Opcode %02zX has another length in the table, %zu records "
+                        "left out\n", i, mismatchCounts[i]);
+        }
+    }
+
+    return true;
+}
+
+const char* getStatusName(D2PacketStatus status) {
+    switch (status) {
+    case D2PacketStatus::COMPLETE:
+        return "complete";
+
+    case D2PacketStatus::TRUNCATED:
+        return "truncated";
+
+    case D2PacketStatus::UNKNOWN_PACKET:
+        return "unknown packet";
+
+    default:
+        return "malformed";
+    }
+}
+
+size_t failureCount = 0;
+size_t checkCount = 0;
+
+void check(const char* name, bool passed) {
+    checkCount++;
+
+    if (!passed) {
+        std::printf("FAIL %s\n", name);
+        failureCount++;
+    }
+}
+
+bool hasLength(const uint8_t* buffer, size_t size, D2PacketStatus status,
+               size_t length) {
+    size_t readLength = 0;
+    D2PacketStatus readStatus = D2PacketTable::getPacketLength(
+                                    D2PacketTable::SERVER_LENGTHS, buffer, size, readLength);
+
+    return readStatus == status && (status != D2PacketStatus::COMPLETE
+                                    || readLength == length);
+}
+
+void testLengths() {
+    const uint8_t srv03[12] = { 0x03 };
+    check("fixed packets have the size of their struct",
+          hasLength(srv03, sizeof(srv03), D2PacketStatus::COMPLETE, 12));
+    check("short fixed packets are truncated",
+          hasLength(srv03, 11, D2PacketStatus::TRUNCATED, 0));
+
+    // 0x9C stores one byte of length at offset 2, 0x5B two bytes at offset 1.
+    const uint8_t srv9C[20] = { 0x9C, 0x04, 20, 0x10 };
+    check("variable packets have the length they store",
+          hasLength(srv9C, sizeof(srv9C), D2PacketStatus::COMPLETE, 20));
+    check("variable packets shorter than their length are truncated",
+          hasLength(srv9C, 19, D2PacketStatus::TRUNCATED, 0));
+    check("variable packets cut before their length field are truncated",
+          hasLength(srv9C, 2, D2PacketStatus::TRUNCATED, 0));
+
+    const uint8_t srv5B[300] = { 0x5B, 0x2C, 0x01 };
+    check("two byte lengths are little-endian",
+          hasLength(srv5B, sizeof(srv5B), D2PacketStatus::COMPLETE, 300));
+
+    const uint8_t shortSrvAC[13] = { 0xAC, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 12 };
+    check("lengths below the fixed header are malformed",
+          hasLength(shortSrvAC, sizeof(shortSrvAC), D2PacketStatus::MALFORMED, 0));
+
+    const uint8_t srv95[13] = { 0x95 };
+    check("packets without a struct have the size of their row",
+          hasLength(srv95, sizeof(srv95), D2PacketStatus::COMPLETE, 13));
+
+    // 0x94 stores a count of three byte skills at offset 1.
+    const uint8_t srv94[12] = { 0x94, 2 };
+    check("counted packets cover their elements",
+          hasLength(srv94, sizeof(srv94), D2PacketStatus::COMPLETE, 12));
+    check("counted packets shorter than their elements are truncated",
+          hasLength(srv94, 11, D2PacketStatus::TRUNCATED, 0));
+
+    // 0x26 ends with a name and a message after ten bytes.
+    const uint8_t srv26[16] = { 0x26, 1, 0, 0, 0, 0, 0, 0, 0, 0, 'A', 0, 'h', 'i', 0, 0x26 };
+    check("terminated packets end with their last string",
+          hasLength(srv26, sizeof(srv26), D2PacketStatus::COMPLETE, 15));
+    check("terminated packets without their last zero are truncated",
+          hasLength(srv26, 14, D2PacketStatus::TRUNCATED, 0));
+    check("terminated packets cut before their strings are truncated",
+          hasLength(srv26, 10, D2PacketStatus::TRUNCATED, 0));
+
+    const uint8_t undeclared[4] = { 0xFF };
+    check("undeclared packets are unknown",
+          hasLength(undeclared, sizeof(undeclared), D2PacketStatus::UNKNOWN_PACKET,
+                    0));
+}
+
+void testViews() {
+    uint8_t srvA8[24] = { 0xA8, 0x01, 0x78, 0x56, 0x34, 0x12, 16, 0x20 };
+    D2PacketView<D2GSPacketSrvA8> view = D2PacketView<D2GSPacketSrvA8>::parse(
+            srvA8, sizeof(srvA8));
+
+    check("views of variable packets cover their length", view.isValid()
+          && view.getSize() == 16 && view->dwUnitId == 0x12345678 && view->nState == 0x20);
+    check("views of truncated variable packets are invalid",
+          !D2PacketView<D2GSPacketSrvA8>::parse(srvA8, 15).isValid());
+
+    srvA8[6] = 7;
+    check("views of malformed variable packets are invalid",
+          !D2PacketView<D2GSPacketSrvA8>::parse(srvA8, sizeof(srvA8)).isValid());
+}
+
+void testDispatch() {
+    std::vector<uint8_t> stream = generateStream(
+                                      D2PacketDirection::SERVER_TO_CLIENT);
+    D2PacketDispatcher dispatcher(D2PacketDirection::SERVER_TO_CLIENT);
+    registerHandlers(dispatcher, D2PacketDirection::SERVER_TO_CLIENT);
+
+    BenchContext context = {};
+    D2PacketDispatchResult result = dispatcher.dispatch(stream.data(),
+                                    stream.size(), &context);
+    check("generated streams are split into every packet",
+          result.status == D2PacketStatus::COMPLETE
+          && result.packetCount == GENERATED_PACKET_COUNT
+          && result.consumedSize == stream.size());
+
+    // Packets with a struct reach their typed handler, and the others the
+    // raw one.
+    std::vector<uint8_t> mixedStream(12 + 8 + 13, 0);
+    mixedStream[0] = 0x03;
+    mixedStream[12] = 0x9C;
+    mixedStream[14] = 8;
+    mixedStream[20] = 0x95;
+    context = {};
+    result = dispatcher.dispatch(mixedStream.data(), mixedStream.size(), &context);
+    check("declared packets reach their typed handlers",
+          result.status == D2PacketStatus::COMPLETE && result.packetCount == 3
+          && context.rawPacketCount == 1);
+
+    // Cutting a stream in the middle of a variable packet leaves it for the
+    // next buffer.
+    std::vector<uint8_t> cutStream(10, 0);
+    cutStream[0] = 0x02;
+    cutStream[1] = 0x9C;
+    cutStream[3] = 40;
+    result = dispatcher.dispatch(cutStream.data(), cutStream.size(), &context);
+    check("streams stop before a truncated variable packet",
+          result.status == D2PacketStatus::TRUNCATED && result.packetCount == 1
+          && result.consumedSize == 1);
+}
+
+bool runTests() {
+    testLengths();
+    testViews();
+    testDispatch();
+
+    std::printf("%zu of %zu checks passed\n", checkCount - failureCount,
+                checkCount);
+    return failureCount == 0;
+}
+
+void printUsage() {
+    std::fputs("Usage: d2packetbench test\n"
+               "       d2packetbench [--iterations <count>] <client|server> "
+               "[capture or stream file]\n", stderr);
+}
+}
+
+int main(int argc, char** argv) {
+    if (argc == 2 && std::strcmp(argv[1], "test") == 0) {
+        return runTests() ? 0 : 1;
+    }
+
+    size_t iterations = DEFAULT_ITERATIONS;
+    int firstArgument = 1;
+
+    if (argc > 2 && std::strcmp(argv[1], "--iterations") == 0) {
+        iterations = std::strtoul(argv[2], nullptr, 10);
+        firstArgument = 3;
+    }
+
+    if (iterations == 0 || firstArgument >= argc || argc > firstArgument + 2) {
+        printUsage();
+        return 2;
+    }
+
+    D2PacketDirection direction;
+
+    if (std::strcmp(argv[firstArgument], "client") == 0) {
+        direction = D2PacketDirection::CLIENT_TO_SERVER;
+    } else if (std::strcmp(argv[firstArgument], "server") == 0) {
+        direction = D2PacketDirection::SERVER_TO_CLIENT;
+    } else {
+        printUsage();
+        return 2;
+    }
+
+    std::vector<uint8_t> stream;
+
+    if (firstArgument + 1 < argc) {
+        if (!readCapture(argv[firstArgument + 1], direction, stream)
+                && !readStream(argv[firstArgument + 1], stream)) {
+            std::fprintf(stderr, "%s: could not be read\n", argv[firstArgument + 1]);
+            return 1;
+        }
+    } else {
+        stream = generateStream(direction);
+    }
+
+    D2PacketDispatcher dispatcher(direction);
+    registerHandlers(dispatcher, direction);
+
+    BenchContext context = {};
+    D2PacketDispatchResult result = dispatcher.dispatch(stream.data(),
+                                    stream.size(), &context);
+
+    if (result.status != D2PacketStatus::COMPLETE) {
+        std::fprintf(stderr, "The stream stopped at byte %zu: %s\n",
+                     result.consumedSize, getStatusName(result.status));
+    }
+
+    if (result.packetCount == 0) {
+        std::fputs("The stream holds no known packets\n", stderr);
+        return 1;
+    }
+
+    // Only the packets before the first failure are measured.
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < iterations; i++) {
+        dispatcher.dispatch(stream.data(), result.consumedSize, &context);
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() -
+                                            start;
+    double packetCount = (double) result.packetCount * iterations;
+    double byteCount = (double) result.consumedSize * iterations;
+
+    std::printf("%zu packets, %zu bytes, %zu iterations\n", result.packetCount,
+                result.consumedSize, iterations);
+    std::printf("%.1f million packets per second, %.1f MB per second\n",
+                packetCount / elapsed.count() / 1e6,
+                byteCount / elapsed.count() / 1e6);
+    std::printf("Checksum %016llX\n", (unsigned long long)(context.checksum +
+                context.rawPacketCount));
+    return 0;
+}
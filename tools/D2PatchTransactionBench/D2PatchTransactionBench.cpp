@@ -0,0 +1,284 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2PatchTransactionBench.cpp                                             *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   A command line tool that measures how fast the patch core resolves      *
+ *   addresses and commits synthetic patch sets of 100 to 100k entries,      *
+ *   against an emulated process.                                            *
+ *                                                                           *
+ *****************************************************************************/
+
+// Building on Linux, from the root of the repository:
+//
+//   g++ -std=c++17 -O2 -pthread -Itools/compat -Isrc tools/D2PatchTransactionBench/D2PatchTransactionBench.cpp
+//       src/D2EmulatedProcess.cpp src/D2MappedFile.cpp src/D2Memory.cpp src/D2ModuleTable.cpp
+//       src/D2Offset.cpp src/D2OffsetCache.cpp src/D2PEImage.cpp src/D2PEModuleIndex.cpp
+//       src/D2ProcessBackend.cpp src/D2SignatureResolver.cpp src/D2SignatureScanner.cpp
+//       src/D2Version.cpp src/D2VersionCache.cpp src/D2VersionDetector.cpp
+//       src/D2Patch/D2AnyPatch.cpp src/D2Patch/D2BasePatch.cpp src/D2Patch/D2PatchDescriptor.cpp
+//       src/D2Patch/D2PatchDescriptorApply.cpp src/D2Patch/D2PatchIntervalIndex.cpp
+//       src/D2Patch/D2PatchIntervalStore.cpp
+//       src/D2Patch/D2PatchJournal.cpp src/D2Patch/D2PatchTransaction.cpp
+//       src/D2Patch/D2ThreadSuspender.cpp -o d2patchtransactionbench
+//
+// Usage:
+//
+//   d2patchtransactionbench [--iterations <count>]
+//
+// Every set size is run in a new emulated process, with one module running
+// version 1.13c. The cold resolve is the first lookup of each offset, and
+// the warm resolve a second one. The attach latency covers resolving,
+// preparing and committing a set of D2AnyPatch objects with cold offsets,
+// as DllMain would. The descriptor table is committed the same way. The
+// best time of all iterations is reported.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "D2EmulatedProcess.h"
+#include "D2ModuleTable.h"
+#include "D2Offset.h"
+#include "D2Patch.h"
+#include "D2ProcessBackend.h"
+#include "D2Version.h"
+
+namespace {
+constexpr size_t DEFAULT_ITERATIONS = 5;
+constexpr size_t SET_SIZES[] = { 100, 1000, 10000, 100000 };
+constexpr size_t PATCH_SIZE = 4;
+// Patches are spread out, so that each one is a write run of its own.
+constexpr size_t PATCH_SPACING = 16;
+constexpr D2TEMPLATE_DLL_FILES DLL_FILE = D2TEMPLATE_DLL_FILES::D2DLL_D2COMMON;
+constexpr GameVersion GAME_VERSION = GameVersion::VERSION_113c;
+
+struct SetTimes {
+    double coldResolveSeconds;
+    double warmResolveSeconds;
+    double attachSeconds;
+    double revertSeconds;
+    double descriptorAttachSeconds;
+};
+
+double getElapsedSeconds(std::chrono::steady_clock::time_point startTime) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() -
+                                            startTime;
+    return elapsed.count();
+}
+
+D2OffsetTable makeOffsetTable(size_t index) {
+    return D2OffsetTable::make({ { GAME_VERSION, (long long int)(0x1000 + index * PATCH_SPACING) } });
+}
+
+// Each module gets a process of its own, so that nothing is resolved yet.
+std::unique_ptr<D2EmulatedProcess> makeProcess(size_t setSize) {
+    std::unique_ptr<D2EmulatedProcess> process(new D2EmulatedProcess());
+    process->setFileVersion(L"Game.exe", 0x00010000, 0x000D003C);
+
+    // The game version is detected once, and the module name depends on it,
+    // so the process is set before the name is asked for.
+    D2ProcessBackend::setCurrent(process.get());
+
+    size_t imageSize = 0x1000 + setSize * PATCH_SPACING;
+    imageSize = (imageSize + D2EmulatedProcess::PAGE_SIZE - 1) &
+                ~(D2EmulatedProcess::PAGE_SIZE - 1);
+
+    if (process->addModule(D2ModuleTable::getModuleName(DLL_FILE), imageSize,
+                           D2ProcessBackend::PROTECTION_EXECUTE_READ) == 0) {
+        D2ProcessBackend::setCurrent(nullptr);
+        return nullptr;
+    }
+
+    return process;
+}
+
+bool runSet(size_t setSize, SetTimes& setTimes) {
+    // Resolving.
+    std::unique_ptr<D2EmulatedProcess> process = makeProcess(setSize);
+
+    if (process == nullptr) {
+        return false;
+    }
+
+    std::vector<D2Offset> offsets;
+    offsets.reserve(setSize);
+
+    for (size_t i = 0; i < setSize; i++) {
+        offsets.emplace_back(DLL_FILE, makeOffsetTable(i));
+    }
+
+    DWORD addressSum = 0;
+    auto startTime = std::chrono::steady_clock::now();
+
+    for (const D2Offset& offset : offsets) {
+        addressSum += offset.getCurrentAddress();
+    }
+
+    setTimes.coldResolveSeconds = getElapsedSeconds(startTime);
+    startTime = std::chrono::steady_clock::now();
+
+    for (const D2Offset& offset : offsets) {
+        addressSum -= offset.getCurrentAddress();
+    }
+
+    setTimes.warmResolveSeconds = getElapsedSeconds(startTime);
+
+    if (addressSum != 0) {
+        return false;
+    }
+
+    // Attaching with patch objects.
+    process = makeProcess(setSize);
+
+    if (process == nullptr) {
+        return false;
+    }
+
+    std::vector<D2AnyPatch> patches;
+    patches.reserve(setSize);
+
+    for (size_t i = 0; i < setSize; i++) {
+        patches.emplace_back(D2Offset(DLL_FILE, makeOffsetTable(i)), (DWORD) i, false,
+                             0);
+    }
+
+    startTime = std::chrono::steady_clock::now();
+    D2PatchTransaction transaction;
+
+    for (D2AnyPatch& patch : patches) {
+        transaction.addPatch(patch);
+    }
+
+    if (!transaction.commit()) {
+        return false;
+    }
+
+    setTimes.attachSeconds = getElapsedSeconds(startTime);
+
+    // The last patch is read back, to be sure that the set was written.
+    DWORD lastData = 0;
+
+    if (!process->readMemory(patches.back().getD2Offset().getCurrentAddress(),
+                             &lastData, sizeof(lastData)) || lastData != setSize - 1) {
+        return false;
+    }
+
+    startTime = std::chrono::steady_clock::now();
+
+    if (!transaction.revert()) {
+        return false;
+    }
+
+    setTimes.revertSeconds = getElapsedSeconds(startTime);
+
+    // Attaching with a descriptor table.
+    process = makeProcess(setSize);
+
+    if (process == nullptr) {
+        return false;
+    }
+
+    std::vector<D2PatchDescriptor> descriptors;
+    descriptors.reserve(setSize);
+
+    for (size_t i = 0; i < setSize; i++) {
+        descriptors.push_back(D2PatchDescriptor::makeAnyPatch(DLL_FILE,
+                              makeOffsetTable(i), (DWORD) i, false, 0));
+    }
+
+    startTime = std::chrono::steady_clock::now();
+    D2PatchTransaction descriptorTransaction;
+
+    if (!D2Patch::applyPatchDescriptors(descriptors.data(), descriptors.size(),
+                                        descriptorTransaction)) {
+        return false;
+    }
+
+    setTimes.descriptorAttachSeconds = getElapsedSeconds(startTime);
+    bool revertSuccess = descriptorTransaction.revert();
+
+    D2ProcessBackend::setCurrent(nullptr);
+    return revertSuccess;
+}
+
+void printUsage() {
+    std::fputs("Usage: d2patchtransactionbench [--iterations <count>]\n", stderr);
+}
+}
+
+int main(int argc, char** argv) {
+    size_t iterations = DEFAULT_ITERATIONS;
+
+    if (argc == 3 && std::strcmp(argv[1], "--iterations") == 0) {
+        iterations = std::strtoul(argv[2], nullptr, 10);
+    } else if (argc != 1) {
+        iterations = 0;
+    }
+
+    if (iterations == 0) {
+        printUsage();
+        return 2;
+    }
+
+    std::printf("%8s %14s %14s %14s %12s %14s %12s\n", "patches", "cold resolve/s",
+                "warm resolve/s", "patches/s", "attach ms", "descriptors/s", "revert ms");
+
+    for (size_t setSize : SET_SIZES) {
+        SetTimes bestTimes = {};
+
+        for (size_t iteration = 0; iteration < iterations; iteration++) {
+            SetTimes setTimes;
+
+            if (!runSet(setSize, setTimes)) {
+                std::fprintf(stderr, "The set of %zu patches could not be applied\n",
+                             setSize);
+                return 1;
+            }
+
+            if (iteration == 0) {
+                bestTimes = setTimes;
+                continue;
+            }
+
+            bestTimes.coldResolveSeconds = std::min(bestTimes.coldResolveSeconds,
+                                                    setTimes.coldResolveSeconds);
+            bestTimes.warmResolveSeconds = std::min(bestTimes.warmResolveSeconds,
+                                                    setTimes.warmResolveSeconds);
+            bestTimes.attachSeconds = std::min(bestTimes.attachSeconds,
+                                               setTimes.attachSeconds);
+            bestTimes.revertSeconds = std::min(bestTimes.revertSeconds,
+                                               setTimes.revertSeconds);
+            bestTimes.descriptorAttachSeconds = std::min(
+                                                    bestTimes.descriptorAttachSeconds, setTimes.descriptorAttachSeconds);
+        }
+
+        std::printf("%8zu %14.0f %14.0f %14.0f %12.3f %14.0f %12.3f\n", setSize,
+                    setSize / bestTimes.coldResolveSeconds,
+                    setSize / bestTimes.warmResolveSeconds,
+                    setSize / bestTimes.attachSeconds, bestTimes.attachSeconds * 1e3,
+                    setSize / bestTimes.descriptorAttachSeconds, bestTimes.revertSeconds * 1e3);
+    }
+
+    return 0;
+}
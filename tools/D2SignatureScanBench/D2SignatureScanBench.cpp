@@ -0,0 +1,334 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2SignatureScanBench.cpp                                                *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   A command line tool that checks the signature scanner against a plain   *
+ *   byte by byte search, and measures how many gigabytes of code it scans   *
+ *   per second.                                                             *
+ *                                                                           *
+ *****************************************************************************/
+
+// Building on Linux, from the root of the repository:
+//
+//   g++ -std=c++17 -O2 -Itools/compat -Isrc tools/D2SignatureScanBench/D2SignatureScanBench.cpp
+//       src/D2SignatureScanner.cpp src/D2PEImage.cpp -o d2signaturescanbench
+//
+// Add -mavx2 to build the AVX2 search instead of the SSE2 one.
+//
+// Usage:
+//
+//   d2signaturescanbench test
+//   d2signaturescanbench [--iterations <count>] [file]...
+//
+// The test command exits with 1 if any check fails. The benchmark scans the
+// executable sections of the given PE files, such as the game's DLLs, or a
+// generated corpus without a file. Its signatures are taken from the code
+// with their last byte changed, so that they are almost never found and the
+// whole code is scanned, but their anchor bytes are still seen as often as
+// those of real signatures.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "D2PEImage.h"
+#include "D2SignatureScanner.h"
+
+namespace {
+constexpr size_t DEFAULT_ITERATIONS = 10;
+constexpr size_t GENERATED_CORPUS_SIZE = 64 << 20;
+constexpr size_t SIGNATURE_LENGTH = 16;
+constexpr size_t SIGNATURE_COUNTS[] = { 1, 16, 64, 256 };
+
+struct ParseCase {
+    const char* pattern;
+    bool valid;
+    size_t length;
+};
+
+const ParseCase PARSE_CASES[] = {
+    { "8B 0D ?? ?? ?? ?? 85 C9", true, 8 },
+    { "8b 0d ? ? ? ? 85 c9", true, 8 },
+    { "  E8  ??  ", true, 2 },
+    { "?? ?? ??", false, 3 },
+    { "", false, 0 },
+    { "8B 0", false, 0 },
+    { "8B 0DX", false, 0 },
+    { "GG", false, 0 },
+};
+
+uint32_t nextRandom(uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Bytes of real code are far from uniform, so the corpus is mostly made of
+// the bytes that are common in it, which the anchors are chosen to avoid.
+std::vector<uint8_t> generateCorpus(size_t size, uint32_t& state) {
+    static const uint8_t COMMON_BYTES[] = {
+        0x00, 0x04, 0x0F, 0x24, 0x44, 0x50, 0x55, 0x56, 0x57, 0x83, 0x85, 0x89,
+        0x8B, 0x90, 0xC3, 0xCC, 0xE8, 0xFF
+    };
+
+    std::vector<uint8_t> corpus(size);
+
+    for (uint8_t& value : corpus) {
+        uint32_t randomValue = nextRandom(state);
+        value = (randomValue & 0x100) ? (uint8_t) randomValue :
+                COMMON_BYTES[(randomValue >> 16) % sizeof(COMMON_BYTES)];
+    }
+
+    return corpus;
+}
+
+std::string toPattern(const uint8_t* bytes, size_t length,
+                      uint32_t wildcardMask) {
+    static const char HEX_DIGITS[] = "0123456789ABCDEF";
+    std::string pattern;
+
+    for (size_t i = 0; i < length; i++) {
+        if (i != 0) {
+            pattern += ' ';
+        }
+
+        if (i < 32 && (wildcardMask & (1U << i))) {
+            pattern += "??";
+        } else {
+            pattern += HEX_DIGITS[bytes[i] >> 4];
+            pattern += HEX_DIGITS[bytes[i] & 0xF];
+        }
+    }
+
+    return pattern;
+}
+
+size_t findReference(const uint8_t* data, size_t size,
+                     const D2Signature& signature) {
+    for (size_t position = 0; position + signature.getLength() <= size;
+            position++) {
+        bool matched = true;
+
+        for (size_t i = 0; i < signature.getLength() && matched; i++) {
+            matched = (data[position + i] & signature.getMask()[i]) ==
+                      signature.getBytes()[i];
+        }
+
+        if (matched) {
+            return position;
+        }
+    }
+
+    return D2SignatureScanner::NOT_FOUND;
+}
+
+bool runTests() {
+    size_t checkCount = 0;
+    size_t failureCount = 0;
+
+    for (const ParseCase& parseCase : PARSE_CASES) {
+        D2Signature signature(parseCase.pattern);
+        checkCount++;
+
+        if (signature.isValid() != parseCase.valid
+                || (parseCase.valid && signature.getLength() != parseCase.length)) {
+            std::printf("FAIL parse \"%s\"\n", parseCase.pattern);
+            failureCount++;
+        }
+    }
+
+    // Each round scans a corpus for signatures taken from it, some of them
+    // changed so that they may not be found, and compares every result with
+    // a plain search. Short corpora reach the tail that is not a full block.
+    uint32_t state = 0x2545F491;
+
+    for (size_t round = 0; round < 200; round++) {
+        size_t corpusSize = (round < 100) ? round + 1 : 0x1000 + nextRandom(
+                                state) % 0x4000;
+        std::vector<uint8_t> corpus = generateCorpus(corpusSize, state);
+        std::vector<std::unique_ptr<D2Signature>> signatures;
+        std::vector<const D2Signature*> signaturePointers;
+
+        for (size_t i = 0; i < 24; i++) {
+            size_t length = 1 + nextRandom(state) % 40;
+            size_t start = nextRandom(state) % corpusSize;
+            std::vector<uint8_t> bytes(length);
+
+            for (size_t j = 0; j < length; j++) {
+                bytes[j] = (start + j < corpusSize) ? corpus[start + j] : (uint8_t)
+                           nextRandom(state);
+            }
+
+            if (i % 3 == 0) {
+                bytes[nextRandom(state) % length] ^= 0x40;
+            }
+
+            uint32_t wildcardMask = (i % 2 == 0) ? nextRandom(state) & nextRandom(
+                                        state) : 0;
+            signatures.push_back(std::make_unique<D2Signature>(toPattern(bytes.data(),
+                                 length, wildcardMask)));
+            signaturePointers.push_back(signatures.back().get());
+        }
+
+        std::vector<size_t> results(signatures.size());
+        size_t foundCount = D2SignatureScanner::scan(corpus.data(), corpus.size(),
+                            signaturePointers.data(), signaturePointers.size(), results.data());
+        size_t expectedFoundCount = 0;
+
+        for (size_t i = 0; i < signatures.size(); i++) {
+            size_t expected = signatures[i]->isValid() ? findReference(corpus.data(),
+                              corpus.size(), *signatures[i]) : D2SignatureScanner::NOT_FOUND;
+            expectedFoundCount += (expected != D2SignatureScanner::NOT_FOUND);
+            checkCount++;
+
+            if (results[i] != expected) {
+                std::printf("FAIL scan round %zu, signature %zu\n", round, i);
+                failureCount++;
+            }
+        }
+
+        checkCount++;
+
+        if (foundCount != expectedFoundCount) {
+            std::printf("FAIL found count of round %zu\n", round);
+            failureCount++;
+        }
+    }
+
+    std::printf("%zu of %zu checks passed\n", checkCount - failureCount,
+                checkCount);
+    return failureCount == 0;
+}
+
+bool readCorpus(const char* filePath, std::vector<uint8_t>& corpus) {
+    std::ifstream corpusFile(filePath, std::ios::binary);
+
+    if (!corpusFile) {
+        return false;
+    }
+
+    std::vector<uint8_t> fileData((std::istreambuf_iterator<char>(corpusFile)),
+                                  std::istreambuf_iterator<char>());
+    D2PEImage image(fileData.data(), fileData.size(), D2PEImageLayout::FILE);
+
+    if (!image.isValid()) {
+        corpus.insert(corpus.end(), fileData.begin(), fileData.end());
+        return true;
+    }
+
+    for (const D2PESection& section : image.getSections()) {
+        const uint8_t* sectionData = image.getRvaData(section.virtualAddress,
+                                     section.rawDataSize);
+
+        if (section.isExecutable() && sectionData != nullptr) {
+            corpus.insert(corpus.end(), sectionData, sectionData + section.rawDataSize);
+        }
+    }
+
+    return true;
+}
+
+void printUsage() {
+    std::fputs("Usage: d2signaturescanbench test\n"
+               "       d2signaturescanbench [--iterations <count>] [file]...\n", stderr);
+}
+}
+
+int main(int argc, char** argv) {
+    if (argc == 2 && std::strcmp(argv[1], "test") == 0) {
+        return runTests() ? 0 : 1;
+    }
+
+    size_t iterations = DEFAULT_ITERATIONS;
+    int firstPath = 1;
+
+    if (argc > 2 && std::strcmp(argv[1], "--iterations") == 0) {
+        iterations = std::strtoul(argv[2], nullptr, 10);
+        firstPath = 3;
+    }
+
+    if (iterations == 0 || (firstPath < argc && argv[firstPath][0] == '-')) {
+        printUsage();
+        return 2;
+    }
+
+    std::vector<uint8_t> corpus;
+    uint32_t state = 0x2545F491;
+
+    for (int i = firstPath; i < argc; i++) {
+        if (!readCorpus(argv[i], corpus)) {
+            std::fprintf(stderr, "%s: could not be read\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (firstPath == argc) {
+        corpus = generateCorpus(GENERATED_CORPUS_SIZE, state);
+    }
+
+    if (corpus.size() < SIGNATURE_LENGTH) {
+        std::fputs("The code is too short to take signatures from\n", stderr);
+        return 1;
+    }
+
+    std::printf("%zu bytes of code\n", corpus.size());
+
+    for (size_t signatureCount : SIGNATURE_COUNTS) {
+        std::vector<std::unique_ptr<D2Signature>> signatures;
+        std::vector<const D2Signature*> signaturePointers;
+
+        for (size_t i = 0; i < signatureCount; i++) {
+            uint8_t bytes[SIGNATURE_LENGTH];
+            std::memcpy(bytes, &corpus[nextRandom(state) % (corpus.size() -
+                                       SIGNATURE_LENGTH)], SIGNATURE_LENGTH);
+            bytes[SIGNATURE_LENGTH - 1] ^= 0x5A;
+
+            // Wildcards stand for the operands that move between builds.
+            signatures.push_back(std::make_unique<D2Signature>(toPattern(bytes,
+                                 SIGNATURE_LENGTH, 0x0F00)));
+            signaturePointers.push_back(signatures.back().get());
+        }
+
+        std::vector<size_t> results(signatureCount);
+        size_t foundCount = 0;
+        auto start = std::chrono::steady_clock::now();
+
+        for (size_t iteration = 0; iteration < iterations; iteration++) {
+            foundCount = D2SignatureScanner::scan(corpus.data(), corpus.size(),
+                                                  signaturePointers.data(), signatureCount, results.data());
+        }
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() -
+                                                start;
+
+        std::printf("%4zu signatures: %.2f GB per second, %zu found\n",
+                    signatureCount, corpus.size() * iterations / elapsed.count() / 1e9,
+                    foundCount);
+    }
+
+    return 0;
+}
@@ -0,0 +1,685 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2StaticPatcher.cpp                                                     *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   A command line tool that applies the patch descriptors of the template  *
+ *   to copies of the game files, so that servers running a single build of  *
+ *   the game do not have to patch it every time it starts. Every patched    *
+ *   file gets a manifest of the bytes that were changed, which the verify   *
+ *   command checks the file against.                                        *
+ *                                                                           *
+ *****************************************************************************/
+
+// Building on Linux, from the root of the repository:
+//
+//   g++ -std=c++17 -O2 -pthread -Itools/compat -Isrc
+//       tools/D2StaticPatcher/D2StaticPatcher.cpp src/D2MappedFile.cpp
+//       src/D2PEImage.cpp src/D2PEModuleIndex.cpp
+//       src/D2Patch/D2PatchDescriptor.cpp -o d2staticpatcher
+//
+// Usage:
+//
+//   d2staticpatcher patch <version> <game directory> <output directory>
+//   d2staticpatcher verify <output directory>
+//
+// Only ANY patches can be baked into the files. INTERCEPTOR patches call
+// into the template DLL, so they are listed in the manifest as skipped and
+// are still applied when the DLL attaches. Patches are written for the
+// preferred base of each module, which is where the game's libraries load.
+// Patches over an address the loader fixes up would be corrupted if the
+// module were moved, so they are skipped as well.
+
+#include <windows.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "D2MappedFile.h"
+#include "D2ModuleTable.h"
+#include "D2PEImage.h"
+#include "D2PEModuleIndex.h"
+#include "D2Patches.h"
+#include "D2Version.h"
+
+namespace {
+constexpr const char* MANIFEST_MAGIC = "D2StaticPatcher manifest 1";
+constexpr const char* MANIFEST_EXTENSION = ".manifest";
+
+constexpr size_t CHECKSUM_OFFSET = 64;
+constexpr size_t RELOCATION_SIZE = 4;
+constexpr size_t DOS_NEW_HEADER_OFFSET = 0x3C;
+constexpr size_t OPTIONAL_HEADER_OFFSET = 24;
+
+constexpr uint64_t HASH_OFFSET_BASIS = 0xCBF29CE484222325ULL;
+constexpr uint64_t HASH_PRIME = 0x00000100000001B3ULL;
+
+// The labels of the versions, in the order of the GameVersion enum.
+constexpr std::string_view GAME_VERSION_LABELS[] = {
+    "", "1.07", "1.08", "1.09", "1.09b", "1.09c", "1.09d", "1.10", "1.11",
+    "1.11b", "1.12", "1.13c", "1.13d", "1.14a", "1.14b", "1.14c", "1.14d"
+};
+
+static_assert(sizeof(GAME_VERSION_LABELS) / sizeof(GAME_VERSION_LABELS[0]) ==
+              D2Version::GAME_VERSION_COUNT, "Every version needs a label");
+
+struct PatchRecord {
+    size_t descriptorIndex;
+    uint32_t rva;
+    uint32_t fileOffset;
+    std::vector<BYTE> originalBytes;
+    std::vector<BYTE> patchedBytes;
+};
+
+struct ModuleJob {
+    std::string fileName;
+    std::vector<size_t> descriptorIndices;
+
+    bool success;
+    std::string log;
+};
+
+bool parseGameVersion(std::string_view label, GameVersion& gameVersion) {
+    for (int i = 1; i < D2Version::GAME_VERSION_COUNT; i++) {
+        if (GAME_VERSION_LABELS[i] == label) {
+            gameVersion = (GameVersion) i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool isGameVersion114Plus(GameVersion gameVersion) {
+    return gameVersion >= GameVersion::VERSION_114a;
+}
+
+std::string getModuleFileName(D2TEMPLATE_DLL_FILES dllFile,
+                              GameVersion gameVersion) {
+    const D2ModuleFile& moduleFile = D2ModuleTable::MODULE_FILES[(int) dllFile];
+    std::wstring_view name = (moduleFile.mergedIntoGame
+                              && isGameVersion114Plus(gameVersion)) ? D2ModuleTable::GAME_FILE_NAME :
+                             moduleFile.name;
+
+    // The names are plain ASCII.
+    return std::string(name.begin(), name.end());
+}
+
+uint64_t hashBytes(const uint8_t* data, size_t size) {
+    uint64_t hash = HASH_OFFSET_BASIS;
+
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ data[i]) * HASH_PRIME;
+    }
+
+    return hash;
+}
+
+std::string toHex(const std::vector<BYTE>& bytes) {
+    static const char HEX_DIGITS[] = "0123456789ABCDEF";
+    std::string hex;
+
+    for (BYTE byte : bytes) {
+        hex += HEX_DIGITS[byte >> 4];
+        hex += HEX_DIGITS[byte & 0x0F];
+    }
+
+    return hex;
+}
+
+bool fromHex(std::string_view hex, std::vector<BYTE>& bytes) {
+    if (hex.length() % 2 != 0) {
+        return false;
+    }
+
+    bytes.clear();
+
+    for (size_t i = 0; i < hex.length(); i += 2) {
+        unsigned int byte;
+
+        if (std::sscanf(std::string(hex.substr(i, 2)).c_str(), "%2X", &byte) != 1) {
+            return false;
+        }
+
+        bytes.push_back((BYTE) byte);
+    }
+
+    return true;
+}
+
+// Unlike std::stoull, fails instead of throwing, and refuses signs, spaces
+// and trailing characters.
+bool parseNumber(const std::string& text, int base, uint64_t& value) {
+    if (text.empty() || !std::isxdigit((unsigned char) text[0])) {
+        return false;
+    }
+
+    char* end;
+    errno = 0;
+    unsigned long long number = std::strtoull(text.c_str(), &end, base);
+
+    if (errno != 0 || *end != '\0') {
+        return false;
+    }
+
+    value = number;
+    return true;
+}
+
+bool readFile(const std::filesystem::path& filePath,
+              std::vector<uint8_t>& fileData) {
+    D2MappedFile mappedFile;
+
+    if (!mappedFile.open(filePath.wstring())) {
+        return false;
+    }
+
+    fileData.assign(mappedFile.getData(),
+                    mappedFile.getData() + mappedFile.getSize());
+    return true;
+}
+
+// Writes next to the destination first, so that a failed write never leaves
+// a half-written file behind.
+bool writeFile(const std::filesystem::path& filePath, const void* data,
+               size_t size) {
+    std::filesystem::path tempPath = filePath;
+    tempPath += ".tmp";
+
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+
+        if (!file.write((const char*) data, size) || !file.flush()) {
+            return false;
+        }
+    }
+
+    std::error_code errorCode;
+    std::filesystem::rename(tempPath, filePath, errorCode);
+    return !errorCode;
+}
+
+// The same checksum as CheckSumMappedFile, which is only checked for
+// drivers and some system DLLs, but is kept consistent with the contents.
+void updateChecksum(std::vector<uint8_t>& fileData) {
+    uint32_t newHeaderOffset;
+    std::memcpy(&newHeaderOffset, &fileData[DOS_NEW_HEADER_OFFSET],
+                sizeof(newHeaderOffset));
+
+    size_t checksumOffset = (size_t) newHeaderOffset + OPTIONAL_HEADER_OFFSET +
+                            CHECKSUM_OFFSET;
+    uint32_t oldChecksum;
+
+    if (checksumOffset + sizeof(oldChecksum) > fileData.size()) {
+        return;
+    }
+
+    std::memcpy(&oldChecksum, &fileData[checksumOffset], sizeof(oldChecksum));
+
+    if (oldChecksum == 0) {
+        return;
+    }
+
+    uint64_t sum = 0;
+
+    for (size_t i = 0; i < fileData.size(); i += 2) {
+        if (i == checksumOffset || i == checksumOffset + 2) {
+            continue;
+        }
+
+        uint16_t word = fileData[i];
+
+        if (i + 1 < fileData.size()) {
+            word |= (uint16_t)(fileData[i + 1] << 8);
+        }
+
+        sum += word;
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    uint32_t checksum = (uint32_t) sum + (uint32_t) fileData.size();
+    std::memcpy(&fileData[checksumOffset], &checksum, sizeof(checksum));
+}
+
+bool overlapsRelocation(const std::vector<uint32_t>& relocationRvas,
+                        uint32_t rva, size_t size, uint32_t& relocationRva) {
+    // The first fixup that ends past the start of the patch is the only one
+    // that can overlap it.
+    auto relocation = std::upper_bound(relocationRvas.cbegin(),
+                                       relocationRvas.cend(), rva, [](uint32_t patchRva, uint32_t fixupRva) {
+        return patchRva < fixupRva + RELOCATION_SIZE;
+    });
+
+    if (relocation == relocationRvas.cend() || *relocation >= rva + size) {
+        return false;
+    }
+
+    relocationRva = *relocation;
+    return true;
+}
+
+bool resolveRva(const D2PatchDescriptor& descriptor, GameVersion gameVersion,
+                const D2PEModuleIndex& moduleIndex, uint32_t& rva) {
+    long long int offset = descriptor.getOffset(gameVersion);
+
+    if (offset < 0) {
+        return moduleIndex.findExport((uint16_t) - offset, rva);
+    }
+
+    rva = (uint32_t) offset;
+    return rva < moduleIndex.getSizeOfImage();
+}
+
+void patchModule(ModuleJob& job, GameVersion gameVersion,
+                 const std::filesystem::path& gameDirectory,
+                 const std::filesystem::path& outputDirectory) {
+    std::ostringstream log;
+    job.success = false;
+
+    std::vector<uint8_t> fileData;
+
+    if (!readFile(gameDirectory / job.fileName, fileData)) {
+        log << job.fileName << ": could not be read\n";
+        job.log = log.str();
+        return;
+    }
+
+    D2PEImage image(fileData.data(), fileData.size(), D2PEImageLayout::FILE);
+    D2PEModuleIndex moduleIndex(image);
+
+    if (!moduleIndex.isValid()) {
+        log << job.fileName << ": not a valid PE32 image\n";
+        job.log = log.str();
+        return;
+    }
+
+    std::vector<uint32_t> relocationRvas;
+
+    if (!image.readRelocations(relocationRvas)) {
+        log << job.fileName << ": the relocations are malformed\n";
+        job.log = log.str();
+        return;
+    }
+
+    std::vector<PatchRecord> patchRecords;
+    std::vector<size_t> skippedIndices;
+    BYTE buffer[64];
+
+    for (size_t descriptorIndex : job.descriptorIndices) {
+        const D2PatchDescriptor& descriptor = gptTemplatePatches[descriptorIndex];
+
+        if (descriptor.kind != D2PatchKind::ANY) {
+            skippedIndices.push_back(descriptorIndex);
+            continue;
+        }
+
+        PatchRecord patchRecord = { descriptorIndex, 0, 0, {}, {} };
+        size_t writeSize = descriptor.getWriteSize();
+        size_t fileOffset;
+
+        if (!resolveRva(descriptor, gameVersion, moduleIndex, patchRecord.rva)
+                || !image.rvaToDataOffset(patchRecord.rva, writeSize, fileOffset)) {
+            log << job.fileName << ": patch " << descriptorIndex <<
+                " does not resolve to data in the file\n";
+            job.log = log.str();
+            return;
+        }
+
+        uint32_t relocationRva;
+
+        if (overlapsRelocation(relocationRvas, patchRecord.rva, writeSize,
+                               relocationRva)) {
+            log << job.fileName << ": patch " << descriptorIndex <<
+                " overlaps the relocation at RVA " << std::hex << std::uppercase <<
+                relocationRva << std::dec << ", left to the template DLL\n";
+            skippedIndices.push_back(descriptorIndex);
+            continue;
+        }
+
+        DWORD address = image.getImageBase() + patchRecord.rva;
+
+        if (!descriptor.isValid(address)) {
+            log << job.fileName << ": patch " << descriptorIndex << " is not valid\n";
+            job.log = log.str();
+            return;
+        }
+
+        patchRecord.fileOffset = (uint32_t) fileOffset;
+        patchRecord.originalBytes.assign(&fileData[fileOffset],
+                                         &fileData[fileOffset] + writeSize);
+
+        for (size_t written = 0; written < writeSize; written += sizeof(buffer)) {
+            size_t chunkSize = std::min(sizeof(buffer), writeSize - written);
+            descriptor.fillPatchBuffer(address, written, buffer, chunkSize);
+            patchRecord.patchedBytes.insert(patchRecord.patchedBytes.end(), buffer,
+                                            buffer + chunkSize);
+        }
+
+        patchRecords.push_back(std::move(patchRecord));
+    }
+
+    // The game rejects overlapping patches, so the files must as well.
+    std::sort(patchRecords.begin(), patchRecords.end(),
+    [](const PatchRecord & left, const PatchRecord & right) {
+        return left.fileOffset < right.fileOffset;
+    });
+
+    for (size_t i = 1; i < patchRecords.size(); i++) {
+        const PatchRecord& previous = patchRecords[i - 1];
+
+        if (previous.fileOffset + previous.patchedBytes.size() >
+                patchRecords[i].fileOffset) {
+            log << job.fileName << ": patches " << previous.descriptorIndex << " and "
+                << patchRecords[i].descriptorIndex << " overlap\n";
+            job.log = log.str();
+            return;
+        }
+    }
+
+    uint64_t originalHash = hashBytes(fileData.data(), fileData.size());
+
+    for (const auto& patchRecord : patchRecords) {
+        std::copy(patchRecord.patchedBytes.cbegin(), patchRecord.patchedBytes.cend(),
+                  fileData.begin() + patchRecord.fileOffset);
+    }
+
+    updateChecksum(fileData);
+
+    std::ostringstream manifest;
+    manifest << MANIFEST_MAGIC << "\n";
+    manifest << "file\t" << job.fileName << "\n";
+    manifest << "gameVersion\t" << GAME_VERSION_LABELS[(int) gameVersion] << "\n";
+    manifest << std::hex << std::uppercase;
+    manifest << "originalHash\t" << originalHash << "\n";
+    manifest << "patchedHash\t" << hashBytes(fileData.data(),
+             fileData.size()) << "\n";
+    manifest << "size\t" << std::dec << fileData.size() << "\n";
+
+    for (const auto& patchRecord : patchRecords) {
+        manifest << "patch\t" << std::dec << patchRecord.descriptorIndex << std::hex
+                 << "\t" << patchRecord.rva << "\t" << patchRecord.fileOffset << "\t" <<
+                 toHex(patchRecord.originalBytes) << "\t" << toHex(patchRecord.patchedBytes)
+                 << "\n";
+    }
+
+    for (size_t descriptorIndex : skippedIndices) {
+        manifest << "skipped\t" << std::dec << descriptorIndex << "\n";
+    }
+
+    std::string manifestText = manifest.str();
+    std::filesystem::path outputPath = outputDirectory / job.fileName;
+    std::filesystem::path manifestPath = outputPath;
+    manifestPath += MANIFEST_EXTENSION;
+
+    if (!writeFile(outputPath, fileData.data(), fileData.size())
+            || !writeFile(manifestPath, manifestText.data(), manifestText.length())) {
+        log << job.fileName << ": could not be written\n";
+        job.log = log.str();
+        return;
+    }
+
+    log << job.fileName << ": " << patchRecords.size() << " patches applied, " <<
+        skippedIndices.size() << " left to the template DLL\n";
+    job.log = log.str();
+    job.success = true;
+}
+
+void verifyModule(ModuleJob& job, const std::filesystem::path& directory) {
+    std::ostringstream log;
+    job.success = false;
+
+    std::filesystem::path manifestPath = directory / job.fileName;
+    manifestPath += MANIFEST_EXTENSION;
+    std::ifstream manifest(manifestPath);
+    std::string line;
+
+    if (!std::getline(manifest, line) || line != MANIFEST_MAGIC) {
+        log << job.fileName << ": the manifest is missing or not supported\n";
+        job.log = log.str();
+        return;
+    }
+
+    std::vector<uint8_t> fileData;
+
+    if (!readFile(directory / job.fileName, fileData)) {
+        log << job.fileName << ": could not be read\n";
+        job.log = log.str();
+        return;
+    }
+
+    uint64_t originalHash = 0;
+    uint64_t patchedHash = 0;
+    uint64_t fileSize = 0;
+    size_t mismatchCount = 0;
+    size_t patchCount = 0;
+    size_t lineNumber = 1;
+    bool unpatched = true;
+
+    while (std::getline(manifest, line)) {
+        lineNumber++;
+
+        std::istringstream fields(line);
+        std::string key;
+        std::string value;
+        std::getline(fields, key, '\t');
+        std::getline(fields, value, '\t');
+
+        bool malformed = false;
+
+        if (key == "originalHash") {
+            malformed = !parseNumber(value, 16, originalHash);
+        } else if (key == "patchedHash") {
+            malformed = !parseNumber(value, 16, patchedHash);
+        } else if (key == "size") {
+            malformed = !parseNumber(value, 10, fileSize);
+        } else if (key == "patch") {
+            const std::string& descriptorIndex = value;
+            std::string rva, fileOffsetText, originalHex, patchedHex;
+            std::getline(fields, rva, '\t');
+            std::getline(fields, fileOffsetText, '\t');
+            std::getline(fields, originalHex, '\t');
+            std::getline(fields, patchedHex, '\t');
+
+            std::vector<BYTE> originalBytes;
+            std::vector<BYTE> patchedBytes;
+            uint64_t fileOffset;
+            patchCount++;
+
+            if (!parseNumber(fileOffsetText, 16, fileOffset)
+                    || !fromHex(originalHex, originalBytes) || !fromHex(patchedHex, patchedBytes)
+                    || originalBytes.size() != patchedBytes.size()) {
+                malformed = true;
+            } else if (fileOffset > fileData.size()
+                       || patchedBytes.size() > fileData.size() - fileOffset) {
+                log << job.fileName << ": patch " << descriptorIndex <<
+                    " is out of range\n";
+                mismatchCount++;
+            } else {
+                const uint8_t* fileBytes = &fileData[fileOffset];
+
+                if (!std::equal(patchedBytes.cbegin(), patchedBytes.cend(), fileBytes)) {
+                    log << job.fileName << ": patch " << descriptorIndex << " at RVA " << rva <<
+                        " does not match\n";
+                    mismatchCount++;
+                }
+
+                if (!std::equal(originalBytes.cbegin(), originalBytes.cend(), fileBytes)) {
+                    unpatched = false;
+                }
+            }
+        }
+
+        if (malformed) {
+            log << job.fileName << ": line " << lineNumber <<
+                " of the manifest is malformed\n";
+            mismatchCount++;
+        }
+    }
+
+    uint64_t fileHash = hashBytes(fileData.data(), fileData.size());
+
+    if (mismatchCount == 0 && (fileData.size() != fileSize
+                               || fileHash != patchedHash)) {
+        log << job.fileName << ": the patches match, but other bytes changed\n";
+        mismatchCount++;
+    }
+
+    if (mismatchCount == 0) {
+        log << job.fileName << ": OK, " << patchCount << " patches\n";
+        job.success = true;
+    } else if (unpatched && fileHash == originalHash) {
+        log << job.fileName << ": the file is the unpatched original\n";
+    }
+
+    job.log = log.str();
+}
+
+// Every module is handled on its own thread. The output is printed in the
+// order of the jobs once they are all done.
+template<class F>
+bool runJobs(std::vector<ModuleJob>& jobs, F handleJob) {
+    std::vector<std::thread> threads;
+
+    for (auto& job : jobs) {
+        threads.emplace_back([&job, &handleJob]() {
+            handleJob(job);
+        });
+    }
+
+    bool success = true;
+
+    for (size_t i = 0; i < jobs.size(); i++) {
+        threads[i].join();
+        std::fputs(jobs[i].log.c_str(), jobs[i].success ? stdout : stderr);
+        success = success && jobs[i].success;
+    }
+
+    return success;
+}
+
+int patch(std::string_view versionLabel, const std::filesystem::path& gameDirectory,
+          const std::filesystem::path& outputDirectory) {
+    GameVersion gameVersion;
+
+    if (!parseGameVersion(versionLabel, gameVersion)) {
+        std::fprintf(stderr, "Unknown game version: %.*s\n", (int) versionLabel.length(),
+                     versionLabel.data());
+        return 2;
+    }
+
+    std::error_code errorCode;
+    std::filesystem::create_directories(outputDirectory, errorCode);
+
+    if (errorCode) {
+        std::fprintf(stderr, "Could not create %s\n", outputDirectory.string().c_str());
+        return 1;
+    }
+
+    // From 1.14 onwards, several DLL files end up in the same Game.exe job.
+    std::map<std::string, size_t> jobIndices;
+    std::vector<ModuleJob> jobs;
+    size_t descriptorCount = sizeof(gptTemplatePatches) / sizeof(gptTemplatePatches[0]);
+
+    for (size_t i = 0; i < descriptorCount; i++) {
+        const D2PatchDescriptor& descriptor = gptTemplatePatches[i];
+
+        if (!descriptor.offsetTable.hasOffset(gameVersion)
+                || descriptor.isNoPatch(gameVersion)) {
+            continue;
+        }
+
+        std::string fileName = getModuleFileName(descriptor.dllFile, gameVersion);
+        auto jobIndex = jobIndices.find(fileName);
+
+        if (jobIndex == jobIndices.cend()) {
+            jobIndex = jobIndices.insert({ fileName, jobs.size() }).first;
+            jobs.push_back({ fileName, {}, false, std::string() });
+        }
+
+        jobs[jobIndex->second].descriptorIndices.push_back(i);
+    }
+
+    if (jobs.empty()) {
+        std::printf("No patches for %.*s\n", (int) versionLabel.length(),
+                    versionLabel.data());
+        return 0;
+    }
+
+    return runJobs(jobs, [&](ModuleJob & job) {
+        patchModule(job, gameVersion, gameDirectory, outputDirectory);
+    }) ? 0 : 1;
+}
+
+int verify(const std::filesystem::path& directory) {
+    std::vector<ModuleJob> jobs;
+    std::error_code errorCode;
+
+    for (const auto& entry : std::filesystem::directory_iterator(directory,
+            errorCode)) {
+        if (entry.path().extension() == MANIFEST_EXTENSION) {
+            jobs.push_back({ entry.path().stem().string(), {}, false, std::string() });
+        }
+    }
+
+    if (errorCode || jobs.empty()) {
+        std::fprintf(stderr, "No manifests found in %s\n", directory.string().c_str());
+        return 1;
+    }
+
+    std::sort(jobs.begin(), jobs.end(), [](const ModuleJob & left,
+    const ModuleJob & right) {
+        return left.fileName < right.fileName;
+    });
+
+    return runJobs(jobs, [&](ModuleJob & job) {
+        verifyModule(job, directory);
+    }) ? 0 : 1;
+}
+
+void printUsage() {
+    std::fputs("Usage:\n"
+               "  d2staticpatcher patch <version> <game directory> <output directory>\n"
+               "  d2staticpatcher verify <output directory>\n", stderr);
+}
+}
+
+int main(int argc, char** argv) {
+    if (argc == 5 && std::strcmp(argv[1], "patch") == 0) {
+        return patch(argv[2], argv[3], argv[4]);
+    }
+
+    if (argc == 3 && std::strcmp(argv[1], "verify") == 0) {
+        return verify(argv[2]);
+    }
+
+    printUsage();
+    return 2;
+}
@@ -0,0 +1,451 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2StubArenaBench.cpp                                                    *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   A command line tool that checks the pooling and page sealing of the     *
+ *   D2StubArena class on pages mapped with mmap, and measures how many      *
+ *   stubs it hands out and seals per second.                                *
+ *                                                                           *
+ *****************************************************************************/
+
+// Building on Linux, from the root of the repository:
+//
+//   g++ -std=c++17 -O2 -Itools/compat -Isrc tools/D2StubArenaBench/D2StubArenaBench.cpp
+//       src/D2Patch/D2StubArena.cpp -o d2stubarenabench
+//
+// Usage:
+//
+//   d2stubarenabench test
+//   d2stubarenabench [--iterations <count>]
+//
+// The test command exits with 1 if any check fails. On x86, the checks also
+// run code written to sealed stubs. The benchmark writes and seals stubs for
+// a few fake modules one at a time, then frees them all and takes them again
+// from the free lists. Last, it frees them again and writes them all before
+// sealing any, so that each page only changes protection once.
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "D2Patch/D2StubArena.h"
+
+namespace {
+constexpr size_t DEFAULT_ITERATIONS = 20;
+constexpr size_t BENCH_STUB_COUNT = 0x4000;
+constexpr size_t BENCH_STUB_SIZE = 32;
+constexpr size_t FAKE_MODULE_COUNT = 4;
+constexpr size_t FAKE_MODULE_SIZE = 0x100000;
+
+// Hands out the regions of the arena with mmap, taking the module address
+// as a hint. Regions are as large as the allocation granularity of Windows.
+class D2MmapPageAllocator : public D2PageAllocator {
+public:
+    static constexpr size_t REGION_SIZE = 0x10000;
+
+    D2MmapPageAllocator() : pageSize((size_t) sysconf(_SC_PAGESIZE)),
+        protectCount(0), failAllocations(false) {
+    }
+
+    virtual size_t getPageSize() const override {
+        return pageSize;
+    }
+
+    virtual size_t getRegionSize() const override {
+        return REGION_SIZE;
+    }
+
+    virtual uintptr_t allocateNear(uintptr_t address, size_t size) override {
+        if (failAllocations) {
+            return 0;
+        }
+
+        void* region = mmap((void*)(address & ~(REGION_SIZE - 1)), size,
+                            PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        return (region == MAP_FAILED) ? 0 : (uintptr_t) region;
+    }
+
+    virtual bool protect(uintptr_t address, size_t size,
+                         D2PageProtection protection) override {
+        int flags = PROT_READ | PROT_EXEC;
+
+        if (protection == D2PageProtection::READ_WRITE) {
+            flags = PROT_READ | PROT_WRITE;
+        } else if (protection == D2PageProtection::READ_WRITE_EXECUTE) {
+            flags = PROT_READ | PROT_WRITE | PROT_EXEC;
+        }
+
+        protectCount++;
+
+        if (mprotect((void*) address, size, flags) != 0) {
+            return false;
+        }
+
+        for (uintptr_t page = address; page < address + size; page += pageSize) {
+            pageProtections[page] = protection;
+        }
+
+        return true;
+    }
+
+    virtual void release(uintptr_t address, size_t size) override {
+        munmap((void*) address, size);
+    }
+
+    // Pages that were never protected are still read-write.
+    D2PageProtection getProtection(uintptr_t address) const {
+        auto pageProtection = pageProtections.find(address & ~(pageSize - 1));
+        return (pageProtection == pageProtections.end()) ? D2PageProtection::READ_WRITE
+               : pageProtection->second;
+    }
+
+    size_t getProtectCount() const {
+        return protectCount;
+    }
+
+    void setFailAllocations(bool failAllocations) {
+        this->failAllocations = failAllocations;
+    }
+
+private:
+    size_t pageSize;
+    size_t protectCount;
+    bool failAllocations;
+    std::map<uintptr_t, D2PageProtection> pageProtections;
+};
+
+// Reserves address space that stands in for a loaded module.
+uintptr_t mapFakeModule() {
+    void* module = mmap(nullptr, FAKE_MODULE_SIZE, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (module == MAP_FAILED) ? 0 : (uintptr_t) module;
+}
+
+// Writes "mov eax, value; ret", so that a sealed stub can be called.
+void writeReturnStub(uintptr_t stubAddress, uint32_t value) {
+    uint8_t* code = (uint8_t*) stubAddress;
+    code[0] = 0xB8;
+    std::memcpy(&code[1], &value, sizeof(value));
+    code[5] = 0xC3;
+}
+
+bool runsAndReturns(uintptr_t stubAddress, uint32_t value) {
+#if defined(__i386__) || defined(__x86_64__)
+    return ((uint32_t(*)()) stubAddress)() == value;
+#else
+    (void) stubAddress;
+    (void) value;
+    return true;
+#endif
+}
+
+size_t failureCount = 0;
+size_t checkCount = 0;
+
+void check(const char* name, bool passed) {
+    checkCount++;
+
+    if (!passed) {
+        std::printf("FAIL %s\n", name);
+        failureCount++;
+    }
+}
+
+void testSizesAndAlignment(uintptr_t module) {
+    D2MmapPageAllocator pageAllocator;
+    D2StubArena stubArena(pageAllocator);
+
+    check("empty stubs are refused", stubArena.allocateStub(module, 0) == 0);
+    check("oversized stubs are refused", stubArena.allocateStub(module,
+            D2StubArena::MAX_STUB_SIZE + 1) == 0);
+
+    bool aligned = true;
+    bool packed = true;
+    bool reachable = true;
+    uintptr_t previousStub = 0;
+
+    for (size_t i = 0; i < 100; i++) {
+        uintptr_t stub = stubArena.allocateStub(module, 20);
+        aligned = aligned && stub != 0 && stub % D2StubArena::STUB_ALIGNMENT == 0;
+        packed = packed && (previousStub == 0 || stub == previousStub + 32);
+        reachable = reachable && (stub > module ? stub - module : module - stub) <
+                    0x80000000U;
+        previousStub = stub;
+        stubArena.sealStub(stub, 20);
+    }
+
+    check("stubs are aligned", aligned);
+    check("stubs are packed by size class", packed);
+    check("stubs are within rel32 reach of the module", reachable);
+}
+
+void testFreeLists(uintptr_t module) {
+    D2MmapPageAllocator pageAllocator;
+    D2StubArena stubArena(pageAllocator);
+
+    uintptr_t firstStub = stubArena.allocateStub(module, 40);
+    uintptr_t secondStub = stubArena.allocateStub(module, 100);
+    stubArena.sealStub(firstStub, 40);
+    stubArena.sealStub(secondStub, 100);
+    stubArena.freeStub(module, firstStub, 40);
+
+    check("freed slots are reused by the same size class",
+          stubArena.allocateStub(module, 33) == firstStub);
+
+    uintptr_t otherStub = stubArena.allocateStub(module, 20);
+    check("freed slots are not reused by other size classes",
+          otherStub != firstStub && otherStub != secondStub);
+}
+
+void testSealing(uintptr_t module) {
+    D2MmapPageAllocator pageAllocator;
+    D2StubArena stubArena(pageAllocator);
+
+    uintptr_t firstStub = stubArena.allocateStub(module, 16);
+    uintptr_t secondStub = stubArena.allocateStub(module, 16);
+    size_t protectCount = pageAllocator.getProtectCount();
+
+    writeReturnStub(firstStub, 1);
+    stubArena.sealStub(firstStub, 16);
+
+    check("a page is not sealed while another stub on it is written",
+          pageAllocator.getProtectCount() == protectCount
+          && pageAllocator.getProtection(firstStub) == D2PageProtection::READ_WRITE);
+
+    writeReturnStub(secondStub, 2);
+    stubArena.sealStub(secondStub, 16);
+
+    check("a page is sealed by the last of its stubs",
+          pageAllocator.getProtection(firstStub) == D2PageProtection::READ_EXECUTE);
+    check("sealed stubs run", runsAndReturns(firstStub, 1)
+          && runsAndReturns(secondStub, 2));
+
+    check("sealed stubs can be unsealed", stubArena.unsealStub(firstStub, 16)
+          && pageAllocator.getProtection(firstStub) ==
+          D2PageProtection::READ_WRITE_EXECUTE);
+    check("stubs run while another stub on the page is unsealed",
+          runsAndReturns(secondStub, 2));
+
+    writeReturnStub(firstStub, 3);
+    uintptr_t thirdStub = stubArena.allocateStub(module, 16);
+    writeReturnStub(thirdStub, 4);
+    stubArena.sealStub(firstStub, 16);
+
+    check("a reopened page waits for its new stubs",
+          pageAllocator.getProtection(firstStub) ==
+          D2PageProtection::READ_WRITE_EXECUTE);
+
+    stubArena.sealStub(thirdStub, 16);
+
+    check("a reopened page is sealed again",
+          pageAllocator.getProtection(firstStub) == D2PageProtection::READ_EXECUTE
+          && runsAndReturns(firstStub, 3) && runsAndReturns(thirdStub, 4));
+}
+
+void testPageRuns(uintptr_t module) {
+    D2MmapPageAllocator pageAllocator;
+    D2StubArena stubArena(pageAllocator);
+    size_t pageSize = pageAllocator.getPageSize();
+
+    // Take 48 byte stubs until one of them crosses into the next page.
+    uintptr_t stub = 0;
+
+    do {
+        if (stub != 0) {
+            stubArena.sealStub(stub, 48);
+        }
+
+        stub = stubArena.allocateStub(module, 48);
+    } while (stub != 0 && stub / pageSize == (stub + 47) / pageSize);
+
+    size_t protectCount = pageAllocator.getProtectCount();
+    stubArena.sealStub(stub, 48);
+
+    check("a run of pages is sealed with one call",
+          pageAllocator.getProtectCount() == protectCount + 1
+          && pageAllocator.getProtection(stub) == D2PageProtection::READ_EXECUTE
+          && pageAllocator.getProtection(stub + 47) == D2PageProtection::READ_EXECUTE);
+}
+
+void testFailuresAndUsage(uintptr_t module, uintptr_t otherModule) {
+    D2MmapPageAllocator pageAllocator;
+    D2StubArena stubArena(pageAllocator);
+
+    pageAllocator.setFailAllocations(true);
+    check("allocation failures are reported",
+          stubArena.allocateStub(module, 16) == 0);
+    pageAllocator.setFailAllocations(false);
+
+    uintptr_t firstStub = stubArena.allocateStub(module, 16);
+    uintptr_t secondStub = stubArena.allocateStub(module, 64);
+    uintptr_t thirdStub = stubArena.allocateStub(otherModule, 16);
+    stubArena.sealStub(firstStub, 16);
+    stubArena.sealStub(secondStub, 64);
+    stubArena.sealStub(thirdStub, 16);
+    stubArena.freeStub(module, secondStub, 64);
+
+    D2StubArena::Usage usage = stubArena.getUsage();
+    check("usage is reported", usage.moduleCount == 2 && usage.regionCount == 2
+          && usage.reservedBytes == 2 * D2MmapPageAllocator::REGION_SIZE
+          && usage.allocatedBytes == 32 && usage.freeListBytes == 64
+          && usage.stubCount == 2);
+}
+
+bool runTests() {
+    uintptr_t module = mapFakeModule();
+    uintptr_t otherModule = mapFakeModule();
+
+    if (module == 0 || otherModule == 0) {
+        std::fputs("The fake modules could not be mapped\n", stderr);
+        return false;
+    }
+
+    testSizesAndAlignment(module);
+    testFreeLists(module);
+    testSealing(module);
+    testPageRuns(module);
+    testFailuresAndUsage(module, otherModule);
+
+    std::printf("%zu of %zu checks passed\n", checkCount - failureCount,
+                checkCount);
+    return failureCount == 0;
+}
+
+void printUsage() {
+    std::fputs("Usage: d2stubarenabench test\n"
+               "       d2stubarenabench [--iterations <count>]\n", stderr);
+}
+}
+
+int main(int argc, char** argv) {
+    if (argc == 2 && std::strcmp(argv[1], "test") == 0) {
+        return runTests() ? 0 : 1;
+    }
+
+    size_t iterations = DEFAULT_ITERATIONS;
+
+    if (argc == 3 && std::strcmp(argv[1], "--iterations") == 0) {
+        iterations = std::strtoul(argv[2], nullptr, 10);
+    } else if (argc != 1) {
+        iterations = 0;
+    }
+
+    if (iterations == 0) {
+        printUsage();
+        return 2;
+    }
+
+    uintptr_t modules[FAKE_MODULE_COUNT];
+
+    for (size_t i = 0; i < FAKE_MODULE_COUNT; i++) {
+        modules[i] = mapFakeModule();
+
+        if (modules[i] == 0) {
+            std::fputs("The fake modules could not be mapped\n", stderr);
+            return 1;
+        }
+    }
+
+    D2MmapPageAllocator pageAllocator;
+    std::vector<uintptr_t> stubs(BENCH_STUB_COUNT);
+    std::chrono::duration<double> freshElapsed(0);
+    std::chrono::duration<double> reusedElapsed(0);
+    std::chrono::duration<double> batchedElapsed(0);
+    size_t singleProtectCount = 0;
+    size_t batchedProtectCount = 0;
+
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        D2StubArena stubArena(pageAllocator);
+        size_t startProtectCount = pageAllocator.getProtectCount();
+        auto start = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < BENCH_STUB_COUNT; i++) {
+            stubs[i] = stubArena.allocateStub(modules[i % FAKE_MODULE_COUNT],
+                                              BENCH_STUB_SIZE);
+            writeReturnStub(stubs[i], (uint32_t) i);
+            stubArena.sealStub(stubs[i], BENCH_STUB_SIZE);
+        }
+
+        auto middle = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < BENCH_STUB_COUNT; i++) {
+            stubArena.freeStub(modules[i % FAKE_MODULE_COUNT], stubs[i],
+                               BENCH_STUB_SIZE);
+        }
+
+        for (size_t i = 0; i < BENCH_STUB_COUNT; i++) {
+            stubs[i] = stubArena.allocateStub(modules[i % FAKE_MODULE_COUNT],
+                                              BENCH_STUB_SIZE);
+            writeReturnStub(stubs[i], (uint32_t) i);
+            stubArena.sealStub(stubs[i], BENCH_STUB_SIZE);
+        }
+
+        auto reused = std::chrono::steady_clock::now();
+        size_t protectCount = pageAllocator.getProtectCount();
+
+        for (size_t i = 0; i < BENCH_STUB_COUNT; i++) {
+            stubArena.freeStub(modules[i % FAKE_MODULE_COUNT], stubs[i],
+                               BENCH_STUB_SIZE);
+        }
+
+        for (size_t i = 0; i < BENCH_STUB_COUNT; i++) {
+            stubs[i] = stubArena.allocateStub(modules[i % FAKE_MODULE_COUNT],
+                                              BENCH_STUB_SIZE);
+            writeReturnStub(stubs[i], (uint32_t) i);
+        }
+
+        for (size_t i = 0; i < BENCH_STUB_COUNT; i++) {
+            stubArena.sealStub(stubs[i], BENCH_STUB_SIZE);
+        }
+
+        auto end = std::chrono::steady_clock::now();
+        freshElapsed += middle - start;
+        reusedElapsed += reused - middle;
+        batchedElapsed += end - reused;
+        singleProtectCount += protectCount - startProtectCount;
+        batchedProtectCount += pageAllocator.getProtectCount() - protectCount;
+
+        if (iteration == 0) {
+            D2StubArena::Usage usage = stubArena.getUsage();
+            std::printf("%zu stubs of %zu bytes in %zu regions, %zu KiB reserved\n",
+                        usage.stubCount, BENCH_STUB_SIZE, usage.regionCount,
+                        usage.reservedBytes / 1024);
+        }
+    }
+
+    size_t stubCount = BENCH_STUB_COUNT * iterations;
+    std::printf("%.2f million fresh stubs per second\n",
+                stubCount / freshElapsed.count() / 1e6);
+    std::printf("%.2f million freed and reused stubs per second\n",
+                stubCount / reusedElapsed.count() / 1e6);
+    std::printf("%.2f protection changes per stub sealed alone\n",
+                (double) singleProtectCount / (2 * stubCount));
+    std::printf("%.2f million freed and reused stubs per second, sealed in a batch\n",
+                stubCount / batchedElapsed.count() / 1e6);
+    std::printf("%.4f protection changes per stub sealed in a batch\n",
+                (double) batchedProtectCount / stubCount);
+    return 0;
+}
@@ -0,0 +1,365 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2TxtBench.cpp                                                          *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   A command line tool that measures how long it takes to load the game's  *
+ *   .txt data tables, split them into cells and decode all of their         *
+ *   columns.                                                                *
+ *                                                                           *
+ *****************************************************************************/
+
+// Building on Linux, from the root of the repository:
+//
+//   g++ -std=c++17 -O2 -march=native -Itools/compat -Isrc tools/D2TxtBench/D2TxtBench.cpp
+//       src/D2MappedFile.cpp src/D2TxtTable.cpp -o d2txtbench
+//
+// Usage:
+//
+//   d2txtbench [--iterations <count>] <file or directory>...
+//   d2txtbench generate <directory>
+//
+// Directories are searched for .txt files. Each table is also split the
+// simple way, a line and a cell at a time into strings, for comparison.
+// Tables that have a schema are packed into records. Generated tables have
+// the size of the ones shipped with 1.13, and made-up contents.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "D2TxtSchemas.h"
+#include "D2TxtTable.h"
+
+namespace {
+constexpr size_t DEFAULT_ITERATIONS = 10;
+
+struct GeneratedTable {
+    const char* fileName;
+    size_t rowCount;
+    size_t columnCount;
+};
+
+constexpr GeneratedTable GENERATED_TABLES[] = {
+    { "Armor.txt", 202, 170 },
+    { "ItemStatCost.txt", 359, 64 },
+    { "Levels.txt", 151, 220 },
+    { "Misc.txt", 213, 170 },
+    { "MonStats.txt", 734, 250 },
+    { "Skills.txt", 357, 250 },
+    { "TreasureClassEx.txt", 1060, 30 },
+    { "UniqueItems.txt", 401, 80 },
+    { "Weapons.txt", 307, 170 },
+};
+
+struct TableResult {
+    std::filesystem::path filePath;
+    size_t rowCount;
+    size_t columnCount;
+    size_t fileSize;
+    double loadNanoseconds;
+    double decodeNanoseconds;
+    double simpleNanoseconds;
+    size_t recordCount;
+};
+
+bool isTable(const std::filesystem::path& filePath) {
+    std::string extension = filePath.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+    [](unsigned char c) {
+        return (char) std::tolower(c);
+    });
+
+    return extension == ".txt";
+}
+
+void collectFiles(const std::filesystem::path& path,
+                  std::vector<std::filesystem::path>& filePaths) {
+    std::error_code errorCode;
+
+    if (!std::filesystem::is_directory(path, errorCode)) {
+        filePaths.push_back(path);
+        return;
+    }
+
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(path,
+            errorCode)) {
+        if (entry.is_regular_file() && isTable(entry.path())) {
+            filePaths.push_back(entry.path());
+        }
+    }
+}
+
+const D2TxtSchema* findSchema(const std::filesystem::path& filePath) {
+    std::string fileName = filePath.filename().string();
+
+    for (const D2TxtSchema* schema : D2TxtSchemas::SCHEMAS) {
+        if (fileName.size() == std::strlen(schema->fileName)
+                && std::equal(fileName.begin(), fileName.end(), schema->fileName,
+        [](char left, char right) {
+        return std::tolower((unsigned char) left) == std::tolower((
+                    unsigned char) right);
+        })) {
+            return schema;
+        }
+    }
+
+    return nullptr;
+}
+
+// Runs the function the given number of times, and returns the average
+// time of one run.
+template<class F>
+double measure(size_t iterations, F function) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < iterations; i++) {
+        function();
+    }
+
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+// Reads the whole file, and copies every cell into a string of its own.
+size_t splitSimply(const std::filesystem::path& filePath) {
+    std::ifstream tableFile(filePath, std::ios::binary);
+    std::stringstream tableStream;
+    tableStream << tableFile.rdbuf();
+
+    std::vector<std::vector<std::string>> rows;
+    std::string line;
+
+    while (std::getline(tableStream, line)) {
+        std::vector<std::string> row;
+        std::stringstream lineStream(line);
+        std::string cell;
+
+        while (std::getline(lineStream, cell, '\t')) {
+            row.push_back(cell);
+        }
+
+        rows.push_back(std::move(row));
+    }
+
+    return rows.size();
+}
+
+bool benchmarkTable(const std::filesystem::path& filePath, size_t iterations,
+                    TableResult& tableResult) {
+    D2TxtTable table;
+
+    if (!table.load(filePath.wstring())) {
+        std::fprintf(stderr, "%s: could not be read\n", filePath.string().c_str());
+        return false;
+    }
+
+    tableResult = { filePath, table.getRowCount(), table.getColumnCount(),
+                    (size_t) std::filesystem::file_size(filePath), 0, 0, 0, 0
+                  };
+
+    // The volatile sink keeps the work from being optimized away.
+    volatile size_t sink;
+
+    tableResult.loadNanoseconds = measure(iterations, [&]() {
+        D2TxtTable loadedTable;
+        loadedTable.load(filePath.wstring());
+        sink = loadedTable.getRowCount();
+    });
+
+    tableResult.decodeNanoseconds = measure(iterations, [&]() {
+        D2TxtTable loadedTable;
+        loadedTable.load(filePath.wstring());
+
+        for (size_t column = 0; column < loadedTable.getColumnCount(); column++) {
+            sink = loadedTable.getIntColumn(column).size();
+        }
+    });
+
+    tableResult.simpleNanoseconds = measure(iterations, [&]() {
+        sink = splitSimply(filePath);
+    });
+
+    (void) sink;
+
+    const D2TxtSchema* schema = findSchema(filePath);
+    std::vector<uint8_t> records;
+
+    if (schema != nullptr) {
+        if (!table.buildRecords(*schema, records)) {
+            std::fprintf(stderr, "%s: does not match its schema\n",
+                         filePath.string().c_str());
+            return false;
+        }
+
+        tableResult.recordCount = records.size() / schema->recordSize;
+    }
+
+    return true;
+}
+
+bool generateTable(const std::filesystem::path& directoryPath,
+                   const GeneratedTable& generatedTable, uint32_t& state) {
+    std::ofstream tableFile(directoryPath / generatedTable.fileName,
+                            std::ios::binary);
+
+    // The first column is the one the table is looked up by, and the next
+    // are named after the ones the schemas use.
+    const D2TxtKeyColumn* keyColumn = nullptr;
+
+    for (const D2TxtKeyColumn& column : D2TxtSchemas::KEY_COLUMNS) {
+        if (std::strcmp(column.fileName, generatedTable.fileName) == 0) {
+            keyColumn = &column;
+        }
+    }
+
+    bool hasCodeKeys = keyColumn != nullptr
+                       && keyColumn->type == D2TxtColumnType::CODE;
+    tableFile << ((keyColumn != nullptr) ? keyColumn->columnName : "Id") <<
+              "\thcIdx\tCode";
+
+    for (size_t column = 3; column < generatedTable.columnCount; column++) {
+        tableFile << "\tColumn" << column;
+    }
+
+    tableFile << "\r\n";
+
+    for (size_t row = 0; row < generatedTable.rowCount; row++) {
+        std::string code = { (char)('a' + row % 26), (char)('a' + row / 26 % 26), (char)('0' + row / 676 % 10) };
+
+        if (hasCodeKeys) {
+            tableFile << code;
+        } else {
+            tableFile << "entry" << row;
+        }
+
+        tableFile << '\t' << row << '\t' << code;
+
+        for (size_t column = 3; column < generatedTable.columnCount; column++) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+
+            // Most cells of the real tables are empty or small numbers.
+            tableFile << '\t';
+
+            if (state % 3 != 0) {
+                tableFile << (int)(state >> 16) % 2000 - 100;
+            }
+        }
+
+        tableFile << "\r\n";
+    }
+
+    return (bool) tableFile;
+}
+
+void printUsage() {
+    std::fputs("Usage: d2txtbench [--iterations <count>] <file or directory>...\n"
+               "       d2txtbench generate <directory>\n", stderr);
+}
+}
+
+int main(int argc, char** argv) {
+    if (argc == 3 && std::strcmp(argv[1], "generate") == 0) {
+        std::error_code errorCode;
+        std::filesystem::create_directories(argv[2], errorCode);
+        uint32_t state = 0x2545F491;
+
+        for (const GeneratedTable& generatedTable : GENERATED_TABLES) {
+            if (!generateTable(argv[2], generatedTable, state)) {
+                std::fprintf(stderr, "%s: could not be written\n", generatedTable.fileName);
+                return 1;
+            }
+        }
+
+        return 0;
+    }
+
+    size_t iterations = DEFAULT_ITERATIONS;
+    int firstPath = 1;
+
+    if (argc > 2 && std::strcmp(argv[1], "--iterations") == 0) {
+        iterations = std::strtoul(argv[2], nullptr, 10);
+        firstPath = 3;
+    }
+
+    if (iterations == 0 || firstPath >= argc) {
+        printUsage();
+        return 2;
+    }
+
+    std::vector<std::filesystem::path> filePaths;
+
+    for (int i = firstPath; i < argc; i++) {
+        collectFiles(argv[i], filePaths);
+    }
+
+    std::sort(filePaths.begin(), filePaths.end());
+
+    TableResult totals = {};
+    bool success = true;
+
+    std::printf("%-24s %6s %7s %10s %10s %10s %10s\n", "table", "rows", "columns",
+                "bytes", "load ms", "decode ms", "simple ms");
+
+    for (const auto& filePath : filePaths) {
+        TableResult tableResult;
+
+        if (!benchmarkTable(filePath, iterations, tableResult)) {
+            success = false;
+            continue;
+        }
+
+        std::printf("%-24s %6zu %7zu %10zu %10.3f %10.3f %10.3f",
+                    filePath.filename().string().c_str(), tableResult.rowCount,
+                    tableResult.columnCount, tableResult.fileSize,
+                    tableResult.loadNanoseconds / 1e6, tableResult.decodeNanoseconds / 1e6,
+                    tableResult.simpleNanoseconds / 1e6);
+
+        if (tableResult.recordCount != 0) {
+            std::printf("  %zu records", tableResult.recordCount);
+        }
+
+        std::printf("\n");
+
+        totals.rowCount += tableResult.rowCount;
+        totals.fileSize += tableResult.fileSize;
+        totals.loadNanoseconds += tableResult.loadNanoseconds;
+        totals.decodeNanoseconds += tableResult.decodeNanoseconds;
+        totals.simpleNanoseconds += tableResult.simpleNanoseconds;
+    }
+
+    std::printf("%-24s %6zu %7s %10zu %10.3f %10.3f %10.3f\n", "total",
+                totals.rowCount, "", totals.fileSize, totals.loadNanoseconds / 1e6,
+                totals.decodeNanoseconds / 1e6, totals.simpleNanoseconds / 1e6);
+    std::printf("%.0f MB per second split, %.0f MB per second decoded\n",
+                totals.fileSize / totals.loadNanoseconds * 1e3,
+                totals.fileSize / totals.decodeNanoseconds * 1e3);
+    return success ? 0 : 1;
+}
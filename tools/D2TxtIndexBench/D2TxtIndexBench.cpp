@@ -0,0 +1,278 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2TxtIndexBench.cpp                                                     *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   A command line tool that builds the perfect hash indices of the game's  *
+ *   .txt data tables, saves them next to the tables, and compares their     *
+ *   lookups with those of std::unordered_map.                               *
+ *                                                                           *
+ *****************************************************************************/
+
+// Building on Linux, from the root of the repository:
+//
+//   g++ -std=c++17 -O2 -Itools/compat -Isrc tools/D2TxtIndexBench/D2TxtIndexBench.cpp
+//       src/D2MappedFile.cpp src/D2TxtTable.cpp src/D2TxtIndex.cpp -o d2txtindexbench
+//
+// Usage:
+//
+//   d2txtindexbench [--iterations <count>] <directory>
+//
+// The directory holds the tables, such as those of "d2txtbench generate".
+// Each index is saved as <table>.<column>.d2ph, and checked against the rows
+// of its table. Half of the lookups are of keys that are not in the table.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "D2MappedFile.h"
+#include "D2TxtIndex.h"
+#include "D2TxtSchemas.h"
+#include "D2TxtTable.h"
+
+namespace {
+constexpr size_t DEFAULT_ITERATIONS = 100;
+// Enough lookups per table for the clock to be meaningful.
+constexpr size_t LOOKUP_COUNT = 0x100000;
+
+struct IndexResult {
+    size_t keyCount;
+    size_t indexSize;
+    double buildNanoseconds;
+    double loadNanoseconds;
+    double indexLookupNanoseconds;
+    double mapLookupNanoseconds;
+};
+
+template<class F>
+double measure(size_t iterations, F function) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < iterations; i++) {
+        function();
+    }
+
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+bool hashFile(const std::filesystem::path& filePath, uint64_t& fileHash) {
+    D2MappedFile mappedFile;
+
+    if (!mappedFile.open(filePath.wstring())) {
+        return false;
+    }
+
+    fileHash = D2TxtIndex::hashName(std::string_view((const char*)
+                                    mappedFile.getData(), mappedFile.getSize()));
+    return true;
+}
+
+// The lookups are of every key of the table and of as many missing keys,
+// mixed together, and repeated up to the lookup count.
+std::vector<std::string> makeQueries(D2TxtTable& table, size_t column) {
+    std::vector<std::string> keys;
+
+    for (size_t row = 0; row < table.getRowCount(); row++) {
+        std::string_view cell = table.getCell(row, column);
+
+        if (!cell.empty()) {
+            keys.emplace_back(cell);
+            // Codes are at most four characters, so a missing one is made by
+            // changing the last character.
+            std::string missingKey(cell);
+            missingKey.back() = (missingKey.back() == '~') ? '}' : '~';
+            keys.push_back(missingKey);
+        }
+    }
+
+    std::vector<std::string> queries;
+    uint32_t state = 0x2545F491;
+
+    while (!keys.empty() && queries.size() < LOOKUP_COUNT) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        queries.push_back(keys[state % keys.size()]);
+    }
+
+    return queries;
+}
+
+bool benchmarkIndex(const std::filesystem::path& directoryPath,
+                    const D2TxtKeyColumn& keyColumn, size_t iterations,
+                    IndexResult& indexResult) {
+    std::filesystem::path tablePath = directoryPath / keyColumn.fileName;
+    D2TxtTable table;
+    uint64_t tableHash;
+
+    if (!table.load(tablePath.wstring()) || !hashFile(tablePath, tableHash)) {
+        std::fprintf(stderr, "%s: could not be read\n", tablePath.string().c_str());
+        return false;
+    }
+
+    size_t column = table.findColumn(keyColumn.columnName);
+
+    if (column == D2TxtTable::NOT_FOUND) {
+        std::fprintf(stderr, "%s: has no %s column\n", tablePath.string().c_str(),
+                     keyColumn.columnName);
+        return false;
+    }
+
+    bool isCode = keyColumn.type == D2TxtColumnType::CODE;
+    D2TxtIndex index;
+    bool built = false;
+
+    indexResult.buildNanoseconds = measure(iterations, [&]() {
+        built = isCode ? index.buildCodeIndex(table, column, tableHash) :
+                index.buildNameIndex(table, column, tableHash);
+    });
+
+    std::string indexName = tablePath.stem().string() + "." +
+                            keyColumn.columnName + ".d2ph";
+    std::replace(indexName.begin(), indexName.end(), ' ', '_');
+    std::filesystem::path indexPath = directoryPath / indexName;
+
+    if (!built || !index.save(indexPath.wstring())) {
+        std::fprintf(stderr, "%s: could not be written\n", indexPath.string().c_str());
+        return false;
+    }
+
+    D2TxtIndex loadedIndex;
+    bool loaded = false;
+
+    indexResult.loadNanoseconds = measure(iterations, [&]() {
+        loaded = loadedIndex.load(indexPath.wstring(), tableHash);
+    });
+
+    if (!loaded) {
+        std::fprintf(stderr, "%s: could not be loaded\n", indexPath.string().c_str());
+        return false;
+    }
+
+    // The maps hold what the index holds: the first row of every key.
+    std::unordered_map<uint32_t, uint32_t> codeMap;
+    std::unordered_map<std::string_view, uint32_t> nameMap;
+
+    for (size_t row = 0; row < table.getRowCount(); row++) {
+        std::string_view cell = table.getCell(row, column);
+
+        if (cell.empty()) {
+            continue;
+        }
+
+        if (isCode) {
+            codeMap.emplace(D2TxtTable::packCode(cell), (uint32_t) row);
+        } else {
+            nameMap.emplace(cell, (uint32_t) row);
+        }
+    }
+
+    std::vector<std::string> queries = makeQueries(table, column);
+    std::vector<uint32_t> indexRows(queries.size());
+    std::vector<uint32_t> mapRows(queries.size());
+
+    indexResult.indexLookupNanoseconds = measure(iterations, [&]() {
+        for (size_t i = 0; i < queries.size(); i++) {
+            indexRows[i] = isCode ? loadedIndex.findCode(queries[i]) :
+                           loadedIndex.findName(queries[i]);
+        }
+    }) / std::max<size_t>(queries.size(), 1);
+
+    indexResult.mapLookupNanoseconds = measure(iterations, [&]() {
+        for (size_t i = 0; i < queries.size(); i++) {
+            if (isCode) {
+                auto it = codeMap.find(D2TxtTable::packCode(queries[i]));
+                mapRows[i] = (it != codeMap.end()) ? it->second : D2TxtIndex::NOT_FOUND;
+            } else {
+                auto it = nameMap.find(queries[i]);
+                mapRows[i] = (it != nameMap.end()) ? it->second : D2TxtIndex::NOT_FOUND;
+            }
+        }
+    }) / std::max<size_t>(queries.size(), 1);
+
+    if (indexRows != mapRows) {
+        std::fprintf(stderr, "%s: the index does not match the table\n",
+                     indexPath.string().c_str());
+        return false;
+    }
+
+    indexResult.keyCount = loadedIndex.getKeyCount();
+    indexResult.indexSize = loadedIndex.getSize();
+    return true;
+}
+
+void printUsage() {
+    std::fputs("Usage: d2txtindexbench [--iterations <count>] <directory>\n",
+               stderr);
+}
+}
+
+int main(int argc, char** argv) {
+    size_t iterations = DEFAULT_ITERATIONS;
+    int directoryArgument = 1;
+
+    if (argc > 2 && std::strcmp(argv[1], "--iterations") == 0) {
+        iterations = std::strtoul(argv[2], nullptr, 10);
+        directoryArgument = 3;
+    }
+
+    if (iterations == 0 || directoryArgument != argc - 1) {
+        printUsage();
+        return 2;
+    }
+
+    std::filesystem::path directoryPath = argv[directoryArgument];
+    bool success = true;
+
+    std::printf("%-20s %-15s %6s %7s %9s %9s %10s %10s\n", "table", "column",
+                "keys", "bytes", "build us", "load us", "index ns", "map ns");
+
+    for (const D2TxtKeyColumn& keyColumn : D2TxtSchemas::KEY_COLUMNS) {
+        std::error_code errorCode;
+
+        if (!std::filesystem::exists(directoryPath / keyColumn.fileName, errorCode)) {
+            continue;
+        }
+
+        IndexResult indexResult;
+
+        if (!benchmarkIndex(directoryPath, keyColumn, iterations, indexResult)) {
+            success = false;
+            continue;
+        }
+
+        std::printf("%-20s %-15s %6zu %7zu %9.1f %9.1f %10.1f %10.1f\n",
+                    keyColumn.fileName, keyColumn.columnName, indexResult.keyCount,
+                    indexResult.indexSize, indexResult.buildNanoseconds / 1e3,
+                    indexResult.loadNanoseconds / 1e3, indexResult.indexLookupNanoseconds,
+                    indexResult.mapLookupNanoseconds);
+    }
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,275 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2VersionFingerprint.cpp                                                *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   A command line tool that prints the fingerprints of Game.exe files as   *
+ *   rows of D2VersionFingerprints.tsv, and measures how long the template   *
+ *   takes to identify each of them.                                         *
+ *                                                                           *
+ *****************************************************************************/
+
+// Building on Linux, from the root of the repository:
+//
+//   g++ -std=c++17 -O2 -Itools/compat -Isrc
+//       tools/D2VersionFingerprint/D2VersionFingerprint.cpp src/D2MappedFile.cpp
+//       src/D2PEImage.cpp src/D2VersionDetector.cpp -o d2versionfingerprint
+//
+// Usage:
+//
+//   d2versionfingerprint [--benchmark <iterations>] [--version <version>]
+//       <file or directory>...
+//
+// Directories are searched for executables. Each file is printed as a row of
+// src/D2VersionFingerprints.tsv, after a comment naming the file, sorted by
+// fingerprint. The version is read from the version resource, unless it is
+// given with --version, as it must be for a build whose resource was
+// stripped. Rows of unknown builds have "?" for a version.
+
+#include <windows.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "D2MappedFile.h"
+#include "D2PEImage.h"
+#include "D2Version.h"
+#include "D2VersionDetector.h"
+
+namespace {
+// The names of the versions in D2VersionFingerprints.tsv, in the order of
+// the GameVersion enum.
+constexpr const char* GAME_VERSION_NAMES[] = {
+    "?", "1.07", "1.08", "1.09", "1.09b", "1.09c", "1.09d", "1.10", "1.11",
+    "1.11b", "1.12", "1.13c", "1.13d", "1.14a", "1.14b", "1.14c", "1.14d"
+};
+
+static_assert(sizeof(GAME_VERSION_NAMES) / sizeof(GAME_VERSION_NAMES[0]) ==
+              D2Version::GAME_VERSION_COUNT, "Every version needs a name");
+
+struct FingerprintedFile {
+    std::filesystem::path filePath;
+    D2VersionFingerprint fingerprint;
+    GameVersion knownVersion;
+    GameVersion resourceVersion;
+    double fingerprintNanoseconds;
+    double resourceNanoseconds;
+};
+
+bool isExecutable(const std::filesystem::path& filePath) {
+    std::string extension = filePath.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+    [](unsigned char c) {
+        return (char) std::tolower(c);
+    });
+
+    return extension == ".exe";
+}
+
+void collectFiles(const std::filesystem::path& path,
+                  std::vector<std::filesystem::path>& filePaths) {
+    std::error_code errorCode;
+
+    if (!std::filesystem::is_directory(path, errorCode)) {
+        filePaths.push_back(path);
+        return;
+    }
+
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(path,
+            errorCode)) {
+        if (entry.is_regular_file() && isExecutable(entry.path())) {
+            filePaths.push_back(entry.path());
+        }
+    }
+}
+
+// Runs the function the given number of times, and returns the average
+// time of one run.
+template<class F>
+double measure(size_t iterations, F function) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < iterations; i++) {
+        function();
+    }
+
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+bool fingerprintFile(const std::filesystem::path& filePath, size_t iterations,
+                     FingerprintedFile& fingerprintedFile) {
+    D2MappedFile mappedFile;
+
+    if (!mappedFile.open(filePath.wstring())) {
+        std::fprintf(stderr, "%s: could not be read\n", filePath.string().c_str());
+        return false;
+    }
+
+    D2PEImage image(mappedFile.getData(), mappedFile.getSize(),
+                    D2PEImageLayout::FILE);
+    fingerprintedFile = { filePath, {}, GameVersion::INVALID, GameVersion::INVALID, 0, 0 };
+
+    if (!D2VersionDetector::computeFingerprint(image,
+            fingerprintedFile.fingerprint)) {
+        std::fprintf(stderr, "%s: not a valid PE32 image\n",
+                     filePath.string().c_str());
+        return false;
+    }
+
+    fingerprintedFile.knownVersion = D2VersionDetector::findKnownVersion(
+                                         fingerprintedFile.fingerprint);
+    fingerprintedFile.resourceVersion = D2VersionDetector::findResourceVersion(
+                                            image);
+
+    if (iterations == 0) {
+        return true;
+    }
+
+    // The volatile sink keeps the detection from being optimized away.
+    volatile GameVersion sink;
+
+    fingerprintedFile.fingerprintNanoseconds = measure(iterations, [&]() {
+        D2VersionFingerprint fingerprint;
+        D2VersionDetector::computeFingerprint(image, fingerprint);
+        sink = D2VersionDetector::findKnownVersion(fingerprint);
+    });
+
+    fingerprintedFile.resourceNanoseconds = measure(iterations, [&]() {
+        sink = D2VersionDetector::findResourceVersion(image);
+    });
+
+    (void) sink;
+    return true;
+}
+
+void printUsage() {
+    std::fputs("Usage: d2versionfingerprint [--benchmark <iterations>] "
+               "[--version <version>] <file or directory>...\n", stderr);
+}
+
+GameVersion findGameVersion(const char* versionName) {
+    for (size_t i = 1; i < D2Version::GAME_VERSION_COUNT; i++) {
+        if (std::strcmp(GAME_VERSION_NAMES[i], versionName) == 0) {
+            return (GameVersion) i;
+        }
+    }
+
+    return GameVersion::INVALID;
+}
+}
+
+int main(int argc, char** argv) {
+    size_t iterations = 0;
+    GameVersion givenVersion = GameVersion::INVALID;
+    int firstPath = 1;
+
+    while (firstPath + 1 < argc && std::strncmp(argv[firstPath], "--", 2) == 0) {
+        if (std::strcmp(argv[firstPath], "--benchmark") == 0) {
+            iterations = std::strtoul(argv[firstPath + 1], nullptr, 10);
+
+            if (iterations == 0) {
+                printUsage();
+                return 2;
+            }
+        } else if (std::strcmp(argv[firstPath], "--version") == 0) {
+            givenVersion = findGameVersion(argv[firstPath + 1]);
+
+            if (givenVersion == GameVersion::INVALID) {
+                std::fprintf(stderr, "Unknown version '%s'\n", argv[firstPath + 1]);
+                return 2;
+            }
+        } else {
+            printUsage();
+            return 2;
+        }
+
+        firstPath += 2;
+    }
+
+    if (firstPath >= argc) {
+        printUsage();
+        return 2;
+    }
+
+    std::vector<std::filesystem::path> filePaths;
+
+    for (int i = firstPath; i < argc; i++) {
+        collectFiles(argv[i], filePaths);
+    }
+
+    std::vector<FingerprintedFile> fingerprintedFiles;
+    bool success = true;
+
+    for (const auto& filePath : filePaths) {
+        FingerprintedFile fingerprintedFile;
+
+        if (fingerprintFile(filePath, iterations, fingerprintedFile)) {
+            fingerprintedFiles.push_back(fingerprintedFile);
+        } else {
+            success = false;
+        }
+    }
+
+    std::sort(fingerprintedFiles.begin(), fingerprintedFiles.end(),
+    [](const FingerprintedFile & left, const FingerprintedFile & right) {
+        return left.fingerprint < right.fingerprint;
+    });
+
+    for (const auto& fingerprintedFile : fingerprintedFiles) {
+        const D2VersionFingerprint& fingerprint = fingerprintedFile.fingerprint;
+        GameVersion gameVersion = (givenVersion != GameVersion::INVALID) ?
+                                  givenVersion : fingerprintedFile.resourceVersion;
+
+        std::printf("# %s", fingerprintedFile.filePath.string().c_str());
+
+        if (fingerprintedFile.knownVersion != GameVersion::INVALID) {
+            std::printf(" (listed as %s)",
+                        GAME_VERSION_NAMES[(int) fingerprintedFile.knownVersion]);
+        }
+
+        std::printf("\n%s\t0x%08" PRIX32 "\t0x%08" PRIX32 "\t0x%08" PRIX32
+                    "\t0x%016" PRIX64 "\n", GAME_VERSION_NAMES[(int) gameVersion],
+                    fingerprint.timeDateStamp, fingerprint.sizeOfImage,
+                    fingerprint.entryPoint, fingerprint.codeHash);
+    }
+
+    if (iterations > 0) {
+        std::printf("\n%-12s %16s %16s  %s\n", "version", "fingerprint ns",
+                    "resource ns", "file");
+
+        for (const auto& fingerprintedFile : fingerprintedFiles) {
+            std::printf("%-12s %16.1f %16.1f  %s\n",
+                        GAME_VERSION_NAMES[(int) fingerprintedFile.resourceVersion],
+                        fingerprintedFile.fingerprintNanoseconds,
+                        fingerprintedFile.resourceNanoseconds,
+                        fingerprintedFile.filePath.string().c_str());
+        }
+    }
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,341 @@
+/*****************************************************************************
+ *                                                                           *
+ *   D2X86DecoderBench.cpp                                                   *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   A command line tool that checks the x86 length decoder and the          *
+ *   instruction relocator against known byte sequences, and measures how    *
+ *   many instructions the decoder goes through per second.                  *
+ *                                                                           *
+ *****************************************************************************/
+
+// Building on Linux, from the root of the repository:
+//
+//   g++ -std=c++17 -O2 -Itools/compat -Isrc tools/D2X86DecoderBench/D2X86DecoderBench.cpp
+//       src/D2Patch/D2X86Decoder.cpp src/D2PEImage.cpp -o d2x86decoderbench
+//
+// Usage:
+//
+//   d2x86decoderbench test
+//   d2x86decoderbench [--iterations <count>] [file]...
+//
+// The test command exits with 1 if any check fails. The benchmark decodes
+// the executable sections of the given PE files, such as the game's DLLs,
+// or the whole file if it is not a PE image. Bytes that do not decode are
+// skipped one at a time, as a disassembler sweeping the code would. Without
+// a file, a corpus of common instructions is generated.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <iterator>
+#include <vector>
+
+#include "D2PEImage.h"
+#include "D2Patch/D2X86Decoder.h"
+
+namespace {
+constexpr size_t DEFAULT_ITERATIONS = 20;
+constexpr size_t GENERATED_CORPUS_SIZE = 16 << 20;
+
+struct DecodeCase {
+    const char* name;
+    std::initializer_list<uint8_t> code;
+    // 0 if the bytes must not decode.
+    size_t length;
+    D2X86BranchKind branchKind;
+    bool terminator;
+};
+
+const DecodeCase DECODE_CASES[] = {
+    { "push ebp", { 0x55 }, 1, D2X86BranchKind::NONE, false },
+    { "mov ebp, esp", { 0x8B, 0xEC }, 2, D2X86BranchKind::NONE, false },
+    { "sub esp, imm8", { 0x83, 0xEC, 0x10 }, 3, D2X86BranchKind::NONE, false },
+    { "sub esp, imm32", { 0x81, 0xEC, 0x00, 0x01, 0x00, 0x00 }, 6, D2X86BranchKind::NONE, false },
+    { "mov eax, [esp]", { 0x8B, 0x04, 0x24 }, 3, D2X86BranchKind::NONE, false },
+    { "mov eax, [esp+disp8]", { 0x8B, 0x44, 0x24, 0x08 }, 4, D2X86BranchKind::NONE, false },
+    { "mov eax, [esp+disp32]", { 0x8B, 0x84, 0x24, 0x00, 0x01, 0x00, 0x00 }, 7, D2X86BranchKind::NONE, false },
+    { "mov eax, [disp32]", { 0x8B, 0x05, 0x78, 0x56, 0x34, 0x12 }, 6, D2X86BranchKind::NONE, false },
+    { "mov eax, [eax*4+disp32]", { 0x8B, 0x04, 0x85, 0x00, 0x10, 0x00, 0x00 }, 7, D2X86BranchKind::NONE, false },
+    { "mov [ebp-4], imm32", { 0xC7, 0x45, 0xFC, 0x00, 0x00, 0x00, 0x00 }, 7, D2X86BranchKind::NONE, false },
+    { "mov ax, imm16", { 0x66, 0xB8, 0x34, 0x12 }, 4, D2X86BranchKind::NONE, false },
+    { "mov eax, [bp+disp8]", { 0x67, 0x8B, 0x46, 0x10 }, 4, D2X86BranchKind::NONE, false },
+    { "mov eax, [bp+si]", { 0x67, 0x8B, 0x02 }, 3, D2X86BranchKind::NONE, false },
+    { "mov eax, fs:[disp32]", { 0x64, 0xA1, 0x00, 0x00, 0x00, 0x00 }, 6, D2X86BranchKind::NONE, false },
+    { "rep movsd", { 0xF3, 0xA5 }, 2, D2X86BranchKind::NONE, false },
+    { "lock xadd [ecx], eax", { 0xF0, 0x0F, 0xC1, 0x01 }, 4, D2X86BranchKind::NONE, false },
+    { "test cl, imm8", { 0xF6, 0xC1, 0x01 }, 3, D2X86BranchKind::NONE, false },
+    { "test eax, imm32", { 0xF7, 0xC0, 0x01, 0x00, 0x00, 0x00 }, 6, D2X86BranchKind::NONE, false },
+    { "neg eax", { 0xF7, 0xD8 }, 2, D2X86BranchKind::NONE, false },
+    { "movzx eax, byte [ebp+disp8]", { 0x0F, 0xB6, 0x45, 0x08 }, 4, D2X86BranchKind::NONE, false },
+    { "palignr xmm0, xmm1, imm8", { 0x66, 0x0F, 0x3A, 0x0F, 0xC1, 0x08 }, 6, D2X86BranchKind::NONE, false },
+    { "enter imm16, imm8", { 0xC8, 0x10, 0x00, 0x00 }, 4, D2X86BranchKind::NONE, false },
+    { "call [disp32]", { 0xFF, 0x15, 0x00, 0x10, 0x00, 0x00 }, 6, D2X86BranchKind::NONE, false },
+    { "jmp [disp32]", { 0xFF, 0x25, 0x00, 0x10, 0x00, 0x00 }, 6, D2X86BranchKind::NONE, true },
+    { "ret", { 0xC3 }, 1, D2X86BranchKind::NONE, true },
+    { "ret imm16", { 0xC2, 0x08, 0x00 }, 3, D2X86BranchKind::NONE, true },
+    { "jmp rel8", { 0xEB, 0x05 }, 2, D2X86BranchKind::JMP_REL8, true },
+    { "jz rel8", { 0x74, 0x10 }, 2, D2X86BranchKind::JCC_REL8, false },
+    { "loop rel8", { 0xE2, 0xFE }, 2, D2X86BranchKind::LOOP_REL8, false },
+    { "jecxz rel8", { 0xE3, 0x04 }, 2, D2X86BranchKind::LOOP_REL8, false },
+    { "call rel32", { 0xE8, 0x00, 0x01, 0x00, 0x00 }, 5, D2X86BranchKind::CALL_REL32, false },
+    { "jmp rel32", { 0xE9, 0x00, 0x01, 0x00, 0x00 }, 5, D2X86BranchKind::JMP_REL32, true },
+    { "jz rel32", { 0x0F, 0x84, 0x00, 0x01, 0x00, 0x00 }, 6, D2X86BranchKind::JCC_REL32, false },
+    { "jmp rel16", { 0x66, 0xE9, 0x00, 0x01 }, 4, D2X86BranchKind::JMP_REL32, true },
+    { "ud2", { 0x0F, 0x0B }, 2, D2X86BranchKind::NONE, false },
+    { "unsupported two byte opcode", { 0x0F, 0x04 }, 0, D2X86BranchKind::NONE, false },
+    { "prefixes only", { 0x66, 0x67, 0xF3 }, 0, D2X86BranchKind::NONE, false },
+    { "truncated ModRM", { 0x8B }, 0, D2X86BranchKind::NONE, false },
+    { "truncated SIB", { 0x8B, 0x04 }, 0, D2X86BranchKind::NONE, false },
+    { "truncated rel32", { 0xE8, 0x00, 0x00 }, 0, D2X86BranchKind::NONE, false },
+};
+
+constexpr uint32_t SOURCE_ADDRESS = 0x00401000;
+constexpr uint32_t DESTINATION_ADDRESS = 0x10000000;
+
+struct RelocateCase {
+    const char* name;
+    std::initializer_list<uint8_t> source;
+    size_t minimumLength;
+    size_t destinationCapacity;
+    // Empty if the relocation must fail.
+    std::initializer_list<uint8_t> expected;
+};
+
+// The rel32 displacements that the relocated branches are expected to hold.
+constexpr uint32_t relative(uint32_t target, uint32_t instructionEnd) {
+    return target - instructionEnd;
+}
+
+#define D2_REL32(value) (uint8_t)(value), (uint8_t)((value) >> 8), \
+    (uint8_t)((value) >> 16), (uint8_t)((value) >> 24)
+
+const RelocateCase RELOCATE_CASES[] = {
+    {
+        "plain prologue", { 0x55, 0x8B, 0xEC, 0x83, 0xEC, 0x10, 0xCC }, 5, 32,
+        { 0x55, 0x8B, 0xEC, 0x83, 0xEC, 0x10 }
+    },
+    {
+        "call rel32", { 0xE8, 0x00, 0x01, 0x00, 0x00 }, 5, 32,
+        { 0xE8, D2_REL32(relative(SOURCE_ADDRESS + 0x105, DESTINATION_ADDRESS + 5)) }
+    },
+    {
+        "jz rel8 is widened", { 0x74, 0x10, 0x90, 0x90, 0x90 }, 5, 32,
+        { 0x0F, 0x84, D2_REL32(relative(SOURCE_ADDRESS + 0x12, DESTINATION_ADDRESS + 6)), 0x90, 0x90, 0x90 }
+    },
+    {
+        "jmp rel8 is widened", { 0xEB, 0x10 }, 2, 32,
+        { 0xE9, D2_REL32(relative(SOURCE_ADDRESS + 0x12, DESTINATION_ADDRESS + 5)) }
+    },
+    {
+        // The target is copied too, so the branch goes to its copy.
+        "jz rel8 into the copied bytes", { 0x74, 0x01, 0x90, 0x90, 0x90 }, 5, 32,
+        { 0x0F, 0x84, D2_REL32(1), 0x90, 0x90, 0x90 }
+    },
+    {
+        "loop rel8 goes through a rel32 jmp", { 0xE2, 0x10, 0x90, 0x90, 0x90 }, 5, 32,
+        {
+            0xE2, 0x02, 0xEB, 0x05, 0xE9, D2_REL32(relative(SOURCE_ADDRESS + 0x12, DESTINATION_ADDRESS + 9)),
+            0x90, 0x90, 0x90
+        }
+    },
+    { "branch into an instruction", { 0x74, 0x01, 0xB8, 0x00, 0x00, 0x00, 0x00 }, 5, 32, {} },
+    { "function ends too soon", { 0xC3, 0x90, 0x90, 0x90, 0x90 }, 5, 32, {} },
+    { "destination too small", { 0x74, 0x10, 0x90, 0x90, 0x90 }, 5, 8, {} },
+    { "rel16 branch", { 0x66, 0xE9, 0x00, 0x01, 0x90 }, 5, 32, {} },
+    { "source too short", { 0x55, 0x8B, 0xEC }, 5, 32, {} },
+    { "undecodable instruction", { 0x55, 0x0F, 0x04, 0x90, 0x90 }, 5, 32, {} },
+};
+
+#undef D2_REL32
+
+bool runTests() {
+    size_t failureCount = 0;
+
+    for (const DecodeCase& decodeCase : DECODE_CASES) {
+        std::vector<uint8_t> code(decodeCase.code);
+        D2X86Instruction instruction;
+        bool decoded = D2X86Decoder::decodeInstruction(code.data(), code.size(),
+                       instruction);
+
+        bool passed = (decodeCase.length == 0) ? !decoded : decoded
+                      && instruction.length == decodeCase.length
+                      && instruction.branchKind == decodeCase.branchKind
+                      && instruction.terminator == decodeCase.terminator;
+
+        if (!passed) {
+            std::printf("FAIL decode %s\n", decodeCase.name);
+            failureCount++;
+        }
+    }
+
+    for (const RelocateCase& relocateCase : RELOCATE_CASES) {
+        std::vector<uint8_t> source(relocateCase.source);
+        std::vector<uint8_t> expected(relocateCase.expected);
+        std::vector<uint8_t> destination(relocateCase.destinationCapacity, 0xCC);
+        size_t sourceLength = 0;
+        size_t destinationLength = 0;
+
+        bool relocated = D2X86Decoder::relocateInstructions(source.data(),
+                         SOURCE_ADDRESS, source.size(), relocateCase.minimumLength,
+                         destination.data(), DESTINATION_ADDRESS, destination.size(), sourceLength,
+                         destinationLength);
+
+        bool passed = expected.empty() ? !relocated : relocated
+                      && sourceLength >= relocateCase.minimumLength
+                      && destinationLength == expected.size()
+                      && std::memcmp(destination.data(), expected.data(), expected.size()) == 0;
+
+        if (!passed) {
+            std::printf("FAIL relocate %s\n", relocateCase.name);
+            failureCount++;
+        }
+    }
+
+    size_t caseCount = sizeof(DECODE_CASES) / sizeof(DECODE_CASES[0]) +
+                       sizeof(RELOCATE_CASES) / sizeof(RELOCATE_CASES[0]);
+    std::printf("%zu of %zu checks passed\n", caseCount - failureCount, caseCount);
+    return failureCount == 0;
+}
+
+bool readCorpus(const char* filePath, std::vector<uint8_t>& corpus) {
+    std::ifstream corpusFile(filePath, std::ios::binary);
+
+    if (!corpusFile) {
+        return false;
+    }
+
+    std::vector<uint8_t> fileData((std::istreambuf_iterator<char>(corpusFile)),
+                                  std::istreambuf_iterator<char>());
+    D2PEImage image(fileData.data(), fileData.size(), D2PEImageLayout::FILE);
+
+    if (!image.isValid()) {
+        corpus.insert(corpus.end(), fileData.begin(), fileData.end());
+        return true;
+    }
+
+    for (const D2PESection& section : image.getSections()) {
+        const uint8_t* sectionData = image.getRvaData(section.virtualAddress,
+                                     section.rawDataSize);
+
+        if (section.isExecutable() && sectionData != nullptr) {
+            corpus.insert(corpus.end(), sectionData, sectionData + section.rawDataSize);
+        }
+    }
+
+    return true;
+}
+
+// The instructions that decode are mixed at random.
+std::vector<uint8_t> generateCorpus() {
+    std::vector<const DecodeCase*> decodeCases;
+
+    for (const DecodeCase& decodeCase : DECODE_CASES) {
+        if (decodeCase.length != 0) {
+            decodeCases.push_back(&decodeCase);
+        }
+    }
+
+    std::vector<uint8_t> corpus;
+    corpus.reserve(GENERATED_CORPUS_SIZE + D2X86Decoder::MAX_INSTRUCTION_LENGTH);
+    uint32_t state = 0x2545F491;
+
+    while (corpus.size() < GENERATED_CORPUS_SIZE) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+
+        const DecodeCase* decodeCase = decodeCases[state % decodeCases.size()];
+        corpus.insert(corpus.end(), decodeCase->code.begin(), decodeCase->code.end());
+    }
+
+    return corpus;
+}
+
+void printUsage() {
+    std::fputs("Usage: d2x86decoderbench test\n"
+               "       d2x86decoderbench [--iterations <count>] [file]...\n", stderr);
+}
+}
+
+int main(int argc, char** argv) {
+    if (argc == 2 && std::strcmp(argv[1], "test") == 0) {
+        return runTests() ? 0 : 1;
+    }
+
+    size_t iterations = DEFAULT_ITERATIONS;
+    int firstPath = 1;
+
+    if (argc > 2 && std::strcmp(argv[1], "--iterations") == 0) {
+        iterations = std::strtoul(argv[2], nullptr, 10);
+        firstPath = 3;
+    }
+
+    if (iterations == 0 || (firstPath < argc && argv[firstPath][0] == '-')) {
+        printUsage();
+        return 2;
+    }
+
+    std::vector<uint8_t> corpus;
+
+    for (int i = firstPath; i < argc; i++) {
+        if (!readCorpus(argv[i], corpus)) {
+            std::fprintf(stderr, "%s: could not be read\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (firstPath == argc) {
+        corpus = generateCorpus();
+    }
+
+    size_t instructionCount = 0;
+    size_t skippedCount = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t iteration = 0; iteration < iterations; iteration++) {
+        size_t offset = 0;
+
+        while (offset < corpus.size()) {
+            D2X86Instruction instruction;
+
+            if (D2X86Decoder::decodeInstruction(&corpus[offset], corpus.size() - offset,
+                                                instruction)) {
+                offset += instruction.length;
+                instructionCount++;
+            } else {
+                offset++;
+                skippedCount++;
+            }
+        }
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() -
+                                            start;
+
+    std::printf("%zu bytes, %zu instructions and %zu skipped bytes per pass\n",
+                corpus.size(), instructionCount / iterations, skippedCount / iterations);
+    std::printf("%.1f million instructions per second, %.0f MB per second\n",
+                instructionCount / elapsed.count() / 1e6,
+                corpus.size() * iterations / elapsed.count() / 1e6);
+    return 0;
+}
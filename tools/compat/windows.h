@@ -0,0 +1,52 @@
+/*****************************************************************************
+ *                                                                           *
+ *   windows.h                                                               *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   A minimal stand-in for the Windows header, so that the headers shared   *
+ *   with the template can be compiled by the tools on other systems. Only   *
+ *   the types used by those headers are defined.                            *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2TOOLS_WINDOWS_H
+#define _D2TOOLS_WINDOWS_H
+
+#ifdef _WIN32
+#error "Use the real Windows header when building on Windows."
+#endif
+
+#include <cstdint>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int BOOL;
+
+typedef void* HANDLE;
+typedef void* HMODULE;
+typedef HMODULE HINSTANCE;
+typedef void* LPVOID;
+typedef const wchar_t* LPCWSTR;
+
+#define WINAPI
+#define __stdcall
+#define __fastcall
+
+#endif
@@ -0,0 +1,244 @@
+#!/usr/bin/env python3
+#
+# generate_offset_database.py
+# Copyright (C) 2017 Mir Drualga
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Compiles src/D2Offsets.tsv into src/D2OffsetDatabase.h, which holds the
+# offsets of every version as dense constexpr tables.
+#
+# Usage: generate_offset_database.py [input.tsv] [output.h]
+
+import os
+import re
+import sys
+
+SOURCE_DIRECTORY = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                "..", "src")
+
+# The columns of the data file, in the order of the GameVersion enum.
+GAME_VERSIONS = [
+    "1.07", "1.08", "1.09", "1.09b", "1.09c", "1.09d", "1.10", "1.11",
+    "1.11b", "1.12", "1.13c", "1.13d", "1.14a", "1.14b", "1.14c", "1.14d",
+]
+
+DLL_FILES = [
+    "BINKW32", "BNCLIENT", "D2CLIENT", "D2CMP", "D2COMMON", "D2DDRAW",
+    "D2DIRECT3D", "D2GAME", "D2GDI", "D2GFX", "D2GLIDE", "D2LANG", "D2LAUNCH",
+    "D2MCPCLIENT", "D2MULTI", "D2NET", "D2SOUND", "D2WIN", "FOG", "GLIDE3X",
+    "IJL11", "SMACKW32", "STORM",
+]
+
+HEADER = """\
+/*****************************************************************************
+ *                                                                           *
+ *   D2OffsetDatabase.h                                                      *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file is generated from D2Offsets.tsv by                            *
+ *   tools/generate_offset_database.py. Do not edit it by hand.              *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2OFFSETDATABASE_H
+#define _D2OFFSETDATABASE_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "D2Offset.h"
+#include "D2Version.h"
+"""
+
+
+def fail(lineNumber, message):
+    sys.exit("D2Offsets.tsv:%d: %s" % (lineNumber, message))
+
+
+def parseOffset(lineNumber, cell):
+    try:
+        if cell.startswith("-"):
+            return int(cell, 10)
+
+        return int(cell, 16)
+    except ValueError:
+        fail(lineNumber, "invalid offset '%s'" % cell)
+
+
+def readRows(inputPath):
+    rows = []
+    names = set()
+    header = None
+
+    with open(inputPath, encoding="utf-8") as inputFile:
+        for lineNumber, line in enumerate(inputFile, 1):
+            line = line.rstrip("\r\n")
+
+            if not line or line.startswith("#"):
+                continue
+
+            cells = [cell.strip() for cell in line.split("\t")]
+
+            if header is None:
+                if cells != ["name", "dll"] + GAME_VERSIONS:
+                    fail(lineNumber, "the header must be name, dll and the "
+                         "versions from 1.07 to 1.14d")
+
+                header = cells
+                continue
+
+            if len(cells) != len(header):
+                fail(lineNumber, "expected %d cells, found %d"
+                     % (len(header), len(cells)))
+
+            name, dll = cells[0], cells[1]
+
+            if not re.match(r"^[A-Za-z_][A-Za-z0-9_]*$", name):
+                fail(lineNumber, "invalid name '%s'" % name)
+
+            if dll not in DLL_FILES:
+                fail(lineNumber, "unknown dll '%s'" % dll)
+
+            identifier = dll + "_" + name
+
+            if identifier in names:
+                fail(lineNumber, "'%s' is listed twice" % identifier)
+
+            names.add(identifier)
+            offsets = [None if not cell else parseOffset(lineNumber, cell)
+                       for cell in cells[2:]]
+            rows.append((identifier, dll, offsets))
+
+    if header is None:
+        sys.exit("D2Offsets.tsv: missing header")
+
+    return rows
+
+
+def formatOffset(offset):
+    if offset is None or offset == 0:
+        return "0"
+
+    if offset < 0:
+        return str(offset)
+
+    return "0x%X" % offset
+
+
+def generate(rows):
+    lines = [HEADER]
+
+    lines.append("enum class D2OffsetId : int {")
+
+    for identifier, _, _ in rows:
+        lines.append("    %s," % identifier)
+
+    lines.append("};")
+    lines.append("")
+    lines.append("namespace D2OffsetDatabase {")
+    lines.append("static constexpr size_t OFFSET_COUNT = %d;" % len(rows))
+    lines.append("")
+
+    if rows:
+        lines.append("inline constexpr const char* NAMES[OFFSET_COUNT] = {")
+
+        for identifier, _, _ in rows:
+            lines.append("    \"%s\"," % identifier)
+
+        lines.append("};")
+        lines.append("")
+        lines.append("inline constexpr D2TEMPLATE_DLL_FILES "
+                     "DLL_FILES[OFFSET_COUNT] = {")
+
+        for _, dll, _ in rows:
+            lines.append("    D2TEMPLATE_DLL_FILES::D2DLL_%s," % dll)
+
+        lines.append("};")
+        lines.append("")
+        lines.append("// The first entry of every table belongs to "
+                     "GameVersion::INVALID.")
+        lines.append("inline constexpr D2OffsetTable "
+                     "OFFSET_TABLES[OFFSET_COUNT] = {")
+
+        for identifier, _, offsets in rows:
+            # Bit 0 is GameVersion::INVALID, which never has an offset.
+            versionMask = 0
+
+            for i, offset in enumerate(offsets):
+                if offset is not None:
+                    versionMask |= 1 << (i + 1)
+
+            cells = ", ".join(["0"] + [formatOffset(offset)
+                                       for offset in offsets])
+            lines.append("    // %s" % identifier)
+            lines.append("    { { %s }, 0x%05X }," % (cells, versionMask))
+
+        lines.append("};")
+        lines.append("")
+
+        # The accessors need the tables, which cannot be empty.
+        lines.append("constexpr const char* getName(D2OffsetId offsetId) {")
+        lines.append("    return NAMES[(int) offsetId];")
+        lines.append("}")
+        lines.append("")
+        lines.append("constexpr D2TEMPLATE_DLL_FILES getDllFile(D2OffsetId offsetId) {")
+        lines.append("    return DLL_FILES[(int) offsetId];")
+        lines.append("}")
+        lines.append("")
+        lines.append("constexpr const D2OffsetTable& getOffsetTable(D2OffsetId offsetId) {")
+        lines.append("    return OFFSET_TABLES[(int) offsetId];")
+        lines.append("}")
+    lines.append("}")
+    lines.append("")
+    lines.append("#endif")
+
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    inputPath = (sys.argv[1] if len(sys.argv) > 1
+                 else os.path.join(SOURCE_DIRECTORY, "D2Offsets.tsv"))
+    outputPath = (sys.argv[2] if len(sys.argv) > 2
+                  else os.path.join(SOURCE_DIRECTORY, "D2OffsetDatabase.h"))
+
+    output = generate(readRows(inputPath))
+
+    # Leave the header alone if nothing changed, so that it is not rebuilt.
+    if os.path.exists(outputPath):
+        with open(outputPath, encoding="utf-8") as outputFile:
+            if outputFile.read() == output:
+                return
+
+    with open(outputPath, "w", encoding="utf-8", newline="\n") as outputFile:
+        outputFile.write(output)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+#
+# generate_version_fingerprints.py
+# Copyright (C) 2017 Mir Drualga
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Compiles src/D2VersionFingerprints.tsv into
+# src/D2VersionFingerprintDatabase.h, which holds the fingerprints of the
+# known builds as a constexpr table sorted by fingerprint.
+#
+# Usage: generate_version_fingerprints.py [input.tsv] [output.h]
+
+import os
+import sys
+
+SOURCE_DIRECTORY = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                "..", "src")
+
+# The versions, in the order of the GameVersion enum.
+GAME_VERSIONS = [
+    "1.07", "1.08", "1.09", "1.09b", "1.09c", "1.09d", "1.10", "1.11",
+    "1.11b", "1.12", "1.13c", "1.13d", "1.14a", "1.14b", "1.14c", "1.14d",
+]
+
+COLUMNS = ["version", "timeDateStamp", "sizeOfImage", "entryPoint", "codeHash"]
+
+HEADER = """\
+/*****************************************************************************
+ *                                                                           *
+ *   D2VersionFingerprintDatabase.h                                          *
+ *   Copyright (C) 2017 Mir Drualga                                          *
+ *                                                                           *
+ *   Licensed under the Apache License, Version 2.0 (the "License");         *
+ *   you may not use this file except in compliance with the License.        *
+ *   You may obtain a copy of the License at                                 *
+ *                                                                           *
+ *   http://www.apache.org/licenses/LICENSE-2.0                              *
+ *                                                                           *
+ *   Unless required by applicable law or agreed to in writing, software     *
+ *   distributed under the License is distributed on an "AS IS" BASIS,       *
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.*
+ *   See the License for the specific language governing permissions and     *
+ *   limitations under the License.                                          *
+ *                                                                           *
+ *---------------------------------------------------------------------------*
+ *                                                                           *
+ *   This file is generated from D2VersionFingerprints.tsv by                *
+ *   tools/generate_version_fingerprints.py. Do not edit it by hand.         *
+ *                                                                           *
+ *****************************************************************************/
+
+#pragma once
+
+#ifndef _D2VERSIONFINGERPRINTDATABASE_H
+#define _D2VERSIONFINGERPRINTDATABASE_H
+
+#include <array>
+
+#include "D2Version.h"
+#include "D2VersionDetector.h"
+"""
+
+
+def fail(lineNumber, message):
+    sys.exit("D2VersionFingerprints.tsv:%d: %s" % (lineNumber, message))
+
+
+def parseNumber(lineNumber, cell, bits):
+    try:
+        value = int(cell, 16)
+    except ValueError:
+        fail(lineNumber, "invalid number '%s'" % cell)
+
+    if value < 0 or value >= 1 << bits:
+        fail(lineNumber, "'%s' does not fit in %d bits" % (cell, bits))
+
+    return value
+
+
+def readRows(inputPath):
+    rows = {}
+    header = None
+
+    with open(inputPath, encoding="utf-8") as inputFile:
+        for lineNumber, line in enumerate(inputFile, 1):
+            line = line.rstrip("\r\n")
+
+            if not line or line.startswith("#"):
+                continue
+
+            cells = [cell.strip() for cell in line.split("\t")]
+
+            if header is None:
+                if cells != COLUMNS:
+                    fail(lineNumber, "the header must be %s" % ", ".join(COLUMNS))
+
+                header = cells
+                continue
+
+            if len(cells) != len(header):
+                fail(lineNumber, "expected %d cells, found %d"
+                     % (len(header), len(cells)))
+
+            if cells[0] not in GAME_VERSIONS:
+                fail(lineNumber, "unknown version '%s'" % cells[0])
+
+            fingerprint = (parseNumber(lineNumber, cells[1], 32),
+                           parseNumber(lineNumber, cells[2], 32),
+                           parseNumber(lineNumber, cells[3], 32),
+                           parseNumber(lineNumber, cells[4], 64))
+
+            if fingerprint in rows:
+                fail(lineNumber, "the fingerprint is already listed for %s"
+                     % rows[fingerprint])
+
+            rows[fingerprint] = cells[0]
+
+    if header is None:
+        sys.exit("D2VersionFingerprints.tsv: missing header")
+
+    # Sorted as D2VersionFingerprint::operator< compares them, so that the
+    # table can be searched with a binary search.
+    return sorted(rows.items())
+
+
+def generate(rows):
+    lines = [HEADER]
+
+    lines.append("namespace D2VersionFingerprintDatabase {")
+    lines.append("inline constexpr std::array<D2KnownBuild, %d> KNOWN_BUILDS = {{"
+                 % len(rows))
+
+    for (timeDateStamp, sizeOfImage, entryPoint, codeHash), version in rows:
+        gameVersion = "VERSION_" + version.replace(".", "")
+        lines.append("    { { 0x%08X, 0x%08X, 0x%08X, 0, 0x%016XULL }, "
+                     "GameVersion::%s },"
+                     % (timeDateStamp, sizeOfImage, entryPoint, codeHash,
+                        gameVersion))
+
+    lines.append("}};")
+    lines.append("}")
+    lines.append("")
+    lines.append("#endif")
+
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    inputPath = (sys.argv[1] if len(sys.argv) > 1
+                 else os.path.join(SOURCE_DIRECTORY, "D2VersionFingerprints.tsv"))
+    outputPath = (sys.argv[2] if len(sys.argv) > 2
+                  else os.path.join(SOURCE_DIRECTORY,
+                                    "D2VersionFingerprintDatabase.h"))
+
+    output = generate(readRows(inputPath))
+
+    # Leave the header alone if nothing changed, so that it is not rebuilt.
+    if os.path.exists(outputPath):
+        with open(outputPath, encoding="utf-8") as outputFile:
+            if outputFile.read() == output:
+                return
+
+    with open(outputPath, "w", encoding="utf-8", newline="\n") as outputFile:
+        outputFile.write(output)
+
+
+if __name__ == "__main__":
+    main()